@@ -0,0 +1,93 @@
+// Copyright(c) 1999-2024 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+#ifndef ASL_ARENA_H
+#define ASL_ARENA_H
+
+#include <asl/defs.h>
+
+namespace asl {
+
+/**
+Number of Arena::Scope objects alive in all threads (checked by containers before asking for arena memory)
+*/
+extern ASL_API AtomicCount _activeArenas;
+
+/**
+A bump allocator for building large data structures with many small blocks, such as the Var tree of a big JSON
+document. While an `Arena::Scope` is alive, the blocks of Arrays (and so of Var arrays, objects and long strings)
+created or grown in that thread are taken from the arena instead of the heap.
+
+Memory is obtained in aligned chunks of 1 MB (larger blocks still use the heap). Allocation just advances a pointer
+and releasing a block only decrements a counter in its chunk; a chunk is freed when all its blocks have been
+released and the arena no longer uses it. So the whole structure is freed at once, a chunk at a time.
+
+Objects allocated in an arena are normal objects: they can be copied, modified or destroyed in any thread, and the
+Arena object itself can be destroyed before them. Blocks that grow after the scope ends are moved to the heap. Note
+that a value kept from a larger structure keeps its chunk alive; use `clone()` (outside the scope) to copy it to the
+heap if the rest is released.
+
+~~~
+Var data;
+{
+	Arena arena;
+	Arena::Scope scope(arena);
+	data = Json::decode(json);    // or Json::decode(json, Json::ARENA)
+}
+~~~
+
+An Arena must only be used from one thread at a time.
+\ingroup Containers
+*/
+class ASL_API Arena
+{
+public:
+	Arena();
+	~Arena();
+
+	/**
+	Allocates `n` bytes (aligned to 16 bytes), or returns null if `n` is too large for a chunk
+	*/
+	void* alloc(size_t n);
+
+	/**
+	Releases a block allocated by an Arena
+	*/
+	static void release(void* p);
+
+	/**
+	Allocates `n` bytes from the arena active in this thread, or returns null if there is none
+	*/
+	static void* allocCurrent(size_t n);
+
+	/**
+	Returns the number of bytes allocated from this arena
+	*/
+	Long allocated() const { return _allocated; }
+
+	/**
+	Makes an arena the active one in the current thread while this object is alive
+	*/
+	class ASL_API Scope
+	{
+		Arena* _prev;
+		Scope(const Scope&);
+		void operator=(const Scope&);
+	public:
+		Scope(Arena& arena);
+		~Scope();
+	};
+
+private:
+	char* _chunk;
+	char* _p;
+	char* _end;
+	int _count;      // blocks taken from the current chunk
+	Long _allocated;
+	void retire();
+	Arena(const Arena&);
+	void operator=(const Arena&);
+};
+
+}
+#endif
@@ -5,6 +5,7 @@
 #define ASL_ARRAY_H
 
 #include <asl/defs.h>
+#include <asl/Arena.h>
 #include "foreach1.h"
 #include <string.h>
 #include <stdlib.h>
@@ -69,10 +70,12 @@ class Array
 {
 protected:
 	T* _a;
-	struct Data{int n, s; AtomicCount rc; int pad;}; // n=num. elems, s=allocated size
+	struct Data{int n, s; AtomicCount rc; int arena;}; // n=num. elems, s=allocated size, arena=1 if from an Arena
 	Data& d() const {return *((Data*)_a-1);}
 	void alloc(int m);
 	void free();
+	static Data* allocData(int s);
+	static void freeData(Data* h) { if (h->arena) Arena::release(h); else ::free(h); }
 	ASL_EXPLICIT Array(T* p) {}
 	/*ASL_EXPLICIT*/ operator void* () { return NULL; }
 	ASL_EXPLICIT Array(const String& s) {}
@@ -619,12 +622,9 @@ Array<T>& Array<T>::reserve(int m)
 	int s1 = (m > s)? max(8*s/4, m) : s;
 	T* b = _a;
 	int n=d().n;
-	if(s1 != s && s*sizeof(T) < 2048)
+	if(s1 != s && (s*sizeof(T) < 2048 || d().arena))
 	{
-		char* p = (char*) malloc( s1*sizeof(T)+sizeof(Data) );
-		if(!p)
-			ASL_BAD_ALLOC();
-		b = (T*) ( p + sizeof(Data) );
+		b = (T*)(allocData(s1) + 1);
 		int i = min(m,n), j = sizeof(T), k = i*j;
 		memcpy(b, _a, k);
 	}
@@ -635,8 +635,8 @@ Array<T>& Array<T>::reserve(int m)
 			ASL_BAD_ALLOC();
 		b = (T*) ( p + sizeof(Data) );
 		_a = b;
-		s1 = s;
 		d().s = s1;
+		s1 = s;
 	}
 	if (m < n)
 	{
@@ -646,8 +646,7 @@ Array<T>& Array<T>::reserve(int m)
 	if(s1 != s)
 	{
 		int rc = d().rc;
-		char* p = (char*)_a - sizeof(Data);
-		::free(p);
+		freeData(&d());
 		_a = b;
 		d().rc = rc;
 		d().s = s1;
@@ -670,12 +669,21 @@ Array<T>& Array<T>::insert(int k, const T& x)
 		if (n == 2147483647)
 			ASL_BAD_ALLOC();
 		int s1 = s < 1073741823 ? 2 * s : 2147483647;
-		char* p = (char*)realloc((char*)_a - sizeof(Data), s1 * sizeof(T) + sizeof(Data));
-		if(!p)
-			ASL_BAD_ALLOC();
-		T* b = (T*) ( p + sizeof(Data) );
-		_a = b;
-		h = &d();
+		if (h->arena) // arena blocks cannot be reallocated
+		{
+			Data* h1 = allocData(s1);
+			memcpy((void*)(h1 + 1), (void*)_a, n * sizeof(T));
+			h1->rc = int(h->rc);
+			freeData(h);
+			h = h1;
+		}
+		else
+		{
+			h = (Data*)realloc(h, s1 * sizeof(T) + sizeof(Data));
+			if (!h)
+				ASL_BAD_ALLOC();
+		}
+		_a = (T*)(h + 1);
 		h->s=s1;
 	}
 	if (k < n) {
@@ -686,14 +694,24 @@ Array<T>& Array<T>::insert(int k, const T& x)
 	return *this;
 }
 
+// blocks are taken from the current thread's Arena if there is one
+template<class T>
+typename Array<T>::Data* Array<T>::allocData(int s)
+{
+	size_t n = s * sizeof(T) + sizeof(Data);
+	void* p = _activeArenas > 0 ? Arena::allocCurrent(n) : 0;
+	int arena = p != 0;
+	if (!p && !(p = malloc(n)))
+		ASL_BAD_ALLOC();
+	((Data*)p)->arena = arena;
+	return (Data*)p;
+}
+
 template<class T>
 void Array<T>::alloc(int m)
 {
 	int s=max(m, 3);
-	char* p = (char*) malloc( s*sizeof(T)+sizeof(Data) );
-	if(!p)
-		ASL_BAD_ALLOC();
-	_a = (T*) ( p + sizeof(Data) );
+	_a = (T*)(allocData(s) + 1);
 	d().s = s;
 	d().n = m;
 	d().rc=1;
@@ -704,7 +722,7 @@ template<class T>
 void Array<T>::free()
 {
 	asl_destroy(_a, d().n);
-	::free( (char*)_a - sizeof(Data) );
+	freeData(&d());
 	_a=0;
 }
 
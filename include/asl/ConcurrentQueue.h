@@ -0,0 +1,467 @@
+// Copyright(c) 1999-2024 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+#ifndef ASL_CONCURRENTQUEUE_H
+#define ASL_CONCURRENTQUEUE_H
+
+#include <asl/Array.h>
+#include <asl/Mutex.h>
+#include <asl/atomic.h>
+
+namespace asl {
+
+#define ASL_QUEUE_PAD 64
+
+/*
+Lets consumers (or producers on a full queue) sleep until the other side makes progress. Waiters register before
+checking the queue a last time, and the other side only posts the semaphore if there are more waiters than pending
+posts, so the fast path costs two reads.
+*/
+struct QueueSignal
+{
+	AtomicCount waiters;
+	AtomicCount wakeups; // posts not yet consumed by a waiter
+	Semaphore sem;
+
+	void notify()
+	{
+		if (waiters > wakeups)
+		{
+			++wakeups;
+			sem.post();
+		}
+	}
+
+	/*
+	Used in a loop that retries an operation while `wait()` returns true; gives up after `timeout` seconds
+	(negative for no limit)
+	*/
+	class Waiter
+	{
+		QueueSignal& _s;
+		double _timeout, _deadline;
+		int _spins;
+		bool _registered;
+	public:
+		Waiter(QueueSignal& s, double timeout) : _s(s), _timeout(timeout), _deadline(0), _spins(32), _registered(false) {}
+		~Waiter()
+		{
+			if (_registered)
+				--_s.waiters;
+		}
+		bool wait()
+		{
+			if (_timeout == 0)
+				return false;
+			if (_spins > 0)
+			{
+				if (--_spins == 0 && _timeout > 0)
+					_deadline = now() + _timeout;
+				return true;
+			}
+			if (!_registered) // check once more after registering, so that a notify() is not missed
+			{
+				++_s.waiters;
+				_registered = true;
+				return true;
+			}
+			if (_timeout < 0)
+				_s.sem.wait();
+			else
+			{
+				double t = _deadline - now();
+				if (t <= 0 || !_s.sem.wait(t))
+					return false;
+			}
+			--_s.wakeups;
+			return true;
+		}
+	};
+};
+
+/**
+A fixed-capacity queue for passing items between threads, with any number of producers and consumers. Operations do
+not take locks: each slot holds a sequence number telling whether it is free or filled for the current round, and
+threads claim positions by atomically advancing the head or tail counters.
+
+The `try` functions return immediately if the queue is full or empty. `push()` and `pop()` wait (first
+spinning shortly and then sleeping on a Semaphore) until there is space or an item, optionally up to a timeout.
+
+~~~
+BoundedQueue<Job> jobs(1024);
+
+// producers
+jobs.push(job);
+
+// consumers
+Job job;
+while (jobs.pop(job, 0.5))
+	process(job);
+~~~
+
+The capacity is rounded up to a power of 2.
+\ingroup Threading
+*/
+template<class T>
+class BoundedQueue
+{
+	struct Cell
+	{
+		AtomicCount seq;
+		T value;
+	};
+	Array<Cell> _cells;
+	int _mask;
+	char _pad0[ASL_QUEUE_PAD];
+	AtomicCount _tail;
+	char _pad1[ASL_QUEUE_PAD];
+	AtomicCount _head;
+	char _pad2[ASL_QUEUE_PAD];
+	QueueSignal _items, _space;
+
+	static int seqDiff(int a, int b) { return int(unsigned(a) - unsigned(b)); }
+
+	BoundedQueue(const BoundedQueue&);
+	void operator=(const BoundedQueue&);
+public:
+	/**
+	Creates a queue with space for at least `capacity` items
+	*/
+	BoundedQueue(int capacity = 1024)
+	{
+		int n = 2;
+		while (n < capacity)
+			n *= 2;
+		_cells.resize(n);
+		_mask = n - 1;
+		for (int i = 0; i < _cells.length(); i++)
+			_cells[i].seq = AtomicCount(i);
+	}
+
+	/**
+	Returns the maximum number of items
+	*/
+	int capacity() const { return _cells.length(); }
+
+	/**
+	Returns the number of items in the queue (approximate if other threads are using it)
+	*/
+	int length() const { return max(0, seqDiff(_tail, _head)); }
+
+	/**
+	Adds an item at the end if there is space, returning false otherwise
+	*/
+	bool tryPush(const T& x)
+	{
+		Cell* c;
+		while (1)
+		{
+			int pos = _tail;
+			c = &_cells[pos & _mask];
+			int d = seqDiff(c->seq, pos);
+			if (d == 0)
+			{
+				if (_tail.cas(pos, int(unsigned(pos) + 1)))
+					break;
+			}
+			else if (d < 0)
+				return false;
+		}
+		c->value = x;
+		++c->seq;
+		_items.notify();
+		return true;
+	}
+
+	/**
+	Removes the first item into `x` if there is one, returning false otherwise
+	*/
+	bool tryPop(T& x)
+	{
+		Cell* c;
+		int pos;
+		while (1)
+		{
+			pos = _head;
+			c = &_cells[pos & _mask];
+			int d = seqDiff(c->seq, int(unsigned(pos) + 1));
+			if (d == 0)
+			{
+				if (_head.cas(pos, int(unsigned(pos) + 1)))
+					break;
+			}
+			else if (d < 0)
+				return false;
+		}
+		x = c->value;
+		c->value = T();
+		c->seq += _mask;
+		_space.notify();
+		return true;
+	}
+
+	/**
+	Removes up to `n` items appending them to `a` and returns how many were taken; waits up to `timeout` seconds
+	(negative for no limit) for at least one.
+	*/
+	int popBatch(Array<T>& a, int n, double timeout = 0)
+	{
+		int pos, k;
+		QueueSignal::Waiter w(_items, timeout);
+		while (!claim(n, pos, k))
+			if (!w.wait() && !claim(n, pos, k))
+				return 0;
+		for (int i = 0; i < k; i++)
+		{
+			Cell& c = _cells[(unsigned(pos) + i) & _mask];
+			a << c.value;
+			c.value = T();
+			c.seq += _mask;
+		}
+		_space.notify();
+		return k;
+	}
+
+	/**
+	Adds an item at the end, waiting until there is space
+	*/
+	void push(const T& x)
+	{
+		push(x, -1);
+	}
+
+	/**
+	Adds an item at the end, waiting up to `timeout` seconds for space; returns false if it timed out
+	*/
+	bool push(const T& x, double timeout)
+	{
+		QueueSignal::Waiter w(_space, timeout);
+		while (!tryPush(x))
+			if (!w.wait())
+				return tryPush(x);
+		return true;
+	}
+
+	/**
+	Removes and returns the first item, waiting until there is one
+	*/
+	T pop()
+	{
+		T x;
+		pop(x, -1);
+		return x;
+	}
+
+	/**
+	Removes the first item into `x`, waiting up to `timeout` seconds for one; returns false if it timed out
+	*/
+	bool pop(T& x, double timeout)
+	{
+		QueueSignal::Waiter w(_items, timeout);
+		while (!tryPop(x))
+			if (!w.wait())
+				return tryPop(x);
+		return true;
+	}
+
+private:
+	// claims up to n consecutive filled cells from the head
+	bool claim(int n, int& pos, int& k)
+	{
+		while (1)
+		{
+			pos = _head;
+			for (k = 0; k < n && k <= _mask; k++)
+				if (seqDiff(_cells[(unsigned(pos) + k) & _mask].seq, int(unsigned(pos) + k + 1)) != 0)
+					break;
+			if (k == 0)
+			{
+				if (seqDiff(_cells[pos & _mask].seq, int(unsigned(pos) + 1)) < 0)
+					return false;
+				continue;
+			}
+			if (_head.cas(pos, int(unsigned(pos) + k)))
+				return true;
+		}
+	}
+};
+
+/**
+A queue for passing items between threads, with any number of producers and consumers and no capacity limit.
+
+Items are stored in linked segments of fixed size, so that pushing and popping never move items and memory is
+allocated once per segment. Producers and consumers use separate locks, so they only contend among themselves, and
+`popBatch()` takes many items with a single lock.
+
+The interface is the same as BoundedQueue's, except that pushing never waits.
+
+~~~
+ConcurrentQueue<String> lines;
+
+lines.push(line);             // producers
+
+Array<String> batch;          // consumer
+while (lines.popBatch(batch, 100, 1.0) > 0)
+{
+	write(batch);
+	batch.clear();
+}
+~~~
+\ingroup Threading
+*/
+template<class T>
+class ConcurrentQueue
+{
+	enum { SEGMENT = 256 };
+	struct Segment
+	{
+		T items[SEGMENT];
+		Segment* next;
+		Segment() : next(0) {}
+	};
+	Mutex _tailLock;
+	Segment* _tailSeg;
+	int _tailPos;
+	char _pad0[ASL_QUEUE_PAD];
+	Mutex _headLock;
+	Segment* _headSeg;
+	int _headPos;
+	char _pad1[ASL_QUEUE_PAD];
+	AtomicCount _n;
+	QueueSignal _items;
+
+	ConcurrentQueue(const ConcurrentQueue&);
+	void operator=(const ConcurrentQueue&);
+
+	// takes up to n items, the head lock must be held
+	int take(T* x, Array<T>* a, int n)
+	{
+		n = min(n, (int)_n);
+		for (int i = 0; i < n; i++)
+		{
+			if (_headPos == SEGMENT)
+			{
+				Segment* s = _headSeg;
+				_headSeg = s->next;
+				_headPos = 0;
+				delete s;
+			}
+			T& item = _headSeg->items[_headPos++];
+			if (x)
+				*x = item;
+			else
+				*a << item;
+			item = T();
+		}
+		if (n > 0)
+			_n += -n;
+		return n;
+	}
+
+	bool tryTake(T* x, Array<T>* a, int n, int& k)
+	{
+		if (_n == 0)
+			return false;
+		Lock _(_headLock);
+		k = take(x, a, n);
+		return k > 0;
+	}
+
+public:
+	ConcurrentQueue() : _tailPos(0), _headPos(0)
+	{
+		_headSeg = _tailSeg = new Segment;
+	}
+
+	~ConcurrentQueue()
+	{
+		while (_headSeg)
+		{
+			Segment* s = _headSeg;
+			_headSeg = s->next;
+			delete s;
+		}
+	}
+
+	/**
+	Returns the number of items in the queue (approximate if other threads are using it)
+	*/
+	int length() const { return _n; }
+
+	/**
+	Adds an item at the end
+	*/
+	void push(const T& x)
+	{
+		{
+			Lock _(_tailLock);
+			if (_tailPos == SEGMENT)
+			{
+				Segment* s = new Segment;
+				_tailSeg->next = s;
+				_tailSeg = s;
+				_tailPos = 0;
+			}
+			_tailSeg->items[_tailPos++] = x;
+			++_n;
+		}
+		_items.notify();
+	}
+
+	/**
+	Adds an item at the end (always succeeds, for compatibility with BoundedQueue)
+	*/
+	bool tryPush(const T& x)
+	{
+		push(x);
+		return true;
+	}
+
+	/**
+	Removes the first item into `x` if there is one, returning false otherwise
+	*/
+	bool tryPop(T& x)
+	{
+		int k;
+		return tryTake(&x, 0, 1, k);
+	}
+
+	/**
+	Removes the first item into `x`, waiting up to `timeout` seconds for one; returns false if it timed out
+	*/
+	bool pop(T& x, double timeout)
+	{
+		QueueSignal::Waiter w(_items, timeout);
+		while (!tryPop(x))
+			if (!w.wait())
+				return tryPop(x);
+		return true;
+	}
+
+	/**
+	Removes and returns the first item, waiting until there is one
+	*/
+	T pop()
+	{
+		T x;
+		pop(x, -1);
+		return x;
+	}
+
+	/**
+	Removes up to `n` items appending them to `a` and returns how many were taken; waits up to `timeout` seconds
+	(negative for no limit) for at least one.
+	*/
+	int popBatch(Array<T>& a, int n, double timeout = 0)
+	{
+		int k = 0;
+		QueueSignal::Waiter w(_items, timeout);
+		while (!tryTake(0, &a, n, k))
+			if (!w.wait())
+				return tryTake(0, &a, n, k) ? k : 0;
+		return k;
+	}
+};
+
+}
+#endif
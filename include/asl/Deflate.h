@@ -0,0 +1,115 @@
+// Copyright(c) 1999-2024 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+#ifndef ASL_DEFLATE_H
+#define ASL_DEFLATE_H
+
+#include <asl/defs.h>
+#include <asl/Array.h>
+
+namespace asl {
+
+/**
+Compresses data with the deflate algorithm (using zlib, if the library was built with ASL_ZLIB), producing a raw
+deflate stream, or one in zlib or gzip format. Data can be compressed at once or in pieces, flushing the output after
+each piece so that the receiver can decompress it without waiting for the rest (as WebSocket compression does).
+
+~~~
+ByteArray packed = Deflater::compress(data, Deflater::GZIP);
+ByteArray unpacked = Inflater::decompress(packed, Deflater::GZIP);
+~~~
+
+If zlib is not available, `ok()` is false and compression functions fail.
+*/
+class ASL_API Deflater
+{
+public:
+	/** Output formats */
+	enum Format { RAW, ZLIB, GZIP };
+	/** Flush modes for `compress()` */
+	enum Flush {
+		NONE,   //!< Keep data buffered to compress it better
+		SYNC,   //!< Output all data so far, ending at a byte boundary (the output ends with `00 00 ff ff`)
+		FINISH  //!< Output all data and end the stream
+	};
+
+	/**
+	Creates a compressor with the given format, compression level (0-9) and log2 of the window size (9-15)
+	*/
+	Deflater(Format format = RAW, int level = 6, int windowBits = 15);
+	~Deflater();
+
+	/** Returns true if compression is available */
+	bool ok() const { return _z != 0; }
+
+	/**
+	Compresses `n` bytes and appends the output to `out`, returns false on error
+	*/
+	bool compress(const byte* data, int n, ByteArray& out, Flush flush = SYNC);
+
+	/**
+	Starts a new stream, forgetting previous data
+	*/
+	void reset();
+
+	/**
+	Compresses a whole buffer
+	*/
+	static ByteArray compress(const ByteArray& data, Format format = GZIP, int level = 6);
+
+	/**
+	Returns true if the library was built with compression support
+	*/
+	static bool available();
+
+private:
+	void* _z;
+	Deflater(const Deflater&);
+	void operator=(const Deflater&);
+};
+
+/**
+Decompresses data compressed with the deflate algorithm (raw, or in zlib or gzip formats), at once or in pieces.
+*/
+class ASL_API Inflater
+{
+public:
+	/**
+	Creates a decompressor for the given format (one of `Deflater::Format`) and window size
+	*/
+	Inflater(int format = Deflater::RAW, int windowBits = 15);
+	~Inflater();
+
+	/** Returns true if decompression is available */
+	bool ok() const { return _z != 0; }
+
+	/**
+	Decompresses `n` bytes and appends the output to `out`; returns false on error or if the output would exceed
+	`maxSize` bytes
+	*/
+	bool decompress(const byte* data, int n, ByteArray& out, int maxSize = 0x7fffffff);
+
+	/**
+	Returns true if the end of the compressed stream was reached (zlib or gzip formats)
+	*/
+	bool finished() const { return _end; }
+
+	/**
+	Starts a new stream
+	*/
+	void reset();
+
+	/**
+	Decompresses a whole buffer, returns an empty array on error
+	*/
+	static ByteArray decompress(const ByteArray& data, int format = Deflater::GZIP);
+
+private:
+	void* _z;
+	bool _end;
+	Inflater(const Inflater&);
+	void operator=(const Inflater&);
+};
+
+}
+#endif
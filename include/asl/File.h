@@ -229,6 +229,10 @@ public:
 	Flushes the write buffers effectively writing data on disk
 	*/
 	void flush() {fflush(_file);}
+	/**
+	Writes buffered data and waits until the file contents are stored in the device; returns false on failure
+	*/
+	bool sync();
 	bool error() {return ferror(_file)!=0;}
 
 	/**
@@ -0,0 +1,566 @@
+// Copyright(c) 1999-2024 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+#ifndef ASL_FLATHASHMAP_H
+#define ASL_FLATHASHMAP_H
+
+#include <asl/HashMap.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ASL_HMAP_SSE2
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace asl {
+
+/**
+Scrambles the bits of a hash value so that all of them affect the high and low bits (used by FlatHashMap to select
+slots)
+*/
+inline unsigned mixHash(unsigned h)
+{
+	ULong m = (ULong)h * 0x9e3779b97f4a7c15ull;
+	return unsigned(m >> 32) ^ unsigned(m);
+}
+
+/**
+A hash map with open addressing, an alternative to HashMap with the same interface and better memory locality.
+
+Elements are stored contiguously in a single array of slots instead of a separate node per element. Each slot
+has a control byte holding 7 bits of the key's hash or an empty/deleted mark, and lookups compare groups of 16
+control bytes at once (with SSE2 if available), so that keys are only compared when their hash bits match and a
+probe sequence ends at the first group with an empty slot. The table doubles its size when it is 7/8 full.
+It is usually faster than HashMap, especially with many elements, and uses less memory.
+
+~~~
+FlatHashMap<int, String> names;
+names.reserve(1000);
+names[5] = "five";
+if (String* s = names.find(5))
+	...
+~~~
+
+Enumeration is like in HashMap, with range-based for or the `foreach2` macro. As the table is rebuilt when
+it grows, pointers to values are only valid until the next insertion.
+
+Note: keys and values are relocated in memory with `memcpy` when the table grows, as in Array, so types must not
+hold pointers to themselves.
+
+\ingroup Containers
+*/
+template<class K, class T>
+class FlatHashMap
+{
+protected:
+	struct KeyVal
+	{
+		K key;
+		T value;
+		KeyVal(const K& k, const T& v) : key(k), value(v) {}
+	};
+
+	enum { GROUP = 16, EMPTY = -128, DELETED = -2 };
+
+	struct Data
+	{
+		AtomicCount rc;
+		int n, cap, free;   // elements, slots, empty slots still usable before growing
+		signed char* ctrl;  // cap control bytes followed by a copy of the first GROUP
+		KeyVal* slots;
+		Data() : rc(1), n(0), cap(0), free(0), ctrl(0), slots(0) {}
+	};
+
+	Data* _d;
+
+	static int lowBit(unsigned x)
+	{
+#ifdef _MSC_VER
+		unsigned long i;
+		_BitScanForward(&i, x);
+		return (int)i;
+#else
+		return __builtin_ctz(x);
+#endif
+	}
+
+	static int highBit(unsigned x)
+	{
+#ifdef _MSC_VER
+		unsigned long i;
+		_BitScanReverse(&i, x);
+		return (int)i;
+#else
+		return 31 - __builtin_clz(x);
+#endif
+	}
+
+	// bit mask of the control bytes in the group at p equal to c
+	static unsigned match(const signed char* p, signed char c)
+	{
+#ifdef ASL_HMAP_SSE2
+		__m128i g = _mm_loadu_si128((const __m128i*)p);
+		return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(c)));
+#else
+		unsigned m = 0;
+		for (int i = 0; i < GROUP; i++)
+			m |= unsigned(p[i] == c) << i;
+		return m;
+#endif
+	}
+
+	// bit mask of the empty or deleted slots in the group at p
+	static unsigned matchFree(const signed char* p)
+	{
+#ifdef ASL_HMAP_SSE2
+		__m128i g = _mm_loadu_si128((const __m128i*)p);
+		return (unsigned)_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), g));
+#else
+		unsigned m = 0;
+		for (int i = 0; i < GROUP; i++)
+			m |= unsigned(p[i] < -1) << i;
+		return m;
+#endif
+	}
+
+	template<class Q>
+	static unsigned hashOf(const Q& key) { return mixHash((unsigned)hash(key)); }
+
+	void setCtrl(int i, signed char c)
+	{
+		_d->ctrl[i] = c;
+		if (i < GROUP)
+			_d->ctrl[_d->cap + i] = c;
+	}
+
+	/*
+	Returns the slot of the key with hash `h`, or -1
+	*/
+	template<class Q>
+	int indexOf(const Q& key, unsigned h) const
+	{
+		const Data& d = *_d;
+		if (d.n == 0)
+			return -1;
+		int mask = d.cap - 1;
+		int i = (h >> 7) & mask;
+		signed char h2 = (signed char)(h & 0x7f);
+		for (int step = GROUP;; step += GROUP)
+		{
+			const signed char* g = d.ctrl + i;
+			for (unsigned m = match(g, h2); m != 0; m &= m - 1)
+			{
+				int j = (i + lowBit(m)) & mask;
+				if (d.slots[j].key == key)
+					return j;
+			}
+			if (match(g, EMPTY) != 0)
+				return -1;
+			i = (i + step) & mask;
+		}
+	}
+
+	/*
+	Returns the first empty or deleted slot in the probe sequence of hash `h`
+	*/
+	int freeSlot(unsigned h) const
+	{
+		int mask = _d->cap - 1;
+		int i = (h >> 7) & mask;
+		for (int step = GROUP;; step += GROUP)
+		{
+			unsigned m = matchFree(_d->ctrl + i);
+			if (m != 0)
+				return (i + lowBit(m)) & mask;
+			i = (i + step) & mask;
+		}
+	}
+
+	void resize(int cap)
+	{
+		Data& d = *_d;
+		signed char* ctrl = d.ctrl;
+		KeyVal* slots = d.slots;
+		int n = d.cap;
+		d.cap = cap;
+		d.free = cap - cap / 8 - d.n;
+		d.ctrl = (signed char*)malloc(cap + GROUP);
+		d.slots = (KeyVal*)malloc(cap * sizeof(KeyVal));
+		memset(d.ctrl, EMPTY, cap + GROUP);
+		for (int i = 0; i < n; i++)
+		{
+			if (ctrl[i] >= 0)
+			{
+				unsigned h = hashOf(slots[i].key);
+				int j = freeSlot(h);
+				setCtrl(j, (signed char)(h & 0x7f));
+				memcpy((void*)&d.slots[j], (void*)&slots[i], sizeof(KeyVal));
+			}
+		}
+		free(ctrl);
+		free(slots);
+	}
+
+	void removeAt(int i)
+	{
+		Data& d = *_d;
+		asl_destroy(&d.slots[i]);
+		// the slot can be marked empty if no probe sequence could have passed it, that is, if there is no full group
+		// around it
+		unsigned after = match(d.ctrl + i, EMPTY);
+		unsigned before = match(d.ctrl + ((i - GROUP) & (d.cap - 1)), EMPTY);
+		if (after && before && lowBit(after) + (GROUP - 1 - highBit(before)) < GROUP)
+		{
+			setCtrl(i, EMPTY);
+			d.free++;
+		}
+		else
+			setCtrl(i, DELETED);
+		d.n--;
+	}
+
+	T& insert(const K& key, unsigned h)
+	{
+		int i = freeSlot(h);
+		if (_d->free == 0 && _d->ctrl[i] == EMPTY)
+		{
+			resize(_d->n * 2 >= _d->cap - _d->cap / 8 ? _d->cap * 2 : _d->cap);
+			i = freeSlot(h);
+		}
+		if (_d->ctrl[i] == EMPTY)
+			_d->free--;
+		setCtrl(i, (signed char)(h & 0x7f));
+		new (&_d->slots[i]) KeyVal(key, T());
+		_d->n++;
+		return _d->slots[i].value;
+	}
+
+	void release()
+	{
+		if (--_d->rc == 0)
+		{
+			clear();
+			free(_d->ctrl);
+			free(_d->slots);
+			delete _d;
+		}
+	}
+
+public:
+	FlatHashMap() : _d(new Data)
+	{
+		resize(GROUP);
+	}
+
+	/**
+	Constructs an empty map with space for `n` elements
+	*/
+	FlatHashMap(int n) : _d(new Data)
+	{
+		reserve(n);
+	}
+
+	FlatHashMap(const FlatHashMap& b) : _d(b._d)
+	{
+		++_d->rc;
+	}
+
+	~FlatHashMap()
+	{
+		release();
+	}
+
+	void operator=(const FlatHashMap& b)
+	{
+		++b._d->rc;
+		release();
+		_d = b._d;
+	}
+
+	FlatHashMap& dup()
+	{
+		FlatHashMap b(_d->n);
+		for (int i = 0; i < _d->cap; i++)
+			if (_d->ctrl[i] >= 0)
+				b[_d->slots[i].key] = _d->slots[i].value;
+		swap(_d, b._d);
+		return *this;
+	}
+
+	/**
+	Returns an independent copy of this map
+	*/
+	FlatHashMap clone() const
+	{
+		FlatHashMap b(*this);
+		return b.dup();
+	}
+
+	/**
+	Makes room for at least `n` elements so that they can be inserted without resizing the table
+	*/
+	void reserve(int n)
+	{
+		int cap = max((int)GROUP, nextPoT(n + n / 7 + 1));
+		if (cap > _d->cap)
+			resize(cap);
+	}
+
+	/**
+	Clears the map removing all elements (the table keeps its size)
+	*/
+	void clear()
+	{
+		Data& d = *_d;
+		for (int i = 0; i < d.cap; i++)
+			if (d.ctrl[i] >= 0)
+				asl_destroy(&d.slots[i]);
+		if (d.ctrl)
+			memset(d.ctrl, EMPTY, d.cap + GROUP);
+		d.n = 0;
+		d.free = d.cap - d.cap / 8;
+	}
+
+	/**
+	Returns the ratio of used slots to table size
+	*/
+	float fillFactor() const
+	{
+		return (float)_d->n / _d->cap;
+	}
+
+	/**
+	Returns a reference to the value associated to the given key,
+	the key has to exist
+	*/
+	const T& operator[](const K& key) const
+	{
+		const T* p = find(key);
+		if (p)
+			return *p;
+		else
+		{
+			static const T def = T();
+			return def;
+		}
+	}
+
+	/**
+	Returns a reference to the value associated to the given key,
+	creating one if the key does not exist.
+	*/
+	T& operator[](const K& key)
+	{
+		unsigned h = hashOf(key);
+		int i = indexOf(key, h);
+		if (i >= 0)
+			return _d->slots[i].value;
+		return insert(key, h);
+	}
+
+	/**
+	Returns a pointer to the element with key `key` or a null pointer if it is not found
+	*/
+	T* find(const K& key)
+	{
+		int i = indexOf(key, hashOf(key));
+		return i >= 0 ? &_d->slots[i].value : NULL;
+	}
+
+	const T* find(const K& key) const
+	{
+		return const_cast<FlatHashMap*>(this)->find(key);
+	}
+
+	/**
+	Returns the value for the given key or the value `def` if it is not found
+	*/
+	const T& get(const K& key, const T& def) const
+	{
+		const T* p = find(key);
+		return p ? *p : def;
+	}
+
+	FlatHashMap& set(const K& key, const T& value)
+	{
+		(*this)[key] = value;
+		return *this;
+	}
+
+	/**
+	Removes the given key
+	*/
+	void remove(const K& key)
+	{
+		int i = indexOf(key, hashOf(key));
+		if (i >= 0)
+			removeAt(i);
+	}
+
+	/**
+	Checks if the given key exists in the map
+	*/
+	bool has(const K& key) const
+	{
+		return indexOf(key, hashOf(key)) >= 0;
+	}
+
+	/**
+	Returns the number of elements in the map
+	*/
+	int length() const
+	{
+		return _d->n;
+	}
+
+	/**
+	Returns true if both maps are equal (equal keys and values)
+	*/
+	bool operator==(const FlatHashMap& b) const
+	{
+		if (length() != b.length())
+			return false;
+		for (Enumerator e(all()); e; ++e)
+		{
+			const T* p = b.find(~e);
+			if (!p || !(*p == *e))
+				return false;
+		}
+		return true;
+	}
+
+	bool operator!=(const FlatHashMap& b) const
+	{
+		return !(*this == b);
+	}
+
+	struct Enumerator
+	{
+		Data* d;
+		int i;
+		Enumerator() : d(0), i(0) {}
+		Enumerator(const FlatHashMap& m) : d(m._d), i(-1)
+		{
+			++*this;
+		}
+		void operator++()
+		{
+			while (++i < d->cap && d->ctrl[i] < 0) {}
+		}
+		T& operator*() { return d->slots[i].value; }
+		T* operator->() { return &(d->slots[i].value); }
+		const K& operator~() { return d->slots[i].key; }
+		operator bool() const { return i < d->cap; }
+		bool operator!=(const Enumerator& e) const { return (bool)*this; }
+		Enumerator all() const { return *this; }
+	};
+
+	Enumerator all() const { return Enumerator(*this); }
+
+	struct FEnumerator : public Enumerator
+	{
+		FEnumerator() {}
+		FEnumerator(const FlatHashMap& m) : Enumerator(m) {}
+		KeyVal& operator*() { return this->d->slots[this->i]; }
+	};
+
+	FEnumerator _all() const { return FEnumerator(*this); }
+};
+
+template<class K, class T>
+typename FlatHashMap<K, T>::FEnumerator begin(const FlatHashMap<K, T>& a)
+{
+	return a._all();
+}
+
+template<class K, class T>
+typename FlatHashMap<K, T>::FEnumerator end(const FlatHashMap<K, T>& a)
+{
+	return a._all();
+}
+
+/**
+A FlatHashMap with String keys that can also be looked up with `const char*` without creating a String
+
+~~~
+FlatHashDic<int> ids;
+ids["john"] = 5;       // creates a String key only when inserting
+int id = ids.get("john", -1);
+~~~
+\ingroup Containers
+*/
+template <class T>
+class FlatHashDic : public FlatHashMap<String, T>
+{
+	typedef FlatHashMap<String, T> Base;
+	static unsigned hashOf(const char* key) { return mixHash((unsigned)hash(key, (int)strlen(key))); }
+public:
+	using Base::operator[];
+	using Base::find;
+	using Base::get;
+	using Base::remove;
+	using Base::has;
+
+	FlatHashDic() {}
+	FlatHashDic(int n) : Base(n) {}
+	FlatHashDic(const FlatHashDic& b) : Base(b) {}
+
+	FlatHashDic clone() const
+	{
+		FlatHashDic b(*this);
+		b.dup();
+		return b;
+	}
+
+	T& operator[](const char* key)
+	{
+		unsigned h = hashOf(key);
+		int i = this->indexOf(key, h);
+		if (i >= 0)
+			return this->_d->slots[i].value;
+		return this->insert(key, h);
+	}
+
+	const T& operator[](const char* key) const
+	{
+		const T* p = find(key);
+		if (p)
+			return *p;
+		static const T def = T();
+		return def;
+	}
+
+	T* find(const char* key)
+	{
+		int i = this->indexOf(key, hashOf(key));
+		return i >= 0 ? &this->_d->slots[i].value : NULL;
+	}
+
+	const T* find(const char* key) const
+	{
+		return const_cast<FlatHashDic*>(this)->find(key);
+	}
+
+	const T& get(const char* key, const T& def) const
+	{
+		const T* p = find(key);
+		return p ? *p : def;
+	}
+
+	void remove(const char* key)
+	{
+		int i = this->indexOf(key, hashOf(key));
+		if (i >= 0)
+			this->removeAt(i);
+	}
+
+	bool has(const char* key) const
+	{
+		return this->indexOf(key, hashOf(key)) >= 0;
+	}
+};
+
+}
+#endif
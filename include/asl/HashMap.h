@@ -6,6 +6,7 @@
 
 #include <asl/Array.h>
 #include <asl/String.h>
+#include <asl/hash.h>
 
 namespace asl {
 
@@ -14,45 +15,63 @@ namespace asl {
 #pragma warning(disable : 6011)
 #endif
 
+/**
+\addtogroup Hashing
+@{
+*/
+
 inline int hash(int x)
 {
-	return x;
+	return (int)hashInt((unsigned)x);
+}
+
+inline int hash(unsigned x)
+{
+	return (int)hashInt(x);
+}
+
+inline int hash(Long x)
+{
+	return (int)hashInt((ULong)x);
+}
+
+inline int hash(ULong x)
+{
+	return (int)hashInt(x);
+}
+
+inline int hash(const char* p, int n)
+{
+	return (int)hashBytes(p, n);
 }
 
 inline int hash(const String& s)
 {
-	int h = 0, n = s.length();
-	const char* p = s;
-	for(int i=0; i<n; i++)
-		h = 33*h + p[i];
-	return h;
+	return hash(*s, s.length());
 }
 
 inline int hash(const Array<byte>& s)
 {
-	int h = 0, n = s.length();
-	const byte* p = s.data();
-	for (int i = 0; i<n; i++)
-		h = 33 * h + p[i];
-	return h;
+	return (int)hashBytes(s.data(), s.length());
 }
 
 template<typename T>
 inline int hash(T* p)
 {
-	return ((int)(size_t(p) & 0xffffffff)) >> 2;
+	return (int)hashInt((ULong)size_t(p));
 }
 
+/**
+Default hash for other types, which hashes their bytes (only valid for types with no pointers or padding)
+*/
 template<typename T>
 inline int hash(const T& x)
 {
-	int h = 0;
-	const byte* p = (const byte*)&x;
-	for(int i=0; i<sizeof(x); i++)
-		h = 33*h + p[i];
-	return h;
+	return (int)hashBytes(&x, sizeof(x));
 }
 
+/**@}*/
+
 #ifdef ASL_FILE_H
 inline int hash(const File& f)
 {
@@ -123,8 +142,9 @@ protected:
 	struct KeyValN : public KeyVal
 	{
 		KeyValN* next;
-		KeyValN(): next(0) {}
-		KeyValN(const K& k, const T& v) : KeyVal(k, v), next(0) {}
+		int h; // hash of the key, to rehash without recomputing it and to skip most key comparisons
+		KeyValN(): next(0), h(0) {}
+		KeyValN(const K& k, const T& v, int h_) : KeyVal(k, v), next(0), h(h_) {}
 	};
 
 public:
@@ -173,9 +193,14 @@ public:
 		return b.dup();
 	}
 
+	int binOfHash(int h) const
+	{
+		return (h & (a.length() - ASL_HMAP_SKIP - 1)) + ASL_HMAP_SKIP;
+	}
+
 	int binOf(const K& key) const
 	{
-		return (hash(key) & (a.length() - ASL_HMAP_SKIP - 1)) + ASL_HMAP_SKIP;
+		return binOfHash(hash(key));
 	}
 
 	void operator=(const HashMap& b)
@@ -272,7 +297,7 @@ public:
 				KeyValN* next;
 				do {
 					next = p->next;
-					int bin = (hash(p->key) & (b.length() - ASL_HMAP_SKIP - 1)) + ASL_HMAP_SKIP;
+					int bin = (p->h & (b.length() - ASL_HMAP_SKIP - 1)) + ASL_HMAP_SKIP;
 
 					KeyValN* p2 = b[bin], *q2 = p2;
 					while (p2) {
@@ -316,16 +341,16 @@ public:
 	T& operator[](const K& key)
 	{
 		rehash();
-		int bin = binOf(key);
+		int h = hash(key), bin = binOfHash(h);
 		KeyValN* p = a[bin], *q = p;
 		while(p)
 		{
-			if(p->key == key)
+			if(p->h == h && p->key == key)
 				return p->value;
 			q = p;
 			p = p->next;
 		}
-		p = new KeyValN(key, T());
+		p = new KeyValN(key, T(), h);
 		p->next = 0;
 		if(!q)
 			a[bin] = p;
@@ -340,10 +365,11 @@ public:
 	*/
 	T* find(const K& key)
 	{
-		KeyValN* p = a[binOf(key)];
+		int h = hash(key);
+		KeyValN* p = a[binOfHash(h)];
 		while (p)
 		{
-			if (p->key == key)
+			if (p->h == h && p->key == key)
 				return &p->value;
 			p = p->next;
 		}
@@ -375,18 +401,18 @@ public:
 	*/
 	void remove(const K& key)
 	{
-		int bin = binOf(key);
+		int h = hash(key), bin = binOfHash(h);
 		KeyValN* p = a[bin], *q = p;
 		while(p)
 		{
-			if(p->key == key)
+			if(p->h == h && p->key == key)
 			{
 				KeyValN* n = p->next;
 				delete p;
 				if(q!=p)
 					q->next = n;
 				else
-					a[bin] = 0;
+					a[bin] = n;
 				--_n();
 				return;
 			}
@@ -399,10 +425,11 @@ public:
 	*/
 	bool has(const K& key) const
 	{
-		KeyValN* p = a[binOf(key)];
+		int h = hash(key);
+		KeyValN* p = a[binOfHash(h)];
 		while(p)
 		{
-			if(p->key == key)
+			if(p->h == h && p->key == key)
 				return true;
 			p = p->next;
 		}
@@ -512,6 +539,31 @@ public:
 		b.dup();
 		return b;
 	}
+
+	using HashMap<String, T>::find;
+	using HashMap<String, T>::has;
+
+	/**
+	Returns a pointer to the element with key `key` or a null pointer if it is not found (without creating a String)
+	*/
+	T* find(const char* key)
+	{
+		int h = hash(key, (int)strlen(key));
+		for (typename HashMap<String, T>::KeyValN* p = this->a[this->binOfHash(h)]; p; p = p->next)
+			if (p->h == h && p->key == key)
+				return &p->value;
+		return NULL;
+	}
+
+	const T* find(const char* key) const
+	{
+		return const_cast<HashDic*>(this)->find(key);
+	}
+
+	bool has(const char* key) const
+	{
+		return find(key) != NULL;
+	}
 };
 #ifdef _MSC_VER
 #pragma warning(pop)
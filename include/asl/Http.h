@@ -8,6 +8,7 @@
 #include <asl/String.h>
 #include <asl/Pointer.h>
 #include <asl/Var.h>
+#include <asl/Deflate.h>
 #include <asl/util.h>
 
 namespace asl {
@@ -125,6 +126,8 @@ Base class of HttpRequest and HttpResponse with common functionality.
 class ASL_API HttpMessage
 {
 	friend class Http;
+	friend class HttpClient;
+	friend class HttpServer;
 public:
 	HttpMessage();
 
@@ -178,9 +181,14 @@ public:
 	*/
 	void put(const File& file);
 	/**
-	Returns the binary body of the message.
+	Returns the binary body of the message (a request body not yet received by a server is read first).
 	*/
-	const ByteArray& body() const { return _body; }
+	const ByteArray& body() const
+	{
+		if (_bodyDeferred)
+			const_cast<HttpMessage*>(this)->readBody();
+		return _body;
+	}
 	/**
 	Returns the message body as text
 	*/
@@ -190,6 +198,20 @@ public:
 	*/
 	Var json() const;
 
+	/**
+	Reads up to `n` bytes of the body as it arrives (decoding a chunked body), without keeping it in memory;
+	returns 0 at the end of the body and -1 on error. Servers can use this instead of `body()` to process large
+	uploads in constant memory:
+
+	~~~
+	byte buffer[65536];
+	int n;
+	while ((n = request.read(buffer, sizeof(buffer))) > 0)
+		file.write(buffer, n);
+	~~~
+	*/
+	int read(byte* buffer, int n);
+
 	bool write();
 	/**
 	Sends the currently set headers and starts the message body.
@@ -200,13 +222,21 @@ public:
 	*/
 	void write(const String& text);
 	/**
-	Writes the given buffer to the message body.
+	Writes the given buffer to the message body. If there was no Content-Length header the body is sent in chunks
+	as it is written (ended by `finish()`). Writes block while the peer is not reading, so a message can be produced
+	as fast as it is consumed, in constant memory. A server response with compression negotiated is compressed as it
+	is written, each write being flushed so that the client can decode it without waiting for the rest.
 	*/
 	int write(const char* buffer, int n);
 	/**
-	Sends the content of the given file in the message body
+	Ends a chunked message body, returns false on error (servers call it after `serve()` returns)
+	*/
+	bool finish();
+	/**
+	Sends the content of the given file in the message body, from byte `begin` to byte `end` (inclusive), or to
+	its end if `end` is negative. Plain sockets send it with a zero-copy system call if possible.
 	*/
-	void writeFile(const String& path, int begin = 0, int end = 0);
+	void writeFile(const String& path, Long begin = 0, Long end = -1);
 	/**
 	Sends the content of the given file as the message body and sets the content-length header
 	*/
@@ -219,8 +249,15 @@ public:
 	void setSockError(const String& s) { _socketError = s; }
 
 protected:
+	bool sendHeaders(const char* body, int n);
+	int writeBody(const char* buffer, int n);
+	void setEncoding(int format);
+	static int acceptedEncoding(const String& accept);
+	static bool compressible(const String& type);
 	void readHeaders();
-	void readBody();
+	bool readBody();
+	bool beginBody();
+	bool skipBody(Long maxSize);
 	String _command;
 	String _proto;
 	Dic<> _headers;
@@ -231,6 +268,15 @@ protected:
 	bool _fileBody;
 	bool _chunked;
 	bool _headersSent;
+	bool _finished;
+	bool _bodyDeferred;  // the body will be read on demand
+	int _bodyState;      // 0: not started, 1: reading, 2: ended
+	bool _bodyChunked;
+	Long _bodyLeft;      // bytes left in the body or in the current chunk
+	int _encodeFormat;   // compression format for a streamed body (a Deflater::Format, or -1)
+	int _encodeLevel;
+	Shared<Deflater> _encoder;
+	bool _decode;        // decompress a body with a Content-Encoding
 	Shared<HttpStatus> _status;
 	String _socketError;
 };
@@ -288,7 +334,12 @@ public:
 		_recursion = 0;
 		_followRedirects = true;
 	}
-	void read();
+	using HttpMessage::read;
+	/**
+	Reads a request from the socket, including its body unless `body` is false (then it can be read later with
+	`read(buffer, n)` or `body()`)
+	*/
+	void read(bool body = true);
 	const String& resource() const
 	{
 		return _res;
@@ -446,6 +497,118 @@ protected:
 };
 
 
+struct HttpPool;
+
+/**
+An HTTP/HTTPS client that keeps connections open and reuses them for subsequent requests to the same server, saving
+the TCP handshake and, for HTTPS, the TLS handshake of each request. It has the same request functions as Http, which
+actually uses a shared HttpClient (`HttpClient::shared()`), so calls to `Http::get()`, `Http::post()`, etc. already
+reuse connections.
+
+Idle connections are kept per protocol, host and port, and closed when unused for some time (`setIdleTimeout()`) or
+when the server closes them. The number of simultaneous connections to a server can be limited
+(`setMaxConnections()`); threads making requests beyond that wait for a connection to be free. An HttpClient can be
+used from several threads at once.
+
+~~~
+HttpClient client;
+client.setMaxConnections(4);
+for (int i = 0; i < 100; i++)
+	auto res = client.get("http://localhost:8000/api/items/" + String(i));
+~~~
+
+A new HTTPS connection to a server already visited resumes the TLS session (an abbreviated handshake) if the server
+supports it.
+*/
+class ASL_API HttpClient
+{
+public:
+	HttpClient();
+	~HttpClient();
+
+	/** Sends an HTTP request and returns the response. */
+	HttpResponse request(HttpRequest& req);
+
+	/** Sends an HTTP GET request for the given url and returns the response. */
+	HttpResponse get(const String& url, const Dic<>& headers = Dic<>())
+	{
+		HttpRequest req("GET", url, headers);
+		return request(req);
+	}
+
+	/** Sends an HTTP PUT request for the given url with the given data and returns the response. */
+	template<class T>
+	HttpResponse put(const String& url, const T& body, const Dic<>& headers = Dic<>())
+	{
+		HttpRequest req("PUT", url, body, headers);
+		return request(req);
+	}
+
+	/** Sends an HTTP POST request for the given url with the given body and returns the response. */
+	template<class T>
+	HttpResponse post(const String& url, const T& body, const Dic<>& headers = Dic<>())
+	{
+		HttpRequest req("POST", url, body, headers);
+		return request(req);
+	}
+
+	/** Sends an HTTP DELETE request for the given url and returns the response. */
+	HttpResponse delet(const String& url, const Dic<>& headers = Dic<>())
+	{
+		HttpRequest req("DELETE", url, headers);
+		return request(req);
+	}
+
+	/** Sends an HTTP PATCH request for the given url with the given data and returns the response. */
+	template<class T>
+	HttpResponse patch(const String& url, const T& body, const Dic<>& headers = Dic<>())
+	{
+		HttpRequest req("PATCH", url, body, headers);
+		return request(req);
+	}
+
+	/**
+	Enables or disables reusing connections (enabled by default); if disabled, each request uses a new connection
+	*/
+	HttpClient& setKeepAlive(bool enable);
+
+	/**
+	Sets the maximum number of simultaneous connections to each server (default 8, 0 = no limit)
+	*/
+	HttpClient& setMaxConnections(int n);
+
+	/**
+	Sets the time in seconds after which unused connections are closed (default 30)
+	*/
+	HttpClient& setIdleTimeout(double t);
+
+	/**
+	Enables or disables asking servers for compressed responses (enabled by default if the library has zlib);
+	compressed bodies are decompressed transparently, keeping the Content-Encoding header
+	*/
+	HttpClient& setCompression(bool enable);
+
+	/**
+	Returns the number of open connections not in use
+	*/
+	int idleConnections() const;
+
+	/**
+	Closes all connections not in use
+	*/
+	void closeIdle();
+
+	/**
+	Returns the client used by the Http static functions
+	*/
+	static HttpClient& shared();
+
+private:
+	HttpPool* _pool;
+	HttpClient(const HttpClient&);
+	void operator=(const HttpClient&);
+};
+
 /**
 This class contains the basic HTTP/HTTPS client functionality.
 
@@ -516,6 +679,8 @@ Using **IPv6** addresses is supported with square brackets in the host part `[ip
 ~~~
 auto res = Http::get("http://[::1]:80/path");
 ~~~
+
+Connections are kept open and reused by subsequent requests to the same server, see HttpClient.
 */
 
 class ASL_API Http
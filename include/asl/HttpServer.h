@@ -12,6 +12,7 @@
 namespace asl {
 
 class WebSocketServer;
+struct HttpFileCache;
 
 /**
 This class can be used to create application-specific HTTP servers.
@@ -60,12 +61,21 @@ A server like that will respond to requests such as `/api/clients/132337` or `/a
 
 Each request is handled in a separate thread. So, you should probably use mutexes for synchronization.
 
+For many concurrent keep-alive clients, `setEventDriven(true)` serves requests from a fixed pool of threads
+instead of one thread per connection (see SocketServer).
+
+With `setCompression(true)` responses of text types (HTML, CSS, JavaScript, JSON, XML) are sent compressed with gzip
+or deflate to clients that accept it: bodies set with `put()` of at least a minimum size, bodies written in chunks
+(compressed as they are written) and static files, which are served from a `.gz` file next to them if it is not
+older, or compressed once and kept in the file cache.
+
 */
 
 class ASL_API HttpServer: public SocketServer
 {
 public:
 	HttpServer(int port = -1);
+	~HttpServer();
 
 	/**
 	* Sets the root directory from where files will be served by default
@@ -95,6 +105,19 @@ public:
 	*/
 	void serveFile(HttpRequest& request, HttpResponse& response);
 
+	/**
+	Sets the memory used to keep small static files (up to `maxFileSize` bytes each) mapped in memory, up to
+	`maxSize` bytes in total (64 MB and 64 KB by default), or disables the cache if `maxSize` is 0. Larger files are
+	sent with a zero-copy system call if the connection is not encrypted. This must be called before `start()`.
+	*/
+	void setFileCache(Long maxSize, Long maxFileSize = 64 * 1024);
+
+	/**
+	Enables or disables compressing responses for clients that accept it (disabled by default); bodies smaller than
+	`minSize` bytes are sent as they are, and `level` is the compression level (1-9)
+	*/
+	void setCompression(bool on, int minSize = 1024, int level = 6);
+
 	/**
 	Links this socket with the given WebSocket server to process incoming WebSocket connections
 	*/
@@ -107,8 +130,18 @@ protected:
 	String _methods;
 	bool _cors;
 	WebSocketServer* _wsserver;
+	HttpFileCache* _cache;
+	bool _compression;
+	int _compressMinSize;
+	int _compressLevel;
 private:
+	void sendFile(HttpRequest& request, HttpResponse& response, const File& file);
+	bool gzipVariant(HttpRequest& request, HttpResponse& response, const File& file, const String& mime,
+		String& gzpath, ByteArray& packed);
+	void compressBody(HttpResponse& response);
 	void serve(Socket client);
+	bool serveInput(Socket client);
+	bool serveRequest(Socket& client);
 };
 }
 #endif
@@ -0,0 +1,485 @@
+// Copyright(c) 1999-2024 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+#ifndef ASL_INDEXEDDIC_H
+#define ASL_INDEXEDDIC_H
+
+#include <asl/Map.h>
+#include <asl/HashMap.h>
+#include <asl/time.h>
+
+namespace asl {
+
+/**
+A dictionary with String keys, like Dic, but with constant time insertion and lookup. This is the storage of
+Var objects.
+
+Elements are stored in an array, with their key hashes in another. Lookups in small dictionaries (up to 8 elements)
+compare the hashes sequentially; larger ones use an open addressing index of element positions. New elements are
+appended, and enumeration is in key order as with Dic: if elements were not added in order (as they are when parsing
+sorted data) or some were removed, the key order is computed on the first enumeration and kept until the next change.
+Reading never moves elements, so pointers returned by `find()` stay valid and several threads can read at once.
+
+Copies share their contents, like other containers in ASL; use `clone()` for an independent copy.
+
+~~~
+IndexedDic<int> ages;
+ages["john"] = 25;
+ages["ann"] = 30;
+foreach2(String& name, int age, ages)
+	printf("%s: %i\n", *name, age);     // "ann" first
+~~~
+\ingroup Containers
+*/
+template<class T>
+class IndexedDic
+{
+public:
+	typedef typename Map<String, T>::KeyVal KeyVal;
+
+protected:
+	enum { SMALL = 8 };
+
+	struct Data
+	{
+		AtomicCount rc;
+		Array<KeyVal> items;
+		Array<unsigned> hashes;
+		Array<int> index;   // element positions + 1 (0 = free slot), empty while the dictionary is small
+		Array<int> order;   // element positions in key order if the items are not sorted and `ordered` is 2
+		AtomicCount ordered; // 0: no order computed, 1: being computed, 2: computed
+		bool sorted;        // items are in key order
+		bool arena;         // allocated from an Arena
+		Data() : rc(1), ordered(0), sorted(true), arena(false) {}
+	};
+
+	// elements are sorted by the first 8 bytes of their keys (as a big-endian number), then by the whole keys
+	struct SortKey
+	{
+		ULong prefix;
+		int i;
+	};
+
+	struct KeyLess
+	{
+		const KeyVal* a;
+		KeyLess(const KeyVal* p) : a(p) {}
+		bool operator()(const SortKey& x, const SortKey& y) const
+		{
+			return x.prefix != y.prefix ? x.prefix < y.prefix : compare(a[x.i].key, a[y.i].key) < 0;
+		}
+	};
+
+	Data* _d;
+
+	static unsigned hashOf(const String& key) { return (unsigned)hashBytes(*key, key.length()); }
+
+	int indexOf(const String& key, unsigned h) const
+	{
+		const Data& d = *_d;
+		const KeyVal* a = d.items.data();
+		const unsigned* hs = d.hashes.data();
+		if (d.index.length() == 0)
+		{
+			for (int i = 0, n = d.items.length(); i < n; i++)
+				if (hs[i] == h && a[i].key == key)
+					return i;
+			return -1;
+		}
+		const int* t = d.index.data();
+		int mask = d.index.length() - 1;
+		for (int j = h & mask; t[j] != 0; j = (j + 1) & mask)
+		{
+			int i = t[j] - 1;
+			if (hs[i] == h && a[i].key == key)
+				return i;
+		}
+		return -1;
+	}
+
+	// returns the index slot holding element i
+	int slotOf(int i) const
+	{
+		const int* t = _d->index.data();
+		int mask = _d->index.length() - 1;
+		int j = _d->hashes[i] & mask;
+		while (t[j] != i + 1)
+			j = (j + 1) & mask;
+		return j;
+	}
+
+	void link(int i)
+	{
+		int* t = _d->index.data();
+		int mask = _d->index.length() - 1;
+		int j = _d->hashes[i] & mask;
+		while (t[j] != 0)
+			j = (j + 1) & mask;
+		t[j] = i + 1;
+	}
+
+	// frees slot j, moving back the following entries of the cluster that would not be found otherwise
+	void unlink(int j)
+	{
+		int* t = _d->index.data();
+		int mask = _d->index.length() - 1;
+		for (int k = (j + 1) & mask; t[k] != 0; k = (k + 1) & mask)
+		{
+			int home = _d->hashes[t[k] - 1] & mask;
+			if (((k - home) & mask) >= ((k - j) & mask))
+			{
+				t[j] = t[k];
+				j = k;
+			}
+		}
+		t[j] = 0;
+	}
+
+	void rehash(int cap)
+	{
+		_d->index = Array<int>(cap, 0);
+		for (int i = 0; i < _d->items.length(); i++)
+			link(i);
+	}
+
+	// called on changes that can break the key order (no enumeration can be running meanwhile)
+	void unsorted()
+	{
+		_d->sorted = false;
+		_d->ordered.cas(2, 0);
+	}
+
+	T& insert(const String& key, const T& value, unsigned h)
+	{
+		Data& d = *_d;
+		int n = d.items.length();
+		if (n > 0 && compare(d.items[n - 1].key, key) > 0)
+			unsorted();
+		d.items << KeyVal(key, value);
+		d.hashes << h;
+		if (d.index.length() > 0 || n >= SMALL)
+		{
+			if (2 * (n + 1) > d.index.length())
+				rehash(nextPoT(4 * (n + 1)));
+			else
+				link(n);
+		}
+		return d.items[n].value;
+	}
+
+	Array<int> sortedOrder() const
+	{
+		int n = length();
+		const KeyVal* a = _d->items.data();
+		Array<SortKey> keys(n);
+		for (int i = 0; i < n; i++)
+		{
+			const byte* k = (const byte*)*a[i].key;
+			ULong x = 0;
+			for (int j = 0, m = min(a[i].key.length(), 8); j < m; j++)
+				x |= ULong(k[j]) << (56 - 8 * j);
+			keys[i].prefix = x;
+			keys[i].i = i;
+		}
+		keys.sort(KeyLess(a));
+		Array<int> order(n);
+		for (int i = 0; i < n; i++)
+			order[i] = keys[i].i;
+		return order;
+	}
+
+	// returns the element positions in key order, or null if the items are sorted; the order is computed by one
+	// reader and kept for the next ones (others reading at the same time wait for it)
+	const int* order() const
+	{
+		Data& d = *_d;
+		if (d.sorted)
+			return NULL;
+		while (!d.ordered.cas(2, 2))
+		{
+			if (d.ordered.cas(0, 1))
+			{
+				d.order = sortedOrder();
+				d.ordered.cas(1, 2);
+			}
+			else
+				sleep(2e-5);
+		}
+		return d.order.data();
+	}
+
+	static Data* newData()
+	{
+		void* p = _activeArenas > 0 ? Arena::allocCurrent(sizeof(Data)) : 0;
+		if (!p)
+			return new Data;
+		Data* d = new (p) Data;
+		d->arena = true;
+		return d;
+	}
+
+	void release()
+	{
+		if (--_d->rc != 0)
+			return;
+		if (_d->arena)
+		{
+			_d->~Data();
+			Arena::release(_d);
+		}
+		else
+			delete _d;
+	}
+
+public:
+	IndexedDic() : _d(newData()) {}
+
+	IndexedDic(const IndexedDic& b) : _d(b._d)
+	{
+		++_d->rc;
+	}
+
+	~IndexedDic()
+	{
+		release();
+	}
+
+	void operator=(const IndexedDic& b)
+	{
+		++b._d->rc;
+		release();
+		_d = b._d;
+	}
+
+	/** Returns the number of elements */
+	int length() const { return _d->items.length(); }
+
+	bool operator!() const { return length() == 0; }
+
+	/** Removes all elements */
+	void clear()
+	{
+		_d->items.clear();
+		_d->hashes.clear();
+		_d->index.clear();
+		_d->sorted = true;
+		_d->ordered.cas(2, 0);
+	}
+
+	/**
+	Makes room for `n` elements so that they can be added without reallocations
+	*/
+	void reserve(int n)
+	{
+		_d->items.reserve(n);
+		_d->hashes.reserve(n);
+		if (n > SMALL && 2 * n > _d->index.length())
+			rehash(nextPoT(4 * n));
+	}
+
+	/** Detaches this dictionary from other ones possibly sharing it */
+	IndexedDic& dup()
+	{
+		Data* d = newData();
+		d->items = _d->items.clone();
+		d->hashes = _d->hashes.clone();
+		d->index = _d->index.clone();
+		d->sorted = _d->sorted;
+		release();
+		_d = d;
+		return *this;
+	}
+
+	/** Returns an independent copy of this dictionary */
+	IndexedDic clone() const
+	{
+		IndexedDic b(*this);
+		return b.dup();
+	}
+
+	/** Returns true if an element with key `key` exists */
+	bool has(const String& key) const
+	{
+		return indexOf(key, hashOf(key)) >= 0;
+	}
+
+	/**
+	Returns a pointer to the element with key `key` or a null pointer if it is not found
+	*/
+	T* find(const String& key)
+	{
+		int i = indexOf(key, hashOf(key));
+		return i >= 0 ? &_d->items[i].value : NULL;
+	}
+
+	const T* find(const String& key) const
+	{
+		return const_cast<IndexedDic*>(this)->find(key);
+	}
+
+	/** Returns a reference to the element with key `key`, or a static default constructed item if not found */
+	const T& operator[](const String& key) const
+	{
+		const T* p = find(key);
+		static T def = T();
+		return p ? *p : def;
+	}
+
+	/** Returns a reference to the element with key `key`, adding a default one if not found */
+	T& operator[](const String& key)
+	{
+		unsigned h = hashOf(key);
+		int i = indexOf(key, h);
+		return i >= 0 ? _d->items[i].value : insert(key, T(), h);
+	}
+
+	/** Returns the element with key `key` or the value `def` if key is not found */
+	const T& get(const String& key, const T& def) const
+	{
+		const T* p = find(key);
+		return p ? *p : def;
+	}
+
+	IndexedDic& set(const String& key, const T& value)
+	{
+		unsigned h = hashOf(key);
+		int i = indexOf(key, h);
+		if (i >= 0)
+			_d->items[i].value = value;
+		else
+			insert(key, value, h);
+		return *this;
+	}
+
+	/** Removes the element named `key` */
+	bool remove(const String& key)
+	{
+		int i = indexOf(key, hashOf(key));
+		if (i < 0)
+			return false;
+		Data& d = *_d;
+		int last = d.items.length() - 1;
+		if (d.index.length() > 0)
+		{
+			unlink(slotOf(i));
+			if (i != last)
+				d.index[slotOf(last)] = i + 1;
+		}
+		if (i != last)
+		{
+			bswap(d.items[i], d.items[last]);
+			d.hashes[i] = d.hashes[last];
+		}
+		d.items.removeLast();
+		d.hashes.removeLast();
+		if (d.items.length() == 0)
+			clear();
+		else if (i != last)
+			unsorted();
+		else
+			d.ordered.cas(2, 0);
+		return true;
+	}
+
+	/** Returns an array containing all keys in order */
+	Array<String> keys() const
+	{
+		Array<String> k;
+		k.reserve(length());
+		for (Enumerator e(*this); e; ++e)
+			k << ~e;
+		return k;
+	}
+
+	/** Returns the contents as a Dic */
+	Dic<T> dic() const
+	{
+		Dic<T> b;
+		b.reserve(length());
+		for (KeyValEnumerator e(*this); e; ++e)
+			b.kv() << *e;
+		return b;
+	}
+
+	/** Returns the contents as a Dic */
+	operator Dic<T>() const { return dic(); }
+
+	bool operator==(const IndexedDic& b) const
+	{
+		if (length() != b.length())
+			return false;
+		for (int i = 0; i < length(); i++)
+		{
+			const KeyVal& kv = _d->items[i];
+			int j = b.indexOf(kv.key, _d->hashes[i]);
+			if (j < 0 || b._d->items[j].value != kv.value)
+				return false;
+		}
+		return true;
+	}
+
+	bool operator!=(const IndexedDic& b) const { return !(*this == b); }
+
+	struct Enumerator
+	{
+		IndexedDic* d;
+		const int* order;
+		int i;
+		Enumerator(const IndexedDic& m) : d((IndexedDic*)&m), order(m.order()), i(0) {}
+		Enumerator(const IndexedDic& m, int i_) : d((IndexedDic*)&m), order(NULL), i(i_) {}
+		void operator++() { i++; }
+		KeyVal& item() const { return d->_d->items[order ? order[i] : i]; }
+		T& operator*() { return item().value; }
+		T* operator->() { return &**this; }
+		const String& operator~() const { return item().key; }
+		operator bool() const { return i < d->length(); }
+		bool operator!=(const Enumerator&) const { return i < d->length(); }
+	};
+
+	/** An enumerator giving key-value pairs (as range-based for loops do) */
+	struct KeyValEnumerator : public Enumerator
+	{
+		KeyValEnumerator(const IndexedDic& m) : Enumerator(m) {}
+		KeyValEnumerator(const IndexedDic& m, int i_) : Enumerator(m, i_) {}
+		KeyVal& operator*() { return this->item(); }
+		KeyVal* operator->() { return &this->item(); }
+	};
+
+	/** Returns an enumerator in key order */
+	Enumerator all() const { return Enumerator(*this); }
+
+	/**
+	Joins the contents into a string, using `s1` as element separator and `s2` as key-value separator.
+	*/
+	String join(const String& s1, const String& s2) const
+	{
+		int i = 0, n = length();
+		String out;
+		foreach2(String& k, const String& v, *this)
+		{
+			out << k << s2 << v;
+			if (i++ < n - 1)
+				out << s1;
+		}
+		return out;
+	}
+};
+
+#ifdef ASL_HAVE_RANGEFOR
+
+template<class T>
+typename IndexedDic<T>::KeyValEnumerator begin(const IndexedDic<T>& a)
+{
+	return typename IndexedDic<T>::KeyValEnumerator(a);
+}
+
+template<class T>
+typename IndexedDic<T>::KeyValEnumerator end(const IndexedDic<T>& a)
+{
+	return typename IndexedDic<T>::KeyValEnumerator(a, a.length());
+}
+
+#endif
+
+}
+#endif
@@ -35,7 +35,7 @@ Write and encode functions support an additional argument to control style. By d
 
 The `SIMPLE` and `NICE` (same but multiline, indented) values will
 write real numbers having a slightly reduced precision to avoid numbers like `12.25000001` or `2.09999999` (will look like `12.25` and `2.1`). By default
-numbers are written so that they are recovered exactly when parsing.
+numbers are written with the shortest text that is recovered exactly when parsing.
 
 ~~~
 Json::write(data, "data.json", Json::NICE);
@@ -62,7 +62,7 @@ Var data = Var("a", "abc")
 struct ASL_API Json
 {
 	/**
-	Options for Json::encode and Json::write
+	Options for Json::encode and Json::write (and ARENA for Json::decode and Json::read)
 	*/
 	enum Mode {
 		NONE = 0,    //!< Compact format in a single line
@@ -72,13 +72,14 @@ struct ASL_API Json
 		JSON = 8,
 		EXACT = 16,
 		SHORTF = 32, //!< Format doubles as short as floats
+		ARENA = 64,  //!< Decode allocating the tree in an Arena (faster for large documents, see Arena)
 		NICE = 3     //!< Same as PRETTY and SIMPLE
 	};
 
 	/**
 	Reads and decodes data from a file in JSON format
 	*/
-	static Var read(const String& file);
+	static Var read(const String& file, Mode mode = NONE);
 	
 	/**
 	Writes a var to a file in JSON format
@@ -94,7 +95,7 @@ struct ASL_API Json
 	Decodes the JSON-encoded string into a Var that will contain all the structure. It is similar to JavaScript's
 	`JSON.parse()`. If there are format parsing errors, the result will be a `Var::NONE` typed variable.
 	*/
-	static Var decode(const String& json);
+	static Var decode(const String& json, Mode mode = NONE);
 
 	/**
 	Encodes the given Var into a JSON-format representation. It is similar to JavaScript's
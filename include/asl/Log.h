@@ -7,10 +7,12 @@
 #include <asl/defs.h>
 #include <asl/Singleton.h>
 #include <asl/String.h>
+#include <asl/atomic.h>
 
 namespace asl {
 
 class Mutex;
+struct LogQueue;
 
 /**
 Log is a utility to log messages to either the console, a file or both. Messages have a *category*
@@ -50,6 +52,17 @@ On Android this class uses the system logger.
 
 Log files do not grow indefinitely. When reaching about 1 MB, they will be moved to a file with "-1" appended
 to its name (like "log-1.log"), and a new empty file will be started. Any logs older than that will be lost.
+
+By default each message is written to the file and console before returning. In asynchronous mode messages are
+formatted by the caller, pushed to a lock-free queue and written in batches by a background thread that keeps the
+log file open, which is much faster for frequent logging. When the queue is full callers can wait or the message
+can be dropped. `flush()` waits until all previous messages have been written.
+
+~~~
+Log::setAsync(true, 8192, Log::DROP);
+...
+Log::flush();
+~~~
 \ingroup Logging
 */
 
@@ -60,10 +73,14 @@ class ASL_API Log : public Singleton<Log>
 	String _logfile;
 	int _maxLevel;
 	Mutex* _mutex;
+	LogQueue* _queue;
+	AtomicCount _queueUsers; // threads using _queue, negative while setAsync() replaces it
 	void storeState();
 	void updateState();
-	Log(const Log&) : _mutex(0) { _maxLevel = 0; _useconsole = _usefile = false; }
-	void operator=(const Log&) { _mutex = 0; _maxLevel = 0; _useconsole = _usefile = false;}
+	Log(const Log&) : _mutex(0), _queue(0) { _maxLevel = 0; _useconsole = _usefile = false; }
+	void operator=(const Log&) { _mutex = 0; _queue = 0; _maxLevel = 0; _useconsole = _usefile = false;}
+	friend struct LogQueue;
+	friend struct LogQueueRef;
 public:
 	Log();
 	~Log();
@@ -75,6 +92,15 @@ public:
 		ERR, WARNING, INFO, DEBUG, VERBOSE
 	};
 
+	/**
+	What to do in asynchronous mode when the queue is full
+	*/
+	enum Overflow {
+		BLOCK,      //!< Wait until there is space
+		DROP,       //!< Discard the message (they are counted in `dropped()`)
+		DROP_REPORT //!< Discard the message and later write a warning with the number of messages discarded
+	};
+
 	friend ASL_API void log(const String& cat, Log::Level level, const String& message);
 	friend ASL_API void log(const String& cat, Log::Level level, ASL_PRINTF_W1 const char* fmt, ...) ASL_PRINTF_W2(3);
 
@@ -102,6 +128,19 @@ public:
 	Gets the current maximum log level
 	*/
 	static int maxLevel();
+	/**
+	Enables or disables asynchronous logging with a queue of the given number of messages and an overflow policy;
+	when switching, messages already queued are written first (this can be called while other threads are logging)
+	*/
+	static void setAsync(bool on, int queueSize = 8192, Overflow policy = BLOCK);
+	/**
+	Waits until all messages logged so far have been written (in asynchronous mode)
+	*/
+	static void flush();
+	/**
+	Returns the number of messages discarded because the queue was full
+	*/
+	static int dropped();
 
 	void log(const String& cat, Log::Level level, const String& message);
 };
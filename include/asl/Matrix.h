@@ -8,6 +8,40 @@
 
 namespace asl {
 
+/**
+Computes C += alpha * A * B on matrices in raw memory, where A is m x k, B is k x n, element (i, j) of A is at
+`a[i * ars + j * acs]`, of B at `b[i * brs + j * bcs]` and of C at `c[i * ldc + j]`. Operands can be transposed
+by exchanging their strides. This is used by Matrix_ products and solvers; the versions for float and double are
+cache-blocked and vectorized (with AVX2/FMA if the CPU supports it).
+\ingroup Math3D
+*/
+template<class T>
+void matMulAdd(int m, int n, int k, T alpha, const T* a, int ars, int acs, const T* b, int brs, int bcs, T* c, int ldc)
+{
+	for (int i = 0; i < m; i++)
+		for (int l = 0; l < k; l++)
+		{
+			T f = alpha * a[i * ars + l * acs];
+			const T* bl = b + l * brs;
+			T* ci = c + i * ldc;
+			for (int j = 0; j < n; j++)
+				ci[j] += f * bl[j * bcs];
+		}
+}
+
+ASL_API void matMulAdd(int m, int n, int k, float alpha, const float* a, int ars, int acs, const float* b, int brs, int bcs,
+	float* c, int ldc);
+
+ASL_API void matMulAdd(int m, int n, int k, double alpha, const double* a, int ars, int acs, const double* b, int brs, int bcs,
+	double* c, int ldc);
+
+/**
+Enables splitting large float and double matrix products (and so LU and Cholesky factorizations) among the threads
+of the pool used by Thread::parallel_for. It is off by default.
+\ingroup Math3D
+*/
+ASL_API void setMatrixParallel(bool on);
+
 /**
  * A matrix supporting basic arithmetic operations. With two predefined specializations: `Matrix` for doubles and `Matrixf` for floats.
  * 
@@ -199,16 +233,12 @@ public:
 	Matrix_ operator*(const Matrix_& b) const
 	{
 		const Matrix_& a = *this;
-		Matrix_ c(a.rows(), b.cols());
+		Matrix_ c(a.rows(), b.cols(), T(0));
 		if (a.cols() != b.rows())
 			return c.clear();
-		for (int i = 0; i < c.rows(); i++)
-			for (int j = 0; j < c.cols(); j++)
-			{
-				c(i, j) = 0;
-				for (int k = 0; k < a.cols(); k++)
-					c(i, j) += a(i, k) * b(k, j);
-			}
+		if (c.length() > 0 && a.cols() > 0)
+			matMulAdd(a.rows(), b.cols(), a.cols(), T(1), a.array().data(), a.cols(), 1, b.array().data(), b.cols(), 1,
+				c.array().data(), c.cols());
 		return c;
 	}
 	/**
@@ -217,16 +247,12 @@ public:
 	Matrix_ transposed(const Matrix_& b) const
 	{
 		const Matrix_& a = *this;
-		Matrix_        c(a.cols(), b.cols());
+		Matrix_ c(a.cols(), b.cols(), T(0));
 		if (a.rows() != b.rows())
 			return c.clear();
-		for (int i = 0; i < c.rows(); i++)
-			for (int j = 0; j < c.cols(); j++)
-			{
-				c(i, j) = 0;
-				for (int k = 0; k < a.rows(); k++)
-					c(i, j) += a(k, i) * b(k, j);
-			}
+		if (c.length() > 0 && a.rows() > 0)
+			matMulAdd(a.cols(), b.cols(), a.rows(), T(1), a.array().data(), 1, a.cols(), b.array().data(), b.cols(), 1,
+				c.array().data(), c.cols());
 		return c;
 	}
 
@@ -368,90 +394,296 @@ struct SolveParams
 };
 
 
+/**
+Methods for solve()
+*/
+enum SolveMethod
+{
+	SOLVE_AUTO,     //!< LU if the matrix is square, least-squares with QR if it has more rows than columns
+	SOLVE_LU,       //!< LU decomposition with partial pivoting (normal equations if not square)
+	SOLVE_CHOLESKY, //!< Cholesky decomposition for symmetric positive-definite matrices (normal equations if not square)
+	SOLVE_QR        //!< Householder QR decomposition, least-squares if there are more rows than columns
+};
+
+#define ASL_MATRIX_BLOCK 64
+
+/**
+Solves T * X = B in place in `b` (n x nrhs, row stride ldb) for a lower or upper triangular matrix with element (i, j)
+at `t[i * trs + j * tcs]`, with unit diagonal or not. Works in blocks of rows, with most of the work done by matMulAdd.
+*/
 template<class T>
-Matrix_<T> solve_(Matrix_<T>& A, Matrix_<T>& b);
+void triSolve(int n, const T* t, int trs, int tcs, bool lower, bool unit, T* b, int nrhs, int ldb)
+{
+	const int NB = ASL_MATRIX_BLOCK;
+	for (int ib = 0; ib < n; ib += NB)
+	{
+		int i0 = lower ? ib : max(0, n - ib - NB), i1 = lower ? min(n, ib + NB) : n - ib;
+		if (lower)
+			matMulAdd(i1 - i0, nrhs, i0, T(-1), t + i0 * trs, trs, tcs, b, ldb, 1, b + i0 * ldb, ldb);
+		else
+			matMulAdd(i1 - i0, nrhs, n - i1, T(-1), t + i0 * trs + i1 * tcs, trs, tcs, b + i1 * ldb, ldb, 1, b + i0 * ldb, ldb);
+		for (int ii = i0; ii < i1; ii++)
+		{
+			int i = lower ? ii : i0 + i1 - 1 - ii;
+			T* bi = b + i * ldb;
+			for (int k = lower ? i0 : i + 1; k < (lower ? i : i1); k++)
+			{
+				T f = t[i * trs + k * tcs];
+				const T* bk = b + k * ldb;
+				for (int j = 0; j < nrhs; j++)
+					bi[j] -= f * bk[j];
+			}
+			if (!unit)
+			{
+				T d = t[i * trs + i * tcs];
+				for (int j = 0; j < nrhs; j++)
+					bi[j] /= d;
+			}
+		}
+	}
+}
 
 /**
- * Solves the matrix equation A*x=b and returns x; if b is a matrix (not a column) then the equation is solved
- * for each of b's columns and solutions returned as the columns of the returned matrix; if A is not square (more equations than unknowns),
- then a least-squares solution is computed
- * \ingroup Math3D
- */
+Factorizes the n x n matrix in `a` (row stride lda) in place as P * A = L * U with partial pivoting, where `piv[k]`
+is the row swapped with row k at step k. Works in blocks of columns, updating the rest of the matrix with matMulAdd.
+Returns false if the matrix is singular.
+*/
 template<class T>
-Matrix_<T> solve(const Matrix_<T>& A, const Matrix_<T>& b)
+bool luFactor(int n, T* a, int lda, int* piv)
 {
-	if (A.rows() != A.cols())
+	const int NB = ASL_MATRIX_BLOCK;
+	bool ok = true;
+	for (int k0 = 0; k0 < n; k0 += NB)
 	{
-		Matrix_<T> A2 = A.transposed(A), b2 = A.transposed(b);
-		return solve_(A2, b2);
+		int k1 = min(n, k0 + NB);
+		for (int k = k0; k < k1; k++)
+		{
+			int p = k;
+			T big = fabs(a[k * lda + k]);
+			for (int i = k + 1; i < n; i++)
+			{
+				if (fabs(a[i * lda + k]) > big)
+				{
+					big = fabs(a[i * lda + k]);
+					p = i;
+				}
+			}
+			piv[k] = p;
+			if (p != k)
+				for (int j = 0; j < n; j++)
+					swap(a[k * lda + j], a[p * lda + j]);
+			T d = a[k * lda + k];
+			if (d == T(0))
+			{
+				ok = false;
+				continue;
+			}
+			const T* ak = a + k * lda;
+			for (int i = k + 1; i < n; i++)
+			{
+				T* ai = a + i * lda;
+				T f = ai[k] /= d;
+				for (int j = k + 1; j < k1; j++)
+					ai[j] -= f * ak[j];
+			}
+		}
+		if (k1 == n)
+			break;
+		triSolve(k1 - k0, a + k0 * lda + k0, lda, 1, true, true, a + k0 * lda + k1, n - k1, lda);
+		matMulAdd(n - k1, n - k1, k1 - k0, T(-1), a + k1 * lda + k0, lda, 1, a + k0 * lda + k1, lda, 1, a + k1 * lda + k1, lda);
 	}
+	return ok;
+}
 
-	Matrix_<T> A2 = A.clone();
-	Matrix_<T> b2 = b.clone();
-	return solve_(A2, b2);
+/**
+Solves A * X = B in place in `b` (n x nrhs) given the factorization of A computed by luFactor()
+*/
+template<class T>
+void luSolve(int n, const T* a, int lda, const int* piv, T* b, int nrhs, int ldb)
+{
+	for (int k = 0; k < n; k++)
+		if (piv[k] != k)
+			for (int j = 0; j < nrhs; j++)
+				swap(b[k * ldb + j], b[piv[k] * ldb + j]);
+	triSolve(n, a, lda, 1, true, true, b, nrhs, ldb);
+	triSolve(n, a, lda, 1, false, false, b, nrhs, ldb);
 }
 
+/**
+Factorizes the symmetric positive-definite n x n matrix in `a` in place as A = L * L^T, leaving L in the lower
+triangle. Returns false if the matrix is not positive-definite.
+*/
 template<class T>
-Matrix_<T> Matrix_<T>::inverse() const
+bool choleskyFactor(int n, T* a, int lda)
 {
-	return solve(*this, Matrix_<T>::identity(this->rows()));
+	const int NB = ASL_MATRIX_BLOCK;
+	for (int k0 = 0; k0 < n; k0 += NB)
+	{
+		int k1 = min(n, k0 + NB);
+		for (int j = k0; j < k1; j++)
+		{
+			T* aj = a + j * lda;
+			T d = aj[j];
+			for (int l = k0; l < j; l++)
+				d -= aj[l] * aj[l];
+			if (!(d > T(0)))
+				return false;
+			d = sqrt(d);
+			aj[j] = d;
+			for (int i = j + 1; i < n; i++)
+			{
+				T* ai = a + i * lda;
+				T s = ai[j];
+				for (int l = k0; l < j; l++)
+					s -= ai[l] * aj[l];
+				ai[j] = s / d;
+			}
+		}
+		for (int i0 = k1; i0 < n; i0 += NB) // only the lower triangle of A22 -= L21 * L21^T
+		{
+			int i1 = min(n, i0 + NB);
+			matMulAdd(i1 - i0, i1 - k1, k1 - k0, T(-1), a + i0 * lda + k0, lda, 1, a + k1 * lda + k0, 1, lda, a + i0 * lda + k1, lda);
+		}
+	}
+	return true;
 }
 
+/**
+Solves A * X = B in place in `b` (n x nrhs) given the factorization of A computed by choleskyFactor()
+*/
+template<class T>
+void choleskySolve(int n, const T* a, int lda, T* b, int nrhs, int ldb)
+{
+	triSolve(n, a, lda, 1, true, false, b, nrhs, ldb);
+	triSolve(n, a, 1, lda, false, false, b, nrhs, ldb);
+}
+
+// applies the reflection I - tau * v * v^T (with v[0] = 1) to the m x n matrix c; w is scratch space for n elements
 
 template<class T>
-Matrix_<T> solve_(Matrix_<T>& A_, Matrix_<T>& b_)
+void householder_(int m, int n, const T* v, int vs, T tau, T* c, int ldc, T* w)
 {
-	if (A_.rows() != A_.cols())
+	if (tau == T(0))
+		return;
+	for (int j = 0; j < n; j++)
+		w[j] = c[j];
+	for (int i = 1; i < m; i++)
+	{
+		T vi = v[i * vs];
+		const T* ci = c + i * ldc;
+		for (int j = 0; j < n; j++)
+			w[j] += vi * ci[j];
+	}
+	for (int j = 0; j < n; j++)
+		c[j] -= tau * w[j];
+	for (int i = 1; i < m; i++)
 	{
-		Matrix_<T> A2 = A_.transposed(A_), b2 = A_.transposed(b_);
-		return solve_(A2, b2);
+		T f = tau * v[i * vs];
+		T* ci = c + i * ldc;
+		for (int j = 0; j < n; j++)
+			ci[j] -= f * w[j];
 	}
-	Matrix_<T> x(b_.rows(), b_.cols());
-	int n = A_.rows();
-	Array<int> _(n);
-	Matrix_<T> A = b_.cols() == 1 ? A_ : A_.clone();
-	Matrix_<T> b = b_;
+}
 
-	for (int j = 0; j < b_.cols(); j++)
+/**
+Factorizes the m x n matrix in `a` (m >= n) in place as A = Q * R using Householder reflections. R is left in the
+upper triangle, and the reflection vectors below the diagonal, with their factors in `tau` (n elements).
+*/
+template<class T>
+void qrFactor(int m, int n, T* a, int lda, T* tau)
+{
+	Array<T> w(n);
+	for (int k = 0; k < n; k++)
 	{
-		if (j > 0)
-			A.copy(A_);
-		for (int i = 0; i < n; i++)
-			_[i] = i;
-		for (int k = 0; k < n - 1; k++)
+		T s = 0;
+		for (int i = k; i < m; i++)
+			s += a[i * lda + k] * a[i * lda + k];
+		T alpha = a[k * lda + k];
+		if (s == T(0))
 		{
-			T max = 0;
-			int ipivot = 0;
-			for (int i = k; i < n; i++)
-			{
-				if (max < fabs(A(_[i], k))) {
-					max = fabs(A(_[i], k));
-					ipivot = i;
-				}
-			}
-
-			swap(_[k], _[ipivot]);
-
-			for (int i = k + 1; i < n; i++)
-			{
-				int ii = _[i], kk =_[k];
-				T f = -A(ii, k) / A(kk, k);
-				for (int jj = k; jj < n; jj++)
-					A(ii, jj) += A(kk, jj) * f;
-				b(ii, j) += b(kk, j) * f;
-			}
+			tau[k] = 0;
+			continue;
 		}
+		T beta = alpha > T(0) ? -sqrt(s) : sqrt(s);
+		T f = T(1) / (alpha - beta);
+		for (int i = k + 1; i < m; i++)
+			a[i * lda + k] *= f;
+		tau[k] = (beta - alpha) / beta;
+		a[k * lda + k] = beta;
+		householder_(m - k, n - k - 1, a + k * lda + k, lda, tau[k], a + k * lda + k + 1, lda, w.data());
+	}
+}
+
+/**
+Computes the least-squares solution of A * X = B in place in the first n rows of `b` (m x nrhs) given the
+factorization of A computed by qrFactor()
+*/
+template<class T>
+void qrSolve(int m, int n, const T* a, int lda, const T* tau, T* b, int nrhs, int ldb)
+{
+	Array<T> w(nrhs);
+	for (int k = 0; k < n; k++)
+		householder_(m - k, nrhs, a + k * lda + k, lda, tau[k], b + k * ldb, ldb, w.data());
+	triSolve(n, a, lda, 1, false, false, b, nrhs, ldb);
+}
 
-		for (int k = n - 1; k >= 0; k--)
+/**
+ * Solves A*x=b like solve() but using A and b as working space (their contents are modified)
+ * \ingroup Math3D
+ */
+template<class T>
+Matrix_<T> solve_(Matrix_<T>& A, Matrix_<T>& b, SolveMethod method = SOLVE_AUTO)
+{
+	int m = A.rows(), n = A.cols(), nb = b.cols();
+	if (b.rows() != m || n == 0)
+		return Matrix_<T>();
+	if ((method == SOLVE_AUTO && m > n) || (method == SOLVE_QR && m >= n))
+	{
+		Array<T> tau(n);
+		qrFactor(m, n, A.array().data(), n, tau.data());
+		qrSolve(m, n, A.array().data(), n, tau.data(), b.array().data(), nb, nb);
+		return m == n ? b : b.slice(0, n, 0, nb);
+	}
+	if (m != n)
+	{
+		Matrix_<T> A2 = A.transposed(A), b2 = A.transposed(b);
+		return solve_(A2, b2, method == SOLVE_CHOLESKY ? SOLVE_CHOLESKY : SOLVE_LU);
+	}
+	if (method == SOLVE_CHOLESKY)
+	{
+		Matrix_<T> L = A.clone();
+		if (choleskyFactor(n, L.array().data(), n))
 		{
-			T sum = 0;
-			int kk = _[k];
-			for (int i = k + 1; i < n; i++)
-				sum += A(kk, i) * x(i, j);
-			x(k, j) = (b(kk, j) - sum) / A(kk, k);
+			choleskySolve(n, L.array().data(), n, b.array().data(), nb, nb);
+			return b;
 		}
 	}
-	return x;
+	Array<int> piv(n);
+	luFactor(n, A.array().data(), n, piv.data());
+	luSolve(n, A.array().data(), n, piv.data(), b.array().data(), nb, nb);
+	return b;
+}
+
+/**
+ * Solves the matrix equation A*x=b and returns x; if b is a matrix (not a column) then the equation is solved
+ * for each of b's columns and solutions returned as the columns of the returned matrix; if A is not square (more equations than unknowns),
+ * then a least-squares solution is computed. By default square systems are solved by LU decomposition and least-squares
+ * problems by QR decomposition; `method` can select Cholesky decomposition for symmetric positive-definite matrices
+ * (or fast least-squares with normal equations), which is about twice as fast as LU.
+ * \ingroup Math3D
+ */
+template<class T>
+Matrix_<T> solve(const Matrix_<T>& A, const Matrix_<T>& b, SolveMethod method = SOLVE_AUTO)
+{
+	Matrix_<T> A2 = A.clone();
+	Matrix_<T> b2 = b.clone();
+	return solve_(A2, b2, method);
+}
+
+template<class T>
+Matrix_<T> Matrix_<T>::inverse() const
+{
+	return solve(*this, Matrix_<T>::identity(this->rows()));
 }
 
 /**
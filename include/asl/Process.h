@@ -5,6 +5,7 @@
 #define ASL_PROCESS
 
 #include <asl/String.h>
+#include <asl/util.h>
 
 namespace asl {
 
@@ -30,7 +31,8 @@ while(true) {
 ~~~
 
 A **shorthand** function allows executing a program and, after it finishes, getting its full output,
-errors and exitcode.
+errors and exitcode (its input is closed, and its output is collected as it is produced, waiting for events on the
+pipes, not polling).
 
 ~~~
 Process p = Process::execute("ipconfig");
@@ -61,8 +63,14 @@ class ASL_API Process
 	PipeHandle _stdin, _stdout, _stderr;
 	String _output, _errors;
 	bool _detached;
+	ByteArray _obuf; // output read ahead by readOutputLine()
+	int _obeg, _oend;
 
 	static int exec(const String& command, const Array<String>& args = Array<String>());
+	int readPipe(PipeHandle h, void* p, int n);
+	int pipeAvailable(PipeHandle h);
+	void collectOutput();
+	friend class Processes;
 
 public:
 	Process();
@@ -91,7 +99,12 @@ public:
 	*/
 	void writeInput(const String& s) { writeInput(*s, s.length()); }
 	/**
-	Reads one text line from the process' *stdout* or a "\n" if the process ended
+	Closes the process' *stdin*, so that it gets an end of file when reading it
+	*/
+	void closeInput();
+	/**
+	Reads one text line from the process' *stdout* or a "\n" if the process ended (output is read in blocks, and
+	the rest kept for the following reads)
 	*/
 	String readOutputLine();
 	/**
@@ -226,5 +239,61 @@ public:
 
 };
 
+struct ProcessesState;
+
+/**
+Runs many subprocesses concurrently and collects their output from a single thread. Each process is executed as with
+Process::execute(), and when it ends a callback receives it, with its output, errors and exit status. Callbacks are
+called from `wait()`, in the thread calling it.
+
+~~~
+Processes procs;
+procs.setMaxRunning(8);
+foreach(String& file, files)
+	procs.execute("gzip", array<String>("-k", file), [](Process& p) {
+		if (!p.success())
+			printf("%s\n", *p.errors());
+	});
+procs.wait();
+~~~
+
+On Linux, waiting uses poll() on the processes' pipes and on pidfds for their exits.
+*/
+class ASL_API Processes
+{
+public:
+	typedef Function<void, Process&> Callback;
+
+	Processes();
+	~Processes();
+
+	/**
+	Sets the maximum number of processes running at the same time (others are started as those end)
+	*/
+	void setMaxRunning(int n);
+
+	/**
+	Adds a program to run, and a function to call with the Process when it ends
+	*/
+	void execute(const String& command, const Array<String>& args, const Callback& done);
+
+	/**
+	Runs the processes until all have ended (calling their callbacks), or for up to `timeout` seconds if not
+	negative; returns the number of processes not ended yet
+	*/
+	int wait(double timeout = -1);
+
+	/**
+	Returns the number of processes running or waiting to run
+	*/
+	int length() const;
+
+private:
+	ProcessesState* _s;
+	void start();
+	Processes(const Processes&);
+	void operator=(const Processes&);
+};
+
 }
 #endif
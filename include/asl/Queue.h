@@ -27,6 +27,9 @@ int x1, x2;
 if(queue.length() >= 2)
 	queue >> x1 >> x2;
 ~~~
+
+Removing items moves the remaining ones, and the queue is not thread-safe. To pass items between threads
+use BoundedQueue or ConcurrentQueue.
 */
 
 template <class T>
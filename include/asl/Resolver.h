@@ -0,0 +1,131 @@
+// Copyright(c) 1999-2024 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+#ifndef ASL_RESOLVER_H
+#define ASL_RESOLVER_H
+
+#include <asl/Socket.h>
+#include <asl/HashMap.h>
+#include <asl/Mutex.h>
+#include <asl/util.h>
+
+namespace asl {
+
+struct ResolverPending;
+struct ResolverJob;
+class ResolverWorker;
+
+/**
+Resolves host names to addresses, keeping recent results in a cache. Names found are kept for a time (the positive
+TTL) and names that could not be resolved are also remembered for a shorter time (the negative TTL), so that
+repeated connections to the same host do not wait for the system resolver each time. Concurrent lookups of the same
+name, from several threads or asynchronous requests, are coalesced into a single query.
+
+`InetAddress::lookup()` and `Socket::connect(host, port)` use the shared resolver:
+
+~~~
+Array<InetAddress> addrs = Resolver::shared().lookup("example.com");
+~~~
+
+Lookups can also be asynchronous, with the result given to a callback (called in a resolver thread, or immediately
+in the calling thread if the name was cached):
+
+~~~
+Resolver::shared().lookup("example.com", [](const Array<InetAddress>& addrs) {
+	printf("%i addresses\n", addrs.length());
+});
+~~~
+
+Literal addresses ("10.0.0.1", "::1") are translated directly, without using the cache. The actual name resolution
+can be replaced with a custom function (for example for testing) with `setBackend()`.
+\ingroup Sockets
+*/
+class ASL_API Resolver
+{
+public:
+	typedef Function<Array<InetAddress>, const String&> Backend;
+	typedef Function<void, const Array<InetAddress>&> Callback;
+
+	Resolver();
+	~Resolver();
+
+	/**
+	Returns the process-wide resolver used by InetAddress and Socket
+	*/
+	static Resolver& shared();
+
+	/**
+	Returns the addresses of a host (IPv4 ones first), from the cache or waiting for the lookup; the result is empty if
+	the name could not be resolved
+	*/
+	Array<InetAddress> lookup(const String& host);
+
+	/**
+	Resolves a host in the background and calls `callback` with the addresses found (empty on failure)
+	*/
+	void lookup(const String& host, const Callback& callback);
+
+	/**
+	Returns true if the host is in the cache and has not expired (as found or as not found)
+	*/
+	bool isCached(const String& host);
+
+	/**
+	Sets the time in seconds that found names (`positive`) and names not found (`negative`) are kept in the cache;
+	a 0 time disables caching of that kind of result
+	*/
+	void setTTL(double positive, double negative = 5);
+
+	/**
+	Sets the maximum number of names kept in the cache
+	*/
+	void setCacheSize(int n);
+
+	/**
+	Sets the maximum number of threads resolving asynchronous requests in parallel
+	*/
+	void setMaxThreads(int n);
+
+	/**
+	Replaces the function that actually resolves names (by default `InetAddress::resolve()`), and clears the cache
+	*/
+	void setBackend(const Backend& backend);
+
+	/**
+	Removes all names from the cache
+	*/
+	void clear();
+
+	/**
+	Returns the number of lookups that went to the backend (cache misses not coalesced with others)
+	*/
+	int queries() const { return _queries; }
+
+private:
+	struct Entry
+	{
+		Array<InetAddress> addrs;
+		double expires;
+	};
+	Array<InetAddress> query(const String& host);
+	Array<InetAddress> resolve(const String& host);
+	bool cached(const String& host, Array<InetAddress>& addrs);
+	bool nextJob(String& host);
+	friend class ResolverWorker;
+	Mutex _mutex;
+	Condition _done;
+	Condition _work;
+	HashMap<String, Entry> _cache;
+	HashMap<String, ResolverPending*> _pending;
+	Array<String> _jobs;
+	Array<ResolverWorker*> _workers;
+	Backend _backend;
+	double _ttl, _negativeTtl;
+	int _maxEntries, _maxThreads, _idle, _queries;
+	bool _stop;
+	Resolver(const Resolver&);
+	void operator=(const Resolver&);
+};
+
+}
+#endif
@@ -21,19 +21,125 @@ struct SocketOptionException : public Exception
 };
 
 class Socket;
+class File;
 
+/**
+A block of memory to be sent together with others in a single call to Socket::write(const SocketSpan*, int)
+\ingroup Sockets
+*/
+struct SocketSpan
+{
+	const void* data;
+	int length;
+};
+
+struct SocketPollerState;
+
+/**
+Waits for many sockets at once: sockets are registered once, with interest in input (`READ`) and/or in being able to
+write (`WRITE`), and `wait()` returns the ones that are ready without going through the whole set. On Linux it uses
+epoll, so waiting costs the same with 10 or 100000 idle sockets and there is no limit in their number or descriptor
+values; elsewhere it uses poll() (or select() on Windows).
+
+~~~
+SocketPoller poller;
+poller.add(server);
+...
+int n = poller.wait(1.0);
+for (int i = 0; i < n; i++)
+{
+	Socket& s = poller.ready(i);
+	if (s == server)
+		poller.add(server.accept());
+	else if (poller.events(i) & SocketPoller::READ)
+		...
+}
+~~~
+
+A socket with data already buffered (read from the network but not yet consumed) when added, or after being reported,
+is reported again in the next `wait()`; after reading from a socket outside the wait loop, add it again so that its
+buffered data is noticed. Sockets must be removed before closing them.
+
+With the `EDGE` flag a socket is only reported when it becomes ready again (e.g. when new data arrives), so it should
+be read until no data is left; this is only supported with epoll, elsewhere it has no effect.
+\ingroup Sockets
+*/
+class ASL_API SocketPoller
+{
+public:
+	/** Interest and readiness flags */
+	enum Events {
+		READ = 1,  //!< Data available, a connection to accept, or the connection closed
+		WRITE = 2, //!< Data can be written without blocking
+		EDGE = 4   //!< Report only changes to ready (edge-triggered)
+	};
+	SocketPoller();
+	~SocketPoller();
+	/**
+	Registers a socket for the given events, or changes them if it was already registered; returns false on error
+	*/
+	bool add(const Socket& s, int events = READ);
+	/**
+	Unregisters a socket
+	*/
+	bool remove(const Socket& s);
+	/**
+	Returns true if the socket is registered
+	*/
+	bool has(const Socket& s) const;
+	/**
+	Returns the number of registered sockets
+	*/
+	int length() const;
+	/**
+	Waits until some socket is ready or `timeout` seconds pass (forever if negative) and returns the number of ready
+	sockets, or -1 on error
+	*/
+	int wait(double timeout = 60);
+	/**
+	Returns the i-th ready socket after a `wait()`
+	*/
+	Socket& ready(int i);
+	/**
+	Returns the events (`READ`, `WRITE`) for which the i-th ready socket is ready
+	*/
+	int events(int i) const;
+	/**
+	Returns true if the socket was ready in the last `wait()`
+	*/
+	bool isReady(const Socket& s) const;
+private:
+	SocketPollerState* _s;
+	SocketPoller(const SocketPoller&);
+	void operator=(const SocketPoller&);
+};
+
+/**
+A set of sockets to wait for input on any of them (a SocketPoller for input with a simpler interface)
+\ingroup Sockets
+*/
 class ASL_API Sockets
 {
-	Array<Socket> set, changed;
+	Array<Socket> set;
+	Shared<SocketPoller> _poller;
 public:
-	Sockets() {}
+	Sockets() : _poller(new SocketPoller) {}
 	int length() const { return set.length(); }
 	Socket& operator[](int i) { return set[i]; }
 	const Socket& operator[](int i) const { return set[i]; }
 	Sockets& operator<<(Socket& s);
+	/**
+	Waits for input in any socket for up to `t` seconds, returns the number of sockets with input, or -1 on error
+	*/
 	int waitInput(double t=60);
+	/**
+	Returns true if the given socket had input in the last `waitInput()`
+	*/
 	bool hasInput(const Socket& s);
-	Socket& activeAt(int i) {return changed[i];}
+	/**
+	Returns the i-th socket with input after `waitInput()`
+	*/
+	Socket& activeAt(int i) { return _poller->ready(i); }
 	void close();
 };
 
@@ -86,9 +192,14 @@ public:
 	Type type() const { return _type; }
 	/**
 	Resolves a name and returns a list of addresses, possibly including IPv4 and IPv6, or translates a
-	literal (such as "10.0.0.1" or "::1")
+	literal (such as "10.0.0.1" or "::1"). Names are looked up through the shared Resolver, which caches them.
 	*/
 	static Array<InetAddress> lookup(const String& name);
+	/**
+	Resolves a name with the system resolver, without caching, or only translates literal addresses if `numeric`
+	is true (returning an empty list for other names)
+	*/
+	static Array<InetAddress> resolve(const String& name, bool numeric = false);
 protected:
 	ByteArray _data;
 	Type _type;
@@ -98,6 +209,7 @@ ASL_SMART_CLASS(Socket, SmartObject)
 {
 	ASL_SMART_INNER_DEF(Socket);
 	friend class Sockets;
+	friend class SocketPoller;
 	int _handle;
 	enum { TCP, PACKET, LOCAL } _type;
 	Endian _endian;
@@ -105,8 +217,12 @@ ASL_SMART_CLASS(Socket, SmartObject)
 	String _hostname;
 	int _error;
 	bool _blocking;
+	ByteArray _rbuf;
+	int _rbeg, _rend;
 	virtual bool setOption(int level, int opt, const void* p, int n);
 	bool init(bool force = false);
+	int buffered() const { return _rend - _rbeg; }
+	bool fill();
 	Socket_();
 	Socket_(int fd);
 	virtual ~Socket_();
@@ -123,11 +239,18 @@ ASL_SMART_CLASS(Socket, SmartObject)
 	InetAddress remoteAddress() const;
 	InetAddress localAddress() const;
 	virtual bool connect(const InetAddress& host);
+	virtual bool connect(const Array<InetAddress>& addrs);
 	virtual void close();
 	String readLine();
+	String readUntil(const String& delim, int maxLength);
+	ByteArray peek(int n);
 	virtual int available();
-	virtual int read(void* data, int size);
+	virtual int recv(void* data, int size);
+	int read(void* data, int size);
 	virtual int write(const void* data, int n);
+	virtual int write(const SocketSpan* spans, int n);
+	virtual Long sendFile(File& file, Long offset, Long n);
+	Long copyFile(File& file, Long offset, Long n);
 	ByteArray read(int n = -1);
 	void skip(int n);
 	virtual bool waitInput(double timeout = 60);
@@ -200,7 +323,9 @@ public:
 	*/
 	InetAddress localAddress() const { return _()->localAddress(); }
 	/**
-	Connects this socket to the given host name and port, trying all addresses assigned to that name until one succeeds
+	Connects this socket to the given host name and port, trying all addresses assigned to that name until one succeeds.
+	If built with ASL_IPV6 and the name has both IPv4 and IPv6 addresses, attempts alternate families and overlap
+	(a new one starts every 250 ms while others are pending) and the first to connect is kept ("happy eyeballs").
 	*/
 	bool connect(const String& host, int port);
 	/**
@@ -214,10 +339,20 @@ public:
 	*/
 	void close() { _()->close(); }
 	/**
-	Reads a line of text from the socket (keep in mind this is not buffered, can be a bit inefficient, and there is a length limit of 8000 bytes)
+	Reads a line of text from the socket up to a '\n', which is not included (the '\r' of CRLF line endings is kept),
+	with a length limit of 16000 bytes
 	*/
 	String readLine() { return _()->readLine(); }
 	/**
+	Reads text until the given delimiter is found and returns it without the delimiter, which is consumed (returns
+	an empty string and sets an error if the delimiter does not appear in `maxLength` bytes)
+	*/
+	String readUntil(const String& delim, int maxLength = 16000) { return _()->readUntil(delim, maxLength); }
+	/**
+	Returns the next `n` bytes of input (or less if the connection ends before) without consuming them
+	*/
+	ByteArray peek(int n) { return _()->peek(n); }
+	/**
 	Returns the number of bytes available for reading without blocking
 	*/
 	int available() { return _()->available(); }
@@ -234,6 +369,17 @@ public:
 	*/
 	int write(const ByteArray& data) { return _()->write(data.data(), data.length()); }
 	/**
+	Writes `n` memory blocks in order, with a single system call if possible (gather write), and returns the number
+	of bytes sent. This avoids copying a message and its header into one buffer or sending them in two packets.
+	*/
+	int write(const SocketSpan* spans, int n) { return _()->write(spans, n); }
+	/**
+	Sends `n` bytes of an open file starting at `offset` and returns the number of bytes sent. On Linux, plain
+	TCP and local sockets let the kernel copy the file to the socket (`sendfile`), without passing it through user
+	memory; other sockets (e.g. TLS) read and write it in blocks.
+	*/
+	Long sendFile(File& file, Long offset, Long n) { return _()->sendFile(file, offset, n); }
+	/**
 	Reads n bytes and returns them as an array of bytes, or reads all available bytes if no argument is given.
 	*/
 	ByteArray read(int n = -1) { return _()->read(n); }
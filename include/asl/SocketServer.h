@@ -10,6 +10,7 @@ namespace asl {
 	
 struct SockServerThread;
 struct SockClientThread;
+struct SockReactor;
 
 /**
 This is a reusable TCP socket server that listens to incoming connections and answers them concurrently (default) or sequentially.
@@ -59,17 +60,45 @@ void serve(Socket client)
 
 Add `&& !_requestStop` to the while condition to let the service be stoppable by SocketServer::stop().
 
+**Event-driven mode**
+
+Starting a thread per connection does not scale to many thousands of mostly idle clients. With `setEventDriven(true)`
+(Linux only) all connections are watched by a single epoll loop and a fixed pool of worker threads (one per core by
+default) handles them only when they have input ready. In this mode the server calls `serveInput()` instead of `serve()`:
+it should process one message (e.g. a request) and return `true` to keep the connection open for more.
+
+~~~
+class EchoServer : public SocketServer
+{
+public:
+	bool serveInput(Socket client)
+	{
+		String line = client.readLine();
+		client << line << "\n";
+		return true;
+	}
+};
+
+EchoServer server;
+server.bind(9000);
+server.setEventDriven(true);
+server.start();
+~~~
+
 \ingroup Sockets
 */
 
 class ASL_API SocketServer
 {
 	friend struct SockClientThread;
+	friend struct SockReactor;
 	SockServerThread* _thread;
 protected:
 	Sockets _sockets;
 	bool _requestStop;
 	bool _sequential;
+	bool _eventDriven;
+	int _numWorkers;
 	bool _running;
 	AtomicCount _numClients;
 	String _socketError;
@@ -104,6 +133,17 @@ public:
 	in a subclass to make a specific server.
 	*/
 	virtual void serve(Socket client) {}
+	/**
+	In event-driven mode this function is called in a worker thread when a client connection has input available.
+	It should handle that input and return `true` to keep the connection for further messages, or `false` to close it.
+	The default implementation calls `serve()` and closes the connection.
+	*/
+	virtual bool serveInput(Socket client) { serve(client); return false; }
+	/**
+	In event-driven mode this function is called when a client connection is removed, because `serveInput()` returned
+	false, the client disconnected or the server stopped.
+	*/
+	virtual void clientClosed(Socket client) {}
 
 	void startLoop();
 	/**
@@ -117,6 +157,12 @@ public:
 	*/
 	void setSequential(bool on) { _sequential = on; }
 	/**
+	Enables the event-driven mode, where connections are multiplexed with epoll and served by a fixed pool of
+	`nworkers` threads (by default the number of processors) through `serveInput()`; this must be called before `start()`.
+	On platforms without epoll the server stays in concurrent mode.
+	*/
+	void setEventDriven(bool on, int nworkers = 0) { _eventDriven = on; _numWorkers = nworkers; }
+	/**
 	Returns true if this server started and has not yet stopped or still has clients running
 	*/
 	bool running() const { return _running || _numClients != 0; }
@@ -11,6 +11,42 @@
 
 namespace asl {
 
+/**
+A column of a table loaded with TabularDataFile::loadColumns(). Values are stored in a typed array: `numbers` for
+numeric columns, `ints` for integer (or hexadecimal) columns, and for string columns each value is an index (`codes`)
+in the array of distinct strings found (`strings`).
+
+~~~{.cpp}
+Array<DataColumn> table = TabularDataFile("data.csv").loadColumns();
+const DataColumn& x = table[1];
+for (int i = 0; i < x.length(); i++)
+	sum += x.numbers[i];
+~~~
+*/
+struct ASL_API DataColumn
+{
+	enum Type { NUMBER, INT, STRING };
+	String name;
+	Type type;
+	Array<double> numbers;
+	Array<int> ints;
+	Array<int> codes;
+	Array<String> strings;
+
+	DataColumn() : type(NUMBER) {}
+	/**
+	Returns the number of rows
+	*/
+	int length() const { return type == NUMBER ? numbers.length() : type == INT ? ints.length() : codes.length(); }
+	/**
+	Returns the value at row `i`
+	*/
+	Var operator[](int i) const
+	{
+		return type == NUMBER ? Var(numbers[i]) : type == INT ? Var(ints[i]) : Var(strings[codes[i]]);
+	}
+};
+
 /**
 This class allows reading/writing CSV files and writing ARFF files.
 Files have an optional header with column names, and data rows that can contain
@@ -54,6 +90,8 @@ TabularDataFile file("data.csv");
 Array<Array<Var>> dataset = file.data();
 ~~~
 
+Large files are read much faster, and stored more compactly, as typed columns with `loadColumns()` (see DataColumn).
+
 If a file uses a specific format that autodetection can't handle, use `readAs()` to sepecify column types.
 That includes the ability to read numbers as hexadecimal. For example:
 
@@ -85,6 +123,7 @@ public:
 	Creates a data file with name `filename` for writing with the given column names
 	*/
 	TabularDataFile(const String& filename, const Array<String>& cols);
+	~TabularDataFile();
 
 	/**
 	Defines the columns for the data with a comma separated list of column names
@@ -138,20 +177,33 @@ public:
 		_quoteStrings = true;
 	}
 	/**
-	Forces a real disk write every `nrows` number of rows.
+	Writes the rows added to the file every `nrows` number of rows (by default rows are written in large blocks), and
+	if `sync` is true also waits for the data to be stored in the disk.
 	*/
-	void flushEvery(int nrows)
+	void flushEvery(int nrows, bool sync = false)
 	{
 		_flushEvery = nrows;
+		_sync = sync;
+	}
+	/**
+	Sets the size of the block of rows that is formatted in memory before writing it to the file (1 MB by default)
+	*/
+	void setBufferSize(int bytes)
+	{
+		_bufferSize = bytes;
 	}
 	/**
+	Writes the rows added so far to the file (this is done automatically when the file is destroyed)
+	*/
+	void flush();
+	/**
 	Sets the types to read for each column as a string with chars:
 	i:int, n:number, h:hex, s:string
 	*/
 	void readAs(const String& types);
 	/**
 	Appends one data item to the current row, and writes the row if it reaches the
-	number of columns defined.
+	number of columns defined. Numbers are written with the shortest form that reads back as the same value.
 	*/
 	TabularDataFile& operator<<(const Var& x);
 
@@ -160,6 +212,14 @@ public:
 	*/
 	Array<Array<Var> > data();
 	/**
+	Reads all rows of the file (or those not read yet) into typed columns. Column types are those given with
+	`readAs()` or, otherwise, numeric if the first rows only have numbers in that column, and string if not.
+	Missing or invalid numbers are read as NaN (or 0 in integer columns). The file is read in large blocks that are
+	parsed in the parallel thread pool (or only in the calling thread if `parallel` is false).
+	Rows cannot span several lines (as with `nextRow()`).
+	*/
+	Array<DataColumn> loadColumns(bool parallel = true);
+	/**
 	Reads the next row and returns true if it succeded
 	*/
 	bool nextRow();
@@ -180,6 +240,7 @@ public:
 protected:
 	bool readHeader();
 	void init();
+	void writeRow();
 
 	mutable TextFile _file;
 	Array<String> _columnNames;
@@ -190,9 +251,11 @@ protected:
 	String _types;
 	char _separator, _decimal, _quote;
 	String _equote;
+	String _buffer;
 	bool _quoteStrings;
 	bool _dataStarted;
-	int _flushEvery, _rowIndex, _numCols;
+	bool _sync;
+	int _flushEvery, _rowIndex, _numCols, _bufferSize;
 };
 
 }
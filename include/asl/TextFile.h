@@ -96,6 +96,10 @@ public:
 	TextFile& operator<<(const T& x) { write(String(x)); return *this; }
 	TextFile& operator<<(const String& x);
 	TextFile& operator<<(const char* x);
+	/** Writes a number directly, without intermediate strings (doubles in their shortest round-trip form) */
+	TextFile& operator<<(int x);
+	TextFile& operator<<(Long x);
+	TextFile& operator<<(double x);
 };
 
 }
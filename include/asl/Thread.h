@@ -58,6 +58,34 @@ template<class T>
 class ThreadGroup;
 class Thread;
 
+/**
+A range of loop iterations to be run by the thread pool behind Thread::parallel_for()
+*/
+struct ParallelTask
+{
+	virtual ~ParallelTask() {}
+	virtual void run(int i0, int i1) = 0;
+};
+
+/**
+Runs `task` over the range [i0, i1) in the process-wide thread pool, splitting it in chunks of at least `grain`
+iterations (0 = automatic) that idle workers steal from each other; the calling thread takes part and returns
+when all iterations are done. If `maxThreads` is positive, at most that many threads (counting the caller) run
+the task at the same time.
+*/
+ASL_API void parallelRun(ParallelTask& task, int i0, int i1, int grain = 0, int maxThreads = 0);
+
+/**
+Sets the number of worker threads of the pool (by default one less than the number of processors, at least 1);
+must be called before the pool is first used
+*/
+ASL_API void setParallelThreads(int n);
+
+/**
+Returns the number of worker threads of the pool
+*/
+ASL_API int parallelThreads();
+
 /**
 The Thread class represents an execution thread. To create threads, derive a class from Thread and reimplement
 the `run()` function. That is what objects of the new class will execute in parallel when the `start()` function is called.
@@ -107,6 +135,7 @@ class Thread
 #endif
 	Handle_ _thread;
 	volatile bool _threadFinished;
+	bool _autoDelete;
 private:
 	template<class F>
 	struct Context {
@@ -146,8 +175,12 @@ private:
 	static ASL_THREADFUNC_RET ASL_THREADFUNC_API begin(void* p)
 	{
 		Thread* t = (Thread*)p;
+		bool autoDelete = t->_autoDelete;
 		t->run();
-		t->_threadFinished = true;
+		if (autoDelete)
+			delete t;
+		else
+			t->_threadFinished = true;
 		return 0;
 	}
 #ifdef ASL_EXP_THREADING
@@ -159,28 +192,18 @@ private:
 		s.f();
 		s.t->_threadFinished = true;
 	}
-	template<class Func>
-	static void ASL_THREADFUNC_API beginfN(void* p)
-	{
-		if (!p) return;
-		Context<Func> s = *(Context<Func>*)p;
-		((Context<Func>*)p)->ready = true;
-		for (int i = s.i0; i < s.i1; i += s.s)
-		{
-			s.f(i);
-		}
-		s.t->_threadFinished = true;
-	}
 #endif
 public:
 	Thread()
 	{
 		_thread = 0;
 		_threadFinished = false;
+		_autoDelete = false;
 	}
 	Thread(const Thread& t) : _thread(t._thread)
 	{
 		_threadFinished = false;
+		_autoDelete = false;
 		const_cast<Thread&>(t)._thread = 0;
 	}
 	void operator=(const Thread& t)
@@ -207,6 +230,15 @@ public:
 	{
 		run(Thread::begin, this);
 	}
+	/**
+	Starts a new thread that deletes this object when run() ends (the object must have been created with `new`
+	and not be used after this call)
+	*/
+	void startDetached()
+	{
+		_autoDelete = true;
+		run(Thread::begin, this);
+	}
 	/** Cancels a thread, but you should not normally do this
 	\deprecated Threads should end when their function ends
 	*/
@@ -262,6 +294,7 @@ public:
 	{
 		_thread = 0;
 		_threadFinished = false;
+		_autoDelete = false;
 		*this = start(f, this);
 	}
 	template<class Func>
@@ -290,25 +323,54 @@ public:
 	}
 	~~~
 	
-	but with iterations run in `nth` parallel threads.
+	but with iterations run in parallel by the threads of a persistent pool. The range is split dynamically in
+	chunks (of at least `grain` iterations if given) that idle threads steal, so uneven iterations are balanced.
+	Loops can be nested. If `nth` is positive, at most `nth` threads (including the calling one) run iterations of
+	this loop at the same time, and if it is 1 the loop runs sequentially in the calling thread.
 	*/
 	template<class F>
-	static void parallel_for(int i0, int i1, const F& f, int nth = 8)
+	static void parallel_for(int i0, int i1, const F& f, int nth = 0, int grain = 0)
 	{
-		Array<Thread*> threads;
-		int n = min(nth, i1 - i0);
-		for (int i = 0; i<n; i++)
-		{
-			threads << new Thread;
-			Context<F> s = { f, threads.last(), false, i0 + i, i1, n };
-			threads.last()->run((Function_)Thread::beginfN<F>, (void*)&s);
-			while (!s.ready) {}
-		}
-		foreach(Thread* t, threads)
+		if (nth == 1 || i1 - i0 < 2)
 		{
-			t->join();
-			delete t;
+			for (int i = i0; i < i1; i++)
+				f(i);
+			return;
 		}
+		ForTask<F> task(f);
+		parallelRun(task, i0, i1, grain, nth);
+	}
+	/**
+	Computes a reduction over a range in parallel: the result is `reduce` applied to the values `f(i)` for all `i`
+	in [i0, i1), starting with `init`. Values are combined in chunks of `grain` iterations and then the chunk
+	results in order, so the result is deterministic for a given grain.
+
+	~~~
+	double sum = Thread::parallel_reduce(0, n, 0.0, [&](int i) { return x[i] * y[i]; },
+		[](double a, double b) { return a + b; });
+	~~~
+	*/
+	template<class T, class F, class R>
+	static T parallel_reduce(int i0, int i1, const T& init, const F& f, const R& reduce, int grain = 0)
+	{
+		int n = i1 - i0;
+		if (n <= 0)
+			return init;
+		if (grain <= 0)
+			grain = max(1, n / (8 * (parallelThreads() + 1)));
+		int nchunks = (n + grain - 1) / grain;
+		Array<T> partial(nchunks);
+		parallel_for(0, nchunks, [&](int c) {
+			int j0 = i0 + c * grain, j1 = min(j0 + grain, i1);
+			T x = f(j0);
+			for (int i = j0 + 1; i < j1; i++)
+				x = reduce(x, f(i));
+			partial[c] = x;
+		}, 0, 1);
+		T result = init;
+		for (int c = 0; c < nchunks; c++)
+			result = reduce(result, partial[c]);
+		return result;
 	}
 	/**
 	Runs the two functions/lambdas in parallel and returns when both are finished.
@@ -316,9 +378,9 @@ public:
 	template<class F1, class F2>
 	static void parallel_invoke(const F1& f1, const F2& f2)
 	{
-		Thread t2(f2);
-		f1();
-		t2.join();
+		parallel_for(0, 2, [&](int i) {
+			if (i == 0) f1(); else f2();
+		}, 0, 1);
 	}
 	/**
 	Runs the 3 functions/lambdas in parallel and returns when all are finished.
@@ -326,12 +388,9 @@ public:
 	template<class F1, class F2, class F3>
 	static void parallel_invoke(const F1& f1, const F2& f2, const F3& f3)
 	{
-		Array<Thread> threads;
-		Thread t2(f2), t3(f3);
-		f1();
-		threads << t2 << t3;
-		foreach(Thread& t, threads)
-			t.join();
+		parallel_for(0, 3, [&](int i) {
+			if (i == 0) f1(); else if (i == 1) f2(); else f3();
+		}, 0, 1);
 	}
 	/**
 	Runs the 4 functions/lambdas in parallel and returns when all are finished.
@@ -339,13 +398,23 @@ public:
 	template<class F1, class F2, class F3, class F4>
 	static void parallel_invoke(const F1& f1, const F2& f2, const F3& f3, const F4& f4)
 	{
-		Array<Thread> threads;
-		Thread t2(f2), t3(f3), t4(f4);
-		f1();
-		threads << t2 << t3 << t4;
-		foreach(Thread& t, threads)
-			t.join();
+		parallel_for(0, 4, [&](int i) {
+			if (i == 0) f1(); else if (i == 1) f2(); else if (i == 2) f3(); else f4();
+		}, 0, 1);
 	}
+private:
+	template<class F>
+	struct ForTask : public ParallelTask
+	{
+		const F& f;
+		ForTask(const F& f_) : f(f_) {}
+		void run(int i0, int i1)
+		{
+			for (int i = i0; i < i1; i++)
+				f(i);
+		}
+	};
+public:
 #endif
 };
 
@@ -25,10 +25,13 @@ ASL_SMART_CLASS(TlsSocket, Socket)
 	void listen(int n = 5);
 	Socket_* accept();
 	bool connect(const InetAddress& host);
+	bool connect(const Array<InetAddress>& addrs);
 	void close();
 	int available();
-	int read(void* data, int size);
+	int recv(void* data, int size);
 	int write(const void* data, int n);
+	int write(const SocketSpan* spans, int n);
+	Long sendFile(File& file, Long offset, Long n) { return copyFile(file, offset, n); } // data must be encrypted
 	bool waitInput(double timeout = 60);
 	String errorMsg() const;
 	bool useCert(const String& cert);
@@ -6,7 +6,7 @@
 
 #include <asl/String.h>
 #include <asl/Array.h>
-#include <asl/Map.h>
+#include <asl/IndexedDic.h>
 #include <asl/Pointer.h>
 #define VDic Dic
 #define ASL_VAR_STATIC
@@ -18,8 +18,8 @@ namespace asl {
 #define NEW_ARRAY(a) (a) = new Array<Var>
 #define NEW_ARRAYC(a, x) (a) = new Array<Var>(x)
 #define DEL_ARRAY(a) delete (a)
-#define NEW_DIC(d) (d) = new VDic<Var>
-#define NEW_DICC(d, x) (d) = new VDic<Var>(x)
+#define NEW_DIC(d) (d) = new IndexedDic<Var>
+#define NEW_DICC(d, x) (d) = new IndexedDic<Var>(x)
 #define DEL_DIC(d) delete (d)
 #define NEW_STRING(s) (s) = new asl::Array<char>()
 #define NEW_STRINGC(s, n) (s) = new asl::Array<char>(n)
@@ -267,7 +267,7 @@ class ASL_API Var
 	template<class T>
 	Var(const VDic<T>& v);
 	Var(const Array<Var>& v) {_type=ARRAY; NEW_ARRAYC(_a, v);}
-	Var(const VDic<Var>& v) {_type=DIC; NEW_DICC(_o, v);}
+	Var(const VDic<Var>& v);
 	Var(double x);
 	Var(int x): _type(INT), _i(x){}
 	Var(float x): _type(FLOAT) {_d=x;}
@@ -305,9 +305,9 @@ class ASL_API Var
 	operator VDic<T>() const;
 
 	/**
-	Returns the internal Dic if this var is an object
+	Returns the internal dictionary if this var is an object (it shares the properties, changes affect the Var)
 	*/
-	Dic<Var> object() const { return _type == OBJ ? *_o : Dic<Var>(); }
+	IndexedDic<Var> object() const { return _type == OBJ ? *_o : IndexedDic<Var>(); }
 
 	/**
 	Returns the internal Array if this var is an array
@@ -398,9 +398,9 @@ class ASL_API Var
 	/**
 	Gets a pointer to the property named `key` if it exists or a null pointer otherwise
 	*/
-	Var* getp(const String& key) { return has(key) ? &(*this)[key] : NULL; }
+	Var* getp(const String& key) { return _type == OBJ ? _o->find(key) : NULL; }
 
-	const Var* getp(const String& key) const { return has(key) ? &(*this)[key] : NULL; }
+	const Var* getp(const String& key) const { return _type == OBJ ? _o->find(key) : NULL; }
 
 	/** Sets the value of property `key` of this var to `v` (Useful for Var construction) */
 	template <class T>
@@ -578,16 +578,16 @@ class ASL_API Var
 	{
 		Var& v;
 #ifndef ASL_VAR_STATIC
-		VDic<Var>::Enumerator* e;
+		IndexedDic<Var>::Enumerator* e;
 #else
-		StaticSpace< VDic<Var>::Enumerator > e;
+		StaticSpace< IndexedDic<Var>::Enumerator > e;
 #endif
 		int i;
 		Enumerator(const Var& x) : v(*(Var*)&x), i(0)
 		{
 			if(x._type==DIC)
 #ifndef ASL_VAR_STATIC
-				e=new VDic<Var>::Enumerator(*x._o);
+				e=new IndexedDic<Var>::Enumerator(*x._o);
 #else
 				e.construct(*x._o);
 #endif
@@ -622,11 +622,11 @@ class ASL_API Var
 		Long _l;
 #ifndef ASL_VAR_STATIC
 		Array<Var>* _a;
-		VDic<Var>* _o;
+		IndexedDic<Var>* _o;
 		Array<char>* _s;
 #else
 		StaticSpace< Array<Var> > _a;
-		StaticSpace< VDic<Var> > _o;
+		StaticSpace< IndexedDic<Var> > _o;
 		StaticSpace< Array<char> > _s;
 #endif
 		char _ss[VAR_SSPACE];
@@ -675,6 +675,7 @@ Var::Var(const VDic<T>& x)
 {
 	_type=DIC;
 	NEW_DIC(_o);
+	_o->reserve(x.length());
 	foreach2(String& k, T& v, x)
 		_o->set(k, v);
 }
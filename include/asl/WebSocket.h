@@ -8,10 +8,50 @@
 #include <asl/String.h>
 #include <asl/SocketServer.h>
 #include <asl/Mutex.h>
+#include <asl/HashMap.h>
+#include <asl/Pointer.h>
+#include <asl/Deflate.h>
 
 namespace asl {
 
 class Var;
+struct WsConnection;
+struct WsHub;
+
+/**
+Options of WebSocket compression (the permessage-deflate extension, RFC 7692), used by WebSocket::setCompression()
+and WebSocketServer::setCompression(). The client offers them and the server answers with the ones both accept.
+*/
+struct WebSocketCompression
+{
+	bool enabled;                 //!< Use compression if the peer supports it
+	int level;                    //!< Compression level (1 fastest to 9 smallest)
+	int threshold;                //!< Messages shorter than this are sent uncompressed
+	int serverMaxWindowBits;      //!< Log2 of the window the server compresses with (9-15)
+	int clientMaxWindowBits;      //!< Log2 of the window the client compresses with (9-15)
+	bool serverNoContextTakeover; //!< The server compresses each message independently (less memory, less compression)
+	bool clientNoContextTakeover; //!< The client compresses each message independently
+	int maxMessageSize;           //!< Largest decompressed message accepted (larger ones close with code 1009)
+	WebSocketCompression() : enabled(true), level(6), threshold(64), serverMaxWindowBits(15), clientMaxWindowBits(15),
+		serverNoContextTakeover(false), clientNoContextTakeover(false), maxMessageSize(64 * 1024 * 1024) {}
+};
+
+/*
+Compression state of a connection with a negotiated permessage-deflate extension
+*/
+struct WebSocketDeflate
+{
+	Deflater deflater;
+	Inflater inflater;
+	int threshold;
+	int windowBits;
+	bool noContextTakeover; // reset the deflater after each message
+	int maxSize;            // largest message inflated
+	ByteArray buffer;
+	WebSocketDeflate(int level, int windowBits_, bool noContext, int threshold_, int maxSize_) :
+		deflater(Deflater::RAW, level, windowBits_), inflater(Deflater::RAW, 15), threshold(threshold_),
+		windowBits(windowBits_), noContextTakeover(noContext), maxSize(maxSize_) {}
+};
 
 struct WebSocketMsg
 {
@@ -44,15 +84,35 @@ String msg = ws.receive();
 ws.close();
 ~~~
 
+Messages can be compressed (permessage-deflate) if both ends enable it, if the library was built with zlib:
+
+~~~
+ws.setCompression(WebSocketCompression());
+ws.connect("ws://some-websocketserver:9000");
+~~~
+
 To connect to a TLS secure server, use the "wss:" protocol:
 
 ~~~
 ws.connect("wss://some-encrypted-websocketserver:443");
 ~~~
+
+Each frame is sent with its header in a single write. Many small messages can be sent together by enabling batching,
+which queues them until `flush()` (or until enough data accumulates):
+
+~~~
+ws.setBatching(true);
+for (auto& update : updates)
+	ws.send(update);
+ws.flush();
+~~~
 */
 
 class ASL_API WebSocket
 {
+	friend class WebSocketServer;
+	friend struct WsConnection;
+	friend struct WsHub;
 public:
 	enum FrameType { FRAME_CONT, FRAME_TEXT, FRAME_BINARY, FRAME_CLOSE=8, FRAME_PING, FRAME_PONG };
 	/**
@@ -75,6 +135,11 @@ public:
 
 	void send(const byte* p, int len, FrameType = FRAME_TEXT);
 
+	/**
+	Sends a message from a buffer that can be modified: client sockets mask the data in place instead of copying it
+	*/
+	void sendInPlace(byte* p, int len, FrameType type = FRAME_BINARY);
+
 	/**
 	Sends a binary message to the peer
 	*/
@@ -90,6 +155,17 @@ public:
 	*/
 	void send(const Var& v);
 	/**
+	Enables or disables batching: while enabled, sent messages are queued and written together by `flush()`, or
+	when the queue exceeds 64 KB (`receive()` and `wait()` also flush it); disabling it flushes the queue.
+	While batching, sending and receiving must be done from the same thread.
+	*/
+	void setBatching(bool on);
+
+	/**
+	Writes the messages queued while batching, returns false if the connection failed
+	*/
+	bool flush();
+	/**
 	Waits for incoming data for a maximum time or a disconnection, returns true if something
 	happened before timeout
 	*/
@@ -107,17 +183,43 @@ public:
 	/** Returns the close status code if the socket was closed */
 	int code() const { return _code; }
 
+	/**
+	Sets the compression options to offer when connecting (call before `connect()`)
+	*/
+	void setCompression(const WebSocketCompression& options) { _compression = options; }
+
+	/**
+	Returns true if messages are being compressed (permessage-deflate was negotiated)
+	*/
+	bool compressed() const { return _z; }
+
+	/**
+	Returns the number of bytes sent in frames (headers included)
+	*/
+	Long sentBytes() const { return _sentBytes; }
+
 	/**
 	Tests if this WebSocket is closed, possibly by the other end
 	*/
 	bool closed();
 protected:
+	void sendFrame(const byte* p, int len, int opcode, bool inPlace);
+	void sendMessage(const byte* p, int len, FrameType type, bool inPlace);
+	int output(const SocketSpan* spans, int n);
 	Socket _socket;
-	ByteArray _buffer;
+	ByteArray _buffer;  // scratch for masking outgoing data
+	ByteArray _control; // control frames received
+	Mutex _sendLock;
+	ByteArray _out;    // queued frames while batching
 	bool _isClient;
 	bool _closed;
+	bool _batching;
 	int _code;
+	Long _sentBytes;
 	Random _random;
+	WebSocketCompression _compression;
+	Shared<WebSocketDeflate> _z;
+	WsConnection* _conn; // send queue of a connection in an event-driven server
 };
 
 /**
@@ -154,31 +256,143 @@ function in the HTTP server and only start that one.
 httpserver.link(wsserver);
 httpserver.start();
 ~~~
+
+Instead of (or in addition to) `serve()`, a server can implement `onOpen()`, `onMessage()` and `onClose()`, and push
+messages to all clients with `broadcast()`, or to those subscribed to a topic with `publish()`:
+
+~~~
+class ChatServer : public WebSocketServer
+{
+public:
+	void onMessage(WebSocket& ws, const WebSocketMsg& msg)
+	{
+		Var m = msg;
+		if (m["join"].ok())
+			subscribe(ws, m["join"]);
+		else
+			publish(m["room"], m["text"].toString());
+	}
+};
+~~~
+
+**Hub mode**
+
+With `setEventDriven(true)` (Linux only) the server does not use a thread per connection: all connections are
+watched by one epoll loop and a pool of workers calls `onMessage()` when a message arrives. Sends never block in this
+mode: what the socket does not take at once is kept in a per-connection queue written when the socket is ready, and a
+client whose queue exceeds `setSendQueueLimit()` is disconnected as a slow consumer. Broadcast messages are encoded
+(and compressed) once and the same frame is written to all clients.
+
+~~~
+ChatServer server;
+server.bind(9000);
+server.setEventDriven(true);
+server.start();
+~~~
 */
 
 class ASL_API WebSocketServer: public SocketServer
 {
 	friend class HttpServer;
+	friend struct WsClientThread;
+	friend struct WsConnection;
+	friend struct WsHub;
 public:
 	WebSocketServer();
 	WebSocketServer(int port);
+	~WebSocketServer();
 	/**
 	Serves the incoming client websocket, implement this function in a subclass to define
-	the behavior of this server.
+	the behavior of this server. The default implementation receives messages and passes them to `onMessage()`.
 	*/
 	virtual void serve(WebSocket& s);
 	/**
+	Called when a client connects (before `serve()`)
+	*/
+	virtual void onOpen(WebSocket& ws) {}
+	/**
+	Called when a message from a client arrives (by the default `serve()`, or in hub mode)
+	*/
+	virtual void onMessage(WebSocket& ws, const WebSocketMsg& msg) {}
+	/**
+	Called when a client connection ends
+	*/
+	virtual void onClose(WebSocket& ws) {}
+	/**
+	Sends a text message to all clients
+	*/
+	void broadcast(const String& msg) { send((const byte*)*msg, msg.length(), WebSocket::FRAME_TEXT, NULL); }
+	/**
+	Sends a binary message to all clients
+	*/
+	void broadcast(const ByteArray& msg) { send(msg.data(), msg.length(), WebSocket::FRAME_BINARY, NULL); }
+	void broadcast(const char* msg) { broadcast(String(msg)); }
+	/**
+	Sends a Var as JSON to all clients
+	*/
+	void broadcast(const Var& msg);
+	/**
+	Sends a text message to the clients subscribed to a topic
+	*/
+	void publish(const String& topic, const String& msg)
+	{
+		send((const byte*)*msg, msg.length(), WebSocket::FRAME_TEXT, &topic);
+	}
+	/**
+	Sends a binary message to the clients subscribed to a topic
+	*/
+	void publish(const String& topic, const ByteArray& msg)
+	{
+		send(msg.data(), msg.length(), WebSocket::FRAME_BINARY, &topic);
+	}
+	/**
+	Sends a Var as JSON to the clients subscribed to a topic
+	*/
+	void publish(const String& topic, const Var& msg);
+	void publish(const String& topic, const char* msg) { publish(topic, String(msg)); }
+	/**
+	Subscribes a client to a topic
+	*/
+	void subscribe(WebSocket& ws, const String& topic);
+	/**
+	Unsubscribes a client from a topic
+	*/
+	void unsubscribe(WebSocket& ws, const String& topic);
+	/**
+	Sets the maximum bytes waiting to be sent to a client in hub mode; a client with more pending is disconnected
+	(default 4 MB)
+	*/
+	void setSendQueueLimit(int bytes) { _queueLimit = bytes; }
+	/**
+	Returns the number of clients disconnected because their send queue was full
+	*/
+	int slowClients() const { return _slowClients; }
+	bool serveInput(Socket client);
+	void clientClosed(Socket client);
+	/**
 	Returns an array of currently connected client websockets
 	*/
 	const Array<WebSocket*>& clients() const { return _clients; }
 	Mutex& mutex() { return _mutex; }
+	/**
+	Enables compression (permessage-deflate) of connections with clients that support it, with the given options
+	*/
+	void setCompression(const WebSocketCompression& options) { _compression = options; }
 protected:
 	ByteArray readMessage();
 private:
 	void process(Socket& socket, const Dic<String>& headers);
+	bool handshake(Socket& socket, const Dic<String>& headers, WebSocket& ws);
+	void remove(WebSocket& ws);
+	void send(const byte* p, int n, WebSocket::FrameType type, const String* topic);
 	void serve(Socket client);
 	Array<WebSocket*> _clients;
+	HashMap<String, Array<WebSocket*> > _topics;
 	Mutex _mutex;
+	WebSocketCompression _compression;
+	WsHub* _hub;
+	int _queueLimit;
+	AtomicCount _slowClients;
 };
 }
 #endif
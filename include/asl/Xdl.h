@@ -9,6 +9,7 @@
 #include <asl/String.h>
 #include <asl/Var.h>
 #include <asl/JSON.h>
+#include <asl/File.h>
 
 namespace asl {
 
@@ -17,6 +18,28 @@ namespace asl {
  * @{
  */
 
+/**
+An incremental XDL/JSON parser. Text can be given in pieces with `parse()` and, by default, a Var tree is built
+with the result, available with `value()`.
+
+The parser can also be used as a SAX-style event parser by subclassing it and overriding the callback functions
+(`begin_object()`, `new_property()`, `new_number()`, ...). If all of them are overridden no tree is built, so files of
+any size can be processed with `parseFile()` using memory proportional to the nesting depth.
+
+~~~
+struct CountNumbers : public XdlParser
+{
+	int count;
+	CountNumbers() : count(0) {}
+	void new_number(int x) { count++; }
+	void new_number(double x) { count++; }
+	...
+};
+
+CountNumbers counter;
+counter.parseFile("huge.json");
+~~~
+*/
 class ASL_API XdlParser
 {
 	typedef char State;
@@ -28,14 +51,25 @@ class ASL_API XdlParser
 	String _buffer;
 	bool _inComment;
 	int _unicodeCount;
-	char _ldp;
 	char _unicode[4];
 	wchar_t _wchar;
 	void put(const Var& x);
+	const char* parseNumber(const char* p, const char* end);
 public:
 	XdlParser();
-	~XdlParser();
+	virtual ~XdlParser();
+	/**
+	Parses the next piece of text (pieces can split values at any point)
+	*/
 	void parse(const char* s);
+	/**
+	Parses a whole file, reading it in fixed-size chunks; returns false if it could not be read or had errors
+	*/
+	bool parseFile(const String& file);
+	/**
+	Returns true if a syntax error was found
+	*/
+	bool error() const;
 	void value_end();
 	virtual void reset();
 	Var value() const;
@@ -46,6 +80,7 @@ public:
 	virtual void new_string(const char* x) { put(x); }
 	virtual void new_string(const String& x) { put(x); }
 	virtual void new_bool(bool b) { put(b); }
+	virtual void new_null() { put(Var::NUL); }
 	virtual void begin_array();
 	virtual void end_array();
 	virtual void begin_object(const char* _class);
@@ -53,6 +88,113 @@ public:
 	virtual void new_property(const String& name);
 };
 
+struct XdlEventParser;
+
+/**
+A pull parser for XDL or JSON files of any size. It reads the input in chunks and returns a sequence of events
+(start and end of objects and arrays, property names and simple values) without building the whole document. Sub-trees
+of interest can be read as a Var with `readValue()` or passed over with `skip()`. Memory use depends on the chunk size
+and nesting depth, not on the file size.
+
+~~~
+XdlReader reader("telemetry.json");
+while (reader.next())
+{
+	if (reader.event() == XdlReader::PROPERTY && reader.name() == "samples")
+	{
+		reader.next();                    // BEGIN_ARRAY
+		while (reader.next() && reader.event() != XdlReader::END_ARRAY)
+		{
+			Var sample = reader.readValue(); // one item at a time
+			...
+		}
+	}
+}
+if (reader.error())
+	...
+~~~
+*/
+class ASL_API XdlReader
+{
+public:
+	/**
+	Parsing events
+	*/
+	enum Event {
+		NONE,
+		BEGIN_OBJECT,  //!< Start of an object (name() is its class for XDL objects)
+		END_OBJECT,    //!< End of an object
+		BEGIN_ARRAY,   //!< Start of an array
+		END_ARRAY,     //!< End of an array
+		PROPERTY,      //!< A property name in an object (name() is the name)
+		VALUE,         //!< A number, string, boolean or null (value() is the value)
+		END            //!< End of the input (or an error)
+	};
+	XdlReader();
+	/**
+	Creates a reader for the given file
+	*/
+	ASL_EXPLICIT XdlReader(const String& file);
+	~XdlReader();
+	/**
+	Opens a file for reading
+	*/
+	bool open(const String& file);
+	/**
+	Sets a string as input instead of a file
+	*/
+	void setText(const String& text);
+	/**
+	Advances to the next event, returns false at the end of the input or on errors
+	*/
+	bool next();
+	/**
+	Returns the current event
+	*/
+	Event event() const { return _event; }
+	/**
+	Returns the property name of a PROPERTY event
+	*/
+	const String& name() const { return _name; }
+	/**
+	Returns the value of a VALUE event
+	*/
+	const Var& value() const { return _value; }
+	/**
+	Returns the current nesting level (1 after the BEGIN_x event of the root value)
+	*/
+	int depth() const { return _depth; }
+	/**
+	Reads the value starting at the current event (or following the current property name) as a Var; after this, the
+	current event is the last one of that value
+	*/
+	Var readValue();
+	/**
+	Skips the value starting at the current event (or following the current property name) without building it
+	*/
+	void skip();
+	/**
+	Returns true if the input had syntax errors or was truncated
+	*/
+	bool error() const;
+private:
+	XdlReader(const XdlReader&);
+	void operator=(const XdlReader&);
+	void feed();
+	void restart();
+	XdlEventParser* _parser;
+	File _file;
+	String _text;
+	int _textPos;
+	Array<char> _chunk;
+	Event _event;
+	String _name;
+	Var _value;
+	int _depth;
+	bool _eof;
+	bool _truncated;
+};
+
 struct XdlSink;
 
 class ASL_API XdlEncoder
@@ -108,7 +250,7 @@ struct ASL_API Xdl
 	/**
 	Reads and decodes data from a file in XDL format
 	*/
-	static Var read(const String& file);
+	static Var read(const String& file, int mode = 0);
 
 	/**
 	Writes a var to a file in XDL format
@@ -122,9 +264,9 @@ struct ASL_API Xdl
 
 	/**
 	Decodes the XDL-encoded string into a Var that will contain all the structure. If there are format parsing errors,
-	the result will be a `Var::NONE` typed variable.
+	the result will be a `Var::NONE` typed variable. With mode `Json::ARENA` the tree is allocated in an Arena.
 	*/
-	static Var decode(const String& xdl);
+	static Var decode(const String& xdl, int mode = 0);
 
 	/**
 	Encodes the given Var into an XDL-format representation.
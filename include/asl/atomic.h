@@ -11,6 +11,8 @@
 
 inline int atomicInc(volatile int* x) { return ++*x; }
 inline int atomicDec(volatile int* x) { return --*x; }
+inline int atomicAdd(volatile int* x, int n) { return *x += n; }
+inline bool atomicCas(volatile int* x, int a, int b) { if (*x != a) return false; *x = b; return true; }
 
 #elif defined _WIN32
 
@@ -18,11 +20,15 @@ inline int atomicDec(volatile int* x) { return --*x; }
 
 inline int atomicInc(volatile int* x) { return InterlockedIncrement((long*)(x)); }
 inline int atomicDec(volatile int* x) { return InterlockedDecrement((long*)(x)); }
+inline int atomicAdd(volatile int* x, int n) { return InterlockedExchangeAdd((long*)(x), n) + n; }
+inline bool atomicCas(volatile int* x, int a, int b) { return InterlockedCompareExchange((long*)(x), b, a) == a; }
 
 #elif __has_builtin(__sync_add_and_fetch) || (defined(__GNUC__) && ASL_C_VER >= 40102)
 
 inline int atomicInc(int volatile* x) { return __sync_add_and_fetch(x, 1); }
 inline int atomicDec(int volatile* x) { return __sync_sub_and_fetch(x, 1); }
+inline int atomicAdd(int volatile* x, int n) { return __sync_add_and_fetch(x, n); }
+inline bool atomicCas(int volatile* x, int a, int b) { return __sync_bool_compare_and_swap(x, a, b); }
 
 // gcc >= 4.7 ?
 //inline int atomicInc(int volatile* x) { return __atomic_add_fetch(x, 1, __ATOMIC_RELAXED); }
@@ -47,9 +53,19 @@ public:
 #ifdef ASL_NO_ATOMIC_OPS
 	int operator++() { Lock l(mutex); return ++n; }
 	int operator--() { Lock l(mutex); return --n; }
+	int operator+=(int m) { Lock l(mutex); return n += m; }
+	bool cas(int a, int b) { Lock l(mutex); if (n != a) return false; n = b; return true; }
 #else
 	int operator++() { return atomicInc(&n); }
 	int operator--() { return atomicDec(&n); }
+	/**
+	Adds m and returns the new value
+	*/
+	int operator+=(int m) { return atomicAdd(&n, m); }
+	/**
+	Sets the value to b only if it currently is a (compare and swap), returning true if it was set
+	*/
+	bool cas(int a, int b) { return atomicCas(&n, a, b); }
 #endif
 	operator int() const { return n; }
 	bool operator==(int m) const { return n == m; }
@@ -349,10 +349,31 @@ ASL_API Long myatol(const char* s);
 
 ASL_API int myltoa(Long x, char* s);
 
+/**
+Parses a decimal number, correctly rounded and independently of the locale
+*/
 ASL_API double myatof(const char* s);
 
+/**
+Parses a decimal number at the start of `s` with `dec` as decimal separator, correctly rounded, into `x`, and returns
+a pointer past the number (or `s` if there is no number)
+*/
+ASL_API const char* myatof(const char* s, double& x, char dec = '.');
+
 ASL_API int myitoa(int x, char* s);
 
+/**
+Writes the shortest decimal representation of `x` that reads back as the same value (or "nan", "inf", "-inf") in
+buffer `s`, which must have room for 32 chars, and returns its length. The format is like printf's `%.15g`.
+*/
+ASL_API int mydtoa(double x, char* s);
+
+/**
+Writes the shortest decimal representation of float `x` that reads back as the same value, like `mydtoa()`, in the
+format of printf's `%.7g`
+*/
+ASL_API int myftoa(float x, char* s);
+
 inline bool myisspace(char c)
 {
 	return c <= ' ' && (c == ' ' || c == '\n' || c == '\r' || c == '\t');
@@ -0,0 +1,159 @@
+// Copyright(c) 1999-2024 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+#ifndef ASL_HASH_H
+#define ASL_HASH_H
+
+#include <asl/defs.h>
+#include <string.h>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+namespace asl {
+
+/**
+\defgroup Hashing Hashing
+Fast non-cryptographic hash functions used by hash containers (HashMap, HashDic, FlatHashMap, Set).
+
+Strings and byte blocks are hashed with an algorithm of the wyhash family, which consumes 16 or 48 bytes per step
+using 64x64->128 bit multiplications. Integers and pointers are mixed with one multiplication so that sequential
+or aligned values spread over all buckets.
+
+All functions depend on a process-wide seed, which is 0 by default so that hashes (and the iteration order of hash
+containers) are the same on every run. Programs storing keys that come from untrusted sources (e.g. HTTP requests)
+can randomize it at startup, before any hash container is filled, to make collision attacks impractical:
+
+~~~
+int main()
+{
+	randomizeHashSeed();
+	...
+}
+~~~
+@{
+*/
+
+extern ASL_API ULong _hashSeed;
+
+/**
+Returns the current hash seed
+*/
+inline ULong hashSeed() { return _hashSeed; }
+
+/**
+Sets the seed for all hash functions; must be called before any hash container is used
+*/
+ASL_API void setHashSeed(ULong seed);
+
+/**
+Sets a random seed for all hash functions; must be called before any hash container is used
+*/
+ASL_API void randomizeHashSeed();
+
+/**
+Multiplies two 64-bit numbers and returns the xor of the high and low halves of the 128-bit product
+*/
+inline ULong hashMix(ULong a, ULong b)
+{
+#if defined(__SIZEOF_INT128__)
+	unsigned __int128 r = (unsigned __int128)a * b;
+	return ULong(r) ^ ULong(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	ULong hi, lo = _umul128(a, b, &hi);
+	return lo ^ hi;
+#else
+	ULong ha = a >> 32, hb = b >> 32, la = (unsigned)a, lb = (unsigned)b;
+	ULong rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32), c = t < rl;
+	ULong lo = t + (rm1 << 32);
+	c += lo < t;
+	ULong hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+	return lo ^ hi;
+#endif
+}
+
+namespace hash_ {
+
+static const ULong K0 = 0x2d358dccaa6c78a5ull, K1 = 0x8bb84b93962eacc9ull, K2 = 0x4b33a62ed433d4a3ull,
+	K3 = 0x4d5a2da51de1aa47ull;
+
+inline ULong read8(const byte* p) { ULong x; memcpy(&x, p, 8); return x; }
+inline ULong read4(const byte* p) { unsigned x; memcpy(&x, p, 4); return x; }
+inline ULong read3(const byte* p, int n) { return (ULong(p[0]) << 16) | (ULong(p[n >> 1]) << 8) | p[n - 1]; }
+
+}
+
+/**
+Computes a 64-bit hash of `n` bytes at `data`
+*/
+inline ULong hashBytes(const void* data, int n, ULong seed)
+{
+	using namespace hash_;
+	const byte* p = (const byte*)data;
+	ULong a, b;
+	seed ^= hashMix(seed ^ K0, K1);
+	if (n <= 16)
+	{
+		if (n >= 4)
+		{
+			int d = (n >> 3) << 2;
+			a = (read4(p) << 32) | read4(p + d);
+			b = (read4(p + n - 4) << 32) | read4(p + n - 4 - d);
+		}
+		else if (n > 0)
+		{
+			a = read3(p, n);
+			b = 0;
+		}
+		else
+			a = b = 0;
+	}
+	else
+	{
+		int i = n;
+		if (i > 48)
+		{
+			ULong s1 = seed, s2 = seed;
+			do
+			{
+				seed = hashMix(read8(p) ^ K1, read8(p + 8) ^ seed);
+				s1 = hashMix(read8(p + 16) ^ K2, read8(p + 24) ^ s1);
+				s2 = hashMix(read8(p + 32) ^ K3, read8(p + 40) ^ s2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= s1 ^ s2;
+		}
+		while (i > 16)
+		{
+			seed = hashMix(read8(p) ^ K1, read8(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+		a = read8(p + i - 16);
+		b = read8(p + i - 8);
+	}
+	return hashMix(hashMix(a ^ K1, b ^ seed) ^ K0 ^ ULong(n), K1);
+}
+
+/**
+Computes a 64-bit hash of `n` bytes at `data` with the process-wide seed
+*/
+inline ULong hashBytes(const void* data, int n)
+{
+	return hashBytes(data, n, _hashSeed);
+}
+
+/**
+Mixes the bits of an integer so that all of them affect the low bits of the result
+*/
+inline unsigned hashInt(ULong x)
+{
+	return (unsigned)hashMix(x ^ _hashSeed, hash_::K1);
+}
+
+/**@}*/
+
+}
+#endif
@@ -0,0 +1,143 @@
+#include <asl/Arena.h>
+#include <asl/Mutex.h>
+
+#ifdef _MSC_VER
+#define ASL_THREAD_LOCAL __declspec(thread)
+#else
+#define ASL_THREAD_LOCAL __thread
+#endif
+
+#define ASL_ARENA_CHUNK (1 << 20)
+#define ASL_ARENA_MAXBLOCK (ASL_ARENA_CHUNK / 8)
+#define ASL_ARENA_BIAS (1 << 30)
+#define ASL_ARENA_CACHE 32
+
+namespace asl {
+
+AtomicCount _activeArenas;
+
+static ASL_THREAD_LOCAL Arena* currentArena = 0;
+
+/*
+Chunks are aligned to their size, so the chunk of a block is found by clearing the low bits of its address. `live`
+starts with a large bias so that it cannot reach zero while the chunk is in use by its arena; when the arena retires
+it, the bias is replaced by the number of blocks allocated, and the last release frees it.
+*/
+struct ArenaChunk
+{
+	AtomicCount live;
+	int pad[3];
+};
+
+/*
+Released chunks are kept for reuse up to a limit, as fresh memory from the system is much slower to write the first
+time (page faults)
+*/
+static Mutex chunkMutex;
+static void* freeChunks[ASL_ARENA_CACHE];
+static int numFreeChunks = 0;
+
+static ArenaChunk* newChunk()
+{
+	void* p = 0;
+	{
+		Lock _(chunkMutex);
+		if (numFreeChunks > 0)
+			p = freeChunks[--numFreeChunks];
+	}
+	if (p)
+		return new (p) ArenaChunk();
+#ifdef _WIN32
+	p = _aligned_malloc(ASL_ARENA_CHUNK, ASL_ARENA_CHUNK);
+#else
+	if (posix_memalign(&p, ASL_ARENA_CHUNK, ASL_ARENA_CHUNK) != 0)
+		p = 0;
+#endif
+	if (!p)
+		ASL_BAD_ALLOC();
+	return new (p) ArenaChunk();
+}
+
+static void freeChunk(ArenaChunk* c)
+{
+	{
+		Lock _(chunkMutex);
+		if (numFreeChunks < ASL_ARENA_CACHE)
+		{
+			freeChunks[numFreeChunks++] = c;
+			return;
+		}
+	}
+#ifdef _WIN32
+	_aligned_free(c);
+#else
+	::free(c);
+#endif
+}
+
+Arena::Arena() : _chunk(0), _p(0), _end(0), _count(0), _allocated(0)
+{
+}
+
+Arena::~Arena()
+{
+	retire();
+}
+
+void Arena::retire()
+{
+	if (!_chunk)
+		return;
+	ArenaChunk* c = (ArenaChunk*)_chunk;
+	if ((c->live += _count - ASL_ARENA_BIAS) == 0)
+		freeChunk(c);
+	_chunk = _p = _end = 0;
+	_count = 0;
+}
+
+void* Arena::alloc(size_t n)
+{
+	if (n > ASL_ARENA_MAXBLOCK)
+		return 0;
+	n = (n + 15) & ~(size_t)15;
+	if (!_chunk || n > size_t(_end - _p))
+	{
+		retire();
+		ArenaChunk* c = newChunk();
+		c->live += ASL_ARENA_BIAS;
+		_chunk = (char*)c;
+		_p = _chunk + sizeof(ArenaChunk);
+		_end = _chunk + ASL_ARENA_CHUNK;
+	}
+	void* p = _p;
+	_p += n;
+	_count++;
+	_allocated += n;
+	return p;
+}
+
+void Arena::release(void* p)
+{
+	ArenaChunk* c = (ArenaChunk*)((size_t)p & ~(size_t)(ASL_ARENA_CHUNK - 1));
+	if (--c->live == 0)
+		freeChunk(c);
+}
+
+void* Arena::allocCurrent(size_t n)
+{
+	return currentArena ? currentArena->alloc(n) : 0;
+}
+
+Arena::Scope::Scope(Arena& arena) : _prev(currentArena)
+{
+	currentArena = &arena;
+	++_activeArenas;
+}
+
+Arena::Scope::~Scope()
+{
+	currentArena = _prev;
+	--_activeArenas;
+}
+
+}
@@ -0,0 +1,193 @@
+#include <asl/Deflate.h>
+
+#ifdef ASL_ZLIB
+#include <zlib.h>
+#endif
+
+#define ASL_DEFLATE_BLOCK 16384
+
+namespace asl {
+
+#ifdef ASL_ZLIB
+
+// zlib selects the format with the sign and range of the window bits
+
+static int zlibWindowBits(int format, int bits)
+{
+	return format == Deflater::RAW ? -bits : format == Deflater::GZIP ? bits + 16 : bits;
+}
+
+Deflater::Deflater(Format format, int level, int windowBits)
+{
+	z_stream* z = new z_stream;
+	memset(z, 0, sizeof(z_stream));
+	windowBits = clamp(windowBits, 9, 15);
+	if (deflateInit2(z, level, Z_DEFLATED, zlibWindowBits(format, windowBits), 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		delete z;
+		z = 0;
+	}
+	_z = z;
+}
+
+Deflater::~Deflater()
+{
+	if (!_z)
+		return;
+	deflateEnd((z_stream*)_z);
+	delete (z_stream*)_z;
+}
+
+void Deflater::reset()
+{
+	if (_z)
+		deflateReset((z_stream*)_z);
+}
+
+bool Deflater::compress(const byte* data, int n, ByteArray& out, Flush flush)
+{
+	z_stream* z = (z_stream*)_z;
+	if (!z)
+		return false;
+	z->next_in = (Bytef*)data;
+	z->avail_in = n;
+	int mode = flush == SYNC ? Z_SYNC_FLUSH : flush == FINISH ? Z_FINISH : Z_NO_FLUSH;
+	int i = out.length();
+	out.resize(i + (int)deflateBound(z, n) + 16);
+	while (true)
+	{
+		z->next_out = out.data() + i;
+		z->avail_out = out.length() - i;
+		int r = deflate(z, mode);
+		i = out.length() - z->avail_out;
+		if (r == Z_STREAM_END || (r == Z_OK && z->avail_out > 0 && z->avail_in == 0) || (r == Z_BUF_ERROR && z->avail_in == 0))
+			break;
+		if (r != Z_OK && r != Z_BUF_ERROR)
+		{
+			out.resize(i);
+			return false;
+		}
+		out.resize(out.length() + max(out.length() / 2, ASL_DEFLATE_BLOCK));
+	}
+	out.resize(i);
+	return true;
+}
+
+Inflater::Inflater(int format, int windowBits) : _end(false)
+{
+	z_stream* z = new z_stream;
+	memset(z, 0, sizeof(z_stream));
+	windowBits = clamp(windowBits, 8, 15);
+	if (inflateInit2(z, zlibWindowBits(format, windowBits)) != Z_OK)
+	{
+		delete z;
+		z = 0;
+	}
+	_z = z;
+}
+
+Inflater::~Inflater()
+{
+	if (!_z)
+		return;
+	inflateEnd((z_stream*)_z);
+	delete (z_stream*)_z;
+}
+
+void Inflater::reset()
+{
+	if (_z)
+		inflateReset((z_stream*)_z);
+	_end = false;
+}
+
+bool Inflater::decompress(const byte* data, int n, ByteArray& out, int maxSize)
+{
+	z_stream* z = (z_stream*)_z;
+	if (!z)
+		return false;
+	z->next_in = (Bytef*)data;
+	z->avail_in = n;
+	int i = out.length();
+	while (!_end)
+	{
+		if (i >= maxSize)
+		{
+			out.resize(i);
+			return false;
+		}
+		out.resize(min(maxSize, i + max(2 * n, ASL_DEFLATE_BLOCK)));
+		z->next_out = out.data() + i;
+		z->avail_out = out.length() - i;
+		int r = inflate(z, Z_SYNC_FLUSH);
+		i = out.length() - z->avail_out;
+		if (r == Z_STREAM_END)
+			_end = true;
+		else if (r == Z_BUF_ERROR) // needs more input
+			break;
+		else if (r != Z_OK)
+		{
+			out.resize(i);
+			return false;
+		}
+		else if (z->avail_in == 0 && z->avail_out > 0)
+			break;
+	}
+	out.resize(i);
+	return true;
+}
+
+#else
+
+Deflater::Deflater(Format, int, int) : _z(0) {}
+
+Deflater::~Deflater() {}
+
+void Deflater::reset() {}
+
+bool Deflater::compress(const byte*, int, ByteArray&, Flush)
+{
+	return false;
+}
+
+Inflater::Inflater(int, int) : _z(0), _end(false) {}
+
+Inflater::~Inflater() {}
+
+void Inflater::reset() {}
+
+bool Inflater::decompress(const byte*, int, ByteArray&, int)
+{
+	return false;
+}
+
+#endif
+
+bool Deflater::available()
+{
+#ifdef ASL_ZLIB
+	return true;
+#else
+	return false;
+#endif
+}
+
+ByteArray Deflater::compress(const ByteArray& data, Format format, int level)
+{
+	Deflater deflater(format, level);
+	ByteArray out;
+	if (!deflater.compress(data.data(), data.length(), out, FINISH))
+		out.clear();
+	return out;
+}
+
+ByteArray Inflater::decompress(const ByteArray& data, int format)
+{
+	Inflater inflater(format);
+	ByteArray out;
+	if (!inflater.decompress(data.data(), data.length(), out) || (format != Deflater::RAW && !inflater.finished()))
+		out.clear();
+	return out;
+}
+
+}
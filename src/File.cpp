@@ -307,6 +307,17 @@ int File::write(const void* p, int n)
 	return (int)fwrite(p, 1, n, _file);
 }
 
+bool File::sync()
+{
+	if (!_file || fflush(_file) != 0)
+		return false;
+#ifdef _WIN32
+	return _commit(_fileno(_file)) == 0;
+#else
+	return fsync(fileno(_file)) == 0;
+#endif
+}
+
 File File::temp(const String& ext)
 {
 	File file;
@@ -5,6 +5,8 @@
 #include <asl/Http.h>
 #include <asl/JSON.h>
 #include <asl/TlsSocket.h>
+#include <asl/Mutex.h>
+#include <asl/time.h>
 #include <ctype.h>
 
 #define SEND_BLOCK_SIZE 128000
@@ -168,18 +170,26 @@ HttpMessage::HttpMessage() : _proto("HTTP/1.1"), _socket(NULL), _fileBody(false)
 {
 	_sink = new HttpSinkArray(_body);
 	_headersSent = false;
+	_finished = false;
+	_bodyDeferred = false;
+	_bodyState = 0;
+	_bodyChunked = false;
+	_bodyLeft = 0;
+	_encodeFormat = -1;
+	_encodeLevel = 6;
+	_decode = false;
 	_status = new HttpStatus;
 	memset(&*_status, 0, sizeof(*_status));
 }
 
 String HttpMessage::text() const
 {
-	return String(_body);
+	return String(body());
 }
 
 Var HttpMessage::json() const
 {
-	String str = _body;
+	String str = body();
 	Var data = Json::decode(str);
 	return data.ok() ? data : Var(Url::parseQuery(str));
 }
@@ -212,6 +222,44 @@ void HttpMessage::put(const File& body)
 	_fileBody = true;
 }
 
+// the preferred encoding in an Accept-Encoding header that we can produce: gzip, deflate (zlib format) or none (-1)
+
+int HttpMessage::acceptedEncoding(const String& accept)
+{
+	if (!Deflater::available())
+		return -1;
+	int format = -1;
+	Array<String> items = accept.toLowerCase().split(',');
+	foreach(String& item, items)
+	{
+		Array<String> parts = item.split(';');
+		String name = parts[0].trimmed(), q = parts.length() > 1 ? parts[1].trimmed() : String();
+		if (q.startsWith("q=") && q.substring(2).toDouble() <= 0)
+			continue;
+		if (name == "gzip" || name == "x-gzip")
+			return Deflater::GZIP;
+		if (name == "deflate")
+			format = Deflater::ZLIB;
+	}
+	return format;
+}
+
+// content types that are worth compressing (text formats)
+
+bool HttpMessage::compressible(const String& type)
+{
+	String t = type.toLowerCase();
+	return t.startsWith("text/") || t.contains("json") || t.contains("javascript") || t.contains("xml");
+}
+
+void HttpMessage::setEncoding(int format)
+{
+	setHeader("Content-Encoding", format == Deflater::GZIP ? "gzip" : "deflate");
+	String vary = header("Vary");
+	if (!vary.contains("Accept-Encoding"))
+		setHeader("Vary", vary.ok() ? vary + ", Accept-Encoding" : String("Accept-Encoding"));
+}
+
 void HttpMessage::setHeader(const String& header, const String& value)
 {
 	String name;// = capitalize(header);
@@ -257,76 +305,311 @@ void HttpMessage::readHeaders()
 	}
 }
 
-void HttpMessage::readBody()
-{
-	int size = header("Content-Length");
+// prepares to read the body after the headers; returns false if its end is only marked by closing the connection
 
-	int currentsize = 0;
+bool HttpMessage::beginBody()
+{
+	_bodyState = 1;
+	_bodyChunked = header("Transfer-Encoding").toLowerCase() == "chunked";
+	_bodyLeft = _bodyChunked ? 0 : hasHeader("Content-Length") ? header("Content-Length").toLong() : 0;
+	if (!_bodyChunked && _bodyLeft <= 0)
+		_bodyState = 2;
+	else if (header("Expect").toLowerCase() == "100-continue")
+		*_socket << "HTTP/1.1 100 Continue\r\n\r\n"; // a client waits for this before sending a large body
+	return _bodyChunked || hasHeader("Content-Length");
+}
 
-	bool chunked = header("Transfer-Encoding") == "chunked"; // Handle specially!!
+int HttpMessage::read(byte* buffer, int n)
+{
+	_bodyDeferred = false;
+	if (_bodyState == 0)
+		beginBody();
+	if (_bodyState == 2 || n <= 0)
+		return 0;
+	if (_bodyChunked && _bodyLeft == 0)
+	{
+		String line = _socket->readLine();
+		if (line == "\r") // the end of the previous chunk
+			line = _socket->readLine();
+		int i = line.indexOf(';'); // chunk extensions are ignored
+		String hex = (i < 0 ? line : line.substring(0, i)).trimmed();
+		if (hex.length() == 0 || hex.length() > 15 || _socket->error())
+		{
+			_bodyState = 2;
+			return -1;
+		}
+		_bodyLeft = 0;
+		for (int k = 0; k < hex.length(); k++)
+			_bodyLeft = _bodyLeft * 16 + (isdigit(hex[k]) ? hex[k] - '0' : (tolower(hex[k]) - 'a' + 10) & 15);
+		if (_bodyLeft == 0)
+		{
+			while (line = _socket->readLine(), line != "\r" && !_socket->error()) // trailers
+				;
+			_bodyState = 2;
+			return _socket->error() ? -1 : 0;
+		}
+	}
+	// read what has arrived (at least one byte), up to the end of the body or chunk
+	int available = _socket->available();
+	while (available == 0 && _socket->waitInput(60))
+	{
+		available = _socket->available();
+		if (available == 0) // readable but empty: closed
+			break;
+	}
+	if (available <= 0)
+	{
+		_bodyState = 2;
+		return -1;
+	}
+	int m = (int)min((Long)min(n, available), _bodyLeft);
+	int r = _socket->read(buffer, m);
+	if (r <= 0)
+	{
+		_bodyState = 2;
+		return -1;
+	}
+	_bodyLeft -= r;
+	if (_bodyLeft == 0 && !_bodyChunked)
+		_bodyState = 2;
+	return r;
+}
 
-	_sink->init(size);
+// returns true if the body was completely read and the connection can be used for another message
 
+bool HttpMessage::readBody()
+{
+	_bodyDeferred = false;
 	_socket->setBlocking(true);
+	if (_bodyState == 0 && !beginBody())
+		return false;
+	Long size = _bodyChunked ? 0 : _bodyLeft;
+	_sink->init(size < 0x7fffffff ? (int)size : 0);
+	_status->totalReceive = (int)size;
+	_status->received = 0;
+	String encoding = _decode ? header("Content-Encoding").toLowerCase() : String();
+	Shared<Inflater> inflater;
+	if (encoding == "gzip" || encoding == "x-gzip" || encoding == "deflate")
+		inflater = new Inflater(encoding == "deflate" ? Deflater::ZLIB : Deflater::GZIP);
+	ByteArray buffer(65536), plain;
+	int n;
+	while ((n = read(buffer.data(), buffer.length())) > 0)
+	{
+		_status->received += n;
+		if (inflater && inflater->ok())
+		{
+			plain.resize(0);
+			if (!inflater->decompress(buffer.data(), n, plain))
+				return false;
+			_sink->write(plain.data(), plain.length());
+		}
+		else
+			_sink->write(buffer.data(), n);
+		if (_progress)
+			_progress(*_status);
+	}
+	return n == 0;
+}
 
-	bool end = false;
+// discards a body that was not read, if not too large; returns false if the connection cannot be reused
 
-	if (hasHeader("Content-Length")) {
-		if (header("Content-Length") == "0")
-			return;
+bool HttpMessage::skipBody(Long maxSize)
+{
+	_bodyDeferred = false;
+	if (_bodyState == 2)
+		return true;
+	if (_bodyState == 0)
+	{
+		if (header("Expect").toLowerCase() == "100-continue") // the client has not sent it
+			return false;
+		if (!beginBody())
+			return true;
 	}
-	else if(!chunked)
-		return;
+	if (!_bodyChunked && _bodyLeft > maxSize)
+		return false;
+	byte buffer[8192];
+	int n;
+	Long total = 0;
+	while ((n = read(buffer, sizeof(buffer))) > 0 && (total += n) <= maxSize)
+		;
+	return n == 0;
+}
 
-	_status->totalReceive = size;
-	_status->received = 0;
+struct HttpConnection
+{
+	Socket socket;
+	double lastUse;
+	HttpConnection() : socket((Socket::Ptr)NULL), lastUse(0) {}
+};
 
-	while (!end)
+struct HttpHostPool
+{
+	Array<HttpConnection> idle;
+	int active;
+	HttpHostPool() : active(0) {}
+};
+
+struct HttpPool
+{
+	Mutex mutex;
+	Condition freed;
+	Dic<HttpHostPool> hosts;
+	bool keepAlive;
+	bool compression;
+	int maxConnections;
+	double idleTimeout;
+	HttpPool() : keepAlive(true), compression(Deflater::available()), maxConnections(8), idleTimeout(30)
 	{
-		int av = _socket->available();
-		if (av < 0 || !_socket->waitInput()) {
-			break;
-		}
-		byte buffer[RECV_BLOCK_SIZE];
-		int maxToRead = _socket->available(), bytesRead = 0;
-		if (chunked)
+		freed.use(mutex);
+	}
+
+	// closes the idle connections unused for too long, of all hosts (some may never be contacted again), and
+	// forgets hosts left without connections
+	void expire()
+	{
+		double t = now();
+		Array<String> unused;
+		foreach2(String& key, HttpHostPool& host, hosts)
 		{
-			String chunkSize = _socket->readLine();
-			maxToRead = chunkSize.hexToInt();
-			if (maxToRead == 0)
-				end = true;
+			for (int i = host.idle.length() - 1; i >= 0; i--)
+				if (t - host.idle[i].lastUse > idleTimeout)
+				{
+					host.idle[i].socket.close();
+					host.idle.remove(i);
+				}
+			if (host.idle.length() == 0 && host.active == 0)
+				unused << key;
 		}
-		while (maxToRead > 0) {
-			bytesRead = _socket->read(buffer, min(maxToRead, (int)sizeof(buffer)));
-			if (bytesRead <= 0) {
-				return;
-			}
-			currentsize += bytesRead;
-			_status->received = currentsize;
-			_sink->write(buffer, bytesRead);
-			if(_progress)
-				_progress(*_status);
-			maxToRead -= bytesRead;
-			if (size) {
-				size -= bytesRead;
-				if (size <= 0) {
-					return;
+		foreach(String& key, unused)
+			hosts.remove(key);
+	}
+
+	// gets an idle connection to a server, or returns false when a new one should be opened, waiting while the
+	// server has too many connections
+	bool acquire(const String& key, Socket& socket)
+	{
+		Lock _(mutex);
+		while (true)
+		{
+			expire();
+			HttpHostPool& host = hosts[key];
+			while (host.idle.length() > 0)
+			{
+				Socket s = host.idle.last().socket;
+				host.idle.removeLast();
+				if (s.error() || s.waitInput(0)) // closed by the server (or sent something unexpected)
+				{
+					s.close();
+					continue;
 				}
+				host.active++;
+				socket = s;
+				return true;
 			}
+			if (maxConnections <= 0 || host.active < maxConnections)
+			{
+				host.active++;
+				return false;
+			}
+			freed.wait(1.0);
 		}
-		//if (maxToRead == 0) // ANDROID ?
-		//	break;
+	}
 
-		if (chunked)
+	// returns a connection to the pool, or closes it if it cannot be reused
+	void release(const String& key, Socket& socket, bool reusable)
+	{
+		Lock _(mutex);
+		expire();
+		HttpHostPool& host = hosts[key];
+		host.active--;
+		if (reusable && keepAlive && !socket.error())
 		{
-			if (_socket->read(buffer, 2) < 2) // skip crlf
-				break;
+			HttpConnection c;
+			c.socket = socket;
+			c.lastUse = now();
+			host.idle << c;
 		}
+		else if (socket.ptr())
+			socket.close();
+		freed.signal();
+	}
+};
+
+HttpClient::HttpClient() : _pool(new HttpPool)
+{
+}
+
+HttpClient::~HttpClient()
+{
+	closeIdle();
+	delete _pool;
+}
+
+HttpClient& HttpClient::shared()
+{
+	static HttpClient client;
+	return client;
+}
+
+HttpClient& HttpClient::setKeepAlive(bool enable)
+{
+	{
+		Lock _(_pool->mutex);
+		_pool->keepAlive = enable;
+	}
+	if (!enable)
+		closeIdle();
+	return *this;
+}
+
+HttpClient& HttpClient::setMaxConnections(int n)
+{
+	Lock _(_pool->mutex);
+	_pool->maxConnections = n;
+	return *this;
+}
+
+HttpClient& HttpClient::setIdleTimeout(double t)
+{
+	Lock _(_pool->mutex);
+	_pool->idleTimeout = t;
+	return *this;
+}
+
+HttpClient& HttpClient::setCompression(bool enable)
+{
+	Lock _(_pool->mutex);
+	_pool->compression = enable && Deflater::available();
+	return *this;
+}
+
+int HttpClient::idleConnections() const
+{
+	Lock _(_pool->mutex);
+	_pool->expire();
+	int n = 0;
+	foreach(HttpHostPool& host, _pool->hosts)
+		n += host.idle.length();
+	return n;
+}
+
+void HttpClient::closeIdle()
+{
+	Lock _(_pool->mutex);
+	foreach(HttpHostPool& host, _pool->hosts)
+	{
+		foreach(HttpConnection& c, host.idle)
+			c.socket.close();
+		host.idle.clear();
 	}
-	//printf("readbody end\n");
 }
 
 HttpResponse Http::request(HttpRequest& request)
+{
+	return HttpClient::shared().request(request);
+}
+
+HttpResponse HttpClient::request(HttpRequest& request)
 {
 	Socket socket((Socket::Ptr)NULL);
 	HttpResponse response(request);
@@ -334,58 +617,90 @@ HttpResponse Http::request(HttpRequest& request)
 
 	Url url(request.url());
 	bool hasPort = url.port != 0;
+	bool https = url.protocol == "https";
 
-	if (url.protocol == "https")
+#ifndef ASL_TLS
+	if (https)
 	{
-#ifdef ASL_TLS
-		socket = TlsSocket();
-		if (!hasPort) url.port = 443;
-#else
 		response.setSockError("SOCKET_NO_TLS_AVAILABLE");
 		return response;
-#endif
-	}
-	else {
-		socket = Socket();
-		if (!hasPort) url.port = 80;
 	}
+#endif
+	if (!hasPort)
+		url.port = https ? 443 : 80;
 
-	response.use(socket);
-	request.use(socket);
-
-	if (!socket.connect(url.host, url.port)) {
-		//printf("Cannot connect to %s : %i\n", *url.host, url.port);
-		socket.close();
-		response.setSockError(socket.errorMsg());
-		return response;
-	}
-	
 	if (request.body().length() != 0) {
 		request.setHeader("Content-Length", request.body().length());
 	}
 
+	bool compression = _pool->compression;
+	if (compression && !request.hasHeader("Accept-Encoding"))
+		request.setHeader("Accept-Encoding", "gzip, deflate");
+
 	String title;
 	title << request.method() << ' ' << url.path << " HTTP/1.1\r\nHost: " << url.host;
 	if (hasPort)
 		title << ':' << url.port;
 	request._command = title;
 
-	if (!request.write())
+	String key;
+	key << url.protocol << "://" << url.host << ':' << url.port;
+	String line;
+
+	// a reused connection may have been closed by the server just before sending the request, then retry once
+	// with a new one; if the request was sent but no answer came, the server may have processed it, so only
+	// idempotent methods are retried
+
+	String method = request.method();
+	bool idempotent = method == "GET" || method == "HEAD" || method == "PUT" || method == "DELETE" ||
+		method == "OPTIONS";
+
+	for (int attempt = 0; ; attempt++)
 	{
-		response.setSockError(socket.errorMsg());
-		return response;
-	}
-	
-	String line = socket.readLine();
-	if (!line.ok()) {
-		socket.close();
-		response.setSockError(socket.errorMsg());
-		return response;
+		bool reused = _pool->acquire(key, socket);
+		if (!reused)
+		{
+#ifdef ASL_TLS
+			if (https)
+				socket = TlsSocket();
+			else
+#endif
+				socket = Socket();
+			if (!socket.connect(url.host, url.port)) {
+				response.setSockError(socket.errorMsg());
+				_pool->release(key, socket, false);
+				return response;
+			}
+		}
+
+		response.use(socket);
+		request.use(socket);
+		request._headersSent = false;
+
+		if (!request.write())
+		{
+			response.setSockError(socket.errorMsg());
+			_pool->release(key, socket, false);
+			if (reused && attempt == 0)
+				continue;
+			return response;
+		}
+
+		line = socket.readLine();
+		if (!line.ok()) {
+			response.setSockError(socket.errorMsg());
+			_pool->release(key, socket, false);
+			if (reused && attempt == 0 && idempotent)
+				continue;
+			return response;
+		}
+		break;
 	}
+
 	Array<String> parts = line.split();
 	if (parts.length() < 2) {
-		socket.close();
 		response.setSockError(socket.errorMsg());
+		_pool->release(key, socket, false);
 		return response;
 	}
 
@@ -397,7 +712,7 @@ HttpResponse Http::request(HttpRequest& request)
 
 	if (request.followRedirects() && (code == 301 || code == 302 || code == 307 || code == 308)) // 303 ?
 	{
-		socket.close();
+		_pool->release(key, socket, false);
 		String loc = response.header("Location");
 		HttpRequest req(request);
 		req.setUrl(loc);
@@ -406,7 +721,7 @@ HttpResponse Http::request(HttpRequest& request)
 		int n = request.recursion() + 1;
 		if (n < 4) {
 			req.setRecursion(n);
-			return Http::request(req);
+			return this->request(req);
 		}
 		else {
 			response.setCode(421);
@@ -417,15 +732,22 @@ HttpResponse Http::request(HttpRequest& request)
 
 	response.onProgress(request._progress);
 	response.useSink(request._sink);
+	response._decode = compression;
+
+	String connection = response.header("Connection").toLowerCase();
+	bool keepAlive = connection == "keep-alive" || (connection != "close" && response.protocol() == "HTTP/1.1");
+	bool complete;
 
-	response.readBody();
+	if (request.method() == "HEAD" || code == 204 || code == 304 || code / 100 == 1)
+		complete = true;
+	else
+		complete = response.readBody();
 
-	socket.close();
+	_pool->release(key, socket, keepAlive && complete);
 	return response;
 }
 
-
-void HttpRequest::read()
+void HttpRequest::read(bool body)
 {
 	_addr = _socket->remoteAddress();
 	_command = _socket->readLine();
@@ -442,7 +764,10 @@ void HttpRequest::read()
 	_proto = _command.substring(j + 1).trim();
 
 	readHeaders();
-	readBody();
+	if (body)
+		readBody();
+	else
+		_bodyDeferred = true;
 	/*
 	if(_body.length() > 0) // dump
 	{
@@ -535,6 +860,10 @@ void HttpResponse::setCode(int code)
 		msg = "Not Found";
 	else if (code == 206)
 		msg = "Partial Content";
+	else if (code == 304)
+		msg = "Not Modified";
+	else if (code == 416)
+		msg = "Range Not Satisfiable";
 	else
 		msg = "Not found";
 
@@ -559,6 +888,18 @@ void HttpMessage::useSink(const Shared<HttpSink>& s)
 
 bool HttpMessage::sendHeaders()
 {
+	return sendHeaders(NULL, 0);
+}
+
+// sends the headers followed by the first n bytes of the body (if not chunked) in a single write, so that small
+// messages do not take two packets
+
+bool HttpMessage::sendHeaders(const char* body, int n)
+{
+	// without a length, a response (or a request that starts sending a body) is sent in chunks
+	_chunked = !_headers.has("Content-Length") && (n > 0 || _command.startsWith("HTTP/"));
+	if (_chunked)
+		_headers["Transfer-Encoding"] = "chunked";
 	String s;
 	s << _command << "\r\n";
 	foreach2(String& name, String& value, _headers)
@@ -566,12 +907,21 @@ bool HttpMessage::sendHeaders()
 		s << name << ": " << value << "\r\n";
 	}
 	s << "\r\n";
+	if (n > 0 && _chunked)
+		s << String::f("%x\r\n", n) << String(body, n) << "\r\n";
+	else if (n > 0)
+		s << String(body, n);
 	int sent = _socket->write(*s, s.length());
 	if (sent <= 0)
 		return false;
 	_headersSent = true;
-	_chunked = !_headers.has("Content-Length");
 	_status->totalSend = _chunked ? 0 : int(_headers["Content-Length"]);
+	if (n > 0)
+	{
+		_status->sent += n;
+		if (_progress)
+			_progress(*_status);
+	}
 	return true;
 }
 
@@ -588,18 +938,56 @@ void HttpMessage::write(const String& text)
 	write(*text, text.length());
 }
 
+// a body without a length is compressed as it is written if compression was negotiated for it; each write is
+// flushed so that it can be decoded on arrival
+
 int HttpMessage::write(const char* buffer, int n)
 {
+	if (!_headersSent && _encodeFormat >= 0 && !_headers.has("Content-Length") && !_headers.has("Content-Encoding") &&
+		compressible(header("Content-Type")))
+	{
+		_encoder = new Deflater((Deflater::Format)_encodeFormat, _encodeLevel);
+		if (_encoder->ok())
+			setEncoding(_encodeFormat);
+		else
+			_encoder = Shared<Deflater>();
+	}
+	_encodeFormat = -1;
+	if (_encoder && n > 0)
+	{
+		ByteArray packed;
+		if (!_encoder->compress((const byte*)buffer, n, packed, Deflater::SYNC))
+			return 0;
+		return writeBody((const char*)packed.data(), packed.length()) == packed.length() ? n : 0;
+	}
+	return writeBody(buffer, n);
+}
+
+int HttpMessage::writeBody(const char* buffer, int n)
+{
+	int sent = n == 0 ? 1 : 0;
 	if (!_headersSent)
-		if (!sendHeaders())
+	{
+		int m = min(n, SEND_BLOCK_SIZE);
+		if (!sendHeaders(buffer, m))
 			return false;
-	int sent = n == 0 ? 1 : 0;
+		sent += m;
+		buffer += m;
+		n -= m;
+	}
 	while (n > 0)
 	{
 		int m = min(n, SEND_BLOCK_SIZE);
-		if (_chunked)
-			*_socket << String::f("%x\r\n", m);
-		int written = _socket->write(buffer, m);
+		int written;
+		if (_chunked) // chunk size, data and end in one write
+		{
+			char head[16];
+			int h = snprintf(head, sizeof(head), "%x\r\n", m);
+			SocketSpan spans[3] = { { head, h }, { buffer, m }, { "\r\n", 2 } };
+			written = _socket->write(spans, 3) - h - 2;
+		}
+		else
+			written = _socket->write(buffer, m);
 		if (written != m)
 			return sent;
 		_status->sent += written;
@@ -607,43 +995,68 @@ int HttpMessage::write(const char* buffer, int n)
 			_progress(*_status);
 
 		sent += written;
-		if (_chunked)
-			*_socket << "\r\n";
 		n -= m;
 		buffer += m;
 	}
 	return sent;
 }
 
-void HttpMessage::writeFile(const String& path, int begin, int end)
+bool HttpMessage::finish()
+{
+	if (!_headersSent || !_chunked || _finished)
+		return true;
+	_finished = true;
+	if (_encoder)
+	{
+		ByteArray packed;
+		if (!_encoder->compress(NULL, 0, packed, Deflater::FINISH) ||
+			(packed.length() > 0 && writeBody((const char*)packed.data(), packed.length()) != packed.length()))
+			return false;
+		_encoder = Shared<Deflater>();
+	}
+	return _socket->write("0\r\n\r\n", 5) == 5;
+}
+
+void HttpMessage::writeFile(const String& path, Long begin, Long end)
 {
 	File file(path, File::READ);
 	if (!file)
 		return;
-	if (!_headersSent)
-		sendHeaders();
-	int n = 1;
-	file.seek(begin);
-	Long size = file.size();
-	if (begin != end)
-		size = end - begin + 1;
-	int bytesSent = 0;
-	//HttpStatus status;
-	//status.sent = 0;
-	//status.totalSend = (int)size;
-	while(n > 0 && bytesSent < (int)size)
-	{
-		char buf[RECV_BLOCK_SIZE];
-		n = file.read(buf, min((int)sizeof(buf), (int)size - bytesSent));
-		if (n > 0) {
-			int w = 0;
-			if ((w = write(buf, n)) < 0)
-			{
-				break;
-			}
-			bytesSent += n;
+	Long size = file.size() - begin;
+	if (end >= 0)
+		size = min(size, end - begin + 1);
+	if (!_headersSent && size > 0 && size <= SEND_BLOCK_SIZE) // small: send it together with the headers
+	{
+		ByteArray buf((int)size);
+		file.seek(begin);
+		int n = file.read(buf.data(), (int)size);
+		if (n > 0)
+			write((const char*)buf.data(), n);
+		return;
+	}
+	if (!_headersSent && !sendHeaders())
+		return;
+	if (size <= 0)
+		return;
+	if (_chunked)
+		*_socket << String::f("%llx\r\n", size);
+	Long offset = begin, last = begin + size;
+	while (offset < last) // in blocks only to report progress
+	{
+		Long n = _progress ? min(last - offset, (Long)SEND_BLOCK_SIZE) : last - offset;
+		Long sent = _socket->sendFile(file, offset, n);
+		if (sent > 0)
+		{
+			offset += sent;
+			_status->sent += (int)sent;
+			if (_progress)
+				_progress(*_status);
 		}
-	};
+		if (sent != n)
+			return;
+	}
+	if (_chunked)
+		*_socket << "\r\n";
 }
 
 bool HttpMessage::putFile(const String& path, int begin, int end)
@@ -656,13 +1069,16 @@ bool HttpMessage::putFile(const String& path, int begin, int end)
 		return false;
 	}
 	if (begin == 0 && end == 0 && !hasHeader("Content-Range"))
+	{
 		setHeader("Content-Length", file.size());
+		end = -1;
+	}
 	else
 	{
 		Long size = file.size();
-		if (end == 0)
+		if (end == 0 || end >= size)
 			end = (int)size - 1;
-		if (end <= begin || begin < 0 || end > size)
+		if (end < begin || begin < 0)
 		{
 			setHeader("Content-Length", "0");
 			setHeader("Content-Range", String::f("bytes */%lli", size));
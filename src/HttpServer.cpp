@@ -7,11 +7,190 @@
 #include <asl/SocketServer.h>
 #include <asl/HttpServer.h>
 #include <asl/WebSocket.h>
+#include <asl/Thread.h>
+#include <asl/HashMap.h>
+#include <asl/Deflate.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 namespace asl {
 
 bool verbose = false;
 
+/*
+A small static file kept in memory while it does not change: a read-only mapping of it, or a copy where files are
+not mapped. The file is checked on each request (size and date, which need a stat anyway for the headers).
+*/
+struct CachedFile
+{
+	const byte* data;
+	Long size;
+	double modified;
+	int lastUse;
+	ByteArray copy;
+	ByteArray gzip;
+	bool packed;
+
+	CachedFile(const File& file) : data(0), size(file.size()), modified(file.lastModified().time()), lastUse(0),
+		packed(false)
+	{
+#ifndef _WIN32
+		int fd = open(file.path(), O_RDONLY);
+		if (fd < 0)
+			return;
+		void* p = size > 0 ? mmap(0, (size_t)size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+		::close(fd);
+		if (p != MAP_FAILED)
+		{
+			data = (const byte*)p;
+			return;
+		}
+#endif
+		copy = File(file.path()).content();
+		data = copy.data();
+	}
+	~CachedFile()
+	{
+#ifndef _WIN32
+		if (data && !copy.length())
+			munmap((void*)data, (size_t)size);
+#endif
+	}
+	bool ok() const { return data != 0 || size == 0; }
+	bool current(const File& file) const
+	{
+		return file.size() == size && file.lastModified().time() == modified;
+	}
+};
+
+/*
+Files served recently, up to a total size; the least recently used are dropped to make room for new ones
+*/
+struct HttpFileCache
+{
+	Mutex mutex;
+	HashMap<String, Shared<CachedFile> > files;
+	Long total, maxTotal, maxFile;
+	int uses;
+
+	HttpFileCache(Long maxTotal, Long maxFile) : total(0), maxTotal(maxTotal), maxFile(maxFile), uses(0) {}
+
+	Shared<CachedFile> get(const File& file)
+	{
+		Lock _(mutex);
+		Shared<CachedFile>* entry = files.find(file.path());
+		if (entry && (*entry)->current(file))
+		{
+			(*entry)->lastUse = ++uses;
+			return *entry;
+		}
+		if (entry)
+		{
+			total -= (*entry)->size;
+			files.remove(file.path());
+		}
+		Shared<CachedFile> f = new CachedFile(file);
+		if (!f->ok())
+			return Shared<CachedFile>((CachedFile*)0);
+		while (total + f->size > maxTotal && files.length() > 0)
+		{
+			String oldest;
+			int oldestUse = uses + 1;
+			foreach2(String& path, Shared<CachedFile>& g, files)
+			{
+				if (g->lastUse < oldestUse)
+				{
+					oldest = path;
+					oldestUse = g->lastUse;
+				}
+			}
+			total -= files[oldest]->size;
+			files.remove(oldest);
+		}
+		f->lastUse = ++uses;
+		total += f->size;
+		files[file.path()] = f;
+		return f;
+	}
+
+	// returns the file compressed with gzip (compressed only the first time), or an empty array if that does not
+	// make it smaller or it cannot be cached
+	ByteArray compressed(const File& file, int level)
+	{
+		Shared<CachedFile> f = get(file);
+		if (!f)
+			return ByteArray();
+		{
+			Lock _(mutex);
+			if (f->packed)
+				return f->gzip;
+		}
+		ByteArray gzip;
+		Deflater deflater(Deflater::GZIP, level);
+		if (!deflater.compress(f->data, (int)f->size, gzip, Deflater::FINISH) || gzip.length() >= f->size)
+			gzip.clear();
+		Lock _(mutex);
+		f->gzip = gzip;
+		f->packed = true;
+		return gzip;
+	}
+};
+
+// parses a single range "bytes=a-b", "bytes=a-" or "bytes=-n"; returns 1 if valid, -1 if not satisfiable, and 0 if
+// it should be ignored (malformed or multiple ranges, which are answered with the whole file); `begin` and `end`
+// are only set if valid
+
+static int parseRange(const String& range, Long size, Long& begin, Long& end)
+{
+	if (!range.startsWith("bytes=") || range.contains(','))
+		return 0;
+	Array<String> parts = range.substr(6).split('-');
+	if (parts.length() != 2)
+		return 0;
+	String first = parts[0].trim(), last = parts[1].trim();
+	Long a, b = size - 1;
+	if (first.ok())
+	{
+		a = first.toLong();
+		if (last.ok() && last.toLong() < a)
+			return 0;
+		if (last.ok())
+			b = min(last.toLong(), size - 1);
+	}
+	else if (last.ok())
+		a = max(size - last.toLong(), (Long)0);
+	else
+		return 0;
+	if (a >= size || a < 0)
+		return -1;
+	begin = a;
+	end = b;
+	return 1;
+}
+
+// Serves a WebSocket connection on its own thread so that it does not hold a worker of an event-driven server
+
+struct WsClientThread : public Thread
+{
+	WebSocketServer* _server;
+	Socket _client;
+	Dic<> _headers;
+
+	WsClientThread(WebSocketServer* svr, const Socket& cli, const Dic<>& headers) :
+		_server(svr), _client(cli), _headers(headers)
+	{
+		startDetached();
+	}
+	void run()
+	{
+		_server->process(_client, _headers);
+	}
+};
+
 HttpServer::HttpServer(int port):
 	_proto("HTTP/1.1"),
 	_methods("GET, POST, OPTIONS, PUT, DELETE, PATCH, HEAD")
@@ -21,6 +200,10 @@ HttpServer::HttpServer(int port):
 		bind(port);
 	_wsserver = NULL;
 	_cors = false;
+	_cache = new HttpFileCache(64 * 1024 * 1024, 64 * 1024);
+	_compression = false;
+	_compressMinSize = 1024;
+	_compressLevel = 6;
 	_mimetypes = String(
 		"css:text/css,"
 		"gif:image/gif,"
@@ -39,6 +222,26 @@ HttpServer::HttpServer(int port):
 		).split(',', ':');
 }
 
+HttpServer::~HttpServer()
+{
+	delete _cache;
+}
+
+void HttpServer::setFileCache(Long maxSize, Long maxFileSize)
+{
+	if (running()) // workers may be using the cache
+		return;
+	delete _cache;
+	_cache = maxSize > 0 ? new HttpFileCache(maxSize, min(maxFileSize, maxSize)) : NULL;
+}
+
+void HttpServer::setCompression(bool on, int minSize, int level)
+{
+	_compression = on && Deflater::available();
+	_compressMinSize = max(minSize, 0);
+	_compressLevel = clamp(level, 1, 9);
+}
+
 void HttpServer::addMimeType(const String& ext, const String& type)
 {
 	_mimetypes[ext] = type;
@@ -52,82 +255,202 @@ void HttpServer::serve(Socket client)
 		if (!client.waitData(5))
 			continue;
 
-		HttpRequest request(client);
-		if (client.error())
+		if (!serveRequest(client))
 			break;
+	}
+}
 
-		String hconn = request.header("Connection").toLowerCase();
+bool HttpServer::serveInput(Socket client)
+{
+	return serveRequest(client);
+}
 
-		if (request.header("Upgrade") == "websocket" && _wsserver)
-		{
-			if(verbose) printf("handing over to ws\n");
+// the request body is read on demand by the handler (all at once or streamed with `read()`)
+
+bool HttpServer::serveRequest(Socket& client)
+{
+	HttpRequest request;
+	request.use(client);
+	request.read(false);
+	if (client.error())
+		return false;
+
+	String hconn = request.header("Connection").toLowerCase();
+
+	if (request.header("Upgrade") == "websocket" && _wsserver)
+	{
+		if(verbose) printf("handing over to ws\n");
+		if (_eventDriven)
+			new WsClientThread(_wsserver, client, request.headers());
+		else
 			_wsserver->process(client, request.headers());
-			return;
-		}
+		return false;
+	}
+
+	HttpResponse response(request);
+	if (_compression)
+	{
+		response._encodeFormat = HttpMessage::acceptedEncoding(request.header("Accept-Encoding"));
+		response._encodeLevel = _compressLevel;
+	}
+
+	if (_cors && request.hasHeader("Origin"))
+	{
+		response.setHeader("Access-Control-Allow-Origin", request.header("Origin"));
+		response.setHeader("Access-Control-Allow-Credentials", "true");
+	}
+	if (!handleOptions(request, response))
+	{
+		serve(request, response);
+
+		if (!response.body())
+			response.put("");
 
-		HttpResponse response(request);
+		if (response.code() == 405)
+			response.setHeader("Allow", _methods);
 
-		if (_cors && request.hasHeader("Origin"))
+		if (response.containsFile())
 		{
-			response.setHeader("Access-Control-Allow-Origin", request.header("Origin"));
-			response.setHeader("Access-Control-Allow-Credentials", "true");
+			File file(response.text());
+			if (!file.exists())
+			{
+				response.setCode(404);
+				response.setHeader("Content-Type", "text/html");
+				response.put("<h1>Error</h1><p>File <b>" + file.name() + "</b> not found</p>");
+				return true;
+			}
+
+			String mime = _mimetypes.get(file.extension(), "text/plain");
+			response.setHeader("Date", Date::now().toString(Date::HTTP));
+			response.setHeader("Content-Type", mime);
+			if (hconn == "keep-alive")
+				response.setHeader("Connection", "keep-alive");
+			if (!response.hasHeader("Cache-Control"))
+				response.setHeader("Cache-Control", "max-age=60, public");
+			sendFile(request, response, file);
 		}
-		if (!handleOptions(request, response))
+		else
 		{
-			serve(request, response);
+			compressBody(response);
+			response.write();
+		}
+		if (!response.finish())
+			return false;
+	}
 
-			if (!response.body())
-				response.put("");
+	// a body the handler did not read is skipped if small, otherwise the connection is not reused
+	if (!request.skipBody(1024 * 1024))
+		return false;
+	
+	return !((request.protocol() == "HTTP/1.0" && hconn != "keep-alive") || hconn == "close");
+}
 
-			if (response.code() == 405)
-				response.setHeader("Allow", _methods);
+// compresses a complete body if compression was negotiated and it is a text large enough to be worth it
 
-			if (response.containsFile())
-			{
-				File file(response.text());
-				if (!file.exists())
-				{
-					response.setCode(404);
-					response.setHeader("Content-Type", "text/html");
-					response.put("<h1>Error</h1><p>File <b>" + file.name() + "</b> not found</p>");
-					continue;
-				}
+void HttpServer::compressBody(HttpResponse& response)
+{
+	int format = response._encodeFormat;
+	if (format < 0 || response._headersSent || response._body.length() < _compressMinSize || response.code() == 206 ||
+		response.hasHeader("Content-Encoding") || !HttpMessage::compressible(response.header("Content-Type")))
+		return;
+	ByteArray packed = Deflater::compress(response._body, (Deflater::Format)format, _compressLevel);
+	if (packed.length() == 0 || packed.length() >= response._body.length())
+		return;
+	response.put(packed);
+	response.setEncoding(format);
+}
 
-				String mime = _mimetypes.get(file.extension(), "text/plain");
-				response.setHeader("Date", Date::now().toString(Date::HTTP));
-				response.setHeader("Content-Type", mime);
-				if (hconn == "keep-alive")
-					response.setHeader("Connection", "keep-alive");
-				if (!response.hasHeader("Cache-Control"))
-					response.setHeader("Cache-Control", "max-age=60, public");
-				if (request.hasHeader("Range"))
-				{
-					String range = request.header("Range");
-					if (range.startsWith("bytes=") && !range.contains(',')) // no multiple ranges
-					{
-						Array<String> parts = range.substr(6).split('-');
-						int begin = parts[0];
-						int end = parts[1];
-						response.setCode(206);
-						response.setHeader("Content-Range", "");
-						response.putFile(file.path(), begin, end);
-					}
-				}
-				else
-					response.putFile(file.path());
-				if (response.header("Content-Range").contains('*'))
-				{
-					response.setCode(416);
-					response.write();
-				}
-			}
-			else
-				response.write();
+// a whole text file can be sent with gzip: a newer .gz file next to it (its path goes in `gzpath`), or the file
+// compressed once and cached (returned in `packed`)
+
+bool HttpServer::gzipVariant(HttpRequest& request, HttpResponse& response, const File& file, const String& mime,
+	String& gzpath, ByteArray& packed)
+{
+	if (response._encodeFormat != Deflater::GZIP || request.hasHeader("Range") || !HttpMessage::compressible(mime))
+		return false;
+	File gzfile(file.path() + ".gz");
+	if (gzfile.isFile() && file.lastModified() <= gzfile.lastModified())
+	{
+		gzpath = gzfile.path();
+		return true;
+	}
+	Long size = file.size();
+	packed = _cache && size >= _compressMinSize && size <= _cache->maxFile ?
+		_cache->compressed(file, _compressLevel) : ByteArray();
+	return packed.length() > 0;
+}
+
+// the gzip representation is a different one, so it needs its own entity tag (RFC 9110 8.8.3)
+
+static String gzipETag(const String& etag)
+{
+	return etag.endsWith('"') && !etag.endsWith("-gz\"") ? etag.substring(0, etag.length() - 1) + "-gz\"" : etag;
+}
+
+void HttpServer::sendFile(HttpRequest& request, HttpResponse& response, const File& file)
+{
+	String gzpath;
+	ByteArray packed;
+	if (gzipVariant(request, response, file, response.header("Content-Type"), gzpath, packed))
+	{
+		response._encodeFormat = -1;
+		response.setEncoding(Deflater::GZIP);
+		if (response.hasHeader("Etag")) // names are stored capitalized like this
+			response.setHeader("ETag", gzipETag(response.header("Etag")));
+		if (gzpath != "")
+		{
+			sendFile(request, response, File(gzpath));
+			return;
 		}
-		
-		if ((request.protocol() == "HTTP/1.0" && hconn != "keep-alive") || hconn == "close")
-			break;
+		response.setHeader("Content-Length", String(packed.length()));
+		if (request.method() == "HEAD")
+			response.write("");
+		else
+			response.write((const char*)packed.data(), packed.length());
+		return;
 	}
+	Long size = file.size(), begin = 0, end = size - 1;
+	int range = request.hasHeader("Range") ? parseRange(request.header("Range"), size, begin, end) : 0;
+	if (range != 0 && request.hasHeader("If-Range")) // a range of a version the client has, or else the whole file
+	{
+		String version = request.header("If-Range");
+		if (version != response.header("Etag") && version != response.header("Last-Modified"))
+		{
+			range = 0;
+			begin = 0;
+			end = size - 1;
+		}
+	}
+	if (range < 0)
+	{
+		response.setCode(416);
+		response.setHeader("Content-Range", String::f("bytes */%lli", size));
+		response.setHeader("Content-Length", "0");
+		response.write("");
+		return;
+	}
+	if (range > 0)
+	{
+		response.setCode(206);
+		response.setHeader("Content-Range", String::f("bytes %lli-%lli/%lli", begin, end, size));
+	}
+	Long n = end - begin + 1;
+	response.setHeader("Content-Length", String(n));
+	if (request.method() == "HEAD" || n == 0)
+	{
+		response.write("");
+		return;
+	}
+	if (_cache && size <= _cache->maxFile)
+	{
+		Shared<CachedFile> cached = _cache->get(file);
+		if (cached.get())
+		{
+			response.write((const char*)cached->data + begin, (int)n);
+			return;
+		}
+	}
+	response.writeFile(file.path(), begin, end);
 }
 
 void HttpServer::setRoot(const String& root)
@@ -153,15 +476,31 @@ void HttpServer::serveFile(HttpRequest& request, HttpResponse& response)
 		}
 		else if (file.exists())
 		{
-			if (request.hasHeader("If-Modified-Since"))
+			Date modified = file.lastModified();
+			String etag = String::f("\"%llx-%llx\"", file.size(), (Long)(modified.time() * 1000));
+			String gzpath;
+			ByteArray packed;
+			if (gzipVariant(request, response, file, _mimetypes.get(file.extension(), "text/plain"), gzpath, packed))
+				etag = gzipETag(etag);
+			response.setHeader("ETag", etag);
+			response.setHeader("Last-Modified", modified.toString(Date::HTTP));
+			if (request.hasHeader("If-None-Match"))
+			{
+				String match = request.header("If-None-Match");
+				if (match == "*" || match.contains(etag))
+				{
+					response.setCode(304);
+					return;
+				}
+			}
+			else if (request.hasHeader("If-Modified-Since"))
 			{
 				Date ifdate = request.header("If-Modified-Since");
-				if (file.lastModified() <= ifdate + 1.0) {
+				if (modified <= ifdate + 1.0) {
 					response.setCode(304);
 					return;
 				}
 			}
-			response.setHeader("Last-Modified", file.lastModified().toString(Date::HTTP));
 			response.put(file);
 		}
 		else
@@ -6,9 +6,12 @@
 #include <asl/Directory.h>
 #include <asl/Mutex.h>
 #include <asl/Process.h>
+#include <asl/Thread.h>
+#include <asl/atomic.h>
 #include <stdarg.h>
 
 #define ASL_LOG_MAX_SIZE 1000000
+#define ASL_LOG_SWITCHING 0x40000000
 
 #ifdef _MSC_VER
 #pragma warning(disable : 26812)
@@ -16,6 +19,244 @@
 
 namespace asl {
 
+static void rotateLog(const String& logfile)
+{
+	Path   path = logfile;
+	String oldfile = path.noExt() + "-1." + path.extension();
+	if (File(oldfile).exists())
+		Directory::remove(oldfile);
+	Directory::move(logfile, oldfile);
+}
+
+// Asynchronous mode: a bounded lock-free multi-producer queue of preformatted lines (each slot has a sequence
+// number telling whether it is free or filled for a given round) and a writer thread that empties it in batches
+
+// positions are compared with wrap-around
+
+static inline int seqDiff(int a, int b)
+{
+	return int(unsigned(a) - unsigned(b));
+}
+
+struct LogRecord
+{
+	AtomicCount seq;
+	Date time;
+	String line;
+	Console::Color color;
+	bool toConsole;
+	bool toFile;
+};
+
+struct LogQueue : public Thread
+{
+	Array<LogRecord> records;
+	int mask;
+	Log::Overflow policy;
+	AtomicCount tail;        // next position claimed by producers
+	int head;                // next position read by the writer
+	AtomicCount written;     // position up to which lines were written
+	AtomicCount sleeping;
+	AtomicCount dropped;
+	AtomicCount unreported;
+	Semaphore wakeup;
+	Mutex mutex;
+	Condition doneWriting;
+	volatile bool quit;
+	TextFile file;
+	String filename;
+	Long fileSize;
+
+	LogQueue(int n, Log::Overflow p) : records(nextPow2(max(n, 2))), policy(p), head(0), quit(false), fileSize(0)
+	{
+		mask = records.length() - 1;
+		for (int i = 0; i < records.length(); i++)
+			records[i].seq = AtomicCount(i);
+		doneWriting.use(mutex);
+	}
+
+	static int nextPow2(int n)
+	{
+		int m = 1;
+		while (m < n)
+			m *= 2;
+		return m;
+	}
+
+	void push(const Date& time, const String& line, Console::Color color, bool toConsole, bool toFile)
+	{
+		LogRecord* r;
+		while (1)
+		{
+			int pos = tail;
+			r = &records[pos & mask];
+			int dif = seqDiff(r->seq, pos);
+			if (dif == 0)
+			{
+				if (tail.cas(pos, int(unsigned(pos) + 1)))
+					break;
+			}
+			else if (dif < 0) // full
+			{
+				if (policy != Log::BLOCK)
+				{
+					++dropped;
+					++unreported;
+					return;
+				}
+				wake();
+				sleep(0.0002);
+			}
+		}
+		r->time = time;
+		r->line = line;
+		r->color = color;
+		r->toConsole = toConsole;
+		r->toFile = toFile;
+		++r->seq;
+		if (sleeping == 1 && sleeping.cas(1, 0))
+			wakeup.post();
+	}
+
+	void wake()
+	{
+		if (sleeping == 1 && sleeping.cas(1, 0))
+			wakeup.post();
+	}
+
+	bool empty() const
+	{
+		return seqDiff(records[head & mask].seq, int(unsigned(head) + 1)) < 0;
+	}
+
+	void run()
+	{
+		String batch(16384, 0);
+		String stamp;
+		double second = -1;
+		int idle = 0;
+		while (!quit || !empty())
+		{
+			if (empty())
+			{
+				if (idle++ == 0) // a short nap lets a batch accumulate before going to sleep
+				{
+					sleep(0.001);
+					continue;
+				}
+				sleeping.cas(0, 1); // producers will post after this
+				if (empty() && !quit)
+					wakeup.wait(0.5);
+				sleeping.cas(1, 0);
+				continue;
+			}
+			idle = 0;
+			batch.clear();
+			int n = 0;
+			while (!empty() && n < records.length())
+			{
+				LogRecord& r = records[head & mask];
+				if (floor(r.time.time()) != second) // timestamps have 1 s resolution
+				{
+					second = floor(r.time.time());
+					stamp = String(0, "[%s]", *Date(second).toString());
+				}
+				if (r.toConsole)
+				{
+					if (r.color != Console::COLOR_DEFAULT)
+						console.color(r.color);
+					printf("%s%s", *stamp, *r.line);
+					if (r.color != Console::COLOR_DEFAULT)
+						console.color();
+				}
+				if (r.toFile)
+					batch << stamp << r.line;
+				r.seq += records.length() - 1;
+				head = int(unsigned(head) + 1);
+				n++;
+			}
+			int lost = unreported;
+			if (lost > 0 && policy == Log::DROP_REPORT)
+			{
+				unreported += -lost;
+				batch << String(0, "[%s][Log] WARNING: %i messages dropped\n", *Date::now().toString(), lost);
+			}
+			if (batch.length() > 0)
+				writeFile(batch);
+			Lock _(mutex);
+			written += n;
+			doneWriting.signal();
+		}
+		file.close();
+	}
+
+	void writeFile(const String& text)
+	{
+		String logfile;
+		{
+			Lock _(*Log::instance()->_mutex);
+			logfile = Log::instance()->_logfile;
+		}
+		if (logfile != filename || !file)
+		{
+			file.close();
+			filename = logfile;
+			fileSize = max(TextFile(filename).size(), (Long)0);
+		}
+		if (fileSize > ASL_LOG_MAX_SIZE)
+		{
+			file.close();
+			rotateLog(filename);
+			fileSize = 0;
+		}
+		if (!file && !file.open(filename, File::APPEND))
+			return;
+		file.write(text);
+		file.flush();
+		fileSize += text.length();
+	}
+
+	void flush()
+	{
+		int target = tail;
+		wake();
+		Lock _(mutex);
+		while (seqDiff(written, target) < 0 && !finished())
+			doneWriting.wait(0.1);
+	}
+
+	void stop()
+	{
+		quit = true;
+		wakeup.post();
+		join();
+	}
+};
+
+/*
+Threads using the queue (to push messages, flush or count drops) are counted in `_queueUsers`. To replace the queue,
+setAsync() makes that count negative, which makes new users wait, and waits for the current ones to leave.
+*/
+
+struct LogQueueRef
+{
+	Log* log;
+	LogQueue* queue;
+	LogQueueRef(Log* l) : log(l)
+	{
+		while (++log->_queueUsers <= 0)
+		{
+			--log->_queueUsers;
+			sleep(0.0001);
+		}
+		queue = log->_queue;
+	}
+	~LogQueueRef()
+	{
+		--log->_queueUsers;
+	}
+};
+
 Log::Log()
 {
 	_logfile = "log.log";
@@ -23,19 +264,63 @@ Log::Log()
 	_usefile = true;
 	_maxLevel = 3;
 	_mutex = new Mutex;
+	_queue = 0;
 }
 
 Log::~Log()
 {
+	if (_queue)
+	{
+		_queue->stop();
+		delete _queue;
+	}
 	delete _mutex;
 }
 
 void Log::setFile(const String& file)
 {
-	Log::instance()->_logfile = file;
+	{
+		Lock _(*Log::instance()->_mutex);
+		Log::instance()->_logfile = file;
+	}
 	Log::instance()->storeState();
 }
 
+void Log::setAsync(bool on, int queueSize, Overflow policy)
+{
+	static Mutex switching;
+	Lock _(switching);
+	Log* log = Log::instance();
+	log->_queueUsers += -ASL_LOG_SWITCHING;
+	while (!log->_queueUsers.cas(-ASL_LOG_SWITCHING, -ASL_LOG_SWITCHING)) // users that got the queue finish pushing
+		sleep(0.0001);
+	if (log->_queue)
+	{
+		log->_queue->stop();
+		delete log->_queue;
+		log->_queue = 0;
+	}
+	if (on)
+	{
+		log->_queue = new LogQueue(queueSize, policy);
+		log->_queue->start();
+	}
+	log->_queueUsers += ASL_LOG_SWITCHING;
+}
+
+void Log::flush()
+{
+	LogQueueRef ref(Log::instance());
+	if (ref.queue)
+		ref.queue->flush();
+}
+
+int Log::dropped()
+{
+	LogQueueRef ref(Log::instance());
+	return ref.queue ? (int)ref.queue->dropped : 0;
+}
+
 void Log::enable(bool on)
 {
 	if ((!on && Log::instance()->_maxLevel < 0) || (on && Log::instance()->_maxLevel >= 0))
@@ -137,20 +422,6 @@ void Log::log(const String& cat, Log::Level level, const String& message)
 	String catg = cat.substring(i0, i1);
 	bool useconsole = _useconsole;
 
-	Lock lock(*_mutex);
-
-#ifndef __ANDROID_API__
-	String logfile = _logfile;
-	if (_usefile && TextFile(logfile).size() > ASL_LOG_MAX_SIZE)
-	{
-		Path   path = logfile;
-		String oldfile = path.noExt() + "-1." + path.extension();
-		if (File(oldfile).exists())
-			Directory::remove(oldfile);
-		Directory::move(logfile, oldfile);
-	}
-#endif
-
 	const char* slevel = "";
 	Console::Color color = Console::COLOR_DEFAULT;
 
@@ -174,13 +445,30 @@ void Log::log(const String& cat, Log::Level level, const String& message)
 		break;
 	}
 
-	if (useconsole && color != Console::COLOR_DEFAULT)
-		console.color(color);
-
-	String line(0, "[%s][%s] %s%s\n", *now.toString(), *catg, slevel, *message);
+	String text(0, "[%s] %s%s\n", *catg, slevel, *message);
 
 	if (message.endsWith('\n'))
-		line.resize(line.length() - 1);
+		text.resize(text.length() - 1);
+
+	{
+		LogQueueRef ref(this);
+		if (ref.queue) // the timestamp is formatted by the writer thread
+		{
+			ref.queue->push(now, text, color, useconsole, _usefile);
+			return;
+		}
+	}
+
+	String line = '[' + now.toString() + ']' + text;
+
+	Lock lock(*_mutex);
+
+	String logfile = _logfile;
+	if (_usefile && TextFile(logfile).size() > ASL_LOG_MAX_SIZE)
+		rotateLog(logfile);
+
+	if (useconsole && color != Console::COLOR_DEFAULT)
+		console.color(color);
 
 	if (_usefile)
 		TextFile(_logfile).append(line);
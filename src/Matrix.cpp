@@ -0,0 +1,325 @@
+#include <asl/Matrix.h>
+#include <asl/Thread.h>
+#include <stdlib.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define ASL_MAT_AVX2 __attribute__((target("avx2,fma")))
+#define ASL_MAT_AVX2_RUNTIME
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define ASL_MAT_AVX2
+#endif
+
+namespace asl {
+
+/*
+Matrix product C += alpha * A * B, as in BLIS/GotoBLAS: B is copied in panels of KC x NC and A in blocks of MC x KC,
+rearranged so that a micro-kernel reads them sequentially while it keeps an MR x NR tile of C in registers. Blocks of
+A stay in L2 cache and slivers of B in L1 while they are reused. Packing also makes the kernel independent of the
+strides of A and B (so products with transposed operands cost the same) and pads partial tiles with zeros.
+
+The micro-kernel uses AVX2 and FMA when the CPU has them (chosen at run time with GCC and Clang), otherwise plain
+loops that the compiler vectorizes for the baseline instruction set.
+*/
+
+static bool matrixParallel = false;
+
+void setMatrixParallel(bool on)
+{
+	matrixParallel = on;
+}
+
+template<class T>
+struct GemmShape;
+
+template<>
+struct GemmShape<double>
+{
+	enum { MR = 6, NR = 8, KC = 256, MC = 96, NC = 2048 };
+};
+
+template<>
+struct GemmShape<float>
+{
+	enum { MR = 6, NR = 16, KC = 256, MC = 96, NC = 2048 };
+};
+
+// copies rows [0, m) x cols [0, k) of A into MR-row slivers, column by column
+
+template<class T>
+static void packA(int m, int k, const T* a, int ars, int acs, T* p)
+{
+	const int MR = GemmShape<T>::MR;
+	for (int i0 = 0; i0 < m; i0 += MR)
+	{
+		int mr = min(MR, m - i0);
+		for (int l = 0; l < k; l++)
+		{
+			const T* src = a + i0 * ars + l * acs;
+			for (int i = 0; i < mr; i++)
+				p[i] = src[i * ars];
+			for (int i = mr; i < MR; i++)
+				p[i] = 0;
+			p += MR;
+		}
+	}
+}
+
+// copies rows [0, k) x cols [0, n) of B into NR-column slivers, row by row
+
+template<class T>
+static void packB(int k, int n, const T* b, int brs, int bcs, T* p)
+{
+	const int NR = GemmShape<T>::NR;
+	for (int j0 = 0; j0 < n; j0 += NR)
+	{
+		int nr = min(NR, n - j0);
+		for (int l = 0; l < k; l++)
+		{
+			const T* src = b + l * brs + j0 * bcs;
+			if (bcs == 1 && nr == NR)
+				memcpy(p, src, NR * sizeof(T));
+			else
+			{
+				for (int j = 0; j < nr; j++)
+					p[j] = src[j * bcs];
+				for (int j = nr; j < NR; j++)
+					p[j] = 0;
+			}
+			p += NR;
+		}
+	}
+}
+
+template<class T>
+static void kernelPlain(int k, const T* a, const T* b, T* c, int ldc, T alpha, int mr, int nr)
+{
+	const int MR = GemmShape<T>::MR, NR = GemmShape<T>::NR;
+	T acc[MR][NR];
+	for (int i = 0; i < MR; i++)
+		for (int j = 0; j < NR; j++)
+			acc[i][j] = 0;
+	for (int l = 0; l < k; l++, a += MR, b += NR)
+		for (int i = 0; i < MR; i++)
+			for (int j = 0; j < NR; j++)
+				acc[i][j] += a[i] * b[j];
+	for (int i = 0; i < mr; i++)
+		for (int j = 0; j < nr; j++)
+			c[i * ldc + j] += alpha * acc[i][j];
+}
+
+#ifdef ASL_MAT_AVX2
+
+ASL_MAT_AVX2 static void kernelAvx2(int k, const double* a, const double* b, double* c, int ldc, double alpha, int mr, int nr)
+{
+	__m256d c00 = _mm256_setzero_pd(), c01 = c00, c10 = c00, c11 = c00, c20 = c00, c21 = c00,
+		c30 = c00, c31 = c00, c40 = c00, c41 = c00, c50 = c00, c51 = c00;
+	for (int l = 0; l < k; l++, a += 6, b += 8)
+	{
+		__m256d b0 = _mm256_loadu_pd(b), b1 = _mm256_loadu_pd(b + 4);
+		__m256d x = _mm256_broadcast_sd(a);
+		c00 = _mm256_fmadd_pd(x, b0, c00); c01 = _mm256_fmadd_pd(x, b1, c01);
+		x = _mm256_broadcast_sd(a + 1);
+		c10 = _mm256_fmadd_pd(x, b0, c10); c11 = _mm256_fmadd_pd(x, b1, c11);
+		x = _mm256_broadcast_sd(a + 2);
+		c20 = _mm256_fmadd_pd(x, b0, c20); c21 = _mm256_fmadd_pd(x, b1, c21);
+		x = _mm256_broadcast_sd(a + 3);
+		c30 = _mm256_fmadd_pd(x, b0, c30); c31 = _mm256_fmadd_pd(x, b1, c31);
+		x = _mm256_broadcast_sd(a + 4);
+		c40 = _mm256_fmadd_pd(x, b0, c40); c41 = _mm256_fmadd_pd(x, b1, c41);
+		x = _mm256_broadcast_sd(a + 5);
+		c50 = _mm256_fmadd_pd(x, b0, c50); c51 = _mm256_fmadd_pd(x, b1, c51);
+	}
+	__m256d acc[6][2] = { { c00, c01 }, { c10, c11 }, { c20, c21 }, { c30, c31 }, { c40, c41 }, { c50, c51 } };
+	__m256d s = _mm256_set1_pd(alpha);
+	if (nr == 8)
+	{
+		for (int i = 0; i < mr; i++)
+		{
+			double* ci = c + i * ldc;
+			_mm256_storeu_pd(ci, _mm256_fmadd_pd(s, acc[i][0], _mm256_loadu_pd(ci)));
+			_mm256_storeu_pd(ci + 4, _mm256_fmadd_pd(s, acc[i][1], _mm256_loadu_pd(ci + 4)));
+		}
+		return;
+	}
+	double t[8];
+	for (int i = 0; i < mr; i++)
+	{
+		_mm256_storeu_pd(t, acc[i][0]);
+		_mm256_storeu_pd(t + 4, acc[i][1]);
+		for (int j = 0; j < nr; j++)
+			c[i * ldc + j] += alpha * t[j];
+	}
+}
+
+ASL_MAT_AVX2 static void kernelAvx2(int k, const float* a, const float* b, float* c, int ldc, float alpha, int mr, int nr)
+{
+	__m256 c00 = _mm256_setzero_ps(), c01 = c00, c10 = c00, c11 = c00, c20 = c00, c21 = c00,
+		c30 = c00, c31 = c00, c40 = c00, c41 = c00, c50 = c00, c51 = c00;
+	for (int l = 0; l < k; l++, a += 6, b += 16)
+	{
+		__m256 b0 = _mm256_loadu_ps(b), b1 = _mm256_loadu_ps(b + 8);
+		__m256 x = _mm256_broadcast_ss(a);
+		c00 = _mm256_fmadd_ps(x, b0, c00); c01 = _mm256_fmadd_ps(x, b1, c01);
+		x = _mm256_broadcast_ss(a + 1);
+		c10 = _mm256_fmadd_ps(x, b0, c10); c11 = _mm256_fmadd_ps(x, b1, c11);
+		x = _mm256_broadcast_ss(a + 2);
+		c20 = _mm256_fmadd_ps(x, b0, c20); c21 = _mm256_fmadd_ps(x, b1, c21);
+		x = _mm256_broadcast_ss(a + 3);
+		c30 = _mm256_fmadd_ps(x, b0, c30); c31 = _mm256_fmadd_ps(x, b1, c31);
+		x = _mm256_broadcast_ss(a + 4);
+		c40 = _mm256_fmadd_ps(x, b0, c40); c41 = _mm256_fmadd_ps(x, b1, c41);
+		x = _mm256_broadcast_ss(a + 5);
+		c50 = _mm256_fmadd_ps(x, b0, c50); c51 = _mm256_fmadd_ps(x, b1, c51);
+	}
+	__m256 acc[6][2] = { { c00, c01 }, { c10, c11 }, { c20, c21 }, { c30, c31 }, { c40, c41 }, { c50, c51 } };
+	__m256 s = _mm256_set1_ps(alpha);
+	if (nr == 16)
+	{
+		for (int i = 0; i < mr; i++)
+		{
+			float* ci = c + i * ldc;
+			_mm256_storeu_ps(ci, _mm256_fmadd_ps(s, acc[i][0], _mm256_loadu_ps(ci)));
+			_mm256_storeu_ps(ci + 8, _mm256_fmadd_ps(s, acc[i][1], _mm256_loadu_ps(ci + 8)));
+		}
+		return;
+	}
+	float t[16];
+	for (int i = 0; i < mr; i++)
+	{
+		_mm256_storeu_ps(t, acc[i][0]);
+		_mm256_storeu_ps(t + 8, acc[i][1]);
+		for (int j = 0; j < nr; j++)
+			c[i * ldc + j] += alpha * t[j];
+	}
+}
+
+static bool hasAvx2()
+{
+#ifdef ASL_MAT_AVX2_RUNTIME
+	static int avx2 = -1;
+	if (avx2 < 0)
+	{
+		__builtin_cpu_init();
+		avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	}
+	return avx2 != 0;
+#else
+	return true;
+#endif
+}
+#endif
+
+template<class T>
+static void gemmSerial(int m, int n, int k, T alpha, const T* a, int ars, int acs, const T* b, int brs, int bcs, T* c, int ldc)
+{
+	typedef GemmShape<T> S;
+#ifdef ASL_MAT_AVX2
+	bool avx2 = hasAvx2();
+#endif
+	// buffers for packed blocks, aligned to 64 bytes
+	int nc = min((int)S::NC, (n + S::NR - 1) / S::NR * S::NR), kc = min((int)S::KC, k);
+	int mc = min((int)S::MC, (m + S::MR - 1) / S::MR * S::MR);
+	char* mem = (char*)malloc((kc * (nc + mc)) * sizeof(T) + 128);
+	T* bp = (T*)(((size_t)mem + 63) & ~(size_t)63);
+	T* ap = (T*)(((size_t)(bp + kc * nc) + 63) & ~(size_t)63);
+
+	for (int j0 = 0; j0 < n; j0 += S::NC)
+	{
+		int nb = min((int)S::NC, n - j0);
+		for (int l0 = 0; l0 < k; l0 += S::KC)
+		{
+			int kb = min((int)S::KC, k - l0);
+			packB(kb, nb, b + l0 * brs + j0 * bcs, brs, bcs, bp);
+			for (int i0 = 0; i0 < m; i0 += S::MC)
+			{
+				int mb = min((int)S::MC, m - i0);
+				packA(mb, kb, a + i0 * ars + l0 * acs, ars, acs, ap);
+				for (int jr = 0; jr < nb; jr += S::NR)
+				{
+					const T* bs = bp + jr * kb;
+					int nr = min((int)S::NR, nb - jr);
+					for (int ir = 0; ir < mb; ir += S::MR)
+					{
+						const T* as = ap + ir * kb;
+						int mr = min((int)S::MR, mb - ir);
+						T* cij = c + (i0 + ir) * ldc + j0 + jr;
+#ifdef ASL_MAT_AVX2
+						if (avx2)
+							kernelAvx2(kb, as, bs, cij, ldc, alpha, mr, nr);
+						else
+#endif
+							kernelPlain(kb, as, bs, cij, ldc, alpha, mr, nr);
+					}
+				}
+			}
+		}
+	}
+	free(mem);
+}
+
+template<class T>
+struct GemmTask : public ParallelTask
+{
+	int m, n, k, ars, acs, brs, bcs, ldc;
+	T alpha;
+	const T* a, * b;
+	T* c;
+	void run(int i0, int i1)
+	{
+		int r0 = i0 * GemmShape<T>::MC, r1 = min(m, i1 * GemmShape<T>::MC);
+		gemmSerial(r1 - r0, n, k, alpha, a + r0 * ars, ars, acs, b, brs, bcs, c + r0 * ldc, ldc);
+	}
+};
+
+template<class T>
+static void gemm(int m, int n, int k, T alpha, const T* a, int ars, int acs, const T* b, int brs, int bcs, T* c, int ldc)
+{
+	if (m <= 0 || n <= 0 || k <= 0)
+		return;
+	if ((double)m * n * k < 24 * 24 * 24) // packing does not pay off for small products
+	{
+		for (int i = 0; i < m; i++)
+		{
+			T* ci = c + i * ldc;
+			for (int l = 0; l < k; l++)
+			{
+				T f = alpha * a[i * ars + l * acs];
+				const T* bl = b + l * brs;
+				if (bcs == 1)
+					for (int j = 0; j < n; j++)
+						ci[j] += f * bl[j];
+				else
+					for (int j = 0; j < n; j++)
+						ci[j] += f * bl[j * bcs];
+			}
+		}
+		return;
+	}
+	int blocks = (m + GemmShape<T>::MC - 1) / GemmShape<T>::MC;
+	if (matrixParallel && blocks > 1 && (double)m * n * k > 1e6)
+	{
+		GemmTask<T> task;
+		task.m = m; task.n = n; task.k = k;
+		task.alpha = alpha;
+		task.a = a; task.ars = ars; task.acs = acs;
+		task.b = b; task.brs = brs; task.bcs = bcs;
+		task.c = c; task.ldc = ldc;
+		parallelRun(task, 0, blocks, 1);
+		return;
+	}
+	gemmSerial(m, n, k, alpha, a, ars, acs, b, brs, bcs, c, ldc);
+}
+
+void matMulAdd(int m, int n, int k, float alpha, const float* a, int ars, int acs, const float* b, int brs, int bcs, float* c, int ldc)
+{
+	gemm(m, n, k, alpha, a, ars, acs, b, brs, bcs, c, ldc);
+}
+
+void matMulAdd(int m, int n, int k, double alpha, const double* a, int ars, int acs, const double* b, int brs, int bcs, double* c, int ldc)
+{
+	gemm(m, n, k, alpha, a, ars, acs, b, brs, bcs, c, ldc);
+}
+
+}
@@ -1,35 +1,48 @@
 #include <asl/Process.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <asl/Path.h>
+#include <asl/time.h>
+
+#define ASL_PIPE_BLOCK 65536
 
 namespace asl {
 
+/*
+Jobs of a Processes set: they wait in a queue until they can start, then their output is collected until both pipes
+are closed and the process has exited (on Linux, then waiting on a pidfd if it has not exited yet, -2 if not opened).
+*/
+
+struct ProcessJob
+{
+	String command;
+	Array<String> args;
+	Processes::Callback done;
+	Process* process;
+	bool outOpen, errOpen;
+	int pidfd;
+};
+
+struct ProcessesState
+{
+	Array<ProcessJob*> queued, running;
+	int maxRunning;
+};
+
+static void endJob(ProcessJob* job)
+{
+	job->done(*job->process);
+	delete job->process;
+	delete job;
+}
+
 Process Process::execute(const String& command, const Array<String>& args)
 {
 	Process p;
 	p.run(command, args);
-	int n, i = 0;
-	char buffer[8000];
-	while (p.running())
-	{
-		sleep((i++)%16 == 0 ? 0.001 : 0);
-		if (p.outputAvailable() > 0)
-		{
-			n = p.readOutput(buffer, sizeof(buffer));
-			p._output.append(buffer, n);
-		}
-		if (p.errorsAvailable() > 0)
-		{
-			n = p.readErrors(buffer, sizeof(buffer));
-			p._errors.append(buffer, n);
-		}
-	}
-	while (n = p.readOutput(buffer, sizeof(buffer)), n > 0)
-		p._output.append(buffer, n);
-	while (n = p.readErrors(buffer, sizeof(buffer)), n > 0)
-		p._errors.append(buffer, n);
-	p._exitstat = p.exitStatus();
+	p.closeInput();
+	p.collectOutput();
 	return p;
 }
 
@@ -41,6 +54,7 @@ Process::Process(const Process& p) : _output(p._output), _errors(p._errors)
 	_ok = p._hasExited;
 	_ready = false;
 	_detached = p._detached;
+	_obeg = _oend = 0;
 #ifdef _WIN32
 	_hProcess = NULL;
 #endif
@@ -52,24 +66,61 @@ Process::Process(const Process& p) : _output(p._output), _errors(p._errors)
 
 String Process::readOutputLine()
 {
-	char c;
 	String line;
-	int n;
-	while ((n = readOutput(&c, 1)) > 0)
+	while (true)
 	{
-		if (c == '\n') {
-			if (line[line.length() - 1] == '\r')
+		const char* p = (const char*)_obuf.data() + _obeg;
+		int n = _oend - _obeg;
+		const char* end = (const char*)memchr(p, '\n', n);
+		if (end)
+		{
+			line.append(p, int(end - p));
+			_obeg += int(end - p) + 1;
+			if (line.length() > 0 && line[line.length() - 1] == '\r')
 				line.resize(line.length() - 1);
-			break;
+			return line;
 		}
-		line << c;
+		line.append(p, n);
+		if (_obuf.length() == 0)
+			_obuf.resize(4096);
+		_obeg = _oend = 0;
+		n = readPipe(_stdout, _obuf.data(), _obuf.length());
+		if (n <= 0)
+			break;
+		_oend = n;
 	}
-	if (n <= 0 && line.length() == 0) {
+	if (line.length() == 0)
 		line = '\n';
-	}
 	return line;
 }
 
+int Process::readOutput(void* p, int n)
+{
+	if (_obeg < _oend)
+	{
+		n = min(n, _oend - _obeg);
+		memcpy(p, _obuf.data() + _obeg, n);
+		_obeg += n;
+		return n;
+	}
+	return readPipe(_stdout, p, n);
+}
+
+int Process::readErrors(void* p, int n)
+{
+	return readPipe(_stderr, p, n);
+}
+
+int Process::outputAvailable()
+{
+	return (_oend - _obeg) + pipeAvailable(_stdout);
+}
+
+int Process::errorsAvailable()
+{
+	return pipeAvailable(_stderr);
+}
+
 String Process::myDir()
 {
 	return Path(myPath()).directory().string();
@@ -80,6 +131,67 @@ void Process::ignoreOutput()
 	_detached = true;
 }
 
+Processes::Processes() : _s(new ProcessesState)
+{
+	_s->maxRunning = 64;
+}
+
+// processes still running are left alone, but their pipes are closed
+
+Processes::~Processes()
+{
+	foreach(ProcessJob* job, _s->queued)
+		delete job;
+	foreach(ProcessJob* job, _s->running)
+	{
+		delete job->process;
+		delete job;
+	}
+	delete _s;
+}
+
+void Processes::setMaxRunning(int n)
+{
+	_s->maxRunning = max(n, 1);
+}
+
+int Processes::length() const
+{
+	return _s->queued.length() + _s->running.length();
+}
+
+void Processes::execute(const String& command, const Array<String>& args, const Callback& done)
+{
+	ProcessJob* job = new ProcessJob;
+	job->command = command;
+	job->args = args.clone();
+	job->done = done;
+	job->process = NULL;
+	job->outOpen = job->errOpen = false;
+	job->pidfd = -2;
+	_s->queued << job;
+}
+
+void Processes::start()
+{
+	ProcessesState& st = *_s;
+	while (st.queued.length() > 0 && st.running.length() < st.maxRunning)
+	{
+		ProcessJob* job = st.queued[0];
+		st.queued.remove(0);
+		job->process = new Process;
+		job->process->run(job->command, job->args);
+		job->process->closeInput();
+		if (!job->process->ready())
+		{
+			endJob(job);
+			continue;
+		}
+		job->outOpen = job->errOpen = true;
+		st.running << job;
+	}
+}
+
 }
 
 #ifdef _WIN32
@@ -137,6 +249,7 @@ namespace asl {
 
 	Process::Process()
 	{
+		_obeg = _oend = 0;
 	    _pipe_err[0] = 0;
 	    _pipe_err[1] = 0;
 	    _pipe_in[0] = 0;
@@ -173,7 +286,8 @@ namespace asl {
 				CloseHandle(_pipe_out[1]);
 				CloseHandle(_pipe_err[1]);
 			}
-			CloseHandle(_pipe_in[1]);
+			if (_pipe_in[1])
+				CloseHandle(_pipe_in[1]);
 			CloseHandle(_pipe_out[0]);
 			CloseHandle(_pipe_err[0]);
 		}
@@ -263,49 +377,111 @@ namespace asl {
 		_stdin = _pipe_in[1];
 	}
 
-	int Process::outputAvailable()
-	{
-		if (!_ready)
-			return 0;
-		DWORD n;
-		return PeekNamedPipe(_stdout, 0, 0, 0, &n, 0) ? n : 0;
-	}
-
-	int Process::errorsAvailable()
+	int Process::pipeAvailable(HANDLE h)
 	{
 		if (!_ready)
 			return 0;
 		DWORD n;
-		return PeekNamedPipe(_stderr, 0, 0, 0, &n, 0) ? n : 0;
+		return PeekNamedPipe(h, 0, 0, 0, &n, 0) ? n : 0;
 	}
 
-	int Process::readOutput(void* p, int n)
+	int Process::readPipe(HANDLE h, void* p, int n)
 	{
 		if(!_ready)
 			return 0;
 		DWORD read;
-		int ok = ReadFile(_stdout, p, n, &read, NULL);
-		return ok? read : -1;
-	}
-
-	int Process::readErrors(void* p, int n)
-	{
-		if(!_ready)
-			return 0;
-		DWORD  read;
-		int ok = ReadFile(_stderr, p, n, &read, NULL);
+		int ok = ReadFile(h, p, n, &read, NULL);
 		return ok? read : -1;
 	}
 
 	int Process::writeInput(const void* p, int n)
 	{
-		if(!_ready)
+		if(!_ready || !_stdin)
 			return 0;
 		DWORD written;
 		WriteFile(_stdin, p, n, &written, NULL);
 		return written;
 	}
 
+	void Process::closeInput()
+	{
+		if (!_ready || !_pipe_in[1])
+			return;
+		CloseHandle(_pipe_in[1]);
+		_pipe_in[1] = _stdin = 0;
+	}
+
+	// anonymous pipes cannot be waited on together with the process, so output is collected by polling here;
+	// appends what can be read now, or all until the pipe is closed if `all`
+
+	static bool readInto(HANDLE h, String& s, bool all)
+	{
+		bool any = false;
+		DWORD n = 0;
+		while (all || (PeekNamedPipe(h, 0, 0, 0, &n, 0) && n > 0))
+		{
+			int len = s.length();
+			if (s.cap() - len < ASL_PIPE_BLOCK)
+				s.resize(len + 4 * ASL_PIPE_BLOCK, true, false);
+			DWORD got = 0;
+			DWORD size = all ? (DWORD)(s.cap() - len - 1) : min((DWORD)(s.cap() - len - 1), n);
+			if (!ReadFile(h, s.data() + len, size, &got, NULL) || got == 0)
+				break;
+			s.data()[len + got] = '\0';
+			s.fix(len + got);
+			any = true;
+		}
+		return any;
+	}
+
+	void Process::collectOutput()
+	{
+		if (!_ready || _pid == -1)
+			return;
+		while (!finished())
+		{
+			bool any = readInto(_stdout, _output, false);
+			any = readInto(_stderr, _errors, false) || any;
+			if (!any)
+				sleep(0.001);
+		}
+		readInto(_stdout, _output, true);
+		readInto(_stderr, _errors, true);
+	}
+
+	int Processes::wait(double timeout)
+	{
+		ProcessesState& st = *_s;
+		double end = now() + timeout;
+		while (true)
+		{
+			start();
+			if (length() == 0)
+				break;
+			bool any = false;
+			for (int i = st.running.length() - 1; i >= 0; i--)
+			{
+				ProcessJob* job = st.running[i];
+				Process& p = *job->process;
+				any = readInto(p._stdout, p._output, false) || any;
+				any = readInto(p._stderr, p._errors, false) || any;
+				if (p._pid == -1 || p.finished())
+				{
+					readInto(p._stdout, p._output, true);
+					readInto(p._stderr, p._errors, true);
+					st.running.remove(i);
+					endJob(job);
+					any = true;
+				}
+			}
+			if (timeout >= 0 && now() >= end)
+				break;
+			if (!any)
+				sleep(0.001);
+		}
+		return length();
+	}
+
 	void Process::signal(int)
 	{
 		//kill(_pid, s);
@@ -357,6 +533,12 @@ namespace asl {
 #include <sys/ioctl.h>
 #include <unistd.h>
 #include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 #ifdef __APPLE__
 #include <mach-o/dyld.h>
 #include <limits.h>
@@ -390,11 +572,20 @@ Process::Process()
 	_hasExited = false;
 	_ready = false;
 	_pid = -1;
+	_exitstat = 0;
 	_detached = false;
+	_obeg = _oend = 0;
 	if(pipe(_pipe_in)==-1 || pipe(_pipe_out)==-1 || pipe(_pipe_err)==-1)
 	{
 		return;
 	}
+	// not inherited by other subprocesses started later (dup2 clears the flag for the child's own ends)
+	for (int i = 0; i < 2; i++)
+	{
+		fcntl(_pipe_in[i], F_SETFD, FD_CLOEXEC);
+		fcntl(_pipe_out[i], F_SETFD, FD_CLOEXEC);
+		fcntl(_pipe_err[i], F_SETFD, FD_CLOEXEC);
+	}
 	_stdin = _pipe_in[1];
 	_stdout = _pipe_out[0];
 	_stderr = _pipe_err[0];
@@ -404,12 +595,15 @@ Process::Process()
 Process::~Process()
 {
 	if (_ready) {
-		close(_pipe_in[0]);
-		close(_pipe_out[0]);
-		close(_pipe_err[0]);
-		close(_pipe_in[1]);
-		close(_pipe_out[1]);
-		close(_pipe_err[1]);
+		for (int i = 0; i < 2; i++)
+		{
+			if (_pipe_in[i] >= 0)
+				close(_pipe_in[i]);
+			if (_pipe_out[i] >= 0)
+				close(_pipe_out[i]);
+			if (_pipe_err[i] >= 0)
+				close(_pipe_err[i]);
+		}
 	}
 }
 
@@ -537,45 +731,182 @@ void Process::run(const String& command, const Array<String>& args)
 			close(_pipe_in[0]);
 			close(_pipe_out[1]);
 			close(_pipe_err[1]);
+			_pipe_in[0] = _pipe_out[1] = _pipe_err[1] = -1;
 		}
 	}
 }
 
-int Process::outputAvailable()
+int Process::pipeAvailable(int h)
 {
 	if (!_ready)
 		return 0;
 	long n;
-	return (ioctl(_stdout, FIONREAD, &n) == 0) ? (int)n : 0;
+	return (ioctl(h, FIONREAD, &n) == 0) ? (int)n : 0;
 }
 
-int Process::errorsAvailable()
+int Process::readPipe(int h, void* p, int n)
 {
-	if (!_ready)
+	if(!_ready)
 		return 0;
-	long n;
-	return (ioctl(_stderr, FIONREAD, &n) == 0) ? (int)n : 0;
+	return read(h, p, n);
 }
 
-int Process::readOutput(void* p, int n)
+int Process::writeInput(const void* p, int n)
 {
-	if(!_ready)
+	if(!_ready || _stdin < 0)
 		return 0;
-	return read(_stdout, p, n);
+	return write(_stdin, p, n);
 }
 
-int Process::readErrors(void* p, int n)
+void Process::closeInput()
 {
-	if(!_ready)
-		return 0;
-	return read(_stderr, p, n);
+	if (!_ready || _pipe_in[1] < 0)
+		return;
+	close(_pipe_in[1]);
+	_pipe_in[1] = _stdin = -1;
 }
 
-int Process::writeInput(const void* p, int n)
+// reads what is available in a pipe directly at the end of a string, returns 0 at the end
+
+static int readInto(int fd, String& s)
 {
-	if(!_ready)
-		return 0;
-	return write(_stdin, p, n);
+	int len = s.length();
+	if (s.cap() - len < ASL_PIPE_BLOCK)
+		s.resize(len + 4 * ASL_PIPE_BLOCK, true, false);
+	int n;
+	do
+		n = (int)read(fd, s.data() + len, s.cap() - len - 1);
+	while (n < 0 && errno == EINTR);
+	if (n > 0)
+	{
+		s.data()[len + n] = '\0';
+		s.fix(len + n);
+	}
+	return n;
+}
+
+static int openPidfd(int pid)
+{
+#if defined(__linux__) && defined(SYS_pidfd_open)
+	return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+	return -1;
+#endif
+}
+
+void Process::collectOutput()
+{
+	if (!_ready)
+		return;
+	if (!_detached)
+	{
+		pollfd fds[2];
+		fds[0].fd = _stdout;
+		fds[1].fd = _stderr;
+		fds[0].events = fds[1].events = POLLIN;
+		while (fds[0].fd >= 0 || fds[1].fd >= 0)
+		{
+			if (::poll(fds, 2, -1) < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+			for (int k = 0; k < 2; k++)
+			{
+				if (fds[k].fd >= 0 && fds[k].revents && readInto(fds[k].fd, k == 0 ? _output : _errors) <= 0)
+					fds[k].fd = -1; // ignored by poll()
+			}
+		}
+	}
+	wait();
+}
+
+/*
+Waits on all open pipes and, for processes whose pipes are closed but have not exited yet (rare), on their pidfds.
+Without pidfds those are checked every few milliseconds (a SIGCHLD handler would affect the whole application).
+*/
+
+int Processes::wait(double timeout)
+{
+	ProcessesState& st = *_s;
+	double end = now() + timeout;
+	Array<pollfd> fds;
+	Array<int> owners;
+	while (true)
+	{
+		start();
+		if (st.running.length() == 0)
+			break;
+		fds.clear();
+		owners.clear();
+		bool exitPending = false;
+		for (int i = 0; i < st.running.length(); i++)
+		{
+			ProcessJob* job = st.running[i];
+			pollfd p;
+			p.events = POLLIN;
+			p.revents = 0;
+			if (job->outOpen)
+			{
+				p.fd = job->process->_stdout;
+				fds << p;
+				owners << i;
+			}
+			if (job->errOpen)
+			{
+				p.fd = job->process->_stderr;
+				fds << p;
+				owners << i;
+			}
+			if (!job->outOpen && !job->errOpen)
+			{
+				if (job->pidfd >= 0)
+				{
+					p.fd = job->pidfd;
+					fds << p;
+					owners << i;
+				}
+				else
+					exitPending = true;
+			}
+		}
+		int ms = timeout < 0 ? -1 : max(0, (int)((end - now()) * 1000 + 0.5));
+		if (exitPending)
+			ms = ms < 0 ? 5 : min(ms, 5);
+		if (::poll(fds.data(), fds.length(), ms) < 0 && errno != EINTR)
+			break;
+		for (int k = 0; k < fds.length(); k++)
+		{
+			if (!fds[k].revents)
+				continue;
+			ProcessJob* job = st.running[owners[k]];
+			Process& p = *job->process;
+			if (fds[k].fd == p._stdout && job->outOpen)
+				job->outOpen = readInto(fds[k].fd, p._output) > 0;
+			else if (fds[k].fd == p._stderr && job->errOpen)
+				job->errOpen = readInto(fds[k].fd, p._errors) > 0;
+		}
+		for (int i = st.running.length() - 1; i >= 0; i--)
+		{
+			ProcessJob* job = st.running[i];
+			if (job->outOpen || job->errOpen)
+				continue;
+			if (!job->process->finished())
+			{
+				if (job->pidfd == -2)
+					job->pidfd = openPidfd(job->process->_pid);
+				continue;
+			}
+			if (job->pidfd >= 0)
+				::close(job->pidfd);
+			st.running.remove(i);
+			endJob(job);
+		}
+		if (timeout >= 0 && now() >= end)
+			break;
+	}
+	return length();
 }
 
 void Process::signal(int s)
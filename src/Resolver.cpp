@@ -0,0 +1,284 @@
+// Copyright(c) 1999-2024 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+#include <asl/Resolver.h>
+#include <asl/Thread.h>
+#include <asl/time.h>
+#include <string.h>
+
+namespace asl {
+
+/*
+A name being resolved has a pending record, found by name, until the query ends. Threads calling the blocking lookup
+for that name wait for it to be done, and asynchronous requests add their callbacks to it. The record is deleted
+when the query ends, or by the last blocking waiter to wake up.
+
+Asynchronous queries are queued for a few worker threads that are started on demand and live as long as the
+resolver (the shared one is never destroyed, as its workers may be sleeping at exit).
+*/
+
+struct ResolverPending
+{
+	Array<InetAddress> addrs;
+	Array<Resolver::Callback*> callbacks;
+	int waiters;
+	bool done;
+	ResolverPending() : waiters(0), done(false) {}
+};
+
+class ResolverWorker : public Thread
+{
+	Resolver& _resolver;
+public:
+	ResolverWorker(Resolver& r) : _resolver(r) {}
+	void run()
+	{
+		String host;
+		while (_resolver.nextJob(host))
+			_resolver.query(host);
+	}
+};
+
+// addresses given to callers are copies, as InetAddress copies share their data (and callers may change the port)
+
+static Array<InetAddress> copyOf(const Array<InetAddress>& addrs)
+{
+	Array<InetAddress> copy(addrs.length());
+	for (int i = 0; i < addrs.length(); i++)
+	{
+		InetAddress a(addrs[i].type());
+		a.resize(addrs[i].length());
+		memcpy(a.ptr(), addrs[i].ptr(), addrs[i].length());
+		copy[i] = a;
+	}
+	return copy;
+}
+
+Resolver::Resolver()
+{
+	_done.use(_mutex);
+	_work.use(_mutex);
+	_ttl = 60;
+	_negativeTtl = 5;
+	_maxEntries = 1024;
+	_maxThreads = 4;
+	_idle = 0;
+	_queries = 0;
+	_stop = false;
+}
+
+Resolver::~Resolver()
+{
+	_mutex.lock();
+	_stop = true;
+	_work.signal();
+	_mutex.unlock();
+	foreach (ResolverWorker* worker, _workers)
+	{
+		worker->join();
+		delete worker;
+	}
+	foreach2 (String& host, ResolverPending* pending, _pending)
+	{
+		(void)host;
+		foreach (Callback* callback, pending->callbacks)
+			delete callback;
+		delete pending;
+	}
+}
+
+Resolver& Resolver::shared()
+{
+	static Resolver* resolver = new Resolver;
+	return *resolver;
+}
+
+void Resolver::setTTL(double positive, double negative)
+{
+	Lock _(_mutex);
+	_ttl = positive;
+	_negativeTtl = negative;
+}
+
+void Resolver::setCacheSize(int n)
+{
+	Lock _(_mutex);
+	_maxEntries = max(n, 1);
+}
+
+void Resolver::setMaxThreads(int n)
+{
+	Lock _(_mutex);
+	_maxThreads = max(n, 1);
+}
+
+void Resolver::setBackend(const Backend& backend)
+{
+	Lock _(_mutex);
+	_backend = backend;
+	_cache.clear();
+}
+
+void Resolver::clear()
+{
+	Lock _(_mutex);
+	_cache.clear();
+}
+
+bool Resolver::isCached(const String& host)
+{
+	Array<InetAddress> addrs;
+	Lock _(_mutex);
+	return cached(host.toLowerCase(), addrs);
+}
+
+bool Resolver::cached(const String& host, Array<InetAddress>& addrs)
+{
+	Entry* entry = _cache.find(host);
+	if (!entry)
+		return false;
+	if (entry->expires < now())
+	{
+		_cache.remove(host);
+		return false;
+	}
+	addrs = copyOf(entry->addrs);
+	return true;
+}
+
+Array<InetAddress> Resolver::lookup(const String& name)
+{
+	Array<InetAddress> addrs = InetAddress::resolve(name, true);
+	if (addrs.length() > 0 || !name.ok())
+		return addrs;
+	String host = name.toLowerCase();
+	_mutex.lock();
+	if (cached(host, addrs))
+	{
+		_mutex.unlock();
+		return addrs;
+	}
+	ResolverPending** found = _pending.find(host);
+	if (found)
+	{
+		ResolverPending* pending = *found;
+		pending->waiters++;
+		while (!pending->done)
+			_done.wait(0.5);
+		addrs = copyOf(pending->addrs);
+		if (--pending->waiters == 0)
+			delete pending;
+		_mutex.unlock();
+		return addrs;
+	}
+	_pending[host] = new ResolverPending;
+	_queries++;
+	_mutex.unlock();
+	return query(host);
+}
+
+void Resolver::lookup(const String& name, const Callback& callback)
+{
+	Callback f = callback;
+	Array<InetAddress> addrs = InetAddress::resolve(name, true);
+	if (addrs.length() > 0 || !name.ok())
+	{
+		f(addrs);
+		return;
+	}
+	String host = name.toLowerCase();
+	_mutex.lock();
+	if (cached(host, addrs))
+	{
+		_mutex.unlock();
+		f(addrs);
+		return;
+	}
+	ResolverPending** found = _pending.find(host);
+	ResolverPending* pending = found ? *found : NULL;
+	if (!pending)
+	{
+		pending = new ResolverPending;
+		_pending[host] = pending;
+		_queries++;
+		_jobs << host;
+		if (_idle == 0 && _workers.length() < _maxThreads)
+		{
+			ResolverWorker* worker = new ResolverWorker(*this);
+			_workers << worker;
+			worker->start();
+		}
+		_work.signal();
+	}
+	pending->callbacks << new Callback(f);
+	_mutex.unlock();
+}
+
+bool Resolver::nextJob(String& host)
+{
+	Lock _(_mutex);
+	while (_jobs.length() == 0 && !_stop)
+	{
+		_idle++;
+		_work.wait(0.5);
+		_idle--;
+	}
+	if (_stop)
+		return false;
+	host = _jobs[0];
+	_jobs.remove(0);
+	return true;
+}
+
+Array<InetAddress> Resolver::resolve(const String& host)
+{
+	return _backend ? _backend(host) : InetAddress::resolve(host);
+}
+
+// runs a query for a name already registered as pending, then stores the result and notifies those waiting for it
+
+Array<InetAddress> Resolver::query(const String& host)
+{
+	Array<InetAddress> addrs = resolve(host);
+	Array<Callback*> callbacks;
+	_mutex.lock();
+	double ttl = addrs.length() > 0 ? _ttl : _negativeTtl;
+	if (ttl > 0)
+	{
+		if (_cache.length() >= _maxEntries)
+		{
+			double t = now();
+			Array<String> expired;
+			foreach2 (String& name, Entry& entry, _cache)
+			{
+				if (entry.expires < t)
+					expired << name;
+			}
+			foreach (String& name, expired)
+				_cache.remove(name);
+			if (_cache.length() >= _maxEntries)
+				_cache.clear();
+		}
+		Entry& entry = _cache[host];
+		entry.addrs = copyOf(addrs);
+		entry.expires = now() + ttl;
+	}
+	ResolverPending* pending = _pending[host];
+	_pending.remove(host);
+	pending->addrs = copyOf(addrs);
+	pending->done = true;
+	callbacks = pending->callbacks;
+	if (pending->waiters == 0)
+		delete pending;
+	_done.signal();
+	_mutex.unlock();
+
+	foreach (Callback* callback, callbacks)
+	{
+		(*callback)(copyOf(addrs));
+		delete callback;
+	}
+	return addrs;
+}
+
+}
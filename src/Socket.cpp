@@ -14,15 +14,25 @@ struct IUnknown; // Workaround for "combaseapi.h(229): error C2187: syntax error
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <netinet/in.h>
 #include <netdb.h>
 #include <sys/wait.h>
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+#endif
+#ifdef __linux__
+#include <sys/sendfile.h>
 #endif
 
 #include <stdio.h>
 #include <string.h>
 #include <asl/Socket.h>
+#include <asl/Resolver.h>
+#include <asl/File.h>
+#include <asl/time.h>
 
 #ifndef ASL_NOEXCEPT
 #define NET_ERROR(o) throw SocketException()
@@ -41,6 +51,8 @@ struct IUnknown; // Workaround for "combaseapi.h(229): error C2187: syntax error
 #define MSG_NOSIGNAL 0
 #endif
 
+#define SOCKET_BUFFER_SIZE 16384
+
 static void verbose_print(...) {}
 //#define verbose_print printf
 
@@ -74,46 +86,31 @@ static const char* messages[] = {
 Sockets& Sockets::operator<<(Socket& s)
 {
 	set << s;
+	_poller->add(s, SocketPoller::READ);
 	return *this;
 }
 
 int Sockets::waitInput(double t)
 {
-	fd_set rset;
-	struct timeval to;
-	to.tv_sec = (int)floor(t);
-	to.tv_usec = (int)((t-floor(t))*1e6);
-	FD_ZERO(&rset);
-	int m=0;
-	for(int i=0; i<set.length(); i++)
+	// sockets may have been read outside this loop, leaving data in their buffers
+	foreach(Socket& s, set)
 	{
-		if (set[i].handle() < 0)
-			return -1;
-		if (set[i].handle() > m) m = set[i].handle();
-		FD_SET(set[i].handle(), &rset);
-	}
-	int r=select(m+1, &rset, 0, 0, &to);
-	if(r<0)
-		return -1;
-	changed.clear();
-	for (int j = 0; j < set.length(); j++) {
-		if (set[j].handle() < 0)
-			return -1;
-		if (FD_ISSET(set[j].handle(), &rset))
-			changed << set[j];
+		if (s._()->buffered() > 0)
+			_poller->add(s, SocketPoller::READ);
 	}
-	return changed.length();
+	return _poller->wait(t);
 }
 
 bool Sockets::hasInput(const Socket& s)
 {
-	return set.contains(s);
+	return _poller->isReady(s);
 }
 
 void Sockets::close()
 {
 	foreach(Socket& s, set)
 	{
+		_poller->remove(s);
 		s.close();
 	}
 }
@@ -235,6 +232,11 @@ bool InetAddress::operator==(const InetAddress& a) const
 }
 
 Array<InetAddress> InetAddress::lookup(const String& host)
+{
+	return Resolver::shared().lookup(host);
+}
+
+Array<InetAddress> InetAddress::resolve(const String& host, bool numeric)
 {
 #ifdef _WIN32
 	if (!g_wsaStarted) startWSA();
@@ -245,7 +247,7 @@ Array<InetAddress> InetAddress::lookup(const String& host)
 	memset(&hints, 0, sizeof(struct addrinfo));
 	hints.ai_family = host.contains(':') ? AF_INET6 : AF_TYPE;
 	hints.ai_socktype = 0;
-	hints.ai_flags = 0;
+	hints.ai_flags = numeric ? AI_NUMERICHOST : 0;
 	hints.ai_protocol = 0;
 	hints.ai_canonname = NULL;
 	hints.ai_addr = NULL;
@@ -253,7 +255,8 @@ Array<InetAddress> InetAddress::lookup(const String& host)
 
 	int s = getaddrinfo(host, NULL, &hints, &info);
 	if (s != 0) {
-		verbose_print("Cannot resolve %s\n", *host);
+		if (!numeric)
+			verbose_print("Cannot resolve %s\n", *host);
 		return addresses;
 	}
 	for (const struct addrinfo* ai = info; ai != NULL; ai = ai->ai_next) {
@@ -277,47 +280,16 @@ Array<InetAddress> InetAddress::lookup(const String& host)
 
 bool InetAddress::set(const String& host, int port)
 {
-#ifdef _WIN32
-	if (!g_wsaStarted) startWSA();
-#endif
 	if (host.ok())
 	{
-		addrinfo hints, *info;
-		memset(&hints, 0, sizeof(addrinfo));
-		hints.ai_family = host.contains(':') ? AF_INET6 : AF_TYPE;
-		hints.ai_socktype = SOCK_STREAM;
-		hints.ai_flags = 0;
-		hints.ai_protocol = 0;
-		hints.ai_canonname = NULL;
-		hints.ai_addr = NULL;
-		hints.ai_next = NULL;
-
-		int s = getaddrinfo(host, NULL, &hints, &info);
-		if (s != 0 || !info) {
+		Array<InetAddress> addrs = lookup(host);
+		if (addrs.length() == 0) {
 			printf("Cannot resolve %s\n", *host);
 			_data.clear();
 			return false;
 		}
-		const addrinfo* inf = info;
-		for (addrinfo* ai = info; ai != NULL; ai = ai->ai_next) {
-			if (ai->ai_family == AF_INET) {
-				inf = ai;
-				break;
-			}
-		}
-		_data.resize((int)inf->ai_addrlen);
-		memcpy(_data.data(), inf->ai_addr, inf->ai_addrlen);
-		if (inf->ai_family == AF_INET)
-		{
-			((sockaddr_in*)_data.data())->sin_port = htons(port);
-			_type = IPv4;
-		}
-		else if (inf->ai_family == AF_INET6)
-		{
-			((sockaddr_in6*)_data.data())->sin6_port = htons(port);
-			_type = IPv6;
-		}
-		freeaddrinfo(info);
+		*this = addrs[0]; // IPv4 addresses come first
+		setPort(port);
 	}
 	else {
 		_data.resize(sizeof(sockaddr_in));
@@ -396,6 +368,7 @@ Socket_::Socket_()
 	_type = TCP;
 	_blocking = true;
 	_endian = ENDIAN_NATIVE;
+	_rbeg = _rend = 0;
 }
 
 Socket_::Socket_(int fd)
@@ -406,6 +379,7 @@ Socket_::Socket_(int fd)
 	_type = TCP;
 	_blocking = true;
 	_endian = ENDIAN_NATIVE;
+	_rbeg = _rend = 0;
 }
 
 Socket_::~Socket_()
@@ -434,6 +408,7 @@ void Socket_::close()
 	closesocket(_handle);
 #endif
 	_handle = -1;
+	_rbeg = _rend = 0;
 }
 
 bool Socket_::bind(const String& name)
@@ -460,8 +435,9 @@ bool Socket_::bind(const String& ip, int port)
 	if (here.length() == 0)
 		return false;
 
-	init(_family != here.type());
+	bool force = _family != here.type();
 	_family = here.type();
+	init(force);
 	if (!setOption(SOL_SOCKET, SO_REUSEADDR, 1))
 		return false;
 
@@ -493,11 +469,126 @@ bool Socket::connect(const String& host, int port)
 	}
 	_()->_hostname = host;
 	for (int i = 0; i < addrs.length(); i++)
+		addrs[i].setPort(port);
+	return _()->connect(addrs);
+}
+
+#if defined(ASL_IPV6) && !defined(_WIN32)
+
+/*
+Happy eyeballs (RFC 8305): attempts alternate address families, starting with the family of the first address, and a
+new attempt starts every 250 ms while previous ones are pending (or at once when one fails). The first socket to
+connect is returned, in blocking mode, and the others are closed.
+*/
+
+static int connectRace(const Array<InetAddress>& addrs, InetAddress::Type& family)
+{
+	Array<InetAddress> first, second, order;
+	for (int i = 0; i < addrs.length(); i++)
+		(addrs[i].type() == addrs[0].type() ? first : second) << addrs[i];
+	for (int i = 0; i < max(first.length(), second.length()); i++)
 	{
-		if (connect(addrs[i].setPort(port)))
+		if (i < first.length())
+			order << first[i];
+		if (i < second.length())
+			order << second[i];
+	}
+
+	Array<pollfd> fds;
+	Array<int> types;
+	int next = 0, fd = -1;
+	double nextStart = 0;
+	while (fd < 0 && (next < order.length() || fds.length() > 0))
+	{
+		if (next < order.length() && now() >= nextStart)
+		{
+			const InetAddress& a = order[next++];
+			int s = (int)socket(sockfamily(a.type()), SOCK_STREAM, 0);
+			if (s < 0)
+				continue;
+			fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+			if (::connect(s, (sockaddr*)a.ptr(), a.length()) == 0)
+			{
+				fd = s;
+				family = a.type();
+				break;
+			}
+			if (errno != EINPROGRESS)
+			{
+				::close(s);
+				continue;
+			}
+			pollfd p;
+			p.fd = s;
+			p.events = POLLOUT;
+			p.revents = 0;
+			fds << p;
+			types << a.type();
+			nextStart = now() + 0.25;
+			continue;
+		}
+		int ms = next < order.length() ? max(0, (int)((nextStart - now()) * 1000) + 1) : -1;
+		int n = poll(fds.data(), fds.length(), ms);
+		if (n < 0 && errno != EINTR)
+			break;
+		for (int i = fds.length() - 1; i >= 0 && n > 0; i--)
+		{
+			if (!fds[i].revents)
+				continue;
+			int err = 0;
+			socklen_t len = sizeof(err);
+			if (getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0 && fd < 0)
+			{
+				fd = fds[i].fd;
+				family = (InetAddress::Type)types[i];
+			}
+			else
+			{
+				::close(fds[i].fd);
+				nextStart = 0;
+			}
+			fds.remove(i);
+			types.remove(i);
+		}
+	}
+	for (int i = 0; i < fds.length(); i++)
+		::close(fds[i].fd);
+	if (fd >= 0)
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+	return fd;
+}
+
+#endif
+
+bool Socket_::connect(const Array<InetAddress>& addrs)
+{
+#if defined(ASL_IPV6) && !defined(_WIN32)
+	bool mixed = false;
+	for (int i = 1; i < addrs.length(); i++)
+		if (addrs[i].type() != addrs[0].type())
+			mixed = true;
+	if (mixed && _type == TCP)
+	{
+		InetAddress::Type family;
+		int fd = connectRace(addrs, family);
+		if (fd < 0)
+		{
+			_error = SOCKET_BAD_CONNECT;
+			return false;
+		}
+		Socket_::close();
+		_handle = fd;
+		_family = family;
+		_error = 0;
+		return true;
+	}
+#endif
+	for (int i = 0; i < addrs.length(); i++)
+	{
+		if (connect(addrs[i]))
 			return true;
 	}
-	_()->_error = SOCKET_BAD_CONNECT;
+	_error = SOCKET_BAD_CONNECT;
 	return false;
 }
 
@@ -555,54 +646,124 @@ int Socket_::available()
 	unsigned long n;
 	if (ioctlsocket(_handle, FIONREAD, &n) == 0)
 #endif
-		return (int)n;
+		return (int)n + buffered();
 	else
 		return -1;
 }
 
+bool Socket_::fill()
+{
+	if (_rbeg == _rend)
+		_rbeg = _rend = 0;
+	else if (_rbeg > 0 && _rend == _rbuf.length())
+	{
+		memmove(_rbuf.data(), _rbuf.data() + _rbeg, _rend - _rbeg);
+		_rend -= _rbeg;
+		_rbeg = 0;
+	}
+	if (_rend == _rbuf.length())
+		_rbuf.resize(max(SOCKET_BUFFER_SIZE, 2 * _rbuf.length()));
+	int n = recv(_rbuf.data() + _rend, _rbuf.length() - _rend);
+	if (n <= 0)
+	{
+		if (_blocking)
+			_error = SOCKET_BAD_RECV;
+		return false;
+	}
+	_rend += n;
+	return true;
+}
+
 String Socket_::readLine()
 {
-	char c;
-	String s;
-	if (available()>0 || waitInput()) {
-		while (1) {
-			int n = read(&c, 1);
-			if (n <= 0 || c == '\n' || _error != 0)
-				break;
-			if (s.length() > 16000) {
-				_error = SOCKET_BAD_LINE;
-				s = "";
+	return readUntil("\n", 16000);
+}
+
+String Socket_::readUntil(const String& delim, int maxLength)
+{
+	int m = delim.length();
+	if (m == 0 || !(available() > 0 || waitInput()))
+		return String();
+	int from = 0;
+	while (1)
+	{
+		const char* p = (const char*)_rbuf.data() + _rbeg;
+		int n = buffered();
+		while (from <= n - m)
+		{
+			const char* q = (const char*)memchr(p + from, delim[0], n - m + 1 - from);
+			if (!q)
 				break;
+			int i = int(q - p);
+			if (memcmp(q, *delim, m) == 0)
+			{
+				_rbeg += i + m;
+				return String(p, i);
 			}
-			s += c;
+			from = i + 1;
+		}
+		from = max(0, n - m + 1);
+		if (n > maxLength)
+		{
+			_error = SOCKET_BAD_LINE;
+			_rbeg = _rend;
+			return String();
+		}
+		if (_error != 0 || !fill())
+		{
+			p = (const char*)_rbuf.data() + _rbeg;
+			n = buffered();
+			_rbeg = _rend;
+			return String(p, n);
 		}
 	}
-	return s;
 }
 
-int Socket_::read(void* data, int size)
+ByteArray Socket_::peek(int n)
+{
+	while (buffered() < n && _error == 0 && fill()) {}
+	return ByteArray(_rbuf.data() + _rbeg, min(n, buffered()));
+}
+
+int Socket_::recv(void* data, int size)
 {
-		int s = 0, size0 = size;
-		do
-		{
 #ifdef _WIN32
-		int n = recv(_handle, (char*)data, size, 0);
+	return ::recv(_handle, (char*)data, size, 0);
 #else
-		int n = ::read(_handle, (char*)data, size);
+	return (int)::read(_handle, (char*)data, size);
 #endif
-		if (!_blocking)
-			return n;
-			if (n <= 0)
-			{
+}
+
+int Socket_::read(void* data, int size)
+{
+	int s = min(buffered(), size);
+	if (s > 0)
+	{
+		memcpy(data, _rbuf.data() + _rbeg, s);
+		_rbeg += s;
+	}
+	if (!_blocking)
+		return s > 0 ? s : recv(data, size);
+	while (s < size)
+	{
+		int n = 0;
+		if (size - s >= SOCKET_BUFFER_SIZE) // large reads go directly to the destination
+			n = recv((char*)data + s, size - s);
+		else if (fill())
+		{
+			n = min(buffered(), size - s);
+			memcpy((char*)data + s, _rbuf.data() + _rbeg, n);
+			_rbeg += n;
+		}
+		if (n <= 0)
+		{
 			_error = SOCKET_BAD_RECV;
 			break;
 		}
-		data = (char*)data + n;
 		s += n;
-		size -= n;
-		} while (s < size0);
-	return s;
 	}
+	return s;
+}
 
 int Socket_::write(const void* data, int size)
 {
@@ -630,6 +791,116 @@ int Socket_::write(const void* data, int size)
 	return s;
 }
 
+int Socket_::write(const SocketSpan* spans, int n)
+{
+	enum { MAX_SPANS = 64 };
+	int total = 0;
+	while (n > 0)
+	{
+		int m = min(n, (int)MAX_SPANS), size = 0;
+#ifdef _WIN32
+		WSABUF bufs[MAX_SPANS];
+		for (int i = 0; i < m; i++)
+		{
+			bufs[i].buf = (char*)spans[i].data;
+			bufs[i].len = spans[i].length;
+			size += spans[i].length;
+		}
+		DWORD sent = 0;
+		int r = WSASend(_handle, bufs, m, &sent, 0, NULL, NULL);
+		int k = r == 0 ? (int)sent : -1;
+#else
+		iovec bufs[MAX_SPANS];
+		for (int i = 0; i < m; i++)
+		{
+			bufs[i].iov_base = (void*)spans[i].data;
+			bufs[i].iov_len = spans[i].length;
+			size += spans[i].length;
+		}
+		msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = bufs;
+		msg.msg_iovlen = m;
+		int k = (int)::sendmsg(_handle, &msg, MSG_NOSIGNAL);
+#endif
+		if (k < 0)
+		{
+			_error = SOCKET_BAD_DATA;
+			return total;
+		}
+		total += k;
+		if (k < size) // partial write: send the rest of the spans normally
+		{
+			if (!_blocking)
+				return total;
+			for (int i = 0; i < m; i++)
+			{
+				if (k >= spans[i].length)
+				{
+					k -= spans[i].length;
+					continue;
+				}
+				int w = spans[i].length - k;
+				if (write((const char*)spans[i].data + k, w) != w)
+					return total;
+				total += w;
+				k = 0;
+			}
+		}
+		spans += m;
+		n -= m;
+	}
+	return total;
+}
+
+Long Socket_::sendFile(File& file, Long offset, Long n)
+{
+#ifdef __linux__
+	if (_type != PACKET && file.stdio())
+	{
+		int fd = fileno(file.stdio());
+		off_t pos = (off_t)offset;
+		Long sent = 0;
+		while (sent < n)
+		{
+			ssize_t k = ::sendfile(_handle, fd, &pos, (size_t)min(n - sent, (Long)(1 << 30)));
+			if (k < 0 && errno == EINTR)
+				continue;
+			if (k < 0 && sent == 0 && (errno == EINVAL || errno == ENOSYS)) // file type not supported
+				return copyFile(file, offset, n);
+			if (k <= 0)
+			{
+				if (k < 0)
+					_error = SOCKET_BAD_DATA;
+				break;
+			}
+			sent += k;
+		}
+		return sent;
+	}
+#endif
+	return copyFile(file, offset, n);
+}
+
+Long Socket_::copyFile(File& file, Long offset, Long n)
+{
+	ByteArray buffer((int)min(n, (Long)SOCKET_BUFFER_SIZE * 4));
+	file.seek(offset);
+	Long sent = 0;
+	while (sent < n)
+	{
+		int k = file.read(buffer.data(), (int)min(n - sent, (Long)buffer.length()));
+		if (k <= 0)
+			break;
+		int w = write(buffer.data(), k);
+		if (w > 0)
+			sent += w;
+		if (w != k)
+			break;
+	}
+	return sent;
+}
+
 ByteArray Socket_::read(int n)
 {
 	ByteArray a((n < 0) ? available() : n);
@@ -660,6 +931,15 @@ bool Socket_::waitInput(double t)
 		_error = SOCKET_BAD_DATA;
 		return true;
 	}
+#ifndef _WIN32
+	pollfd pfd;
+	pfd.fd = handle();
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	int r = poll(&pfd, 1, (int)(t * 1000));
+	if (r >= 0)
+		return r > 0;
+#else
 	fd_set rset;
 	struct timeval to;
 	to.tv_sec = (int)floor(t);
@@ -668,6 +948,7 @@ bool Socket_::waitInput(double t)
 	FD_SET(handle(), &rset);
 	if(select(handle()+1, &rset, 0, 0, &to) >= 0)
 		return FD_ISSET(handle(), &rset)!=0;
+#endif
 	_error = SOCKET_BAD_WAIT;
 	return true;
 }
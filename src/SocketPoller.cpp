@@ -0,0 +1,314 @@
+// Copyright(c) 1999-2024 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+#ifdef _WIN32
+#define FD_SETSIZE 4096
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+struct IUnknown; // Workaround for "combaseapi.h(229): error C2187: syntax error: 'identifier' was unexpected here" when using /permissive-
+#include <winsock2.h>
+#elif defined(__linux__)
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <errno.h>
+#define ASL_EPOLL
+#else
+#include <poll.h>
+#include <errno.h>
+#endif
+
+#include <asl/Socket.h>
+#include <asl/HashMap.h>
+
+namespace asl {
+
+/*
+Registered sockets are kept in slots (reused when freed), found by handle in a hash map. With epoll, the slot number
+is stored with the descriptor, so ready sockets are found directly from the events returned.
+*/
+
+struct SocketPollerSlot
+{
+	Socket socket;
+	int handle;
+	int events; // registered interest, 0 if the slot is free
+	int round;  // last wait() in which it was reported
+	int pos;    // its position in the ready list of that wait()
+	SocketPollerSlot() : socket((Socket::Ptr)NULL), handle(-1), events(0), round(0), pos(0) {}
+};
+
+struct SocketPollerState
+{
+	Array<SocketPollerSlot> slots;
+	Array<int> freeSlots;
+	HashMap<int, int> index;
+	Array<int> readySlots, lastSlots;
+	Array<int> bufferedSlots; // added with data already buffered, checked in the next wait()
+	Array<int> readyEvents;
+	Array<Socket> readySockets;
+	int round;
+#ifdef ASL_EPOLL
+	int fd;
+	Array<epoll_event> events;
+#elif !defined(_WIN32)
+	Array<pollfd> fds; // rebuilt when sockets are added or removed
+	Array<int> fdSlots;
+	bool dirty;
+#endif
+
+	// marks slot i as ready for events e in this round, merging with a previous report in the same round
+	void report(int i, int e)
+	{
+		SocketPollerSlot& slot = slots[i];
+		if (!e)
+			return;
+		if (slot.round == round)
+		{
+			readyEvents[slot.pos] |= e;
+			return;
+		}
+		slot.round = round;
+		slot.pos = readySlots.length();
+		readySlots << i;
+		readyEvents << e;
+		readySockets << slot.socket;
+	}
+};
+
+#ifdef ASL_EPOLL
+
+static unsigned epollEvents(int events)
+{
+	return (events & SocketPoller::READ ? (unsigned)(EPOLLIN | EPOLLRDHUP) : 0u) |
+		(events & SocketPoller::WRITE ? (unsigned)EPOLLOUT : 0u) | (events & SocketPoller::EDGE ? (unsigned)EPOLLET : 0u);
+}
+
+#endif
+
+SocketPoller::SocketPoller() : _s(new SocketPollerState)
+{
+	_s->round = 0;
+#ifdef ASL_EPOLL
+	_s->fd = epoll_create1(EPOLL_CLOEXEC);
+#elif !defined(_WIN32)
+	_s->dirty = false;
+#endif
+}
+
+SocketPoller::~SocketPoller()
+{
+#ifdef ASL_EPOLL
+	if (_s->fd >= 0)
+		::close(_s->fd);
+#endif
+	delete _s;
+}
+
+bool SocketPoller::add(const Socket& s, int events)
+{
+	int handle = s.handle();
+	if (handle < 0 || !(events & (READ | WRITE)))
+		return false;
+	int* found = _s->index.find(handle);
+	int i;
+	if (found)
+		i = *found;
+	else if (_s->freeSlots.length() > 0)
+	{
+		i = _s->freeSlots.last();
+		_s->freeSlots.removeLast();
+	}
+	else
+	{
+		i = _s->slots.length();
+		_s->slots.resize(i + 1);
+	}
+	SocketPollerSlot& slot = _s->slots[i];
+#ifdef ASL_EPOLL
+	// a registered socket may have been closed (dropped by epoll) and its handle reused
+	epoll_event ev;
+	ev.events = epollEvents(events);
+	ev.data.u64 = (unsigned)i;
+	int op = found ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+	if (epoll_ctl(_s->fd, op, handle, &ev) != 0)
+	{
+		if (errno != (found ? ENOENT : EEXIST) ||
+			epoll_ctl(_s->fd, found ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, handle, &ev) != 0)
+		{
+			if (!found)
+				_s->freeSlots << i;
+			return false;
+		}
+	}
+#elif !defined(_WIN32)
+	_s->dirty = true;
+#endif
+	slot.socket = s;
+	slot.handle = handle;
+	slot.events = events;
+	if (!found)
+		_s->index[handle] = i;
+	if ((events & READ) && s._()->buffered() > 0)
+		_s->bufferedSlots << i;
+	return true;
+}
+
+bool SocketPoller::remove(const Socket& s)
+{
+	int handle = s.handle();
+	int* found = _s->index.find(handle);
+	if (!found)
+		return false;
+	int i = *found;
+#ifdef ASL_EPOLL
+	epoll_event ev;
+	epoll_ctl(_s->fd, EPOLL_CTL_DEL, handle, &ev);
+#elif !defined(_WIN32)
+	_s->dirty = true;
+#endif
+	_s->index.remove(handle);
+	SocketPollerSlot& slot = _s->slots[i];
+	slot.socket = Socket((Socket::Ptr)NULL);
+	slot.handle = -1;
+	slot.events = 0;
+	_s->freeSlots << i;
+	return true;
+}
+
+bool SocketPoller::isReady(const Socket& s) const
+{
+	const int* i = _s->index.find(s.handle());
+	return i && _s->slots[*i].round == _s->round;
+}
+
+bool SocketPoller::has(const Socket& s) const
+{
+	return _s->index.has(s.handle());
+}
+
+int SocketPoller::length() const
+{
+	return _s->index.length();
+}
+
+int SocketPoller::wait(double timeout)
+{
+	SocketPollerState& st = *_s;
+	st.round++;
+
+	// data already read into a socket buffer does not make it ready again, so those reported last time and those
+	// added with buffered data are checked
+
+	Array<int> last = st.readySlots;
+	st.readySlots = st.lastSlots;
+	st.lastSlots = last;
+	st.readySlots.clear();
+	st.readyEvents.clear();
+	st.readySockets.clear();
+	for (int k = 0; k < last.length() + st.bufferedSlots.length(); k++)
+	{
+		int i = k < last.length() ? last[k] : st.bufferedSlots[k - last.length()];
+		SocketPollerSlot& slot = st.slots[i];
+		if ((slot.events & READ) && slot.socket._()->buffered() > 0)
+			st.report(i, READ);
+	}
+	st.bufferedSlots.clear();
+	if (st.readySlots.length() > 0)
+		timeout = 0;
+	int ms = timeout < 0 ? -1 : (int)(timeout * 1000 + 0.5);
+
+#ifdef ASL_EPOLL
+	st.events.resize(clamp(st.slots.length(), 16, 1024));
+	int n = epoll_wait(st.fd, st.events.data(), st.events.length(), ms);
+	if (n < 0)
+		return errno == EINTR ? st.readySlots.length() : -1;
+	for (int k = 0; k < n; k++)
+	{
+		int i = (int)st.events[k].data.u64;
+		unsigned ev = st.events[k].events;
+		if (i >= st.slots.length() || st.slots[i].events == 0)
+			continue;
+		int e = (ev & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR) ? READ : 0) |
+			(ev & (EPOLLOUT | EPOLLHUP | EPOLLERR) ? WRITE : 0);
+		st.report(i, e & st.slots[i].events);
+	}
+#elif defined(_WIN32)
+	fd_set rset, wset;
+	FD_ZERO(&rset);
+	FD_ZERO(&wset);
+	int count = 0;
+	for (int i = 0; i < st.slots.length(); i++)
+	{
+		SocketPollerSlot& slot = st.slots[i];
+		if (slot.events & READ)
+			FD_SET(slot.handle, &rset);
+		if (slot.events & WRITE)
+			FD_SET(slot.handle, &wset);
+		if (slot.events)
+			count++;
+	}
+	if (count == 0)
+	{
+		Sleep(ms < 0 ? INFINITE : ms);
+		return st.readySlots.length();
+	}
+	struct timeval to;
+	to.tv_sec = ms / 1000;
+	to.tv_usec = (ms % 1000) * 1000;
+	int n = select(0, &rset, &wset, 0, ms < 0 ? NULL : &to);
+	if (n < 0)
+		return -1;
+	for (int i = 0; i < st.slots.length() && n > 0; i++)
+	{
+		SocketPollerSlot& slot = st.slots[i];
+		if (!slot.events)
+			continue;
+		int e = (FD_ISSET(slot.handle, &rset) ? READ : 0) | (FD_ISSET(slot.handle, &wset) ? WRITE : 0);
+		st.report(i, e);
+	}
+#else
+	if (st.dirty)
+	{
+		st.fds.clear();
+		st.fdSlots.clear();
+		for (int i = 0; i < st.slots.length(); i++)
+		{
+			SocketPollerSlot& slot = st.slots[i];
+			if (!slot.events)
+				continue;
+			pollfd p;
+			p.fd = slot.handle;
+			p.events = (slot.events & READ ? POLLIN : 0) | (slot.events & WRITE ? POLLOUT : 0);
+			st.fds << p;
+			st.fdSlots << i;
+		}
+		st.dirty = false;
+	}
+	for (int k = 0; k < st.fds.length(); k++)
+		st.fds[k].revents = 0;
+	int n = poll(st.fds.data(), st.fds.length(), ms);
+	if (n < 0)
+		return errno == EINTR ? st.readySlots.length() : -1;
+	for (int k = 0; k < st.fds.length() && n > 0; k++)
+	{
+		short ev = st.fds[k].revents;
+		if (!ev)
+			continue;
+		int i = st.fdSlots[k];
+		int e = (ev & (POLLIN | POLLHUP | POLLERR) ? READ : 0) | (ev & (POLLOUT | POLLHUP | POLLERR) ? WRITE : 0);
+		st.report(i, e & st.slots[i].events);
+	}
+#endif
+	return st.readySlots.length();
+}
+
+Socket& SocketPoller::ready(int i)
+{
+	return _s->readySockets[i];
+}
+
+int SocketPoller::events(int i) const
+{
+	return _s->readyEvents[i];
+}
+
+}
@@ -1,10 +1,17 @@
 #include <asl/SocketServer.h>
 #include <asl/Thread.h>
+#include <asl/HashMap.h>
 #ifdef ASL_TLS
 #include <asl/TlsSocket.h>
 #endif
 #include <stdio.h>
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#define ASL_SOCKET_REACTOR
+#endif
+
 namespace asl {
 
 struct SockClientThread : public Thread
@@ -15,14 +22,13 @@ struct SockClientThread : public Thread
 	SockClientThread(SocketServer* svr, const Socket& cli):
 		_server(svr), _client(cli)
 	{
-		start();
+		startDetached();
 	}
 	void run()
 	{
 		_server->serve(_client);
 		_client.close();
 		--_server->_numClients;
-		delete this;
 	}
 };
 
@@ -40,11 +46,215 @@ struct SockServerThread : public Thread
 	}
 };
 
+#ifdef ASL_SOCKET_REACTOR
+
+/*
+Event-driven engine: one epoll loop watches the listening sockets and all client connections (registered as
+one-shot, so a connection is never handed to two workers at once) and a fixed pool of workers serves the ones
+that become readable, then re-arms them.
+*/
+
+struct SockReactor
+{
+	struct Worker : public Thread
+	{
+		SockReactor* _reactor;
+		Worker(SockReactor* r) : _reactor(r) {}
+		void run() { _reactor->work(); }
+	};
+
+	SocketServer* _server;
+	int _epoll;
+	HashMap<int, int> _listeners; // listening fd -> index in _server->_sockets
+	HashMap<int, Socket> _clients;
+	Array<int> _queue;
+	int _head;
+	Array<Worker*> _workers;
+	Mutex _mutex;
+	Semaphore _ready;
+	bool _quit;
+
+	SockReactor(SocketServer* svr) : _server(svr), _clients(4096), _head(0), _quit(false)
+	{
+		_epoll = epoll_create1(EPOLL_CLOEXEC);
+	}
+
+	~SockReactor()
+	{
+		if (_epoll >= 0)
+			::close(_epoll);
+	}
+
+	bool watch(int fd, bool add)
+	{
+		epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+		ev.data.fd = fd;
+		return epoll_ctl(_epoll, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev) == 0;
+	}
+
+	void push(int fd)
+	{
+		_queue << fd;
+		_ready.post();
+	}
+
+	int pop()
+	{
+		int fd = _queue[_head++];
+		if (_head == _queue.length()) {
+			_queue.clear();
+			_head = 0;
+		}
+		else if (_head > 1024 && _head > _queue.length() / 2) {
+			_queue.remove(0, _head);
+			_head = 0;
+		}
+		return fd;
+	}
+
+	void add(Socket& client)
+	{
+		int fd = client.handle();
+		if (fd < 0)
+			return;
+		{
+			Lock _(_mutex);
+			_clients[fd] = client;
+		}
+		++_server->_numClients;
+		if (!watch(fd, true))
+			remove(fd, client);
+	}
+
+	void remove(int fd, Socket& client)
+	{
+		if (client.handle() >= 0)
+			epoll_ctl(_epoll, EPOLL_CTL_DEL, client.handle(), NULL);
+		{
+			Lock _(_mutex);
+			Socket* c = _clients.find(fd);
+			if (!c || !(*c == client)) // the fd may have been reused by a new connection if the handler closed it
+				return;
+			_clients.remove(fd);
+		}
+		_server->clientClosed(client);
+		--_server->_numClients;
+	}
+
+	void work()
+	{
+		while (true)
+		{
+			_ready.wait();
+			int fd;
+			Socket client((Socket::Ptr)NULL);
+			{
+				Lock _(_mutex);
+				if (_quit)
+					return;
+				fd = pop();
+				Socket* c = _clients.find(fd);
+				if (!c)
+					continue;
+				client = *c;
+			}
+			bool keep = !client.disconnected() && _server->serveInput(client);
+			if (keep && client.handle() == fd && !client.error() && !_server->_requestStop)
+			{
+				if (client.available() > 0) { // data already buffered, no readiness event will come for it
+					Lock _(_mutex);
+					push(fd);
+					continue;
+				}
+				if (watch(fd, false))
+					continue;
+			}
+			remove(fd, client);
+		}
+	}
+
+	void run()
+	{
+		if (_epoll < 0)
+			return;
+		for (int i = 0; i < _server->_sockets.length(); i++)
+		{
+			int fd = _server->_sockets[i].handle();
+			epoll_event ev;
+			memset(&ev, 0, sizeof(ev));
+			ev.events = EPOLLIN;
+			ev.data.fd = fd;
+			if (fd >= 0 && epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &ev) == 0)
+				_listeners[fd] = i;
+			_server->_sockets[i].listen(1024); // a longer backlog for connection bursts
+		}
+		int nworkers = _server->_numWorkers > 0 ? _server->_numWorkers : max(Thread::numProcessors(), 1);
+		for (int i = 0; i < nworkers; i++)
+		{
+			_workers << new Worker(this);
+			_workers.last()->start();
+		}
+
+		const int MAX_EVENTS = 256;
+		epoll_event events[MAX_EVENTS];
+
+		while (!_server->_requestStop)
+		{
+			int n = epoll_wait(_epoll, events, MAX_EVENTS, 500);
+			if (n < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+			for (int i = 0; i < n; i++)
+			{
+				int fd = events[i].data.fd;
+				int* k = _listeners.find(fd);
+				if (k)
+				{
+					Socket client = _server->_sockets[*k].accept();
+					add(client);
+					continue;
+				}
+				Lock _(_mutex);
+				if (_clients.has(fd))
+					push(fd);
+			}
+		}
+
+		{
+			Lock _(_mutex);
+			_quit = true;
+		}
+		_ready.post(_workers.length());
+		foreach(Worker* w, _workers)
+		{
+			w->join();
+			delete w;
+		}
+		foreach2(int fd, Socket& client, _clients)
+		{
+			(void)fd;
+			_server->clientClosed(client);
+			client.close();
+		}
+		_clients.clear();
+		_server->_numClients = 0;
+	}
+};
+
+#endif
+
 SocketServer::SocketServer()
 {
 	_thread = NULL;
 	_requestStop = false;
 	_sequential = false;
+	_eventDriven = false;
+	_numWorkers = 0;
 	_running = false;
 	_numClients = 0;
 }
@@ -104,6 +314,15 @@ bool SocketServer::bindPath(const String& sname)
 
 void SocketServer::startLoop()
 {
+#ifdef ASL_SOCKET_REACTOR
+	if (_eventDriven && !_sequential)
+	{
+		SockReactor reactor(this);
+		reactor.run();
+		_running = false;
+		return;
+	}
+#endif
 	int n;
 	do
 	{
@@ -492,16 +492,16 @@ String::String(unsigned x)
 
 String::String(float x)
 {
-	alloc(15);
-	_len = snprintf(str(), cap(), "%.7g", x);
+	alloc(16);
+	_len = myftoa(x, str());
 }
 
 String::String(double x)
 {
 	char s[32];
-	_len = snprintf(s, 32, "%.15g", x);
+	_len = mydtoa(x, s);
 	alloc(_len);
-	strcpy(str(), s);
+	memcpy(str(), s, _len + 1);
 }
 
 String::String(bool x)
@@ -886,40 +886,6 @@ Long myatol(const char* s)
 	return y*sgn;
 }
 
-double myatof(const char* s)
-{
-	double y = 0;
-	double m = 1;
-	int exp = 0;
-	if (s[0] == '-') { m = -1; s++; }
-	const char* p = strchr(s, '.');
-	if (p) {
-		p++;
-		while (*p != '\0' && *p != 'e' && *p != 'E') {
-			exp--;
-			p++;
-		}
-		p--;
-	}
-	if (!p) p = s;
-	while (*p++)
-		if (*p == 'e' || *p == 'E'){
-			if (*(p + 1) == '+')
-				p++;
-			exp += myatoiz(p + 1);
-			break;
-		}
-	long long y1 = 0;
-	while (int c = *s++)
-	{
-		if (c == '.') continue;
-		if (c == 'E' || c == 'e') break;
-		y1 = 10 * y1 + (c - '0');
-	}
-	y = double(y1) * pow(10.0, exp);
-	return y * m;
-}
-
 int myitoa(int x, char* s)
 {
 	char ss[16];
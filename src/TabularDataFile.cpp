@@ -1,6 +1,18 @@
 #include <asl/TabularDataFile.h>
+#include <asl/Thread.h>
 #include <ctype.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ASL_CSV_SSE2
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 #ifdef _MSC_VER
 #pragma warning(disable : 26451 26812)
 #endif
@@ -36,7 +48,9 @@ void TabularDataFile::init()
 	_equote = String::repeat(_quote, 2);
 	_flushEvery = 0;
 	_rowIndex = 0;
+	_bufferSize = 1 << 20;
 	_quoteStrings = false;
+	_sync = false;
 }
 
 TabularDataFile::TabularDataFile()
@@ -57,6 +71,12 @@ TabularDataFile::TabularDataFile(const String& filename, const Array<String>& co
 	columns(cols);
 }
 
+TabularDataFile::~TabularDataFile()
+{
+	if (_buffer.length() > 0 && _file)
+		_file << _buffer;
+}
+
 TabularDataFile& TabularDataFile::columns(int cols)
 {
 	_numCols = cols;
@@ -135,53 +155,98 @@ TabularDataFile& TabularDataFile::operator<<(const Var& x)
 	else
 		_row << x;
 	if (_row.length() == _columnNames.length() || rowFull)
+		writeRow();
+	return *this;
+}
+
+// rows are formatted at the end of a buffer that is written to the file when it is full or on flushEvery() rows
+
+void TabularDataFile::writeRow()
+{
+	String& row = _buffer;
+	if (!_dataStarted)
 	{
-		String row;
-		if(!_dataStarted)
+		row << '\n';
+		_dataStarted = true;
+	}
+	for (int i = 0; i < _row.length(); i++)
+	{
+		if (i > 0)
+			row << _separator;
+		const Var& item = _row[i];
+		switch (item.type())
 		{
-			row << '\n';
-			_dataStarted = true;
+		case Var::NUMBER: {
+			double y = item;
+			if (y != y) // print nans empty
+				break;
+			int n = row.length();
+			row.resize(n + 32, true, false);
+			char* p = row.data() + n;
+			int len = mydtoa(y, p);
+			if (_decimal != '.')
+				for (int j = 0; j < len; j++)
+					if (p[j] == '.')
+						p[j] = _decimal;
+			row.fix(n + len);
+			break;
 		}
-		for(int i=0; i<_row.length(); i++)
-		{
-			if(i>0)
-				row << _separator;
-			Var& item = _row[i];
-			String value = item.ok() ? item.toString() : String();
-
+		case Var::INT: {
+			int n = row.length();
+			row.resize(n + 12, true, false);
+			row.fix(n + myitoa(item, row.data() + n));
+			break;
+		}
+		case Var::STRING: {
+			String value = item.toString();
+			if (value.contains(_quote) || value.contains(_separator))
+				row << _quote << value.replace(_quote, _equote) << _quote;
+			else
+				row << value;
+			break;
+		}
+		default:
 			if (item.is(Var::NUMBER))
 			{
-				float y = item; // print nans empty
+				float y = item;
 				if (y != y)
-					continue;
+					break;
 			}
+			String value = item.ok() ? item.toString() : String();
 			if (_decimal != '.' && item.is(Var::NUMBER))
-			{
 				value.replaceme('.', _decimal);
-				row << value;
-			}
-			else if (item.is(Var::STRING))
-			{
-				if (value.contains(_quote) || value.contains(_separator))
-					row << _quote << value.replace(_quote, _equote) << _quote;
-				else
-					row << value;
-			}
-			else
-				row << value;
+			row << value;
 		}
-		row << '\n';
-		_file << *row;
-		if(++_rowIndex == _flushEvery)
-		{
-			_file.flush();
-			_rowIndex = 0;
-		}
-		_row.clear();
 	}
-	return *this;
+	row << '\n';
+	_row.clear();
+	if (_flushEvery > 0 && ++_rowIndex >= _flushEvery)
+	{
+		flush();
+		_rowIndex = 0;
+	}
+	else if (row.length() >= _bufferSize)
+	{
+		_file << row;
+		row.clear();
+	}
 }
-	
+
+void TabularDataFile::flush()
+{
+	if (!_file)
+		return;
+	if (_buffer.length() > 0)
+	{
+		_file << _buffer;
+		_buffer.clear();
+	}
+	if (_sync)
+		_file.sync();
+	else
+		_file.flush();
+}
+
 Array<Array<Var> > TabularDataFile::data()
 {
 	Array<Array<Var> > data;
@@ -345,6 +410,359 @@ bool TabularDataFile::nextRow()
 	return true;
 }
 
+/*
+Columnar loading: the file is read in blocks of whole lines, which are split in chunks parsed in parallel into
+chunk-local columns (with their own string dictionaries). These are then appended in order to the result, remapping
+string codes to the common dictionary of each column.
+*/
+
+#define ASL_CSV_BLOCK (4 << 20)
+#define ASL_CSV_CHUNK (256 << 10)
+#define ASL_CSV_SAMPLE 100
+
+static inline int firstBit(unsigned x)
+{
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward(&i, x);
+	return (int)i;
+#else
+	return __builtin_ctz(x);
+#endif
+}
+
+// Returns the position of the first separator or newline in [p, end), scanning in blocks if possible
+
+static inline const char* findFieldEnd(const char* p, const char* end, char sep)
+{
+#ifdef __AVX2__
+	const __m256i s32 = _mm256_set1_epi8(sep), n32 = _mm256_set1_epi8('\n');
+	for (; p + 32 <= end; p += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)p);
+		unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, s32), _mm256_cmpeq_epi8(v, n32)));
+		if (mask)
+			return p + firstBit(mask);
+	}
+#endif
+#ifdef ASL_CSV_SSE2
+	const __m128i s = _mm_set1_epi8(sep), n = _mm_set1_epi8('\n');
+	for (; p + 16 <= end; p += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+		unsigned mask = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, s), _mm_cmpeq_epi8(v, n)));
+		if (mask)
+			return p + firstBit(mask);
+	}
+#endif
+	while (p < end && *p != sep && *p != '\n')
+		p++;
+	return p;
+}
+
+// Parses a number taking the whole [p, end), which is followed by a character that cannot continue it (a separator,
+// line end or the terminator after the data)
+
+static bool parseNumber(const char* p, const char* end, char dec, double& y)
+{
+	return p < end && myatof(p, y, dec) == end;
+}
+
+static bool parseInt(const char* p, const char* end, bool hex, int& y)
+{
+	bool neg = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		neg = *p++ == '-';
+	if (hex && end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+		p += 2;
+	if (p == end)
+		return false;
+	unsigned x = 0;
+	for (; p < end; p++)
+	{
+		unsigned d = unsigned(*p - '0');
+		if (hex && d >= 10)
+		{
+			unsigned c = unsigned(*p | 0x20) - 'a';
+			d = c < 6 ? c + 10 : 16;
+		}
+		if (d >= (hex ? 16u : 10u))
+			return false;
+		x = x * (hex ? 16 : 10) + d;
+	}
+	y = neg ? -(int)x : (int)x;
+	return true;
+}
+
+struct CsvChunk
+{
+	const char* begin;
+	const char* end;
+	Array<DataColumn> columns;
+	Array<HashMap<String, int> > dictionaries;
+};
+
+struct CsvParseTask : public ParallelTask
+{
+	Array<CsvChunk> chunks;
+	Array<char> kinds; // 'n', 'i', 'h' or 's' for each column
+	char separator, decimal, quote;
+
+	void run(int i0, int i1)
+	{
+		for (int i = i0; i < i1; i++)
+			parse(chunks[i]);
+	}
+
+	void store(CsvChunk& chunk, int j, const char* p, const char* end)
+	{
+		DataColumn& column = chunk.columns[j];
+		switch (kinds[j])
+		{
+		case 'n': {
+			double y;
+			column.numbers << (parseNumber(p, end, decimal, y) ? y : (double)nan());
+			break;
+		}
+		case 'i':
+		case 'h': {
+			int y;
+			column.ints << (parseInt(p, end, kinds[j] == 'h', y) ? y : 0);
+			break;
+		}
+		default: {
+			String value(p, int(end - p));
+			HashMap<String, int>& dictionary = chunk.dictionaries[j];
+			const int* code = dictionary.find(value);
+			if (code)
+				column.codes << *code;
+			else
+			{
+				int n = column.strings.length();
+				column.strings << value;
+				dictionary[value] = n;
+				column.codes << n;
+			}
+		}
+		}
+	}
+
+	void parse(CsvChunk& chunk)
+	{
+		int ncols = kinds.length();
+		chunk.columns.resize(ncols);
+		chunk.dictionaries.resize(ncols);
+		String value;
+		const char* p = chunk.begin, * end = chunk.end;
+		while (p < end)
+		{
+			if (*p == '\n' || (*p == '\r' && p + 1 < end && p[1] == '\n')) // skip empty lines
+			{
+				p += *p == '\n' ? 1 : 2;
+				continue;
+			}
+			for (int j = 0;; j++)
+			{
+				const char* s = p, * e;
+				if (*p == quote)
+				{
+					value.clear();
+					for (p++; p < end && *p != '\n';)
+					{
+						const char* q = p;
+						while (q < end && *q != quote && *q != '\n')
+							q++;
+						value.append(p, int(q - p));
+						p = q;
+						if (p < end && *p == quote)
+						{
+							if (p + 1 < end && p[1] == quote)
+							{
+								value << quote;
+								p += 2;
+							}
+							else
+							{
+								p++;
+								break;
+							}
+						}
+					}
+					p = findFieldEnd(p, end, separator); // anything after the closing quote is ignored
+					s = value.data();
+					e = s + value.length();
+				}
+				else
+				{
+					p = e = findFieldEnd(p, end, separator);
+					if (e > s && e[-1] == '\r' && (e == end || *e == '\n'))
+						e--;
+				}
+				if (j < ncols)
+					store(chunk, j, s, e);
+				if (p < end && *p == separator)
+				{
+					p++;
+					continue;
+				}
+				if (p < end)
+					p++;
+				for (j++; j < ncols; j++)
+					store(chunk, j, p, p);
+				break;
+			}
+		}
+	}
+};
+
+Array<DataColumn> TabularDataFile::loadColumns(bool parallel)
+{
+	Array<DataColumn> columns;
+	if (!_file && !readHeader())
+		return columns;
+	int ncols = _columnNames.length();
+	columns.resize(ncols);
+	Array<HashMap<String, int> > dictionaries(ncols);
+	CsvParseTask task;
+	task.separator = _separator;
+	task.decimal = _decimal;
+	task.quote = _quote;
+	task.kinds.resize(ncols);
+	for (int j = 0; j < ncols; j++)
+	{
+		columns[j].name = _columnNames[j];
+		char type = j < _types.length() ? _types[j] : 0;
+		task.kinds[j] = (type == 'n' || type == 'i' || type == 'h' || type == 's') ? type : 0;
+	}
+	ByteArray block;
+	int carry = 0;
+	bool first = true;
+	while (true)
+	{
+		block.resize(carry + ASL_CSV_BLOCK + 1);
+		int n = max(_file.read(block.data() + carry, ASL_CSV_BLOCK), 0);
+		block[carry + n] = 0;
+		bool last = n < ASL_CSV_BLOCK;
+		const char* data = (const char*)block.data();
+		const char* begin = data, * end = data + carry + n;
+		if (!last) // parse up to the last full line
+		{
+			while (end > begin && end[-1] != '\n')
+				end--;
+			if (end == begin)
+			{
+				carry += n;
+				continue;
+			}
+		}
+		if (first)
+		{
+			if (!_dataStarted && end - begin >= 3 && memcmp(begin, "\xef\xbb\xbf", 3) == 0) // eat BOM
+				begin += 3;
+
+			// columns without a given type are numeric if all non-empty values in the first rows are numbers
+
+			CsvParseTask sample;
+			sample.separator = _separator;
+			sample.decimal = _decimal;
+			sample.quote = _quote;
+			sample.kinds.resize(ncols);
+			for (int j = 0; j < ncols; j++)
+				sample.kinds[j] = 's';
+			sample.chunks.resize(1);
+			sample.chunks[0].begin = begin;
+			const char* p = begin;
+			for (int i = 0; i < ASL_CSV_SAMPLE && p < end; i++)
+			{
+				while (p < end && *p != '\n')
+					p++;
+				if (p < end)
+					p++;
+			}
+			sample.chunks[0].end = p;
+			sample.parse(sample.chunks[0]);
+			for (int j = 0; j < ncols; j++)
+			{
+				if (task.kinds[j])
+					continue;
+				task.kinds[j] = 'n';
+				foreach (String& value, sample.chunks[0].columns[j].strings)
+				{
+					if (value.length() > 0 && !isnumber(value, _decimal))
+					{
+						task.kinds[j] = 's';
+						break;
+					}
+				}
+			}
+			for (int j = 0; j < ncols; j++)
+				columns[j].type = task.kinds[j] == 'n' ? DataColumn::NUMBER : task.kinds[j] == 's' ? DataColumn::STRING :
+					DataColumn::INT;
+			first = false;
+		}
+
+		task.chunks.clear();
+		for (const char* p = begin; p < end;)
+		{
+			const char* q = p + min((int)(end - p), ASL_CSV_CHUNK);
+			while (q < end && q[-1] != '\n')
+				q++;
+			CsvChunk& chunk = task.chunks.resize(task.chunks.length() + 1).last();
+			chunk.begin = p;
+			chunk.end = q;
+			p = q;
+		}
+		if (parallel && task.chunks.length() > 1)
+			parallelRun(task, 0, task.chunks.length(), 1);
+		else
+			task.run(0, task.chunks.length());
+
+		foreach (CsvChunk& chunk, task.chunks)
+		{
+			for (int j = 0; j < ncols; j++)
+			{
+				DataColumn& column = columns[j];
+				DataColumn& part = chunk.columns[j];
+				switch (column.type)
+				{
+				case DataColumn::NUMBER:
+					column.numbers.append(part.numbers);
+					break;
+				case DataColumn::INT:
+					column.ints.append(part.ints);
+					break;
+				case DataColumn::STRING: {
+					HashMap<String, int>& dictionary = dictionaries[j];
+					Array<int> codes(part.strings.length());
+					foreach2 (int k, String& value, part.strings)
+					{
+						const int* code = dictionary.find(value);
+						if (code)
+							codes[k] = *code;
+						else
+						{
+							codes[k] = column.strings.length();
+							dictionary[value] = codes[k];
+							column.strings << value;
+						}
+					}
+					int i0 = column.codes.length();
+					column.codes.resize(i0 + part.codes.length());
+					for (int i = 0; i < part.codes.length(); i++)
+						column.codes[i0 + i] = codes[part.codes[i]];
+				}
+				}
+			}
+		}
+		if (last)
+			break;
+		carry = int(data + carry + n - end);
+		memmove(block.data(), end, carry);
+	}
+	_dataStarted = true;
+	return columns;
+}
+
 Var TabularDataFile::operator[](int i) const
 {
 	if(i>=_row.length() || i < 0)
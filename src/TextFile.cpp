@@ -272,4 +272,31 @@ TextFile& TextFile::operator<<(const char* x)
 	return *this;
 }
 
+TextFile& TextFile::operator<<(int x)
+{
+	if (!_file && !open(WRITE))
+		return *this;
+	char s[16];
+	fwrite(s, 1, myitoa(x, s), _file);
+	return *this;
+}
+
+TextFile& TextFile::operator<<(Long x)
+{
+	if (!_file && !open(WRITE))
+		return *this;
+	char s[24];
+	fwrite(s, 1, myltoa(x, s), _file);
+	return *this;
+}
+
+TextFile& TextFile::operator<<(double x)
+{
+	if (!_file && !open(WRITE))
+		return *this;
+	char s[32];
+	fwrite(s, 1, mydtoa(x, s), _file);
+	return *this;
+}
+
 }
@@ -0,0 +1,286 @@
+#include <asl/Thread.h>
+#include <asl/atomic.h>
+
+#ifdef _MSC_VER
+#define ASL_THREAD_LOCAL __declspec(thread)
+#else
+#define ASL_THREAD_LOCAL __thread
+#endif
+
+namespace asl {
+
+/*
+Process-wide pool of worker threads for Thread::parallel_for and related functions.
+
+Each worker has a deque of iteration ranges. A thread running a range larger than the job's grain splits it in two,
+pushes the second half at the back of its own deque and continues with the first half. Idle workers take ranges from
+the back of their own deque or steal from the front of others' (the oldest, largest ranges). Threads outside the pool
+push their loops to an extra shared deque. A thread waiting for its loop to finish keeps running pending ranges, so
+nested loops do not block workers.
+
+The pool is never destroyed, as workers may still be sleeping when static objects are destroyed at exit.
+*/
+
+struct ParallelJob
+{
+	ParallelTask* task;
+	int grain;
+	AtomicCount pending; // iterations not finished yet
+};
+
+struct ParallelRange
+{
+	ParallelJob* job;
+	int i0, i1;
+};
+
+struct WorkDeque
+{
+	Mutex mutex;
+	Array<ParallelRange> items;
+	int head;
+	WorkDeque() : head(0) {}
+
+	void push(const ParallelRange& r)
+	{
+		Lock _(mutex);
+		items << r;
+	}
+
+	bool pop(ParallelRange& r)
+	{
+		Lock _(mutex);
+		if (items.length() == head)
+			return false;
+		r = items.last();
+		items.removeLast();
+		if (items.length() == head)
+		{
+			items.clear();
+			head = 0;
+		}
+		return true;
+	}
+
+	bool steal(ParallelRange& r)
+	{
+		Lock _(mutex);
+		if (items.length() == head)
+			return false;
+		r = items[head++];
+		if (items.length() == head)
+		{
+			items.clear();
+			head = 0;
+		}
+		return true;
+	}
+};
+
+struct PoolWorker;
+
+static ASL_THREAD_LOCAL int currentWorker = -1;
+
+struct ThreadPool
+{
+	Array<WorkDeque*> deques; // one per worker plus the shared one (last)
+	Array<PoolWorker*> workers;
+	AtomicCount queued;       // ranges waiting in deques
+	AtomicCount sleeping;
+	Semaphore wakeup;
+
+	ThreadPool(int n);
+
+	static ThreadPool*& instance()
+	{
+		static ThreadPool* pool = NULL;
+		return pool;
+	}
+
+	static ThreadPool* get();
+
+	void push(int me, const ParallelRange& r)
+	{
+		deques[me]->push(r);
+		++queued;
+		if (sleeping > 0)
+			wakeup.post();
+	}
+
+	bool take(int me, ParallelRange& r)
+	{
+		if (queued <= 0)
+			return false;
+		if (deques[me]->pop(r))
+		{
+			--queued;
+			return true;
+		}
+		int n = deques.length();
+		for (int i = 1; i < n; i++)
+		{
+			if (deques[(me + i) % n]->steal(r))
+			{
+				--queued;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void execute(int me, ParallelRange r)
+	{
+		ParallelJob* job = r.job;
+		while (r.i1 - r.i0 > job->grain)
+		{
+			int mid = r.i0 + (r.i1 - r.i0) / 2;
+			ParallelRange rest = { job, mid, r.i1 };
+			push(me, rest);
+			r.i1 = mid;
+		}
+		job->task->run(r.i0, r.i1);
+		job->pending += r.i0 - r.i1; // job may be gone after this
+	}
+
+	bool runOne(int me)
+	{
+		ParallelRange r;
+		if (!take(me, r))
+			return false;
+		execute(me, r);
+		return true;
+	}
+
+	void workerLoop(int me)
+	{
+		currentWorker = me;
+		int idle = 0;
+		while (1)
+		{
+			if (runOne(me))
+			{
+				idle = 0;
+				continue;
+			}
+			if (++idle < 64)
+			{
+				sleep(0.0);
+				continue;
+			}
+			++sleeping;
+			if (queued <= 0)
+				wakeup.wait(0.1);
+			--sleeping;
+		}
+	}
+};
+
+struct PoolWorker : public Thread
+{
+	ThreadPool* pool;
+	int index;
+	void run()
+	{
+		pool->workerLoop(index);
+	}
+};
+
+ThreadPool::ThreadPool(int n)
+{
+	for (int i = 0; i <= n; i++)
+		deques << new WorkDeque;
+	for (int i = 0; i < n; i++)
+	{
+		PoolWorker* w = new PoolWorker;
+		w->pool = this;
+		w->index = i;
+		workers << w;
+		w->start();
+	}
+}
+
+static Mutex poolMutex;
+static int poolSize = 0;
+
+ThreadPool* ThreadPool::get()
+{
+	ThreadPool* pool = instance();
+	if (pool)
+		return pool;
+	Lock _(poolMutex);
+	if (!instance())
+		instance() = new ThreadPool(poolSize > 0 ? poolSize : max(1, Thread::numProcessors() - 1));
+	return instance();
+}
+
+void setParallelThreads(int n)
+{
+	Lock _(poolMutex);
+	poolSize = n;
+}
+
+int parallelThreads()
+{
+	return ThreadPool::get()->workers.length();
+}
+
+// runs a task with limited concurrency as `maxThreads` indivisible slots, each taking chunks of the range in turn
+
+struct LimitedTask : public ParallelTask
+{
+	ParallelTask* task;
+	AtomicCount next;
+	int end, grain;
+
+	void run(int s0, int s1)
+	{
+		for (int s = s0; s < s1; s++)
+		{
+			int j0;
+			while ((j0 = (next += grain) - grain) < end)
+				task->run(j0, min(j0 + grain, end));
+		}
+	}
+};
+
+void parallelRun(ParallelTask& task, int i0, int i1, int grain, int maxThreads)
+{
+	int n = i1 - i0;
+	if (n <= 0)
+		return;
+	ThreadPool* pool = ThreadPool::get();
+	if (maxThreads > 0 && maxThreads <= pool->workers.length())
+	{
+		LimitedTask limited;
+		limited.task = &task;
+		limited.next = AtomicCount(i0);
+		limited.end = i1;
+		limited.grain = grain > 0 ? grain : max(1, n / (8 * maxThreads));
+		parallelRun(limited, 0, min(maxThreads, n), 1);
+		return;
+	}
+	if (grain <= 0)
+		grain = max(1, n / (8 * (pool->workers.length() + 1)));
+	if (n <= grain || pool->workers.length() == 0)
+	{
+		task.run(i0, i1);
+		return;
+	}
+	int me = (currentWorker >= 0 && currentWorker < pool->workers.length()) ? currentWorker : pool->workers.length();
+	ParallelJob job;
+	job.task = &task;
+	job.grain = grain;
+	job.pending = AtomicCount(n);
+	ParallelRange r = { &job, i0, i1 };
+	pool->execute(me, r);
+	int spins = 0;
+	while (job.pending > 0)
+	{
+		if (pool->runOne(me))
+			spins = 0;
+		else if (++spins > 64)
+			sleep(0.0001);
+	}
+}
+
+}
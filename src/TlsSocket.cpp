@@ -7,7 +7,12 @@
 #include <mbedtls/entropy.h>
 #include <mbedtls/ctr_drbg.h>
 #include <mbedtls/error.h>
+#if defined(MBEDTLS_SSL_CACHE_C)
+#include <mbedtls/ssl_cache.h>
+#endif
 #include <asl/TlsSocket.h>
+#include <asl/Mutex.h>
+#include <asl/Map.h>
 #if MBEDTLS_VERSION_MAJOR < 3
 #include <mbedtls/net.h>
 #else
@@ -16,6 +21,8 @@
 
 //#define TLS_DEBUG 3
 
+#define ASL_TLS_MAX_SESSIONS 256
+
 #ifdef _WIN32
 #include <windows.h>
 #include <winsock2.h>
@@ -30,6 +37,7 @@
 #include <sys/wait.h>
 #include <netinet/in.h>
 #include <netdb.h>
+#include <poll.h>
 #endif
 
 #include <stdio.h>
@@ -172,6 +180,77 @@ struct TlsCore
 mbedtls_ssl_config config;
 bool inited = false;
 
+#if defined(MBEDTLS_SSL_CLI_C)
+/*
+Clients keep the session of the last connection to each server and try to resume it in new connections, which
+saves the key exchange (an abbreviated handshake) if the server still has it.
+*/
+struct TlsSessionCache
+{
+	Mutex mutex;
+	Dic<mbedtls_ssl_session*> sessions;
+
+	~TlsSessionCache()
+	{
+		clear();
+	}
+
+	static void free(mbedtls_ssl_session* s)
+	{
+		mbedtls_ssl_session_free(s);
+		delete s;
+	}
+
+	void clear()
+	{
+		foreach(mbedtls_ssl_session* s, sessions)
+			free(s);
+		sessions.clear();
+	}
+
+	void restore(const String& key, mbedtls_ssl_context* ssl)
+	{
+		Lock _(mutex);
+		mbedtls_ssl_session* s = sessions.get(key, NULL);
+		if (s)
+			mbedtls_ssl_set_session(ssl, s);
+	}
+
+	void save(const String& key, const mbedtls_ssl_context* ssl)
+	{
+		mbedtls_ssl_session* s = new mbedtls_ssl_session;
+		mbedtls_ssl_session_init(s);
+		if (mbedtls_ssl_get_session(ssl, s) != 0)
+		{
+			free(s);
+			return;
+		}
+		Lock _(mutex);
+		if (sessions.has(key))
+			free(sessions[key]);
+		else if (sessions.length() >= ASL_TLS_MAX_SESSIONS)
+			clear();
+		sessions[key] = s;
+	}
+};
+
+static TlsSessionCache clientSessions;
+#endif
+
+#if defined(MBEDTLS_SSL_CACHE_C) && defined(MBEDTLS_SSL_SRV_C)
+
+// sessions of clients accepted by servers, so that they can resume them
+
+struct TlsServerCache
+{
+	mbedtls_ssl_cache_context cache;
+	TlsServerCache() { mbedtls_ssl_cache_init(&cache); }
+	~TlsServerCache() { mbedtls_ssl_cache_free(&cache); }
+};
+
+static TlsServerCache serverSessions;
+#endif
+
 TlsSocket_::TlsSocket_()
 {
 	_error = 0;
@@ -234,6 +313,7 @@ void TlsSocket_::close()
 	if (_handle >= 0)
 		mbedtls_ssl_close_notify(&_core->ssl);
 	_handle = -1;
+	_rbeg = _rend = 0;
 }
 
 int TlsSocket_::handle() const
@@ -298,6 +378,9 @@ Socket_* TlsSocket_::accept()
 
 	mbedtls_net_free(&cli->_core->net);
 	ret = mbedtls_ssl_config_defaults(&cli->_core->conf, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+#if defined(MBEDTLS_SSL_CACHE_C) && defined(MBEDTLS_SSL_SRV_C)
+	mbedtls_ssl_conf_session_cache(&cli->_core->conf, &serverSessions.cache, mbedtls_ssl_cache_get, mbedtls_ssl_cache_set);
+#endif
 	if ((ret = mbedtls_ssl_conf_own_cert(&cli->_core->conf, &_core->srvcert, &_core->pkey)) != 0)
 	{
 		verbose_print("TlsSocket: setting certificate failed -0x%x\n", ret);
@@ -369,6 +452,19 @@ Socket_* TlsSocket_::accept()
 	return cli;
 }
 
+// addresses are tried in order, as the TLS layer makes its own connection for each
+
+bool TlsSocket_::connect(const Array<InetAddress>& addrs)
+{
+	for (int i = 0; i < addrs.length(); i++)
+	{
+		if (connect(addrs[i]))
+			return true;
+	}
+	_error = SOCKET_BAD_CONNECT;
+	return false;
+}
+
 bool TlsSocket_::connect(const InetAddress& addr)
 {
 	int ret = mbedtls_net_connect(&_core->net, addr.host(), String(addr.port()), MBEDTLS_NET_PROTO_TCP);
@@ -388,6 +484,11 @@ bool TlsSocket_::connect(const InetAddress& addr)
 	}
 	ret = mbedtls_ssl_set_hostname(&_core->ssl, _hostname);
 
+#if defined(MBEDTLS_SSL_CLI_C)
+	String sessionKey = _hostname + "/" + addr.toString();
+	clientSessions.restore(sessionKey, &_core->ssl);
+#endif
+
 	while ((ret = mbedtls_ssl_handshake(&_core->ssl)) != 0)
 	{
 		if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE && ret != -0x7000)
@@ -397,6 +498,10 @@ bool TlsSocket_::connect(const InetAddress& addr)
 			return false;
 		}
 	}
+
+#if defined(MBEDTLS_SSL_CLI_C)
+	clientSessions.save(sessionKey, &_core->ssl);
+#endif
 	/*unsigned flags;
 	if ((flags = mbedtls_ssl_get_verify_result(&_core->ssl)) != 0)
 	{
@@ -418,34 +523,17 @@ bool TlsSocket_::setOption(int level, int opt, const void* val, int n)
 int TlsSocket_::available()
 {
 	mbedtls_ssl_read(&_core->ssl, NULL, 0);
-	return (int) mbedtls_ssl_get_bytes_avail( &_core->ssl );
+	return (int) mbedtls_ssl_get_bytes_avail( &_core->ssl ) + buffered();
 }
 
-int TlsSocket_::read(void* data, int size)
+int TlsSocket_::recv(void* data, int size)
 {
-	if(_blocking) {
-	int s = size, n;
-	while ((n = mbedtls_ssl_read(&_core->ssl, (unsigned char*)data, size)) < size)
-	{
-		if (n == MBEDTLS_ERR_SSL_WANT_READ || n == MBEDTLS_ERR_SSL_WANT_WRITE)
-			continue;
-		if (n < 0) {_error = SOCKET_BAD_RECV; break;}
-		else if(n==0)
-			return s - size;
-		size -= n;
-		data = (char*)data + n;
-	}
-	return s;
-	}
-	else {
-		int n = 1, m = 0;
-		do {
-			n = mbedtls_ssl_read(&_core->ssl, (unsigned char*)data, size); 
-			if (n > 0) m += n;
-		}
-		while (n > 0 || n == MBEDTLS_ERR_SSL_WANT_READ || n == MBEDTLS_ERR_SSL_WANT_WRITE);
-		return m;
-	}
+	int n;
+	do n = mbedtls_ssl_read(&_core->ssl, (unsigned char*)data, size);
+	while (_blocking && (n == MBEDTLS_ERR_SSL_WANT_READ || n == MBEDTLS_ERR_SSL_WANT_WRITE));
+	if (n == MBEDTLS_ERR_SSL_WANT_READ || n == MBEDTLS_ERR_SSL_WANT_WRITE) // non-blocking, nothing to read yet
+		return 0;
+	return n == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY ? 0 : n;
 }
 
 int TlsSocket_::write(const void* data, int n)
@@ -466,11 +554,43 @@ int TlsSocket_::write(const void* data, int n)
 	return written;
 }
 
+// small blocks are joined so that they go in a single TLS record
+
+int TlsSocket_::write(const SocketSpan* spans, int n)
+{
+	int size = 0;
+	for (int i = 0; i < n; i++)
+		size += spans[i].length;
+	if (size <= 16384)
+	{
+		ByteArray buffer(size);
+		for (int i = 0, j = 0; i < n; j += spans[i++].length)
+			memcpy(buffer.data() + j, spans[i].data, spans[i].length);
+		return write(buffer.data(), size);
+	}
+	int written = 0;
+	for (int i = 0; i < n; i++)
+	{
+		int m = write(spans[i].data, spans[i].length);
+		written += m;
+		if (m != spans[i].length)
+			break;
+	}
+	return written;
+}
+
 bool TlsSocket_::waitInput(double t)
 {
 	if (available() != 0)
 		return true;
 	//else return false;
+#ifndef _WIN32
+	pollfd pfd; // select cannot wait for descriptors beyond FD_SETSIZE
+	pfd.fd = handle();
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	return poll(&pfd, 1, (int)(t * 1000)) > 0;
+#else
 	fd_set rset;
 	struct timeval to;
 	to.tv_sec = (int)floor(t);
@@ -479,6 +599,7 @@ bool TlsSocket_::waitInput(double t)
 	FD_SET(handle(), &rset);
 	select(handle() + 1, &rset, 0, 0, &to);
 	return FD_ISSET(handle(), &rset) != 0;
+#endif
 }
 
 String TlsSocket_::errorMsg() const
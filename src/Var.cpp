@@ -6,8 +6,8 @@ namespace asl {
 #define NEW_ARRAY(a) (a) = new Array<Var>
 #define NEW_ARRAYC(a, x) (a) = new Array<Var>(x)
 #define DEL_ARRAY(a) delete (a)
-#define NEW_DIC(d) (d) = new VDic<Var>
-#define NEW_DICC(d, x) (d) = new VDic<Var>(x)
+#define NEW_DIC(d) (d) = new IndexedDic<Var>
+#define NEW_DICC(d, x) (d) = new IndexedDic<Var>(x)
 #define DEL_DIC(d) delete (d)
 #else
 #define NEW_ARRAY(a) (a).construct()
@@ -111,6 +111,15 @@ Var::Var(char y)
 	_i=y;
 }
 
+Var::Var(const VDic<Var>& x)
+{
+	_type = OBJ;
+	NEW_DIC(_o);
+	_o->reserve(x.length());
+	foreach2(String& k, Var& v, x)
+		_o->set(k, v);
+}
+
 Var::Var(const String& k, const Var& x)
 {
 	_type = OBJ;
@@ -270,11 +279,11 @@ String Var::toString() const
 		break;
 	case FLOAT:
 		r.resize(16);
-		r.fix(snprintf(r.data(), r.cap(), "%.7g", _d));
+		r.fix(myftoa((float)_d, r.data()));
 		break;
 	case NUMBER:
-		r.resize(29);
-		r.fix(snprintf(r.data(), r.cap(), "%.15g", _d));
+		r.resize(32);
+		r.fix(mydtoa(_d, r.data()));
 		break;
 	case BOOL:
 		r=_b?"true":"false";
@@ -6,11 +6,29 @@
 #include <asl/util.h>
 #include <asl/Http.h>
 #include <asl/JSON.h>
+#include <asl/Thread.h>
 #ifdef ASL_TLS
 #include <asl/TlsSocket.h>
 #endif
 #include <ctype.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ASL_WS_SSE2
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <errno.h>
+#define ASL_WS_HUB
+#endif
+
+#define ASL_WS_BLOCK 65536
+
 namespace asl {
 	
 #ifdef _MSC_VER
@@ -44,38 +62,456 @@ WebSocketMsg& WebSocketMsg::fix()
 	return *this;
 }
 
+// writes the header of a frame and returns its length (without the mask key)
+
+static int frameHeader(byte* head, int length, int opcode, bool masked)
+{
+	head[0] = byte(0x80 | opcode);
+	byte mask = masked ? 0x80 : 0;
+	if (length < 126)
+	{
+		head[1] = byte(mask | length);
+		return 2;
+	}
+	if (length < (1 << 16))
+	{
+		head[1] = byte(mask | 126);
+		head[2] = byte(length >> 8);
+		head[3] = byte(length);
+		return 4;
+	}
+	head[1] = byte(mask | 127);
+	for (int i = 0; i < 8; i++)
+		head[2 + i] = byte((ULong)length >> (56 - 8 * i));
+	return 10;
+}
+
+#ifdef ASL_WS_HUB
+
+/*
+A connection of a server in hub mode. All writes to its socket go through here, so frames sent by the connection's
+handler and by broadcasts never interleave. Writes do not block: what the socket does not take at once waits in
+`queue` until the hub's writer thread sees the socket writable again. Broadcast frames are only queued, and the
+writer sends them, so a burst of broadcasts reaches each client in one system call.
+*/
+
+struct WsConnection
+{
+	WsHub* hub;
+	Socket socket;
+	WebSocket ws;
+	Mutex mutex;
+	ByteArray queue;
+	int head;
+	bool tls;
+	bool registered; // added to the writer's epoll set
+	bool waiting;    // armed for writability
+	bool dirty;      // in the writer's list of connections with queued broadcasts
+	bool dead;
+	WsConnection(WsHub* h, const Socket& s) : hub(h), socket(s), ws(s, false), head(0), tls(false), registered(false),
+		waiting(false), dirty(false), dead(false)
+	{
+		ws._conn = this;
+	}
+	int pending() const { return queue.length() - head; }
+	int write(const SocketSpan* spans, int n);
+	bool push(const ByteArray& frame);
+	void drain();
+	void kill();
+	void arm();
+};
+
+/*
+The writer thread of a hub, and state shared by broadcasts: the frame being broadcast and its compressed version
+(compressed into a buffer of the hub, as the buffers of the connections are used by their own threads).
+The writer is woken through an eventfd when broadcasts leave connections with queued data (`dirty`), and by epoll
+when a full socket becomes writable. Connections are looked up by descriptor with the server mutex held, as they may
+be removed meanwhile.
+*/
+
+struct WsHub : public Thread
+{
+	WebSocketServer* server;
+	int epoll;
+	int wakeup;
+	HashMap<int, WsConnection*> conns;
+	Array<int> dirty, draining;
+	Deflater deflater;
+	int windowBits;
+	ByteArray frame, zframe, zdata;
+	bool quit;
+
+	WsHub(WebSocketServer* s, const WebSocketCompression& z) : server(s), conns(1024),
+		deflater(Deflater::RAW, z.level, z.serverMaxWindowBits), windowBits(z.serverMaxWindowBits), quit(false)
+	{
+		epoll = epoll_create1(EPOLL_CLOEXEC);
+		wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = wakeup;
+		epoll_ctl(epoll, EPOLL_CTL_ADD, wakeup, &ev);
+	}
+	~WsHub()
+	{
+		if (epoll >= 0)
+			::close(epoll);
+		if (wakeup >= 0)
+			::close(wakeup);
+	}
+	void run()
+	{
+		const int MAX_EVENTS = 256;
+		epoll_event events[MAX_EVENTS];
+		while (!quit)
+		{
+			int n = epoll_wait(epoll, events, MAX_EVENTS, 200);
+			for (int i = 0; i < n; i++)
+			{
+				int fd = events[i].data.fd;
+				if (fd != wakeup)
+				{
+					Lock _(server->_mutex);
+					drain(fd);
+					continue;
+				}
+				ULong x;
+				if (::read(wakeup, &x, 8) < 0) {}
+				{
+					Lock _(server->_mutex);
+					swap(dirty, draining);
+				}
+				// in slices, so that broadcasts can queue more frames meanwhile and are sent together
+				for (int j = 0; j < draining.length(); j += 64)
+				{
+					Lock _(server->_mutex);
+					for (int k = j; k < min(j + 64, draining.length()); k++)
+						drain(draining[k]);
+				}
+				draining.clear();
+			}
+		}
+	}
+	void drain(int fd)
+	{
+		WsConnection** c = conns.find(fd);
+		if (c)
+			(*c)->drain();
+	}
+	void send(const Array<WebSocket*>& clients, const byte* p, int n, WebSocket::FrameType type);
+};
+
+// closes a connection without releasing the descriptor: the reactor sees the hangup and removes it
+
+void WsConnection::kill()
+{
+	if (dead)
+		return;
+	dead = true;
+	queue.clear();
+	head = 0;
+	::shutdown(socket.handle(), SHUT_RDWR);
+}
+
+void WsConnection::arm()
+{
+	if (waiting)
+		return;
+	epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLOUT | EPOLLONESHOT;
+	ev.data.fd = socket.handle();
+	if (epoll_ctl(hub->epoll, registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, ev.data.fd, &ev) != 0)
+	{
+		kill();
+		return;
+	}
+	registered = waiting = true;
+}
+
+int WsConnection::write(const SocketSpan* spans, int n)
+{
+	Lock _(mutex);
+	if (dead)
+		return -1;
+	if (tls)
+		return socket.write(spans, n);
+	if (pending() > hub->server->_queueLimit) // a slow consumer
+	{
+		++hub->server->_slowClients;
+		kill();
+		return -1;
+	}
+	int total = 0, sent = 0;
+	for (int i = 0; i < n; i++)
+		total += spans[i].length;
+	if (pending() == 0)
+	{
+		iovec iov[16];
+		msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		int k = min(n, 16);
+		for (int i = 0; i < k; i++)
+		{
+			iov[i].iov_base = (void*)spans[i].data;
+			iov[i].iov_len = spans[i].length;
+		}
+		msg.msg_iov = iov;
+		msg.msg_iovlen = k;
+		sent = (int)::sendmsg(socket.handle(), &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (sent < 0)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			{
+				kill();
+				return -1;
+			}
+			sent = 0;
+		}
+	}
+	for (int i = 0; i < n; i++) // queue what was not sent
+	{
+		int m = spans[i].length;
+		if (sent >= m)
+		{
+			sent -= m;
+			continue;
+		}
+		queue.append((const byte*)spans[i].data + sent, m - sent);
+		sent = 0;
+	}
+	if (pending() > 0)
+		arm();
+	return total;
+}
+
+// queues a broadcast frame, returns true if the connection must be added to the writer's list
+
+bool WsConnection::push(const ByteArray& frame)
+{
+	Lock _(mutex);
+	if (dead)
+		return false;
+	if (tls)
+	{
+		socket.write(frame.data(), frame.length());
+		return false;
+	}
+	if (pending() > hub->server->_queueLimit)
+	{
+		++hub->server->_slowClients;
+		kill();
+		return false;
+	}
+	queue.append(frame);
+	if (waiting || dirty)
+		return false;
+	dirty = true;
+	return true;
+}
+
+void WsConnection::drain()
+{
+	Lock _(mutex);
+	waiting = false;
+	dirty = false;
+	if (dead || pending() == 0)
+		return;
+	int r = (int)::send(socket.handle(), queue.data() + head, pending(), MSG_DONTWAIT | MSG_NOSIGNAL);
+	if (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+	{
+		kill();
+		return;
+	}
+	if (r > 0)
+		head += r;
+	if (pending() == 0)
+	{
+		queue.resize(0);
+		head = 0;
+		return;
+	}
+	if (head > 65536 && head > queue.length() / 2)
+	{
+		queue.remove(0, head);
+		head = 0;
+	}
+	arm();
+}
+
+// the frame is encoded once, and compressed once for the clients that negotiated compression with a large enough
+// window and without context takeover (a message compressed from a fresh state can be inflated by any receiver, but
+// it enters the receiver's window, which the connection's own deflater would not know about with context takeover)
+
+void WsHub::send(const Array<WebSocket*>& clients, const byte* p, int n, WebSocket::FrameType type)
+{
+	frame.resize(n + 10);
+	int h = frameHeader(frame.data(), n, type, false);
+	memcpy(frame.data() + h, p, n);
+	frame.resize(h + n);
+	int zstate = 0; // 0: not compressed yet, 1: compressed, -1: failed
+	bool wake = dirty.length() == 0;
+	for (int i = 0; i < clients.length(); i++)
+	{
+		WebSocket* ws = clients[i];
+		WsConnection* c = ws->_conn;
+		if (!c) // linked from an HttpServer, served by its own thread
+		{
+			ws->send(p, n, type);
+			continue;
+		}
+		const ByteArray* f = &frame;
+		if (ws->_z && ws->_z->noContextTakeover && n >= ws->_z->threshold && ws->_z->windowBits >= windowBits &&
+			zstate >= 0)
+		{
+			if (zstate == 0)
+			{
+				ByteArray& z = zdata;
+				z.resize(0);
+				deflater.reset();
+				zstate = deflater.compress(p, n, z, Deflater::SYNC) && z.length() > 4 ? 1 : -1;
+				if (zstate > 0)
+				{
+					int m = z.length() - 4; // without the 00 00 ff ff of the flush
+					zframe.resize(m + 10);
+					h = frameHeader(zframe.data(), m, type | 0x40, false);
+					memcpy(zframe.data() + h, z.data(), m);
+					zframe.resize(h + m);
+				}
+			}
+			if (zstate > 0)
+				f = &zframe;
+		}
+		if (c->push(*f))
+			dirty << c->socket.handle();
+	}
+	if (wake && dirty.length() > 0)
+	{
+		ULong one = 1;
+		if (::write(wakeup, &one, 8) < 0) {}
+	}
+}
+
+#endif
+
 WebSocketServer::WebSocketServer()
 {
 	_requestStop = false;
+	_compression.enabled = false;
+	_hub = NULL;
+	_queueLimit = 4 * 1024 * 1024;
+	_slowClients = 0;
 }
 
 WebSocketServer::WebSocketServer(int port)
 {
 	bind(port);
 	_requestStop = false;
+	_compression.enabled = false;
+	_hub = NULL;
+	_queueLimit = 4 * 1024 * 1024;
+	_slowClients = 0;
 }
 
-void WebSocketServer::serve(Socket client)
+WebSocketServer::~WebSocketServer()
+{
+#ifdef ASL_WS_HUB
+	if (_hub)
+	{
+		_hub->quit = true;
+		_hub->join();
+		foreach2(int fd, WsConnection* c, _hub->conns)
+		{
+			(void)fd;
+			delete c;
+		}
+		delete _hub;
+	}
+#endif
+}
+
+// parses a Sec-WebSocket-Extensions header into offers, each with its name as key "" and its parameters
+
+static Array<Dic<> > parseExtensions(const String& header)
+{
+	Array<Dic<> > offers;
+	Array<String> items = header.split(',');
+	foreach(String& item, items)
+	{
+		Dic<> offer;
+		Array<String> parts = item.split(';');
+		for (int i = 0; i < parts.length(); i++)
+		{
+			String part = parts[i].trim();
+			int j = part.indexOf('=');
+			if (i == 0)
+				offer[""] = part;
+			else if (j < 0)
+				offer[part] = "";
+			else
+				offer[part.substring(0, j).trim()] = part.substring(j + 1).trim().replace("\"", "");
+		}
+		offers << offer;
+	}
+	return offers;
+}
+
+// chooses a permessage-deflate offer compatible with the server options and returns the response extension, with
+// the parameters the server will use in `bits` and `noContext`
+
+static String acceptDeflate(const String& header, const WebSocketCompression& options, int& bits, bool& noContext)
+{
+	Array<Dic<> > offers = parseExtensions(header);
+	foreach(Dic<>& offer, offers)
+	{
+		if (offer[""] != "permessage-deflate")
+			continue;
+		String response = "permessage-deflate";
+		bits = options.serverMaxWindowBits;
+		if (offer.has("server_max_window_bits"))
+		{
+			int n = offer["server_max_window_bits"];
+			if (n < 9 || n > 15) // zlib cannot compress with a 256 byte window
+				continue;
+			bits = min(bits, n);
+			response << "; server_max_window_bits=" << bits;
+		}
+		else if (bits < 15)
+			continue; // the client cannot be told the server uses a smaller window
+		noContext = options.serverNoContextTakeover || offer.has("server_no_context_takeover");
+		if (noContext)
+			response << "; server_no_context_takeover";
+		if (options.clientNoContextTakeover)
+			response << "; client_no_context_takeover";
+		if (offer.has("client_max_window_bits") && options.clientMaxWindowBits < 15)
+			response << "; client_max_window_bits=" << max(options.clientMaxWindowBits, 9);
+		return response;
+	}
+	return String();
+}
+
+// reads the request line and headers of a handshake request
+
+static bool readHandshake(Socket& client, Dic<String>& headers)
 {
 	String head = client.readLine();
 	int i = head.indexOf(' ');
 	if (i == -1)
-		return;
+		return false;
 	int j = head.indexOf(' ', i + 1);
 	if (j == -1)
-		return;
+		return false;
 	String method = head.substring(0, i);
 	String res = head.substring(i + 1, j);
 
 	String line;
-	Dic<String> headers;
 	while (line = client.readLine(), line != "\r")
 	{
 		line = line.trim();
 		int c = line.indexOf(':');
 		if (c < 0) {
 			client.close();
-			return;
+			return false;
 		}
 		String name = line.substring(0, c);
 		String cname;
@@ -92,15 +528,22 @@ void WebSocketServer::serve(Socket client)
 
 	DEBUG_LOG("%s\n\n\n", *headers.join("\n", ": "));
 
-	process(client, headers);
+	return true;
 }
 
-void WebSocketServer::process(Socket& client, const Dic<String>& headers)
+void WebSocketServer::serve(Socket client)
+{
+	Dic<String> headers;
+	if (readHandshake(client, headers))
+		process(client, headers);
+}
+
+bool WebSocketServer::handshake(Socket& client, const Dic<String>& headers, WebSocket& ws)
 {
 	if (!headers.has("Upgrade") || headers["Upgrade"] != "websocket" || !headers["Connection"].split(", ").contains("Upgrade"))
 	{
 		client << "HTTP/1.1 400 Bad request\r\n\r\nNot a WebSocket request";
-		return;
+		return false;
 	}
 
 	String key = headers["Sec-Websocket-Key"];
@@ -115,31 +558,195 @@ void WebSocketServer::process(Socket& client, const Dic<String>& headers)
 
 	if (headers.has("Sec-Websocket-Protocol"))
 		client << "Sec-Websocket-Protocol: chat\r\n";
+
+	int bits = 15;
+	bool noContext = false;
+	String extension;
+#ifdef ASL_ZLIB
+	if (_compression.enabled && headers.has("Sec-Websocket-Extensions"))
+		extension = acceptDeflate(headers["Sec-Websocket-Extensions"], _compression, bits, noContext);
+	if (extension)
+		client << "Sec-WebSocket-Extensions: " << extension << "\r\n";
+#endif
 	client << "\r\n";
 
+	if (extension)
+		ws._z = new WebSocketDeflate(_compression.level, bits, noContext, _compression.threshold,
+			_compression.maxMessageSize);
+	return true;
+}
+
+void WebSocketServer::process(Socket& client, const Dic<String>& headers)
+{
 	WebSocket ws(client, false);
+	if (!handshake(client, headers, ws))
+		return;
 	{
 		Lock l(_mutex);
 		_clients << &ws;
 	}
+	onOpen(ws);
 	serve(ws);
+	remove(ws);
+	onClose(ws);
+	client.close();
+}
+
+void WebSocketServer::remove(WebSocket& ws)
+{
+	Lock l(_mutex);
+	_clients.removeOne(&ws);
+	foreach2(String& topic, Array<WebSocket*>& list, _topics)
+	{
+		(void)topic;
+		list.removeOne(&ws);
+	}
+#ifdef ASL_WS_HUB
+	if (WsConnection* c = ws._conn)
+	{
+		if (c->registered)
+			epoll_ctl(_hub->epoll, EPOLL_CTL_DEL, c->socket.handle(), NULL);
+		_hub->conns.remove(c->socket.handle());
+	}
+#endif
+}
+
+void WebSocketServer::serve(WebSocket& ws)
+{
+	while (!ws.closed() && !_requestStop)
+	{
+		if (!ws.wait(1))
+			continue;
+		WebSocketMsg msg = ws.receive();
+		if (msg)
+			onMessage(ws, msg);
+	}
+}
+
+// in hub mode, the first input of a connection is the handshake, and then each input is a message
+
+bool WebSocketServer::serveInput(Socket client)
+{
+#ifdef ASL_WS_HUB
+	WsConnection* c = NULL;
 	{
 		Lock l(_mutex);
-		_clients.removeOne(&ws);
+		if (!_hub)
+		{
+			_hub = new WsHub(this, _compression);
+			_hub->start();
+		}
+		WsConnection** p = _hub->conns.find(client.handle());
+		if (p && (*p)->socket == client)
+			c = *p;
 	}
-	client.close();
+	if (!c)
+	{
+		Dic<String> headers;
+		if (!readHandshake(client, headers))
+			return false;
+		c = new WsConnection(_hub, client);
+#ifdef ASL_TLS
+		c->tls = !!client.as<TlsSocket>();
+#endif
+		if (!handshake(client, headers, c->ws))
+		{
+			delete c;
+			return false;
+		}
+		{
+			Lock l(_mutex);
+			_hub->conns[client.handle()] = c;
+			_clients << &c->ws;
+		}
+		onOpen(c->ws);
+		return !c->ws._closed;
+	}
+	WebSocketMsg msg = c->ws.receive();
+	if (msg && !c->ws._closed)
+		onMessage(c->ws, msg);
+	return !c->ws._closed;
+#else
+	serve(client);
+	return false;
+#endif
+}
+
+void WebSocketServer::clientClosed(Socket client)
+{
+#ifdef ASL_WS_HUB
+	WsConnection* c = NULL;
+	{
+		Lock l(_mutex);
+		WsConnection** p = _hub ? _hub->conns.find(client.handle()) : NULL;
+		if (p && (*p)->socket == client)
+			c = *p;
+	}
+	if (!c)
+		return;
+	remove(c->ws);
+	c->ws._closed = true;
+	onClose(c->ws);
+	delete c;
+#else
+	(void)client;
+#endif
+}
+
+void WebSocketServer::send(const byte* p, int n, WebSocket::FrameType type, const String* topic)
+{
+	Lock l(_mutex);
+	const Array<WebSocket*>* clients = topic ? _topics.find(*topic) : &_clients;
+	if (!clients || n <= 0)
+		return;
+#ifdef ASL_WS_HUB
+	if (_hub)
+	{
+		_hub->send(*clients, p, n, type);
+		return;
+	}
+#endif
+	for (int i = 0; i < clients->length(); i++)
+		(*clients)[i]->send(p, n, type);
 }
 
+void WebSocketServer::broadcast(const Var& msg)
+{
+	broadcast(Json::encode(msg));
+}
+
+void WebSocketServer::publish(const String& topic, const Var& msg)
+{
+	publish(topic, Json::encode(msg));
+}
 
+void WebSocketServer::subscribe(WebSocket& ws, const String& topic)
+{
+	Lock l(_mutex);
+	Array<WebSocket*>& list = _topics[topic];
+	if (list.indexOf(&ws) < 0)
+		list << &ws;
+}
 
-void WebSocketServer::serve(WebSocket&)
+void WebSocketServer::unsubscribe(WebSocket& ws, const String& topic)
 {
+	Lock l(_mutex);
+	Array<WebSocket*>* list = _topics.find(topic);
+	if (!list)
+		return;
+	list->removeOne(&ws);
+	if (list->length() == 0)
+		_topics.remove(topic);
 }
 
 WebSocket::WebSocket()
 {
 	_isClient = true;
 	_closed = true;
+	_batching = false;
+	_sentBytes = 0;
+	_compression.enabled = false;
+	_conn = NULL;
 	_code = 1000;
 	_socket.setEndian(ENDIAN_BIG);
 }
@@ -149,6 +756,10 @@ WebSocket::WebSocket(const Socket& s, bool isclient):
 	_isClient(isclient)
 {
 	_closed = false;
+	_batching = false;
+	_sentBytes = 0;
+	_compression.enabled = false;
+	_conn = NULL;
 	_code = 1000;
 	_socket.setEndian(ENDIAN_BIG);
 	_socket.setBlocking(true);
@@ -186,14 +797,33 @@ bool WebSocket::connect(const String& uri, int port)
 
 	String key64 = encodeBase64(key, 16);
 
-	_socket << String(200, "GET %s HTTP/1.1\r\n"
+	String offer;
+#ifdef ASL_ZLIB
+	const WebSocketCompression& z = _compression;
+	if (z.enabled)
+	{
+		offer << "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits";
+		if (z.clientMaxWindowBits < 15)
+			offer << '=' << max(z.clientMaxWindowBits, 9);
+		if (z.serverMaxWindowBits < 15)
+			offer << "; server_max_window_bits=" << max(z.serverMaxWindowBits, 9);
+		if (z.serverNoContextTakeover)
+			offer << "; server_no_context_takeover";
+		if (z.clientNoContextTakeover)
+			offer << "; client_no_context_takeover";
+		offer << "\r\n";
+	}
+#endif
+
+	_socket << String(300, "GET %s HTTP/1.1\r\n"
 		"Host: %s:%i\r\n"
 		"Upgrade: websocket\r\n"
 		"Connection: Upgrade\r\n"
 		"Sec-WebSocket-Key: %s\r\n"
 		"Sec-WebSocket-Protocol: chat\r\n"
 		"Sec-WebSocket-Version: 13\r\n"
-		"Pragma: no-cache\r\n\r\n", *url.path, *url.host, url.port, *key64);
+		"%s"
+		"Pragma: no-cache\r\n\r\n", *url.path, *url.host, url.port, *key64, *offer);
 
 	String line = _socket.readLine();
 	int i = line.indexOf(' ');
@@ -236,6 +866,29 @@ bool WebSocket::connect(const String& uri, int port)
 		return false;
 	}
 
+	_z = Shared<WebSocketDeflate>();
+	foreach2(String& name, String& value, headers)
+	{
+		if (name.toLowerCase() != "sec-websocket-extensions")
+			continue;
+		Array<Dic<> > extensions = parseExtensions(value);
+		if (!offer || extensions.length() != 1 || extensions[0][""] != "permessage-deflate")
+		{
+			_socket.close();
+			return false;
+		}
+		Dic<>& params = extensions[0];
+		int bits = params.has("client_max_window_bits") ? (int)params["client_max_window_bits"] : 15;
+		if (bits < 9 || bits > 15)
+		{
+			_socket.close();
+			return false;
+		}
+		bool noContext = _compression.clientNoContextTakeover || params.has("client_no_context_takeover");
+		_z = new WebSocketDeflate(_compression.level, min(bits, _compression.clientMaxWindowBits), noContext,
+			_compression.threshold, _compression.maxMessageSize);
+	}
+
 	_closed = false;
 
 	return true;
@@ -243,8 +896,16 @@ bool WebSocket::connect(const String& uri, int port)
 
 void WebSocket::close()
 {
-	_socket.close();
 	_closed = true;
+#ifdef ASL_WS_HUB
+	if (_conn) // the hub releases the socket when the reactor removes it
+	{
+		Lock _(_conn->mutex);
+		_conn->kill();
+		return;
+	}
+#endif
+	_socket.close();
 }
 
 bool WebSocket::closed()
@@ -252,93 +913,154 @@ bool WebSocket::closed()
 	if (_closed)
 		return true;
 	if (_socket.disconnected()) {
-		_closed = true;
-		_socket.close();
+		close();
 		return true;
 	}
 	return false;
 }
 
+// XORs `n` bytes with the 4-byte mask `key` (repeated), from `src` to `dst`, which can be the same buffer
+
+static void maskBytes(byte* dst, const byte* src, int n, const byte* key)
+{
+	unsigned k;
+	memcpy(&k, key, 4);
+	int i = 0;
+#ifdef ASL_WS_SSE2
+	__m128i m = _mm_set1_epi32((int)k);
+	for (; i + 32 <= n; i += 32)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(src + i + 16));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(a, m));
+		_mm_storeu_si128((__m128i*)(dst + i + 16), _mm_xor_si128(b, m));
+	}
+	for (; i + 16 <= n; i += 16)
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src + i)), m));
+#endif
+	ULong k8 = k | ((ULong)k << 32);
+	for (; i + 8 <= n; i += 8)
+	{
+		ULong x;
+		memcpy(&x, src + i, 8);
+		x ^= k8;
+		memcpy(dst + i, &x, 8);
+	}
+	for (; i < n; i++)
+		dst[i] = src[i] ^ key[i & 3];
+}
+
 WebSocketMsg WebSocket::receive()
 {
+	if (_batching)
+		flush();
 	WebSocketMsg msg;
-	bool haveMsg = false;
-	while (!haveMsg)
-	{
-		ByteArray buffer;
-		byte b0, mlen;
-		DEBUG_LOG("receive\n");
-		if (closed()) {
-			return msg.fix();
+	ByteArray& data = msg._data;
+	bool compressed = false;
+	int opcode = 0;
+	while (!_closed)
+	{
+		byte head[14];
+		if (_socket.read(head, 2) < 2)
+		{
+			close();
+			break;
+		}
+		bool fin = !!(head[0] & 0x80);
+		opcode = head[0] & 0x0f;
+		if ((opcode == 1 || opcode == 2) && (head[0] & 0x40)) // first frame of a compressed message
+		{
+			if (!_z)
+			{
+				close();
+				break;
+			}
+			compressed = true;
 		}
-		DEBUG_LOG("avail %i\n", _socket.available());
-		_socket >> b0 >> mlen;
-		DEBUG_LOG("%i %i\n", b0, mlen);
-		if (closed()) {
-			return msg.fix();
+		bool masked = !!(head[1] & 0x80);
+		int len7 = head[1] & 0x7f;
+		int extra = (len7 == 126 ? 2 : len7 == 127 ? 8 : 0) + (masked ? 4 : 0);
+		if (extra > 0 && _socket.read(head + 2, extra) < extra)
+		{
+			close();
+			break;
 		}
-		bool fin = !!(b0 & 0x80);
-		int opcode = b0 & 0x0f;
-		bool masked = !!(mlen & 0x80);
-		int len = mlen & 0x7f;
-		if (len == 126)
+		ULong len = len7;
+		if (len7 == 126)
+			len = (head[2] << 8) | head[3];
+		else if (len7 == 127)
 		{
-			len = _socket.read<unsigned short>();
+			len = 0;
+			for (int i = 0; i < 8; i++)
+				len = (len << 8) | head[2 + i];
+		}
+		const byte* key = head + extra - 2;
+		if (len > 0x7fffffff - (ULong)data.length()) // larger than we can hold
+		{
+			close();
+			break;
 		}
-		else if (len == 127)
-			len = (int)_socket.read<Long>(); // what if length larger than int?
-
-		unsigned mask = 0;
-		if (masked)
-			_socket >> mask;
-
-		buffer.resize(buffer.length() + len);
-		if (len > 0)
-			_socket.read(buffer.data() + buffer.length() - len, len);
 
 		DEBUG_LOG("frame: op %i fin %i len %i\n", opcode, fin ? 1 : 0, (int)len);
 
-		if (masked)
+		// data frames are read directly at the end of the message, control frames to their own buffer (not the one
+		// used for sending, as another thread may be sending)
+		bool control = opcode >= 8;
+		ByteArray& buffer = control ? _control : data;
+		int n = (int)len, start = control ? 0 : data.length();
+		buffer.resize(start + n);
+		if (n > 0 && _socket.read(buffer.data() + start, n) < n)
 		{
-			swapBytes(mask);
-			buffer.resize(buffer.length() + 4);
-			buffer.resize(buffer.length() - 4);
-			int n = buffer.length() / 4 + 1;
-			for (int i = 0; i < n; i++)
-			{
-				((unsigned*)buffer.data())[i] ^= mask;
-			}
+			close();
+			break;
 		}
+		if (masked)
+			maskBytes(buffer.data() + start, buffer.data() + start, n, key);
 
 		switch (opcode)
 		{
-		case 0: // continuation
-		case 1: // text
-		case 2: // binary
-			msg.append(buffer);
-			break;
 		case 8: // connection close
 		{
-			if (buffer.length() >= 2) {
-				_code = (buffer[0] << 8) | buffer[1];
-				buffer.remove(0, 2);
-				msg = buffer;
+			if (n >= 2) {
+				_code = (_control[0] << 8) | _control[1];
+				data = ByteArray(_control.data() + 2, n - 2);
 			}
-			haveMsg = true;
-			_closed = true;
-			_socket.close();
+			fin = true;
+			close();
 			break;
 		}
 		case 9: // ping
-			send(buffer.data(), buffer.length(), FRAME_PONG);
-			break;
-		case 10: // pong
-			buffer.clear();
+			sendFrame(_control.data(), n, FRAME_PONG, true);
+			if (_batching)
+				flush();
 			break;
 		}
 
 		if (fin)
-			haveMsg = true;
+			break;
+	}
+
+	if (compressed && opcode < 8 && !_closed)
+	{
+		// the deflate block ends with an empty stored block that was removed
+		static const byte tail[] = { 0, 0, 0xff, 0xff };
+		data.append(tail, 4);
+		ByteArray out;
+		if (!_z->inflater.decompress(data.data(), data.length(), out, _z->maxSize))
+		{
+			if (out.length() >= _z->maxSize) // a message too big, maybe a small frame that inflates a lot
+			{
+				static const byte tooBig[] = { 1009 >> 8, 1009 & 0xff };
+				ByteArray reason(tooBig, 2);
+				sendFrame(reason.data(), 2, FRAME_CLOSE, true);
+				if (_batching)
+					flush();
+				_code = 1009;
+			}
+			close();
+			out.clear();
+		}
+		data = out;
 	}
 
 	return msg.fix();
@@ -350,44 +1072,122 @@ void WebSocket::send(const Var& v)
 }
 
 void WebSocket::send(const byte* p, int length, FrameType type)
+{
+	sendMessage(p, length, type, false);
+}
+
+void WebSocket::sendInPlace(byte* p, int length, FrameType type)
+{
+	sendMessage(p, length, type, true);
+}
+
+// messages are compressed (with the RSV1 bit set) if compression was negotiated and they are large enough
+
+void WebSocket::sendMessage(const byte* p, int length, FrameType type, bool inPlace)
 {
 	if (length <= 0 || _closed)
 		return;
-	byte opcode = (type == FRAME_TEXT) ? 1 : (type == FRAME_BINARY) ? 2 : (type == FRAME_PONG) ? 10 : (type == FRAME_PING) ? 9 : 8;
-	byte b0 = 0x80 | opcode;
-	byte masked = _isClient ? 0x80 : 0;
-	StreamBuffer buf(ENDIAN_BIG);
-	buf << b0;
-	Long len = length;
-	if (len < 126)
-		buf << byte(masked | (byte)len);
-	else if (len < (1 << 16))
-		buf << byte(masked | (byte)126) << (unsigned short)len;
-	else
-		buf << byte(masked | (byte)127) << len;
-
-	unsigned mask = 0;
-	if (_isClient) {
-		mask = _random.get();
-		buf << mask;
-	}
-	ByteArray data(p, length);
-	if (mask != 0){
-		swapBytes(mask);
-		data.resize(data.length() + 4);
-		data.resize(data.length() - 4);
-		int n = data.length() / 4 + 1;
-		for (int i = 0; i < n; i++)
-		{
-			((unsigned*)data.data())[i] ^= mask;
-		}
+	if (!_z || length < _z->threshold || (type != FRAME_TEXT && type != FRAME_BINARY))
+	{
+		sendFrame(p, length, type, inPlace);
+		return;
+	}
+	ByteArray& out = _z->buffer;
+	out.resize(0);
+	if (!_z->deflater.compress(p, length, out, Deflater::SYNC) || out.length() < 4)
+	{
+		close();
+		return;
+	}
+	out.resize(out.length() - 4); // remove the 00 00 ff ff of the flush
+	if (_z->noContextTakeover)
+		_z->deflater.reset();
+	sendFrame(out.data(), out.length(), type | 0x40, true);
+}
+
+// the header and payload go in one gather write; client data that cannot be masked in place is masked in blocks
+// into a scratch buffer, or directly into the queue when batching. Frames are sent under a lock, as pongs are sent
+// from the receiving thread and a frame can take several writes.
+
+void WebSocket::sendFrame(const byte* p, int length, int opcode, bool inPlace)
+{
+	Lock _(_sendLock);
+	byte head[14];
+	int h = frameHeader(head, length, opcode, _isClient);
+	const byte* key = head + h;
+	if (_isClient)
+	{
+		unsigned mask = _random.get();
+		memcpy(head + h, &mask, 4);
+		h += 4;
+		if (inPlace)
+			maskBytes((byte*)p, p, length, key);
+	}
+	bool mask = _isClient && !inPlace;
+	_sentBytes += h + length;
+
+	if (_batching)
+	{
+		_out.append(head, h);
+		int i = _out.length();
+		_out.resize(i + length);
+		if (mask)
+			maskBytes(_out.data() + i, p, length, key);
+		else
+			memcpy(_out.data() + i, p, length);
+		if (_out.length() >= ASL_WS_BLOCK)
+			flush();
+		return;
+	}
+
+	if (!mask)
+	{
+		SocketSpan spans[2] = { { head, h }, { p, length } };
+		output(spans, 2);
+		return;
+	}
+
+	_buffer.resize(min(length, (int)ASL_WS_BLOCK));
+	for (int i = 0; i < length; i += ASL_WS_BLOCK)
+	{
+		int n = min(length - i, (int)ASL_WS_BLOCK);
+		maskBytes(_buffer.data(), p + i, n, key);
+		SocketSpan spans[2] = { { head, i == 0 ? h : 0 }, { _buffer.data(), n } };
+		if (output(spans, 2) != spans[0].length + n)
+			break;
 	}
-	if (!_closed || _socket.disconnected())
-		_socket << *buf << data;
+}
+
+void WebSocket::setBatching(bool on)
+{
+	_batching = on;
+	if (!on)
+		flush();
+}
+
+bool WebSocket::flush()
+{
+	if (_out.length() == 0)
+		return !_closed;
+	SocketSpan span = { _out.data(), _out.length() };
+	bool ok = output(&span, 1) == span.length;
+	_out.resize(0);
+	return ok;
+}
+
+int WebSocket::output(const SocketSpan* spans, int n)
+{
+#ifdef ASL_WS_HUB
+	if (_conn)
+		return _conn->write(spans, n);
+#endif
+	return _socket.write(spans, n);
 }
 
 bool WebSocket::wait(double timeout)
 {
+	if (_batching)
+		flush();
 	return _socket.waitInput(timeout);
 }
 
@@ -2,16 +2,20 @@
 #include <asl/TextFile.h>
 #include <stdio.h>
 #include <ctype.h>
-#include <locale.h>
 
 #if defined(_MSC_VER) && _MSC_VER < 1800
 #include <float.h>
 #endif
 
-#ifdef ASL_FAST_JSON
-#define ASL_ATOF myatof
-#else
-#define ASL_ATOF atof
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ASL_XDL_SSE2
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
 #endif
 
 #ifdef _MSC_VER
@@ -40,6 +44,67 @@ struct XdlSinkFile : XdlSink
 	void write(String& s) { file << s; s = ""; }
 };
 
+static inline int firstBit(unsigned x)
+{
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward(&i, x);
+	return (int)i;
+#else
+	return __builtin_ctz(x);
+#endif
+}
+
+// Returns the position of the first quote, backslash or control char in [p, end), scanning in blocks if possible
+
+static inline const char* findStringEnd(const char* p, const char* end)
+{
+#ifdef __AVX2__
+	const __m256i q32 = _mm256_set1_epi8('"'), b32 = _mm256_set1_epi8('\\'), c32 = _mm256_set1_epi8(0x1f);
+	for (; p + 32 <= end; p += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)p);
+		__m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, q32), _mm256_cmpeq_epi8(v, b32)),
+			_mm256_cmpeq_epi8(_mm256_max_epu8(v, c32), c32));
+		unsigned mask = (unsigned)_mm256_movemask_epi8(m);
+		if (mask)
+			return p + firstBit(mask);
+	}
+#endif
+#ifdef ASL_XDL_SSE2
+	const __m128i q = _mm_set1_epi8('"'), b = _mm_set1_epi8('\\'), c = _mm_set1_epi8(0x1f);
+	for (; p + 16 <= end; p += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+		__m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, q), _mm_cmpeq_epi8(v, b)), _mm_cmpeq_epi8(_mm_max_epu8(v, c), c));
+		unsigned mask = (unsigned)_mm_movemask_epi8(m);
+		if (mask)
+			return p + firstBit(mask);
+	}
+#endif
+	for (; p < end; p++)
+	{
+		char c = *p;
+		if (c == '"' || c == '\\' || (unsigned char)c < ' ')
+			break;
+	}
+	return p;
+}
+
+static inline const char* skipDigits(const char* p)
+{
+	while (unsigned(*p - '0') < 10u)
+		p++;
+	return p;
+}
+
+static inline const char* skipSpaces(const char* p)
+{
+	while (*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r')
+		p++;
+	return p;
+}
+
 enum StateN {
 	NUMBER, INT, STRING, PROPERTY, IDENTIFIER,
 	NUMBER_E, NUMBER_ES, NUMBER_EV, NUMBER_DOT, MINUS, WAIT_SEP,
@@ -50,16 +115,21 @@ enum ContextN {ROOT, ARRAY, OBJECT, COMMENT1, COMMENT, LINECOMMENT, ENDCOMMENT};
 
 #define INDENT_CHAR '\t'
 
-Var Xdl::decode(const String& xdl)
+Var Xdl::decode(const String& xdl, int mode)
 {
 	XdlParser parser;
+	if (mode & Json::ARENA)
+	{
+		Arena arena;
+		Arena::Scope scope(arena);
+		return parser.decode(xdl);
+	}
 	return parser.decode(xdl);
 }
 
-Var Json::decode(const String& json)
+Var Json::decode(const String& json, Json::Mode mode)
 {
-	XdlParser parser;
-	return parser.decode(json);
+	return Xdl::decode(json, mode);
 }
 
 String Xdl::encode(const Var& data, int mode)
@@ -73,28 +143,26 @@ String Json::encode(const Var& data, Json::Mode mode)
 	return Xdl::encode(data, mode | Json::JSON);
 }
 
-Var Xdl::read(const String& file)
+#define XDL_CHUNK_SIZE 16384
+
+static void skipBom(File& file)
 {
-	XdlParser parser;
-	TextFile tfile(file, File::READ);
-	if (!tfile)
-		return Var();
-	int size = int(clamp(tfile.size(), 0ll, 100000ll));
-	if (size == 0)
-		return Var();
-	Array<char> buffer(min(16382, size) + 1);
 	byte bom[3];
-	if(tfile.read(bom, 3) == 3 && !(bom[0] == 0xef && bom[1] == 0xbb && bom[2] == 0xbf))
-		tfile.seek(0);
-	while (1)
+	if (file.read(bom, 3) != 3 || !(bom[0] == 0xef && bom[1] == 0xbb && bom[2] == 0xbf))
+		file.seek(0);
+}
+
+Var Xdl::read(const String& file, int mode)
+{
+	if (mode & Json::ARENA)
 	{
-		int n = tfile.read(buffer.data(), buffer.length() - 1);
-		buffer[n] = '\0';
-		parser.parse(buffer.data());
-		if (n < buffer.length() - 1)
-			break;
+		Arena arena;
+		Arena::Scope scope(arena);
+		return read(file, mode & ~Json::ARENA);
 	}
-	parser.parse(" ");
+	XdlParser parser;
+	if (!parser.parseFile(file))
+		return Var();
 	return parser.value();
 }
 
@@ -109,9 +177,9 @@ bool Xdl::write(const Var& v, const String& file, int mode)
 	return true;
 }
 
-Var Json::read(const String& file)
+Var Json::read(const String& file, Json::Mode mode)
 {
-	return Xdl::read(file);
+	return Xdl::read(file, mode);
 }
 
 bool Json::write(const Var& v, const String& file, Json::Mode mode)
@@ -123,7 +191,7 @@ bool Json::write(const Var& v, const String& file, Json::Mode mode)
 inline void XdlParser::value_end()
 {
 	_state = State((_context.top() == ROOT) ? WAIT_VALUE : WAIT_SEP);
-	_buffer="";
+	_buffer.clear();
 }
 
 void XdlParser::reset()
@@ -131,19 +199,101 @@ void XdlParser::reset()
 	_context.clear();
 	_context << ROOT;
 	_state = WAIT_VALUE;
-	_buffer = "";
+	_prevState = _state;
+	_buffer.clear();
+	_inComment = false;
+	_unicodeCount = 0;
+	_props.clear();
+	_lists.clear();
+	_lists << Var(Var::ARRAY);
+}
+
+// Fast path for a number entirely contained in the current chunk. Returns the position after it or NULL if it has to
+// go through the state machine (split between chunks, followed by a comment, unusual syntax or errors).
+
+const char* XdlParser::parseNumber(const char* p, const char* end)
+{
+	const char* q = p;
+	if (*q == '-')
+		q++;
+	const char* d = q;
+	q = skipDigits(q);
+	if (q == d || (*d == '0' && q - d > 1))
+		return NULL;
+	bool real = false;
+	if (*q == '.')
+	{
+		d = ++q;
+		q = skipDigits(q);
+		if (q == d)
+			return NULL;
+		real = true;
+	}
+	if (*q == 'e' || *q == 'E')
+	{
+		if (*++q == '+' || *q == '-')
+			q++;
+		d = q;
+		q = skipDigits(q);
+		if (q == d)
+			return NULL;
+		real = true;
+	}
+	int n = int(q - p);
+	if (q >= end || n > 63 || *q == '/' || (real && !(*q == ',' || myisspace(*q) || *q == ']' || *q == '}')))
+		return NULL;
+	if (real || n > 9) // the number ends at a delimiter, so it can be read in place
+	{
+		double x;
+		myatof(p, x);
+		new_number(x);
+	}
+	else
+	{
+		char number[16];
+		memcpy(number, p, n);
+		number[n] = '\0';
+		new_number(myatoiz(number));
+	}
+	value_end();
+	return q;
+}
+
+bool XdlParser::error() const
+{
+	return _state == ERR;
+}
+
+bool XdlParser::parseFile(const String& file)
+{
+	TextFile tfile(file, File::READ);
+	if (!tfile)
+		return false;
+	skipBom(tfile);
+	Array<char> buffer(XDL_CHUNK_SIZE + 1);
+	while (_state != ERR)
+	{
+		int n = max(0, tfile.read(buffer.data(), XDL_CHUNK_SIZE));
+		buffer[n] = '\0';
+		parse(buffer.data());
+		if (n < XDL_CHUNK_SIZE)
+			break;
+	}
+	parse(" ");
+	return _state != ERR;
 }
 
 void XdlParser::parse(const char* s)
 {
 	if(_state == ERR)
 		return;
+	const char* end = s + strlen(s);
 	while(char c=*s++)
 	{
 		Context ctx = _context.top();
 		if(!_inComment)
 		{
-			if(c=='/' && _state != STRING && _state != ESCAPE)
+			if(c=='/' && _state != STRING && _state != QPROPERTY && _state != ESCAPE)
 			{
 				_inComment = true;
 				_context << COMMENT1;
@@ -182,7 +332,7 @@ void XdlParser::parse(const char* s)
 			}
 			break;
 		default:
-			if(c=='/' && _state != STRING)
+			if(c=='/' && _state != STRING && _state != QPROPERTY && _state != ESCAPE)
 			{
 				_inComment = true;
 				_context << COMMENT1;
@@ -215,7 +365,9 @@ void XdlParser::parse(const char* s)
 		case INT:
 			if(c>='0' && c<='9')
 			{
-				_buffer << c;
+				const char* e = skipDigits(s);
+				_buffer.append(s - 1, int(e - s) + 1);
+				s = e;
 			}
 			else if(c=='.')
 			{
@@ -240,7 +392,7 @@ void XdlParser::parse(const char* s)
 					return;
 
 				if (_buffer.length() > 9) // check better if it fits in an int32
-					new_number(ASL_ATOF(_buffer));
+					new_number(myatof(_buffer));
 				else
 					new_number(myatoiz(_buffer));
 				value_end();
@@ -296,19 +448,13 @@ void XdlParser::parse(const char* s)
 		case NUMBER_EV:
 			if (c >= '0' && c <= '9')
 			{
-				_buffer << c;
+				const char* e = skipDigits(s);
+				_buffer.append(s - 1, int(e - s) + 1);
+				s = e;
 			}
 			else if (c == ',' || myisspace(c) || c == ']' || c == '}')
 			{
-#ifndef ASL_FAST_JSON
-				for (char* p = _buffer.data(); *p; p++)
-					if (*p == '.')
-					{
-						*p = _ldp;
-						break;
-					}
-#endif
-				new_number(ASL_ATOF(_buffer));
+				new_number(myatof(_buffer));
 				value_end();
 				s--;
 			}
@@ -321,7 +467,9 @@ void XdlParser::parse(const char* s)
 		case NUMBER:
 			if(c >= '0' && c <= '9')
 			{
-				_buffer << c;
+				const char* e = skipDigits(s);
+				_buffer.append(s - 1, int(e - s) + 1);
+				s = e;
 			}
 			else if (c == 'e' || c == 'E')
 			{
@@ -330,15 +478,7 @@ void XdlParser::parse(const char* s)
 			}
 			else if(c == ',' || myisspace(c) || c == ']' || c == '}')
 			{
-#ifndef ASL_FAST_JSON
-				for(char* p = _buffer.data(); *p; p++)
-					if (*p == '.')
-					{
-						*p = _ldp;
-						break;
-					}
-#endif
-				new_number(ASL_ATOF(_buffer));
+				new_number(myatof(_buffer));
 				value_end();
 				s--;
 			}
@@ -366,8 +506,12 @@ void XdlParser::parse(const char* s)
 				_state = ERR;
 				return;
 			}
-			else
-				_buffer << c;
+			else // copy up to the next quote, escape or control char
+			{
+				const char* e = findStringEnd(s, end);
+				_buffer.append(s - 1, int(e - s) + 1);
+				s = e;
+			}
 			break;
 
 		case PROPERTY:
@@ -376,7 +520,7 @@ void XdlParser::parse(const char* s)
 				new_property(_buffer);
 				s--;
 				_state=WAIT_EQUAL;
-				_buffer="";
+				_buffer.clear();
 			}
 			else // not checking possible identifier chars !
 				_buffer << c;
@@ -389,12 +533,16 @@ void XdlParser::parse(const char* s)
 				_prevState = QPROPERTY;
 			}
 			else if (c != '"')
-				_buffer << c;
+			{
+				const char* e = findStringEnd(s, end);
+				_buffer.append(s - 1, int(e - s) + 1);
+				s = e;
+			}
 			else
 			{
 				new_property(_buffer);
 				_state = WAIT_EQUAL;
-				_buffer = "";
+				_buffer.clear();
 			}
 			break;
 
@@ -405,6 +553,14 @@ void XdlParser::parse(const char* s)
 				break;
 			} // No more break
 		case WAIT_VALUE:
+			if (((c >= '0' && c <= '9') || c == '-') && _buffer.length() == 0)
+			{
+				if (const char* e = parseNumber(s - 1, end))
+				{
+					s = e;
+					break;
+				}
+			}
 			if (c >= '0' && c <= '9')
 			{
 				_state = INT;
@@ -417,7 +573,19 @@ void XdlParser::parse(const char* s)
 			}
 			else if (c == '\"')
 			{
-				_state = STRING;
+				const char* e = findStringEnd(s, end);
+				if (*e == '"') // whole string without escapes in this chunk
+				{
+					new_string(String(s, int(e - s)));
+					value_end();
+					s = e + 1;
+				}
+				else
+				{
+					_state = STRING;
+					_buffer.append(s, int(e - s));
+					s = e;
+				}
 			}
 			else if (c == '[')
 			{
@@ -429,7 +597,7 @@ void XdlParser::parse(const char* s)
 				begin_object(_buffer);
 				_state=WAIT_PROPERTY;
 				_context << OBJECT;
-				_buffer="";
+				_buffer.clear();
 			}
 			/*else if(c=='.') // not JSON
 			{
@@ -453,7 +621,9 @@ void XdlParser::parse(const char* s)
 				value_end();
 				end_array();
 			}
-			else if(!myisspace(c) /*&& c != ','*/)
+			else if (myisspace(c))
+				s = skipSpaces(s);
+			else
 			{
 				_state = ERR;
 				return;
@@ -488,7 +658,7 @@ void XdlParser::parse(const char* s)
 				begin_object(_buffer);
 				_state = WAIT_PROPERTY;
 				_context << OBJECT;
-				_buffer = "";
+				_buffer.clear();
 			}
 			else if (!myisspace(c))
 			{
@@ -510,7 +680,19 @@ void XdlParser::parse(const char* s)
 			}
 			else if(c=='"') // JSON
 			{
-				_state=QPROPERTY;
+				const char* e = findStringEnd(s, end);
+				if (*e == '"')
+				{
+					new_property(String(s, int(e - s)));
+					_state = WAIT_EQUAL;
+					s = e + 1;
+				}
+				else
+				{
+					_state = QPROPERTY;
+					_buffer.append(s, int(e - s));
+					s = e;
+				}
 			}
 			else if(c=='}')
 			{
@@ -518,7 +700,9 @@ void XdlParser::parse(const char* s)
 				value_end();
 				end_object();
 			}
-			else if(!myisspace(c) /*&& c != ','*/ && c != '}')
+			else if (myisspace(c))
+				s = skipSpaces(s);
+			else
 			{
 				_state = ERR;
 				return;
@@ -564,7 +748,7 @@ void XdlParser::parse(const char* s)
 				}
 				else if(_buffer=="null")
 				{
-					put(Var::NUL);
+					new_null();
 					value_end();
 				}
 				else
@@ -625,8 +809,6 @@ void XdlParser::parse(const char* s)
 
 XdlParser::XdlParser()
 {
-	lconv* loc = localeconv();
-	_ldp = *loc->decimal_point;
 	_context << ROOT;
 	_state = WAIT_VALUE;
 	_inComment = false;
@@ -692,16 +874,19 @@ void XdlParser::new_property(const String& name)
 	_props << name;
 }
 
+// values are temporaries owned by the callers, so they are moved into their container instead of copied
+
 void XdlParser::put(const Var& x)
 {
 	Var& top = _lists.top();
 	switch(top.type())
 	{
 	case Var::ARRAY:
-		top << x;
+		top << Var();
+		bswap(top[top.length() - 1], const_cast<Var&>(x));
 		break;
 	case Var::OBJ: {
-		top[_props.top()] = x;
+		bswap(top[_props.top()], const_cast<Var&>(x));
 		_props.pop();
 		break;
 	}
@@ -709,6 +894,235 @@ void XdlParser::put(const Var& x)
 	}
 }
 
+// Parser that queues events for XdlReader instead of building a tree
+
+struct XdlEventParser : public XdlParser
+{
+	struct Item
+	{
+		XdlReader::Event event;
+		String name;
+		Var value;
+	};
+	Array<Item> items; // reused between chunks
+	int head, count;
+	XdlEventParser() : head(0), count(0) {}
+	void reset()
+	{
+		XdlParser::reset();
+		head = count = 0;
+	}
+	Item& add(XdlReader::Event e)
+	{
+		if (count == items.length())
+			items.resize(count + 1);
+		Item& item = items[count++];
+		item.event = e;
+		return item;
+	}
+	void addValue(const Var& x) { add(XdlReader::VALUE).value = x; }
+	void new_number(int x) { addValue(x); }
+	void new_number(double x) { addValue(x); }
+	void new_number(float x) { addValue(x); }
+	void new_string(const char* x) { addValue(x); }
+	void new_string(const String& x) { addValue(x); }
+	void new_bool(bool b) { addValue(b); }
+	void new_null() { addValue(Var::NUL); }
+	void begin_array() { add(XdlReader::BEGIN_ARRAY); }
+	void end_array() { add(XdlReader::END_ARRAY); }
+	void begin_object(const char* _class) { add(XdlReader::BEGIN_OBJECT).name = _class; }
+	void end_object() { add(XdlReader::END_OBJECT); }
+	void new_property(const String& name) { add(XdlReader::PROPERTY).name = name; }
+};
+
+XdlReader::XdlReader()
+{
+	_parser = new XdlEventParser;
+	_textPos = 0;
+	_event = NONE;
+	_depth = 0;
+	_eof = true;
+	_truncated = false;
+}
+
+XdlReader::XdlReader(const String& file)
+{
+	_parser = new XdlEventParser;
+	_textPos = 0;
+	_event = NONE;
+	_depth = 0;
+	_eof = true;
+	_truncated = false;
+	open(file);
+}
+
+XdlReader::~XdlReader()
+{
+	delete _parser;
+}
+
+// forgets the previous input and the parsing state, so that a reader can be reused after errors or partial reads
+
+void XdlReader::restart()
+{
+	_file.close();
+	_parser->reset();
+	_text = "";
+	_textPos = 0;
+	_event = NONE;
+	_name = "";
+	_value = Var();
+	_depth = 0;
+	_eof = true;
+	_truncated = false;
+}
+
+bool XdlReader::open(const String& file)
+{
+	restart();
+	if (!_file.open(file, File::READ))
+		return false;
+	skipBom(_file);
+	_chunk.resize(XDL_CHUNK_SIZE + 1);
+	_eof = false;
+	return true;
+}
+
+void XdlReader::setText(const String& text)
+{
+	restart();
+	_text = text;
+	_textPos = 0;
+	_chunk.resize(XDL_CHUNK_SIZE + 1);
+	_eof = false;
+}
+
+void XdlReader::feed()
+{
+	int n = 0;
+	if (_file)
+		n = max(0, _file.read(_chunk.data(), XDL_CHUNK_SIZE));
+	else
+	{
+		n = min(_text.length() - _textPos, XDL_CHUNK_SIZE);
+		memcpy(_chunk.data(), *_text + _textPos, n);
+		_textPos += n;
+	}
+	_chunk[n] = '\0';
+	_parser->parse(_chunk.data());
+	if (n < XDL_CHUNK_SIZE)
+	{
+		_parser->parse(" ");
+		_eof = true;
+		if (_file)
+			_file.close();
+	}
+}
+
+bool XdlReader::next()
+{
+	while (_parser->head == _parser->count)
+	{
+		_parser->head = _parser->count = 0;
+		if (_eof || _parser->error())
+		{
+			if (_event != END)
+				_truncated = _depth != 0 || _event == PROPERTY;
+			_event = END;
+			return false;
+		}
+		feed();
+	}
+	XdlEventParser::Item& item = _parser->items[_parser->head++];
+	_event = item.event;
+	switch (_event)
+	{
+	case BEGIN_OBJECT:
+	case BEGIN_ARRAY:
+		_depth++;
+		_name = item.name;
+		break;
+	case END_OBJECT:
+	case END_ARRAY:
+		_depth--;
+		break;
+	case PROPERTY:
+		_name = item.name;
+		break;
+	case VALUE:
+		_value = item.value;
+		item.value = Var();
+		break;
+	default:
+		break;
+	}
+	return true;
+}
+
+bool XdlReader::error() const
+{
+	return _parser->error() || _truncated;
+}
+
+Var XdlReader::readValue()
+{
+	if (_event == PROPERTY && !next())
+		return Var();
+	if (_event == VALUE)
+		return _value;
+	if (_event != BEGIN_OBJECT && _event != BEGIN_ARRAY)
+		return Var();
+	Stack<Var> values;
+	Stack<String> props;
+	do {
+		Var v;
+		switch (_event)
+		{
+		case BEGIN_OBJECT:
+			values << Var(Var::OBJ);
+			if (_name != "")
+				values.top()[ASL_XDLCLASS] = _name;
+			continue;
+		case BEGIN_ARRAY:
+			values << Var(Var::ARRAY);
+			continue;
+		case PROPERTY:
+			props << _name;
+			continue;
+		case VALUE:
+			v = _value;
+			break;
+		case END_OBJECT:
+		case END_ARRAY:
+			v = values.top();
+			values.pop();
+			if (values.length() == 0)
+				return v;
+			break;
+		default:
+			continue;
+		}
+		if (values.top().is(Var::ARRAY))
+			values.top() << v;
+		else
+		{
+			values.top()[props.top()] = v;
+			props.pop();
+		}
+	} while (next());
+	return Var();
+}
+
+void XdlReader::skip()
+{
+	if (_event == PROPERTY && !next())
+		return;
+	if (_event != BEGIN_OBJECT && _event != BEGIN_ARRAY)
+		return;
+	int depth = _depth;
+	while (_depth >= depth && next()) {}
+}
+
 XdlEncoder::XdlEncoder()
 {
 	_level = 0;
@@ -718,8 +1132,8 @@ XdlEncoder::XdlEncoder()
 	_sep1 = ',';
 	_sep2 = ',';
 	_simple = false;
-	_fmtF = "%.9g";
-	_fmtD = "%.17g";
+	_fmtF = NULL;
+	_fmtD = NULL;
 	_sink = new XdlSinkString(_out);
 }
 
@@ -739,10 +1153,11 @@ String XdlEncoder::encode(const Var& v, Json::Mode mode)
 	_pretty = (mode & Json::PRETTY) != 0;
 	_json = (mode & Json::JSON) != 0;
 	_simple = (mode & Json::SIMPLE) != 0;
-	_fmtF = _simple ? "%.7g" : "%.9g";
-	_fmtD = _simple ? "%.15g" : "%.17g";
+	// exact modes write the shortest text that reads back to the same number
+	_fmtF = _simple ? "%.7g" : NULL;
+	_fmtD = _simple ? "%.15g" : NULL;
 	if (mode & Json::SHORTF)
-		_fmtD = _fmtF;
+		_fmtD = _simple ? _fmtF : "%.9g";
 	if (_pretty)
 		_sep1 = ", ";
 	if (!_json && _pretty)
@@ -894,6 +1309,11 @@ void XdlEncoder::new_number(double x)
 		return;
 	}
 	_out.resize(n + 26);
+	if (!_fmtD)
+	{
+		_out.fix(n + mydtoa(x, &_out[n]));
+		return;
+	}
 	_out.fix(n + snprintf(&_out[n], 27, _fmtD, x));
 
 	// Fix decimal comma of some locales
@@ -926,6 +1346,11 @@ void XdlEncoder::new_number(float x)
 		return;
 	}
 	_out.resize(n + 16);
+	if (!_fmtF)
+	{
+		_out.fix(n + myftoa(x, &_out[n]));
+		return;
+	}
 	_out.fix(n + snprintf(&_out[n], 17, _fmtF, x));
 
 	// Fix decimal comma of some locales
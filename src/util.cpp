@@ -1,5 +1,6 @@
 #include <asl/util.h>
 #include <asl/String.h>
+#include <asl/hash.h>
 #include <stdio.h>
 
 #ifdef _WIN32
@@ -142,6 +143,18 @@ void Random::init(bool fast)
 
 Random random;
 
+ULong _hashSeed = 0;
+
+void setHashSeed(ULong seed)
+{
+	_hashSeed = seed;
+}
+
+void randomizeHashSeed()
+{
+	Random::getBytes(&_hashSeed, sizeof(_hashSeed));
+}
+
 double now()
 {
 #ifdef _WIN32
@@ -0,0 +1,1716 @@
+// Performance benchmarks. These are not part of the test suite, run them by name with optional parameters:
+//
+//   benchmarks SocketServer -idle 10000 -active 1000 -mode threads
+//   benchmarks SocketReadLine -count 20000 -mode buffered
+//   benchmarks SocketPoller -rounds 20000
+//   benchmarks Resolver -host localhost -count 2000
+//   benchmarks HttpFiles -clients 8 -seconds 3 -max 1000000000 -cache 1
+//   benchmarks HttpClient -count 10000 -threads 8
+//   benchmarks WebSocket -count 200000
+//   benchmarks WsCompression -count 20000
+//   benchmarks WsFanout -clients 2000 -count 200 -size 100 -mode hub
+//   benchmarks JsonParse -size 20 -rounds 5
+//   benchmarks HttpCompression -size 100 -count 2000 -level 6
+//   benchmarks Process -count 1000 -parallel 16 -mb 1024
+//   benchmarks TabularDataFile -mb 200
+//   benchmarks TabularWrite -cells 100000000 -flush 0 -sync 0
+//   benchmarks Numbers -count 1000000 -floats 0
+//   benchmarks Log -mode async -threads 4 -count 100000
+//   benchmarks ParallelFor -n 1000 -calls 2000
+//   benchmarks HashMap -max 10000000 -keys string
+//   benchmarks Hash -n 100000
+//   benchmarks Queue -count 200000 -batch 1
+//   benchmarks Matrix -max 2000 -type float -parallel 1
+//   benchmarks VarObject -max 100000
+
+#include <asl/CmdArgs.h>
+#include <asl/ConcurrentQueue.h>
+#include <asl/FlatHashMap.h>
+#include <asl/Directory.h>
+#include <asl/File.h>
+#include <asl/Http.h>
+#include <asl/HttpServer.h>
+#include <asl/Log.h>
+#include <asl/Matrix.h>
+#include <asl/Process.h>
+#include <asl/Queue.h>
+#include <asl/Resolver.h>
+#include <asl/SocketServer.h>
+#include <asl/TabularDataFile.h>
+#include <asl/Thread.h>
+#include <asl/WebSocket.h>
+#include <asl/Xdl.h>
+#include <asl/testing.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <poll.h>
+#endif
+#include <time.h>
+
+ASL_TEST_ENABLE()
+
+using namespace asl;
+
+static CmdArgs* options = NULL;
+
+static int option(const char* name, int def)
+{
+	return options->has(name) ? (int)(*options)[name] : def;
+}
+
+static String option(const char* name, const char* def)
+{
+	return (*options)(name, def);
+}
+
+static unsigned benchRandom(unsigned& seed)
+{
+	seed = seed * 1664525u + 1013904223u;
+	return seed >> 8;
+}
+
+static double percentile(Array<double>& x, double p)
+{
+	if (x.length() == 0)
+		return 0;
+	x.sort();
+	return x[min(int(p * x.length()), x.length() - 1)];
+}
+
+// SocketServer: connections per second and request latency in threaded vs event-driven mode
+
+struct EchoServer : public SocketServer
+{
+	void serve(Socket client)
+	{
+		while (!client.disconnected() && !_requestStop)
+		{
+			if (!client.waitData())
+				continue;
+			if (!serveInput(client))
+				break;
+		}
+	}
+	bool serveInput(Socket client)
+	{
+		String line = client.readLine();
+		if (client.error())
+			return false;
+		client << line + "\n";
+		return true;
+	}
+};
+
+struct EchoClients : public Thread
+{
+	Array<Socket> sockets;
+	Array<double> latencies;
+	int rounds;
+	void run()
+	{
+		for (int r = 0; r < rounds; r++)
+			foreach(Socket& s, sockets)
+			{
+				double t1 = now();
+				s << "ping\n";
+				if (s.readLine() != "ping")
+					return;
+				latencies << now() - t1;
+			}
+	}
+};
+
+ASL_TEST(SocketServer)
+{
+	int port = option("port", 9991);
+	int nidle = option("idle", 10000);
+	int nactive = option("active", 1000);
+	int nthreads = option("threads", 4);
+	int rounds = option("rounds", 20);
+	bool threaded = option("mode", "events") == "threads";
+
+	EchoServer server;
+	if (!server.bind("127.0.0.1", port))
+	{
+		printf("Cannot bind port %i\n", port);
+		return;
+	}
+	server.setEventDriven(!threaded);
+	server.start(true);
+	sleep(0.2);
+
+	printf("Mode: %s\n", threaded ? "thread per client" : "event-driven");
+
+	Array<Socket> idle;
+	double t1 = now();
+	for (int i = 0; i < nidle + nactive; i++)
+	{
+		Socket s;
+		if (!s.connect("127.0.0.1", port))
+		{
+			printf("Connect failed after %i connections\n", i);
+			break;
+		}
+		idle << s;
+	}
+	double t2 = now();
+	printf("Connections: %i in %.3f s, %.0f conn/s\n", idle.length(), t2 - t1, idle.length() / (t2 - t1));
+
+	Array<EchoClients> clients(nthreads);
+	for (int i = 0; i < nactive && idle.length() > 0; i++)
+	{
+		clients[i % nthreads].sockets << idle.last();
+		idle.removeLast();
+	}
+	t1 = now();
+	foreach(EchoClients& c, clients)
+	{
+		c.rounds = rounds;
+		c.start();
+	}
+	Array<double> latencies;
+	foreach(EchoClients& c, clients)
+	{
+		c.join();
+		latencies.append(c.latencies);
+	}
+	t2 = now();
+	printf("Requests: %i in %.3f s, %.0f req/s (%i idle clients)\n", latencies.length(), t2 - t1, latencies.length() / (t2 - t1), idle.length());
+	printf("Latency: p50 %.3f ms, p99 %.3f ms\n", percentile(latencies, 0.5) * 1e3, percentile(latencies, 0.99) * 1e3);
+
+	foreach(Socket& s, idle)
+		s.close();
+	foreach(EchoClients& c, clients)
+		foreach(Socket& s, c.sockets)
+			s.close();
+	server.stop(true);
+}
+
+// SocketReadLine: parsing HTTP request headers from a socket, byte-per-syscall vs buffered reads
+
+struct RequestWriter : public Thread
+{
+	Socket socket;
+	ByteArray block;
+	int count;
+	void run()
+	{
+		for (int i = 0; i < count; i++)
+			socket.write(block.data(), block.length());
+	}
+};
+
+static String unbufferedReadLine(Socket& s) // how Socket::readLine used to read
+{
+	String line;
+	char c;
+	while (::recv(s.handle(), &c, 1, 0) == 1 && c != '\n')
+		line += c;
+	return line;
+}
+
+ASL_TEST(SocketReadLine)
+{
+	int port = option("port", 9992);
+	int count = option("count", 20000);
+	String mode = option("mode", "all");
+
+	String request = "GET /index.html?q=1 HTTP/1.1\r\nHost: localhost\r\nUser-Agent: Mozilla/5.0 (X11; Linux x86_64)\r\n"
+		"Accept: text/html,application/xhtml+xml\r\nAccept-Language: en-US,en;q=0.5\r\nAccept-Encoding: gzip, deflate\r\n"
+		"Connection: keep-alive\r\nCache-Control: max-age=0\r\n\r\n";
+	int requestLines = request.split("\n").length() - 1;
+	ByteArray block((const byte*)*request, request.length());
+
+	Socket server;
+	if (!server.bind("127.0.0.1", port))
+	{
+		printf("Cannot bind port %i\n", port);
+		return;
+	}
+	server.listen();
+
+	Array<String> modes = mode == "all" ? String("unbuffered,buffered,http").split(",") : Array<String>() << mode;
+	foreach(String& m, modes)
+	{
+		RequestWriter writer;
+		writer.block = block;
+		writer.count = count;
+		if (!writer.socket.connect("127.0.0.1", port))
+			return;
+		Socket client = server.accept();
+		writer.start();
+		double t1 = now();
+		int n = 0;
+		if (m == "unbuffered")
+		{
+			for (int i = 0; i < count * requestLines; i++)
+				n += unbufferedReadLine(client).length() > 1;
+			n /= requestLines - 1;
+		}
+		else if (m == "buffered")
+		{
+			for (int i = 0; i < count * requestLines; i++)
+				n += client.readLine().length() > 1;
+			n /= requestLines - 1;
+		}
+		else
+		{
+			for (int i = 0; i < count; i++)
+			{
+				HttpRequest req(client);
+				n += req.hasHeader("Host");
+			}
+		}
+		double t2 = now();
+		writer.join();
+		writer.socket.close();
+		client.close();
+		printf("%-10s %i requests in %.3f s, %.0f headers/s, %.1f MB/s\n", *m, n, t2 - t1, n / (t2 - t1),
+			count * request.length() / (t2 - t1) / 1e6);
+	}
+}
+
+// SocketPoller: cost of waking up for one active socket among 100, 10k and 50k registered ones, with SocketPoller
+// and with a scan of the whole set on each wait, as Sockets::waitInput used to do (with poll() instead of select(),
+// which cannot take descriptors beyond FD_SETSIZE). Sockets are local socket pairs, both ends registered.
+
+#ifndef _WIN32
+
+static int scanWait(Array<Socket>& set, Array<pollfd>& fds, Array<Socket>& changed)
+{
+	fds.resize(set.length());
+	for (int i = 0; i < set.length(); i++)
+	{
+		fds[i].fd = set[i].handle();
+		fds[i].events = POLLIN;
+		fds[i].revents = 0;
+	}
+	if (poll(fds.data(), fds.length(), 1000) < 0)
+		return -1;
+	changed = Array<Socket>();
+	for (int i = 0; i < set.length(); i++)
+		if (fds[i].revents)
+			changed << set[i];
+	return changed.length();
+}
+
+ASL_TEST(SocketPoller)
+{
+	int rounds = option("rounds", 20000);
+	rlimit limit;
+	getrlimit(RLIMIT_NOFILE, &limit);
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+
+	int sizes[] = { 100, 10000, 50000 };
+	for (int k = 0; k < 3; k++)
+	{
+		int n = sizes[k];
+		Array<Socket> set;
+		for (int i = 0; i < n / 2; i++)
+		{
+			int fd[2];
+			if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd) != 0)
+				break;
+			set << Socket(new Socket_(fd[0])) << Socket(new Socket_(fd[1]));
+		}
+		if (set.length() < n)
+		{
+			printf("%6i sockets: cannot open them (limit %i descriptors)\n", n, (int)limit.rlim_cur);
+			foreach(Socket& s, set)
+				s.close();
+			continue;
+		}
+		double t1 = now();
+		SocketPoller poller;
+		foreach(Socket& s, set)
+			poller.add(s);
+		double t2 = now();
+
+		unsigned seed = 1;
+		byte c = 0;
+		int errors = 0;
+		for (int i = 0; i < rounds; i++)
+		{
+			int j = benchRandom(seed) % n;
+			set[j ^ 1].write(&c, 1);
+			if (poller.wait(1) != 1 || poller.ready(0).read(&c, 1) != 1)
+				errors++;
+		}
+		double t3 = now();
+		int scanRounds = max(rounds * 100 / n, 10);
+		Array<pollfd> fds;
+		Array<Socket> changed;
+		for (int i = 0; i < scanRounds; i++)
+		{
+			int j = benchRandom(seed) % n;
+			set[j ^ 1].write(&c, 1);
+			if (scanWait(set, fds, changed) != 1 || changed[0].read(&c, 1) != 1)
+				errors++;
+		}
+		double t4 = now();
+		printf("%6i sockets: add %6.2f us/socket  poller %7.2f us/wakeup  scan %9.2f us/wakeup%s\n", n,
+			(t2 - t1) / n * 1e6, (t3 - t2) / rounds * 1e6, (t4 - t3) / scanRounds * 1e6, errors ? "  (errors)" : "");
+		foreach(Socket& s, set)
+			s.close();
+	}
+}
+
+#endif
+
+// HttpFiles: static file throughput of HttpServer with concurrent keep-alive clients, for 1 KB, 1 MB and 1 GB files
+
+struct FileClient : public Thread
+{
+	int port;
+	String path;
+	double until;
+	int requests;
+	Long bytes;
+	bool failed;
+	void run()
+	{
+		Socket s;
+		ByteArray buffer(256 * 1024);
+		String request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n";
+		requests = 0;
+		bytes = 0;
+		failed = !s.connect("127.0.0.1", port);
+		while (!failed && now() < until)
+		{
+			s << request;
+			Long length = -1;
+			String line;
+			while ((line = s.readLine()).trim().ok())
+				if (line.startsWith("Content-Length:"))
+					length = line.substr(15).trim().toLong();
+			if (s.error() || length < 0)
+			{
+				failed = true;
+				break;
+			}
+			for (Long left = length; left > 0;)
+			{
+				int n = s.read(buffer.data(), (int)min(left, (Long)buffer.length()));
+				if (n <= 0)
+				{
+					failed = true;
+					break;
+				}
+				left -= n;
+			}
+			bytes += length;
+			requests++;
+		}
+		s.close();
+	}
+};
+
+ASL_TEST(Resolver)
+{
+	String host = option("host", "localhost");
+	int count = option("count", 2000);
+
+	double t1 = now();
+	int found = 0;
+	for (int i = 0; i < count; i++)
+		found += InetAddress::resolve(host).length() > 0;
+	double t2 = now();
+	Resolver& resolver = Resolver::shared();
+	for (int i = 0; i < count; i++)
+		found += resolver.lookup(host).length() > 0;
+	double t3 = now();
+	printf("%s: system %8.2f us/lookup  cached %6.2f us/lookup%s\n", *host, (t2 - t1) / count * 1e6,
+		(t3 - t2) / count * 1e6, found < 2 * count ? "  (not found)" : "");
+}
+
+ASL_TEST(HttpFiles)
+{
+	int port = option("port", 9993);
+	int nclients = option("clients", 8);
+	double seconds = option("seconds", 3);
+	Long maxSize = String(option("max", "1000000000")).toLong();
+	String dir = Directory::createTemp();
+	HttpServer server;
+	if (!server.bind("127.0.0.1", port))
+	{
+		printf("Cannot bind port %i\n", port);
+		return;
+	}
+	server.setRoot(dir);
+	if (!option("cache", 1))
+		server.setFileCache(0);
+	server.start(true);
+	sleep(0.2);
+
+	Long sizes[] = { 1000, 1000000, 1000000000 };
+	const char* names[] = { "/1k", "/1m", "/1g" };
+	ByteArray block(1000000);
+	for (int i = 0; i < block.length(); i++)
+		block[i] = (byte)i;
+	for (int k = 0; k < 3 && sizes[k] <= maxSize; k++)
+	{
+		File file(dir + names[k], File::WRITE);
+		for (Long n = sizes[k]; n > 0; n -= block.length())
+			file.write(block.data(), (int)min(n, (Long)block.length()));
+		file.close();
+
+		Array<FileClient> clients(nclients);
+		double t1 = now();
+		foreach(FileClient& c, clients)
+		{
+			c.port = port;
+			c.path = names[k];
+			c.until = t1 + seconds;
+			c.start();
+		}
+		int requests = 0;
+		Long bytes = 0;
+		bool failed = false;
+		foreach(FileClient& c, clients)
+		{
+			c.join();
+			requests += c.requests;
+			bytes += c.bytes;
+			failed = failed || c.failed;
+		}
+		double t = now() - t1;
+		printf("%-4s %10.0f req/s  %8.1f MB/s%s\n", names[k] + 1, requests / t, bytes / t * 1e-6, failed ? "  (errors)" : "");
+		File(dir + names[k]).remove();
+	}
+	server.stop(true);
+	Directory::remove(dir);
+}
+
+// HttpClient: small requests per second to a loopback HttpServer, with a new connection per request or reusing them
+
+struct SmallApiServer : public HttpServer
+{
+	void serve(HttpRequest& request, HttpResponse& response)
+	{
+		response.put(Var("id", request.path()));
+	}
+};
+
+static void benchHttpClient(int port, int count, int nthreads, bool keepAlive)
+{
+	HttpClient client;
+	client.setKeepAlive(keepAlive);
+	String url = String::f("http://127.0.0.1:%i/items/", port);
+	AtomicCount errors;
+	Array<Thread> threads;
+	double t1 = now();
+	for (int k = 0; k < nthreads; k++)
+	{
+		threads << Thread([&, k]() {
+			for (int i = k; i < count; i += nthreads)
+			{
+				HttpResponse res = client.get(url + String(i));
+				if (!res.ok() || res.json()["id"] != "/items/" + String(i))
+					++errors;
+			}
+		});
+	}
+	foreach(Thread& t, threads)
+		t.join();
+	double t = now() - t1;
+	printf("%2i threads  %-10s %8.0f req/s  %6.1f us/req%s\n", nthreads, keepAlive ? "pooled" : "new conn.",
+		count / t, t / count * 1e6, int(errors) ? "  (errors)" : "");
+}
+
+ASL_TEST(HttpClient)
+{
+	int port = option("port", 9994);
+	int count = option("count", 10000);
+	int nthreads = option("threads", 8);
+	SmallApiServer server;
+	if (!server.bind("127.0.0.1", port))
+	{
+		printf("Cannot bind port %i\n", port);
+		return;
+	}
+	server.start(true);
+	sleep(0.2);
+	benchHttpClient(port, count, 1, false);
+	benchHttpClient(port, count, 1, true);
+	benchHttpClient(port, count, nthreads, false);
+	benchHttpClient(port, count, nthreads, true);
+	server.stop(true);
+}
+
+// WebSocket: messages per second from a client to a loopback server for 16 B, 1 KB and 1 MB frames, and for 16 B frames
+// sent in batches
+
+struct CountingWsServer : public WebSocketServer
+{
+	void serve(WebSocket& ws)
+	{
+		int n = 0;
+		while (!ws.closed())
+		{
+			WebSocketMsg msg = ws.receive();
+			if (msg.length() == 3 && memcmp(*msg, "end", 3) == 0)
+			{
+				ws.send(String(n));
+				n = 0;
+			}
+			else if (msg)
+				n++;
+		}
+	}
+};
+
+ASL_TEST(WebSocket)
+{
+	int port = option("port", 9995);
+	int count = option("count", 200000);
+	CountingWsServer server;
+	if (!server.bind(port))
+	{
+		printf("Cannot bind port %i\n", port);
+		return;
+	}
+	server.start(true);
+	sleep(0.2);
+	WebSocket ws;
+	if (!ws.connect(String::f("ws://127.0.0.1:%i", port)))
+	{
+		printf("Cannot connect\n");
+		return;
+	}
+	int sizes[] = { 16, 1000, 1000000, 16 };
+	for (int k = 0; k < 4; k++)
+	{
+		bool batch = k == 3;
+		int n = sizes[k] < 1000000 ? count : max(count / 400, 1);
+		ByteArray data(sizes[k], 'x');
+		ws.setBatching(batch);
+		double t1 = now();
+		for (int i = 0; i < n; i++)
+			ws.send(data);
+		ws.setBatching(false);
+		ws.send("end");
+		String ack = ws.receive();
+		int received = ack;
+		double t = now() - t1;
+		printf("%7i B%s %10.0f msg/s  %8.1f MB/s%s\n", sizes[k], batch ? " batched" : "        ", n / t,
+			n * (double)sizes[k] / t * 1e-6, received != n ? "  (errors)" : "");
+	}
+	ws.close();
+	server.stop(true);
+}
+
+// WsCompression: bytes on the wire, CPU time (client and server) and rate of WebSocket messages with dashboard-like
+// JSON snapshots, without compression, with permessage-deflate, and with permessage-deflate without context takeover
+
+static String dashboardSnapshot(int i)
+{
+	Var snapshot = Var("type", "metrics")("seq", i)("time", 1700000000.0 + i * 0.25);
+	Var series = Var(Var::ARRAY);
+	for (int k = 0; k < 12; k++)
+	{
+		series << Var("host", String::f("node-%02i", k))("status", (i + k) % 17 ? "ok" : "warning")
+			("cpu", ((i * 7 + k * 13) % 1000) * 0.1)("memory", 1024 + (i * 3 + k) % 512)
+			("requests", 1000 + i + k * 10)("errors", (i + k) % 5);
+	}
+	snapshot["series"] = series;
+	return Json::encode(snapshot);
+}
+
+ASL_TEST(WsCompression)
+{
+	int port = option("port", 9994);
+	int count = option("count", 20000);
+	Array<String> snapshots;
+	for (int i = 0; i < 100; i++)
+		snapshots << dashboardSnapshot(i);
+	const char* names[] = { "plain", "deflate", "deflate no context" };
+	for (int k = 0; k < 3; k++)
+	{
+		WebSocketCompression options;
+		options.serverNoContextTakeover = options.clientNoContextTakeover = k == 2;
+		CountingWsServer server;
+		if (k > 0)
+			server.setCompression(options);
+		if (!server.bind(port + k))
+		{
+			printf("Cannot bind port %i\n", port + k);
+			return;
+		}
+		server.start(true);
+		sleep(0.2);
+		WebSocket ws;
+		if (k > 0)
+			ws.setCompression(options);
+		if (!ws.connect(String::f("ws://127.0.0.1:%i", port + k)))
+		{
+			printf("Cannot connect\n");
+			return;
+		}
+		Long bytes = 0;
+		double t1 = now();
+		clock_t c1 = clock();
+		for (int i = 0; i < count; i++)
+		{
+			const String& msg = snapshots[i % snapshots.length()];
+			ws.send(msg);
+			bytes += msg.length();
+		}
+		ws.send("end");
+		String ack = ws.receive();
+		int received = ack;
+		double cpu = double(clock() - c1) / CLOCKS_PER_SEC;
+		double t = now() - t1;
+		printf("%-20s %7.0f B/msg (%5.1f%%) %7.1f us/msg %9.0f msg/s%s\n", names[k], (double)ws.sentBytes() / count,
+			100.0 * ws.sentBytes() / bytes, cpu / count * 1e6, count / t, received != count ? "  (errors)" : "");
+		ws.close();
+		server.stop(true);
+	}
+}
+
+// WsFanout: messages per second delivered by broadcasts to thousands of loopback clients, read by a few threads,
+// with the server in hub (event-driven) mode or with a thread per connection
+
+ASL_TEST(WsFanout)
+{
+	int port = option("port", 9992);
+	int nclients = option("clients", 2000);
+	int count = option("count", 200);
+	int size = option("size", 100);
+	int nreaders = option("readers", 4);
+	String mode = option("mode", "hub");
+	WebSocketServer server;
+	if (!server.bind(port))
+	{
+		printf("Cannot bind port %i\n", port);
+		return;
+	}
+	server.setEventDriven(mode == "hub", 1);
+	server.setSendQueueLimit(16 * 1024 * 1024);
+	server.start(true);
+	sleep(0.2);
+
+	Array<WebSocket> clients(nclients);
+	for (int i = 0; i < nclients; i++)
+	{
+		if (!clients[i].connect(String::f("ws://127.0.0.1:%i", port)))
+		{
+			printf("Cannot connect client %i\n", i);
+			return;
+		}
+	}
+	while (server.clients().length() < nclients)
+		sleep(0.01);
+
+	String msg(size, size);
+	memset(msg.data(), 'x', size);
+	AtomicCount delivered;
+	Array<Thread> readers;
+	double t1 = now();
+	for (int k = 0; k < nreaders; k++)
+	{
+		readers << Thread([&, k]() {
+			for (int j = 0; j < count; j++)
+			{
+				for (int i = k; i < nclients; i += nreaders)
+				{
+					if (clients[i].receive().length() == size)
+						++delivered;
+				}
+			}
+		});
+	}
+	for (int j = 0; j < count; j++)
+		server.broadcast(msg);
+	double t2 = now();
+	foreach(Thread& t, readers)
+		t.join();
+	double t = now() - t1;
+	printf("%-7s %5i clients %6i B  broadcast %7.0f msg/s  delivered %9.0f msg/s%s\n", *mode, nclients, size,
+		count / (t2 - t1), int(delivered) / t, int(delivered) != count * nclients || server.slowClients() > 0 ?
+		"  (lost)" : "");
+	foreach(WebSocket& ws, clients)
+		ws.close();
+	server.stop(true);
+}
+
+// JsonParse: decoding throughput on generated corpora similar to canada.json (float coordinates) and
+// twitter.json (indented objects with long strings and escapes), with the tree in the heap or in an Arena, and the
+// time to free the tree
+
+static String canadaLike(int size)
+{
+	unsigned seed = 1;
+	String json = "{\"type\":\"FeatureCollection\",\"features\":[{\"type\":\"Feature\",\"properties\":{\"name\":\"Canada\"},"
+		"\"geometry\":{\"type\":\"Polygon\",\"coordinates\":[";
+	for (int ring = 0; json.length() < size; ring++)
+	{
+		json << (ring > 0 ? ",[" : "[");
+		for (int i = 0; i < 1000; i++)
+		{
+			double x = -141 + benchRandom(seed) % 8000000 * 1e-5, y = 41 + benchRandom(seed) % 4000000 * 1e-5;
+			json << (i > 0 ? ",[" : "[") << String::f("%.15f,%.15f", x, y) << ']';
+		}
+		json << ']';
+	}
+	json << "]}}]}";
+	return json;
+}
+
+static String twitterLike(int size)
+{
+	unsigned seed = 2;
+	const char* words[] = { "the", "cat", "RT", "@user", "http:\\/\\/t.co\\/xyz", "\\u3053\\u3093", "\\\"quoted\\\"", "\\n", "#tag", "caf\xc3\xa9" };
+	String json = "{\n  \"statuses\": [";
+	for (int k = 0; json.length() < size; k++)
+	{
+		String text;
+		for (int i = 0; i < 16; i++)
+			text << (i > 0 ? " " : "") << words[benchRandom(seed) % 10];
+		json << (k > 0 ? "," : "") << "\n    {\n      \"id\": " << String::f("%u", 500000000 + benchRandom(seed)) << ",\n"
+			"      \"created_at\": \"Sun Aug 31 00:29:15 +0000 2014\",\n      \"text\": \"" << text << "\",\n"
+			"      \"truncated\": false,\n      \"in_reply_to_status_id\": null,\n"
+			"      \"user\": {\n        \"id\": " << String::f("%u", benchRandom(seed)) << ",\n        \"name\": \"User name\",\n"
+			"        \"description\": \"" << text << "\",\n        \"followers_count\": " << String::f("%u", benchRandom(seed) % 10000) << ",\n"
+			"        \"verified\": true\n      },\n      \"entities\": {\n        \"hashtags\": [],\n        \"urls\": [\"https://example.com\"]\n      },\n"
+			"      \"retweet_count\": " << String::f("%u", benchRandom(seed) % 1000) << ",\n      \"lang\": \"ja\"\n    }";
+	}
+	json << "\n  ]\n}\n";
+	return json;
+}
+
+ASL_TEST(JsonParse)
+{
+	int size = option("size", 20) * 1000000;
+	int rounds = option("rounds", 5);
+	String corpora[] = { canadaLike(size), twitterLike(size) };
+	const char* names[] = { "canada", "twitter" };
+
+	for (int k = 0; k < 2; k++)
+	{
+		String& json = corpora[k];
+		if (!Json::decode(json).ok())
+		{
+			printf("%s: parse error\n", names[k]);
+			continue;
+		}
+		double t1 = now();
+		for (int i = 0; i < rounds; i++)
+			Json::decode(json);
+		double t2 = now();
+		XdlReader reader;
+		int events = 0;
+		for (int i = 0; i < rounds; i++)
+		{
+			reader.setText(json);
+			while (reader.next())
+				events++;
+		}
+		double t3 = now();
+		double tfree[2] = { 0, 0 };
+		for (int i = 0; i < rounds; i++)
+		{
+			for (int m = 0; m < 2; m++)
+			{
+				Var* v = new Var(Json::decode(json, m == 1 ? Json::ARENA : Json::NONE));
+				double t = now();
+				delete v;
+				tfree[m] += now() - t;
+			}
+		}
+		double t4 = now();
+		for (int i = 0; i < rounds; i++)
+			Json::decode(json, Json::ARENA);
+		double t5 = now();
+		double mb = rounds * json.length() / 1e6;
+		printf("%-8s %.1f MB  decode: %.3f GB/s  arena: %.3f GB/s  reader: %.3f GB/s (%.1f Mevents/s)\n", names[k],
+			json.length() / 1e6, mb / (t2 - t1) / 1e3, mb / (t5 - t4) / 1e3, mb / (t3 - t2) / 1e3, events / (t3 - t2) / 1e6);
+		printf("%-8s free: %.1f ms  arena free: %.1f ms\n", "", tfree[0] * 1e3 / rounds, tfree[1] * 1e3 / rounds);
+	}
+}
+
+// HttpCompression: JSON responses of `size` KB from a loopback server sent as they are, with gzip or with deflate;
+// compression ratio, throughput and CPU time per response (server and client, both in this process)
+
+struct JsonApiServer : public HttpServer
+{
+	String json;
+	void serve(HttpRequest& request, HttpResponse& response)
+	{
+		response.setHeader("Content-Type", "application/json");
+		response.put(json);
+	}
+};
+
+static void benchHttpCompression(const String& url, const char* encoding, int count)
+{
+	HttpClient client;
+	Dic<> headers;
+	if (encoding)
+		headers["Accept-Encoding"] = encoding;
+	else
+		client.setCompression(false);
+	Long wire = 0, raw = 0;
+	int errors = 0;
+	clock_t c1 = clock();
+	double t1 = now();
+	for (int i = 0; i < count; i++)
+	{
+		HttpResponse res = client.get(url, headers);
+		if (!res.ok())
+			errors++;
+		wire += res.header("Content-Length").toLong();
+		raw += res.body().length();
+	}
+	double t = now() - t1, cpu = double(clock() - c1) / CLOCKS_PER_SEC;
+	printf("%-9s %6.1f%% of %.0f KB  %7.0f req/s  %7.1f MB/s  %7.1f us CPU/req%s\n", encoding ? encoding : "identity",
+		100.0 * wire / max(raw, (Long)1), raw / 1e3 / count, count / t, raw / t / 1e6, cpu / count * 1e6,
+		errors ? "  (errors)" : "");
+}
+
+ASL_TEST(HttpCompression)
+{
+	int port = option("port", 9994);
+	int size = option("size", 100) * 1000;
+	int count = option("count", 2000);
+	if (!Deflater::available())
+	{
+		printf("Built without zlib\n");
+		return;
+	}
+	JsonApiServer server;
+	server.json = twitterLike(size);
+	server.setCompression(true, 1024, option("level", 6));
+	if (!server.bind("127.0.0.1", port))
+	{
+		printf("Cannot bind port %i\n", port);
+		return;
+	}
+	server.start(true);
+	sleep(0.2);
+	String url = String::f("http://127.0.0.1:%i/api", port);
+	benchHttpCompression(url, NULL, count);
+	benchHttpCompression(url, "gzip", count);
+	benchHttpCompression(url, "deflate", count);
+	server.stop(true);
+}
+
+// Log: cost per message for callers logging to a file from several threads, synchronous vs asynchronous
+
+struct LogClients : public Thread
+{
+	int count;
+	double time;
+	void run()
+	{
+		double t1 = now();
+		for (int i = 0; i < count; i++)
+			ASL_LOG_D("Request %i handled in %.3f ms", i, 0.25);
+		time = now() - t1;
+	}
+};
+
+// Process: running many short subprocesses and collecting a large output, compared with the former execute() loop
+// that polled the pipes with short sleeps (the subprocesses are this program run with -produce <MB>)
+
+static String pollingExecute(const String& command, const Array<String>& args)
+{
+	Process p;
+	p.run(command, args);
+	String output;
+	char buffer[8000];
+	int n, i = 0;
+	while (p.running())
+	{
+		sleep((i++) % 16 == 0 ? 0.001 : 0);
+		if (p.outputAvailable() > 0)
+		{
+			n = p.readOutput(buffer, sizeof(buffer));
+			output.append(buffer, n);
+		}
+	}
+	while (n = p.readOutput(buffer, sizeof(buffer)), n > 0)
+		output.append(buffer, n);
+	return output;
+}
+
+ASL_TEST(Process)
+{
+	int count = option("count", 1000);
+	int nparallel = option("parallel", 16);
+	int mb = option("mb", 1024);
+	String self = Process::myPath();
+	Array<String> quick = array<String>("-produce", "0");
+
+	double t1 = now();
+	clock_t c1 = clock();
+	int ok = 0;
+	for (int i = 0; i < count; i++)
+		ok += Process::execute(self, quick).success();
+	double t2 = now();
+	clock_t c2 = clock();
+	for (int i = 0; i < count; i++)
+		pollingExecute(self, quick);
+	double t3 = now();
+	clock_t c3 = clock();
+	Processes procs;
+	procs.setMaxRunning(nparallel);
+	for (int i = 0; i < count; i++)
+		procs.execute(self, quick, [&](Process& p) { ok += p.success(); });
+	procs.wait();
+	double t4 = now();
+	clock_t c4 = clock();
+	double cps = 1e6 / CLOCKS_PER_SEC / count;
+	printf("%i processes (us/process, wall / parent CPU):\n  execute   %7.1f / %6.1f\n  polling   %7.1f / %6.1f\n"
+		"  Processes %7.1f / %6.1f  (%i at once)%s\n", count, (t2 - t1) * 1e6 / count, (c2 - c1) * cps,
+		(t3 - t2) * 1e6 / count, (c3 - c2) * cps, (t4 - t3) * 1e6 / count, (c4 - c3) * cps, nparallel,
+		ok != 2 * count ? "  (errors)" : "");
+
+	Array<String> big = array<String>("-produce", mb);
+	t1 = now();
+	c1 = clock();
+	Long size1 = Process::execute(self, big).output().length();
+	t2 = now();
+	c2 = clock();
+	Long size2 = pollingExecute(self, big).length();
+	t3 = now();
+	c3 = clock();
+	printf("%i MB output (MB/s, parent CPU s):\n  execute   %7.0f / %6.2f\n  polling   %7.0f / %6.2f%s\n", mb,
+		mb / (t2 - t1), double(c2 - c1) / CLOCKS_PER_SEC, mb / (t3 - t2), double(c3 - c2) / CLOCKS_PER_SEC,
+		size1 != ((Long)mb << 20) || size2 != size1 ? "  (errors)" : "");
+}
+
+ASL_TEST(TabularDataFile)
+{
+	int mb = option("mb", 200);
+	String name = "bench.csv";
+	{
+		TextFile file(name, File::WRITE);
+		file << "id,x,y,label,z\n";
+		unsigned seed = 1;
+		for (int i = 0; file.position() < ((Long)mb << 20); i++)
+			file.printf("%i,%.6f,%g,cat%u,%.10g\n", i, (benchRandom(seed) % 1000000) * 1e-3, (benchRandom(seed) % 2000) - 1000.0,
+				benchRandom(seed) % 20, (benchRandom(seed) % 100000) * 1.7e-5);
+	}
+	double size = File(name).size() / 1048576.0;
+	printf("%.0f MB, %i cores (MB/s):\n", size, Thread::numProcessors());
+
+	double t1 = now();
+	TabularDataFile rows(name);
+	int n = 0;
+	while (rows.nextRow())
+		n++;
+	double t2 = now();
+	printf("  nextRow()            %7.1f  (%i rows)\n", size / (t2 - t1), n);
+
+	t1 = now();
+	Array<Array<Var> > data = TabularDataFile(name).data();
+	t2 = now();
+	printf("  data()               %7.1f\n", size / (t2 - t1));
+	data.clear();
+
+	t1 = now();
+	Array<DataColumn> cols = TabularDataFile(name).loadColumns(false);
+	t2 = now();
+	printf("  loadColumns(serial)  %7.1f\n", size / (t2 - t1));
+
+	t1 = now();
+	cols = TabularDataFile(name).loadColumns();
+	t2 = now();
+	printf("  loadColumns()        %7.1f%s\n", size / (t2 - t1), cols.length() != 5 || cols[0].length() != n ? "  (errors)" : "");
+	File(name).remove();
+}
+
+ASL_TEST(TabularWrite)
+{
+	double cells = option("cells", 100000000);
+	int flush = option("flush", 0);
+	bool sync = option("sync", 0) != 0;
+	int ncols = 10, nrows = int(cells / ncols);
+	String name = "bench.csv";
+	printf("%i rows x %i numbers (Mcells/s, MB/s):\n", nrows, ncols);
+
+	double t1 = now();
+	{
+		TextFile file(name, File::WRITE);
+		for (int i = 0; i < nrows; i++)
+		{
+			file.printf("%i", i);
+			for (int j = 1; j < ncols; j++)
+				file.printf(",%.17g", i * 1.37e-3 + j);
+			file.printf("\n");
+		}
+	}
+	double t2 = now();
+	double size = File(name).size() / 1048576.0;
+	printf("  printf            %7.1f  %7.1f\n", cells / (t2 - t1) * 1e-6, size / (t2 - t1));
+
+	t1 = now();
+	{
+		TabularDataFile file(name);
+		file.flushEvery(flush, sync);
+		file.columns("i,x1,x2,x3,x4,x5,x6,x7,x8,x9");
+		for (int i = 0; i < nrows; i++)
+		{
+			file << i;
+			for (int j = 1; j < ncols; j++)
+				file << i * 1.37e-3 + j;
+		}
+	}
+	t2 = now();
+	size = File(name).size() / 1048576.0;
+	printf("  TabularDataFile   %7.1f  %7.1f\n", cells / (t2 - t1) * 1e-6, size / (t2 - t1));
+	File(name).remove();
+}
+
+// Numbers: text conversion of doubles with the C library vs mydtoa/myatof, and JSON of number arrays. With
+// -floats 1 also checks that all finite floats are written as text that reads back as the same float.
+
+struct FloatRoundTrip : public ParallelTask
+{
+	Array<int> bad;
+	void run(int i0, int i1)
+	{
+		char s[32];
+		for (int i = i0; i < i1; i++)
+			for (unsigned u = unsigned(i) << 16, e = u + 0x10000; u < e; u++)
+			{
+				float x;
+				memcpy(&x, &u, sizeof(x));
+				myftoa(x, s);
+				if ((float)myatof(s) != x || strtof(s, NULL) != x)
+					bad[i]++;
+			}
+	}
+};
+
+ASL_TEST(Numbers)
+{
+	int count = option("count", 1000000);
+	bool floats = option("floats", 0) != 0;
+	Array<double> values(count);
+	unsigned seed = 1;
+	for (int i = 0; i < count; i++)
+	{
+		ULong bits = ((ULong)benchRandom(seed) << 40) ^ ((ULong)benchRandom(seed) << 20) ^ benchRandom(seed);
+		memcpy(&values[i], &bits, sizeof(double));
+		if (i % 2 || values[i] != values[i] || values[i] - values[i] != 0)
+			values[i] = (benchRandom(seed) % 100000) * 1.37e-3;
+	}
+	Array<String> texts(count);
+	char s[32];
+	printf("%i doubles (ns/number):\n", count);
+
+	double t1 = now();
+	for (int i = 0; i < count; i++)
+		texts[i] = String(s, snprintf(s, sizeof(s), "%.17g", values[i]));
+	double t2 = now();
+	printf("  snprintf %%.17g   %7.1f\n", (t2 - t1) / count * 1e9);
+
+	t1 = now();
+	for (int i = 0; i < count; i++)
+		texts[i] = String(s, mydtoa(values[i], s));
+	t2 = now();
+	printf("  mydtoa           %7.1f\n", (t2 - t1) / count * 1e9);
+
+	t1 = now();
+	for (int i = 0; i < count; i++)
+		snprintf(s, sizeof(s), "%.9g", (float)values[i]);
+	t2 = now();
+	printf("  snprintf %%.9g    %7.1f\n", (t2 - t1) / count * 1e9);
+
+	t1 = now();
+	for (int i = 0; i < count; i++)
+		myftoa((float)values[i], s);
+	t2 = now();
+	printf("  myftoa           %7.1f\n", (t2 - t1) / count * 1e9);
+
+	int bad = 0;
+	t1 = now();
+	for (int i = 0; i < count; i++)
+		bad += strtod(texts[i], NULL) != values[i];
+	t2 = now();
+	printf("  strtod           %7.1f\n", (t2 - t1) / count * 1e9);
+
+	t1 = now();
+	for (int i = 0; i < count; i++)
+		bad += myatof(texts[i]) != values[i];
+	t2 = now();
+	printf("  myatof           %7.1f\n", (t2 - t1) / count * 1e9);
+
+	t1 = now();
+	String json = Json::encode(values);
+	t2 = now();
+	Var decoded = Json::decode(json);
+	double t3 = now();
+	for (int i = 0; i < count; i++)
+		bad += (double)decoded[i] != values[i];
+	printf("  Json::encode     %7.1f  (%.1f MB/s)\n", (t2 - t1) / count * 1e9, json.length() / (t2 - t1) / 1048576);
+	printf("  Json::decode     %7.1f  (%.1f MB/s)\n", (t3 - t2) / count * 1e9, json.length() / (t3 - t2) / 1048576);
+	if (bad)
+		printf("%i numbers did not read back exactly!\n", bad);
+
+	if (!floats)
+		return;
+	FloatRoundTrip task;
+	task.bad = Array<int>(0x7f800000 >> 16, 0);
+	t1 = now();
+	parallelRun(task, 0, task.bad.length(), 16);
+	t2 = now();
+	bad = 0;
+	foreach (int n, task.bad)
+		bad += n;
+	printf("all %u positive finite floats: %i failed round trip (%.1f s)\n", 0x7f800000u, bad, t2 - t1);
+}
+
+ASL_TEST(Log)
+{
+	int nthreads = option("threads", 4);
+	int count = option("count", 100000);
+	String mode = option("mode", "all");
+	String policy = option("overflow", "block");
+
+	Log::setFile("bench.log");
+	Log::useConsole(false);
+	Log::setMaxLevel(Log::DEBUG);
+
+	Array<String> modes = mode == "all" ? String("sync,async").split(",") : Array<String>() << mode;
+	foreach(String& m, modes)
+	{
+		if (m == "async")
+			Log::setAsync(true, option("queue", 8192), policy == "drop" ? Log::DROP : Log::BLOCK);
+		int n = m == "sync" ? count / 10 : count;
+		Array<LogClients> clients(nthreads);
+		double t1 = now();
+		foreach(LogClients& c, clients)
+		{
+			c.count = n;
+			c.start();
+		}
+		double callers = 0;
+		foreach(LogClients& c, clients)
+		{
+			c.join();
+			callers += c.time;
+		}
+		double t2 = now();
+		Log::flush();
+		double t3 = now();
+		printf("%-6s %i messages: %.3f us/message in callers, %.0f messages/s total (flush %.3f s), %i dropped\n", *m,
+			n * nthreads, callers / (n * nthreads) * 1e6, n * nthreads / (t3 - t1), t3 - t2, Log::dropped());
+		Log::setAsync(false);
+	}
+	File("bench.log").remove();
+	File("bench-1.log").remove();
+}
+
+// ParallelFor: many short parallel loops, with a thread pool vs creating threads on every call (the previous way)
+
+template<class F>
+static void spawnParallelFor(int i0, int i1, const F& f, int nth)
+{
+	Array<Thread> threads;
+	int n = min(nth, i1 - i0);
+	for (int k = 1; k < n; k++)
+		threads << Thread([=]() {
+			for (int i = i0 + k; i < i1; i += n)
+				f(i);
+		});
+	for (int i = i0; i < i1; i += n)
+		f(i);
+	foreach(Thread& t, threads)
+		t.join();
+}
+
+ASL_TEST(ParallelFor)
+{
+	int n = option("n", 1000);
+	int calls = option("calls", 2000);
+	int nth = option("threads", 8);
+	Array<float> a(n), b(n);
+	for (int i = 0; i < n; i++)
+		a[i] = (float)i;
+	double check[3];
+
+	for (int mode = 0; mode < 3; mode++)
+	{
+		double t1 = now();
+		for (int k = 0; k < calls; k++)
+		{
+			if (mode == 0)
+				for (int i = 0; i < n; i++)
+					b[i] = sqrt(a[i]) * k;
+			else if (mode == 1)
+				spawnParallelFor(0, n, [&](int i) { b[i] = sqrt(a[i]) * k; }, nth);
+			else
+				Thread::parallel_for(0, n, [&](int i) { b[i] = sqrt(a[i]) * k; });
+		}
+		double t2 = now();
+		check[mode] = b[n - 1];
+		const char* names[] = { "serial", "spawn", "pool" };
+		printf("%-7s %i loops of %i: %.2f us/loop\n", names[mode], calls, n, (t2 - t1) / calls * 1e6);
+	}
+	if (check[1] != check[0] || check[2] != check[0])
+		printf("Results differ!\n");
+
+	double t1 = now();
+	double sum = 0;
+	for (int k = 0; k < calls; k++)
+		sum += Thread::parallel_reduce(0, n, 0.0, [&](int i) { return (double)a[i]; }, [](double x, double y) { return x + y; });
+	double t2 = now();
+	printf("reduce  %i loops of %i: %.2f us/loop (%g)\n", calls, n, (t2 - t1) / calls * 1e6, sum / calls);
+	printf("%i pool threads\n", parallelThreads());
+}
+
+// HashMap: insert, find and erase with HashMap (chained) vs FlatHashMap (open addressing), int or String keys.
+// Keys are looked up in a different order than inserted. Times are the best of several rounds.
+
+template<class M, class K>
+static void benchMap(const char* name, const Array<K>& keys, const Array<K>& missing, const Array<int>& order, int rounds)
+{
+	int n = keys.length();
+	double t[4] = { 1e9, 1e9, 1e9, 1e9 };
+	for (int r = 0; r < rounds; r++)
+	{
+		M m;
+		double t1 = now();
+		for (int i = 0; i < n; i++)
+			m[keys[i]] = i;
+		double t2 = now();
+		int found = 0;
+		for (int i = 0; i < n; i++)
+			if (const int* p = m.find(keys[order[i]]))
+				found += *p == order[i];
+		double t3 = now();
+		for (int i = 0; i < n; i++)
+			found += m.has(missing[i]);
+		double t4 = now();
+		for (int i = 0; i < n; i++)
+			m.remove(keys[order[i]]);
+		double t5 = now();
+		if (found != n || m.length() != 0)
+			printf("Wrong results!\n");
+		t[0] = min(t[0], t2 - t1);
+		t[1] = min(t[1], t3 - t2);
+		t[2] = min(t[2], t4 - t3);
+		t[3] = min(t[3], t5 - t4);
+	}
+	double k = 1e9 / n;
+	printf("%-12s %9i  insert %6.1f  find %6.1f  miss %6.1f  erase %6.1f ns\n", name, n, t[0] * k, t[1] * k, t[2] * k,
+		t[3] * k);
+}
+
+static unsigned scatter(unsigned x) // a bijection, so keys are distinct
+{
+	x ^= x >> 16;
+	x *= 0x85ebca6b;
+	x ^= x >> 13;
+	x *= 0xc2b2ae35;
+	return x ^ (x >> 16);
+}
+
+static void benchKey(unsigned x, int& key) { key = (int)x; }
+static void benchKey(unsigned x, String& key) { key = String::f("key_%08x", x); }
+
+template<class K>
+static void benchMaps(int maxn, int rounds)
+{
+	for (int n = 1000; n <= maxn; n *= 10)
+	{
+		Array<K> keys(n), missing(n);
+		Array<int> order(n);
+		for (int i = 0; i < n; i++) // distinct scattered keys
+		{
+			benchKey(scatter(i), keys[i]);
+			benchKey(scatter(i + n), missing[i]);
+			order[i] = i;
+		}
+		unsigned seed = 1;
+		for (int i = n - 1; i > 0; i--)
+			swap(order[i], order[(benchRandom(seed) * 64 + (benchRandom(seed) & 63)) % (i + 1)]);
+		int r = max(1, min(rounds, 10000000 / n));
+		benchMap<HashMap<K, int>>("HashMap", keys, missing, order, r);
+		benchMap<FlatHashMap<K, int>>("FlatHashMap", keys, missing, order, r);
+	}
+}
+
+ASL_TEST(HashMap)
+{
+	int maxn = option("max", 1000000);
+	int rounds = option("rounds", 5);
+	if (option("keys", "int") == "string")
+		benchMaps<String>(maxn, rounds);
+	else
+		benchMaps<int>(maxn, rounds);
+}
+
+// Hash: bucket distribution and speed of the hash functions, compared with the previous ones (identity for int,
+// address >> 2 for pointers, byte-wise x33 for strings)
+
+static int oldHash(int x) { return x; }
+static int oldHash(void* p) { return ((int)(size_t(p) & 0xffffffff)) >> 2; }
+static int oldHash(const char* p, int n)
+{
+	int h = 0;
+	for (int i = 0; i < n; i++)
+		h = 33 * h + p[i];
+	return h;
+}
+static int oldHash(const String& s) { return oldHash(*s, s.length()); }
+
+// puts hashes in n (power of 2) buckets and reports the keys that landed on a used bucket and the longest chain
+static void benchDistribution(const char* name, const Array<int>& h1, const Array<int>& h2)
+{
+	int n = nextPoT(h1.length());
+	printf("%-14s", name);
+	for (int k = 0; k < 2; k++)
+	{
+		const Array<int>& h = k == 0 ? h1 : h2;
+		Array<int> count(n);
+		memset(count.data(), 0, n * sizeof(int));
+		int collisions = 0, longest = 0;
+		for (int i = 0; i < h.length(); i++)
+		{
+			int& c = count[h[i] & (n - 1)];
+			if (c++ > 0)
+				collisions++;
+			longest = max(longest, c);
+		}
+		printf("  %6.2f%% %6i", 100.0 * collisions / h.length(), longest);
+	}
+	printf("\n");
+}
+
+ASL_TEST(Hash)
+{
+	int n = option("n", 100000);
+	printf("Distribution of %i keys in %i buckets: colliding keys and longest chain (random: %.1f%%)\n", n,
+		nextPoT(n), 100 * (1 - (1 - exp(-double(n) / nextPoT(n))) * nextPoT(n) / n));
+	printf("%-14s  %15s  %15s\n", "keys", "old", "new");
+	Array<int> h1(n), h2(n);
+	for (int i = 0; i < n; i++)
+	{
+		h1[i] = oldHash(i);
+		h2[i] = hash(i);
+	}
+	benchDistribution("int sequence", h1, h2);
+	for (int i = 0; i < n; i++)
+	{
+		h1[i] = oldHash(i * 4096);
+		h2[i] = hash(i * 4096);
+	}
+	benchDistribution("int x 4096", h1, h2);
+	Array<void*> ptrs(n);
+	for (int i = 0; i < n; i++)
+	{
+		ptrs[i] = malloc(48);
+		h1[i] = oldHash(ptrs[i]);
+		h2[i] = hash(ptrs[i]);
+	}
+	benchDistribution("pointers", h1, h2);
+	for (int i = 0; i < n; i++)
+		free(ptrs[i]);
+	for (int i = 0; i < n; i++)
+	{
+		String key = String::f("id%i", i);
+		h1[i] = oldHash(key);
+		h2[i] = hash(key);
+	}
+	benchDistribution("short strings", h1, h2);
+	for (int i = 0; i < n; i++)
+	{
+		String key = String::f("/api/v1/items/%08i/details", i * 7);
+		h1[i] = oldHash(key);
+		h2[i] = hash(key);
+	}
+	benchDistribution("URLs", h1, h2);
+
+	printf("\nSpeed (ns per key and GB/s)\n");
+	int lengths[] = { 4, 8, 16, 32, 64, 256, 4096 };
+	ByteArray data(4096 + 64);
+	for (int i = 0; i < data.length(); i++)
+		data[i] = (byte)(i * 7 + 3);
+	for (int k = 0; k < 7; k++)
+	{
+		int len = lengths[k], count = max(1000, 50000000 / (len + 16));
+		double t[2];
+		unsigned sum = 0;
+		for (int m = 0; m < 2; m++)
+		{
+			double t1 = now();
+			for (int i = 0; i < count; i++)
+			{
+				const char* p = (const char*)data.data() + (i & 63);
+				sum += m == 0 ? oldHash(p, len) : hash(p, len);
+			}
+			t[m] = (now() - t1) / count;
+		}
+		printf("%5i bytes  old %8.2f ns %6.2f GB/s   new %7.2f ns %6.2f GB/s %s\n", len, t[0] * 1e9, len / t[0] * 1e-9,
+			t[1] * 1e9, len / t[1] * 1e-9, sum == 1 ? " " : "");
+	}
+}
+
+// Queue: producer/consumer throughput with Queue guarded by a Mutex and Condition (the usual way so far), BoundedQueue
+// and ConcurrentQueue, for 1, 4 and 16 producers and as many consumers
+
+struct LockedQueue
+{
+	Queue<int> queue;
+	Mutex mutex;
+	Condition cond;
+	LockedQueue() { cond.use(mutex); }
+	void push(int x)
+	{
+		Lock _(mutex);
+		queue.put(x);
+		cond.signal();
+	}
+	bool pop(int& x, double timeout)
+	{
+		Lock _(mutex);
+		if (queue.length() == 0)
+			cond.wait(timeout);
+		if (queue.length() == 0)
+			return false;
+		x = queue.get();
+		return true;
+	}
+	int popBatch(Array<int>& a, int n, double timeout)
+	{
+		Lock _(mutex);
+		if (queue.length() == 0)
+			cond.wait(timeout);
+		n = min(n, queue.length());
+		for (int i = 0; i < n; i++)
+			a << queue.get();
+		return n;
+	}
+};
+
+template<class Q>
+static void benchQueue(const char* name, Q& queue, int nthreads, int count, int batch)
+{
+	AtomicCount consumed;
+	Array<Long> sums(nthreads);
+	Array<Thread> threads;
+	double t1 = now();
+	for (int k = 0; k < nthreads; k++)
+	{
+		sums[k] = 0;
+		threads << Thread([&, k]() {
+			for (int i = 1; i <= count; i++)
+				queue.push(i);
+		});
+		threads << Thread([&, k]() {
+			Array<int> items;
+			int x;
+			while (consumed < nthreads * count)
+			{
+				if (batch > 1)
+				{
+					items.clear();
+					int n = queue.popBatch(items, batch, 0.01);
+					for (int i = 0; i < n; i++)
+						sums[k] += items[i];
+					consumed += n;
+				}
+				else if (queue.pop(x, 0.01))
+				{
+					sums[k] += x;
+					++consumed;
+				}
+			}
+		});
+	}
+	foreach(Thread& t, threads)
+		t.join();
+	double t2 = now();
+	Long sum = 0;
+	foreach(Long s, sums)
+		sum += s;
+	if (sum != (Long)nthreads * count * (count + 1) / 2)
+		printf("Wrong results!\n");
+	printf("%-16s %2iP%iC  %6.2f Mitems/s\n", name, nthreads, nthreads, nthreads * count / (t2 - t1) * 1e-6);
+}
+
+ASL_TEST(Queue)
+{
+	int count = option("count", 200000);
+	int batch = option("batch", 1);
+	int nthreads[] = { 1, 4, 16 };
+	for (int i = 0; i < 3; i++)
+	{
+		int n = nthreads[i], c = count / n;
+		LockedQueue q1;
+		benchQueue("Queue+Mutex", q1, n, c, batch);
+		BoundedQueue<int> q2(1024);
+		benchQueue("BoundedQueue", q2, n, c, batch);
+		ConcurrentQueue<int> q3;
+		benchQueue("ConcurrentQueue", q3, n, c, batch);
+	}
+}
+
+// Matrix: GFLOPS of product, solve (LU and Cholesky) and inverse, compared with a plain triple loop product for the
+// smaller sizes. Times are the best of several rounds.
+
+template<class T>
+static Matrix_<T> benchMatrix(int n, unsigned& seed)
+{
+	Matrix_<T> a(n, n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			a(i, j) = T(benchRandom(seed) % 2000) / 1000 - 1;
+	return a;
+}
+
+template<class T>
+static void benchMatrices(int maxn)
+{
+	int sizes[] = { 100, 200, 500, 1000, 2000, 4000 };
+	printf("%5s %9s %9s %9s %9s %9s  GFLOPS\n", "n", "naive", "mul", "LU", "Cholesky", "inverse");
+	for (int s = 0; s < 6 && sizes[s] <= maxn; s++)
+	{
+		int n = sizes[s];
+		unsigned seed = 1;
+		Matrix_<T> a = benchMatrix<T>(n, seed), b = benchMatrix<T>(n, seed), spd = a.transposed(a);
+		for (int i = 0; i < n; i++)
+			spd(i, i) += T(n);
+		int rounds = max(1, min(5, 200000000 / (n * n * n)));
+		double t[5] = { 1e9, 1e9, 1e9, 1e9, 1e9 };
+		for (int r = 0; r < rounds; r++)
+		{
+			double t1 = now();
+			if (n <= 500)
+			{
+				Matrix_<T> c(n, n);
+				for (int i = 0; i < n; i++)
+					for (int j = 0; j < n; j++)
+					{
+						T x = 0;
+						for (int k = 0; k < n; k++)
+							x += a(i, k) * b(k, j);
+						c(i, j) = x;
+					}
+			}
+			double t2 = now();
+			Matrix_<T> c = a * b;
+			double t3 = now();
+			Matrix_<T> x1 = solve(a, b, SOLVE_LU);
+			double t4 = now();
+			Matrix_<T> x2 = solve(spd, b, SOLVE_CHOLESKY);
+			double t5 = now();
+			Matrix_<T> ai = a.inverse();
+			double t6 = now();
+			t[0] = min(t[0], t2 - t1);
+			t[1] = min(t[1], t3 - t2);
+			t[2] = min(t[2], t4 - t3);
+			t[3] = min(t[3], t5 - t4);
+			t[4] = min(t[4], t6 - t5);
+		}
+		// flops: product 2n^3, LU 2n^3/3 + 2n^3 for n right-hand sides, Cholesky n^3/3 + 2n^3
+		double f = double(n) * n * n * 1e-9;
+		char naive[16] = "-";
+		if (n <= 500)
+			snprintf(naive, sizeof(naive), "%.2f", 2 * f / t[0]);
+		printf("%5i %9s %9.2f %9.2f %9.2f %9.2f\n", n, naive, 2 * f / t[1], 8 * f / 3 / t[2], 7 * f / 3 / t[3],
+			8 * f / 3 / t[4]);
+	}
+}
+
+ASL_TEST(Matrix)
+{
+	int maxn = option("max", 1000);
+	setMatrixParallel(option("parallel", 0) != 0);
+	if (option("type", "double") == "float")
+		benchMatrices<float>(maxn);
+	else
+		benchMatrices<double>(maxn);
+}
+
+// VarObject: building, JSON decoding, member lookup and encoding of objects with 10 to 100k properties. Keys are
+// not sorted in the JSON text, as usual in data from other sources. Times are per property.
+
+ASL_TEST(VarObject)
+{
+	int maxn = option("max", 100000);
+	printf("%7s %9s %9s %9s %9s %9s  ns/key\n", "keys", "build", "decode", "lookup", "miss", "encode");
+	for (int n = 10; n <= maxn; n *= n < 1000 ? 100 : 10)
+	{
+		Array<String> keys(n), missing(n);
+		Array<int> order(n);
+		String json = "{";
+		for (int i = 0; i < n; i++)
+		{
+			keys[i] = String::f("key_%08x", scatter(i));
+			missing[i] = String::f("key_%08x", scatter(i + n));
+			json << (i > 0 ? ",\"" : "\"") << keys[i] << "\":" << i;
+			order[i] = i;
+		}
+		json << '}';
+		unsigned seed = 1;
+		for (int i = n - 1; i > 0; i--)
+			swap(order[i], order[benchRandom(seed) % (i + 1)]);
+		int rounds = max(1, 1000000 / n), found = 0;
+		Var v;
+		double t1 = now();
+		for (int r = 0; r < rounds; r++)
+		{
+			v = Var(Var::OBJ);
+			for (int i = 0; i < n; i++)
+				v[keys[i]] = i;
+		}
+		double t2 = now();
+		for (int r = 0; r < rounds; r++)
+			v = Json::decode(json);
+		double t3 = now();
+		const Var& c = v;
+		for (int r = 0; r < rounds; r++)
+			for (int i = 0; i < n; i++)
+				found += (int)c[keys[order[i]]] == order[i];
+		double t4 = now();
+		for (int r = 0; r < rounds; r++)
+			for (int i = 0; i < n; i++)
+				found += c.has(missing[i]);
+		double t5 = now();
+		for (int r = 0; r < rounds; r++)
+			json = Json::encode(v);
+		double t6 = now();
+		if (found != n * rounds || v.length() != n)
+			printf("lookup error\n");
+		double k = 1e9 / n / rounds;
+		printf("%7i %9.1f %9.1f %9.1f %9.1f %9.1f\n", n, (t2 - t1) * k, (t3 - t2) * k, (t4 - t3) * k, (t5 - t4) * k,
+			(t6 - t5) * k);
+	}
+}
+
+int main(int narg, char* argv[])
+{
+	CmdArgs args(narg, argv);
+	options = &args;
+	if (args.has("produce")) // subprocess for the Process benchmark
+	{
+		Array<char> block(65536);
+		for (int i = 0; i < block.length(); i++)
+			block[i] = i % 64 == 63 ? '\n' : 'x';
+		for (int i = option("produce", 0) * 16; i > 0; i--)
+			fwrite(block.data(), 1, block.length(), stdout);
+		return EXIT_SUCCESS;
+	}
+	if (args.length() < 1)
+	{
+		printf("Usage: benchmarks <name> [-option value ...]\n\nAvailable:\n");
+		for (int i = 0; i < numTests; i++)
+			printf("  %s\n", tests[i].name);
+		return EXIT_SUCCESS;
+	}
+	if (!asl::runTest(args[0]))
+	{
+		printf("Unknown benchmark\n");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -2,11 +2,13 @@
 #include <asl/Map.h>
 #include <asl/Var.h>
 #include <asl/Xdl.h>
+#include <asl/Arena.h>
 #include <asl/CmdArgs.h>
 #include <asl/TabularDataFile.h>
 #include <asl/IniFile.h>
 #include <asl/File.h>
 #include <asl/TextFile.h>
+#include <asl/Thread.h>
 #include <asl/util.h>
 #include <stdio.h>
 #include <asl/testing.h>
@@ -50,11 +52,13 @@ ASL_TEST(File)
 	String line2 = String::repeat('x', 4000);
 	tfile << line1 << '\n';
 	tfile << line2 << '\n';
+	tfile << -25 << ' ' << (Long)1 << 40 << ' ' << 0.1 << ' ' << 1.0 / 3 << ' ' << -2.5e-8 << ' ' << 1e21 << '\n';
 	tfile.close();
 
 	Array<String> lines = TextFile("lines.txt").lines();
 	ASL_ASSERT(lines[0] == line1);
 	ASL_ASSERT(lines[1] == line2);
+	ASL_ASSERT(lines[2] == "-25 140 0.1 0.3333333333333333 -2.5e-08 1e+21");
 }
 
 ASL_TEST(IniFile)
@@ -144,6 +148,86 @@ ASL_TEST(TabularDataFile)
 			ASL_ASSERT(file["name"] == "is, \"quoted\"");
 		}
 	}
+
+	{
+		TabularDataFile file("data2.csv");
+		file.setSeparator(';');
+		file.setDecimal(',');
+		file.setBufferSize(64);
+		file.flushEvery(7, true);
+		file.columns("i,x,name");
+		for (int i = 0; i < 100; i++)
+			file << i << (i == 5 ? nan() : i / 3.0 - 2.5e-8) << (i % 2 ? "a;b" : "c");
+	}
+
+	{
+		TabularDataFile file("data2.csv");
+		Array<DataColumn> cols = file.loadColumns();
+		ASL_ASSERT(cols.length() == 3 && cols[0].length() == 100);
+		for (int i = 0; i < 100; i++)
+		{
+			ASL_ASSERT(cols[0].numbers[i] == i && cols[2][i] == (i % 2 ? "a;b" : "c"));
+			if (i != 5)
+				ASL_APPROX(cols[1].numbers[i], i / 3.0 - 2.5e-8, 1e-14);
+		}
+		ASL_ASSERT(cols[1].numbers[5] != cols[1].numbers[5] && cols[1].numbers[1] == 1 / 3.0 - 2.5e-8);
+	}
+	File("data2.csv").remove();
+}
+
+ASL_TEST(TabularColumns)
+{
+	int N = 150000; // over 4 MB, read in several blocks
+	{
+		TextFile file("columns.csv", File::WRITE);
+		file << "i,x,cat,name,h\n";
+		for (int i = 0; i < N; i++)
+		{
+			String name = (i % 3 == 0) ? String(0, "\"n, \"\"%i\"\"\"", i % 11) : String(0, "n%i", i % 11);
+			file.printf("%i,%.3f,c%i,%s,%x\n", i, (i % 1000) * 0.125 - 60.5, i % 5, *name, i);
+		}
+	}
+
+	TabularDataFile file("columns.csv");
+	Array<DataColumn> cols = file.loadColumns();
+	ASL_ASSERT(cols.length() == 5 && cols[0].name == "i" && cols[4].name == "h");
+	ASL_ASSERT(cols[0].type == DataColumn::NUMBER && cols[1].type == DataColumn::NUMBER);
+	ASL_ASSERT(cols[2].type == DataColumn::STRING && cols[3].type == DataColumn::STRING && cols[4].type == DataColumn::STRING);
+	ASL_ASSERT(cols[0].length() == N && cols[3].length() == N);
+	ASL_ASSERT(cols[2].strings.length() == 5 && cols[3].strings.length() == 22);
+
+	TabularDataFile file2("columns.csv");
+	int k = 0;
+	while (file2.nextRow())
+	{
+		if (k % 7 == 0 || k > N - 100)
+		{
+			ASL_ASSERT(cols[0].numbers[k] == k);
+			ASL_APPROX(cols[1].numbers[k], (double)file2[1], 1e-9);
+			ASL_ASSERT(cols[2][k] == file2[2] && cols[3][k] == file2[3]);
+			ASL_ASSERT(cols[4][k] == String(0, "%x", k));
+		}
+		k++;
+	}
+	ASL_ASSERT(k == N);
+
+	TabularDataFile file3("columns.csv");
+	file3.readAs("innsh");
+	cols = file3.loadColumns(false);
+	ASL_ASSERT(cols[0].type == DataColumn::INT && cols[2].type == DataColumn::NUMBER && cols[4].type == DataColumn::INT);
+	ASL_ASSERT(cols[0].ints[N - 1] == N - 1 && cols[4].ints[N - 1] == N - 1 && cols[4].ints[255] == 255);
+	ASL_ASSERT(cols[2].numbers[0] != cols[2].numbers[0]); // "c0" is not a number
+	ASL_ASSERT(cols[3][3] == "n, \"3\"");
+
+	TextFile("columns2.csv").write("\xef\xbb\xbfname;x;y\r\nab;1,5;2\r\n\"c;d\";-3,25e2\r\n;;7\r\n\r\n");
+	cols = TabularDataFile("columns2.csv").loadColumns();
+	ASL_ASSERT(cols.length() == 3 && cols[0].name == "name" && cols[0].type == DataColumn::STRING);
+	ASL_ASSERT(cols[0].length() == 3 && cols[0][1] == "c;d" && cols[0][2] == "");
+	ASL_ASSERT(cols[1].numbers[0] == 1.5 && cols[1].numbers[1] == -325 && cols[1].numbers[2] != cols[1].numbers[2]);
+	ASL_ASSERT(cols[2].numbers[1] != cols[2].numbers[1] && cols[2].numbers[2] == 7);
+
+	File("columns.csv").remove();
+	File("columns2.csv").remove();
 }
 
 ASL_TEST(CmdArgs)
@@ -409,6 +493,177 @@ ASL_TEST(String)
 	ASL_APPROX(x2.to<float>(), 1.5f, 1e-7f);
 }
 
+ASL_TEST(Numbers)
+{
+	char s[40];
+	ASL_ASSERT(String(0.1) == "0.1");
+	ASL_ASSERT(String(0.1f) == "0.1");
+	ASL_ASSERT(String(1.0 / 3) == "0.3333333333333333");
+	ASL_ASSERT(String(100.0) == "100");
+	ASL_ASSERT(String(-2.5e-8) == "-2.5e-08");
+	ASL_ASSERT(String(1e15) == "1e+15");
+	ASL_ASSERT(String(123456789012345.0) == "123456789012345");
+	ASL_ASSERT(String(5e-324) == "5e-324");
+	ASL_ASSERT(String(1.7976931348623157e308) == "1.7976931348623157e+308");
+	ASL_ASSERT(String(3.4028235e38f) == "3.4028235e+38");
+	ASL_ASSERT(Var(0.3f).toString() == "0.3");
+
+	double x = 0;
+	const char* end = myatof("3,25;", x, ',');
+	ASL_ASSERT(x == 3.25 && *end == ';');
+	end = myatof("-12.5e-1x", x);
+	ASL_ASSERT(x == -1.25 && *end == 'x');
+	end = myatof("abc", x);
+	ASL_ASSERT(x == 0 && *end == 'a');
+
+	// cases needing more than 64 bits of precision or near the limits
+
+	const char* tricky[] = { "9007199254740993", "9007199254740993.0000000000000001", "2.2250738585072011e-308",
+		"2.2250738585072012e-308", "4.9406564584124654e-324", "2.4703282292062328e-324", "2.4703282292062327e-324",
+		"1e23", "8.988465674311579e307", "1.7976931348623158e308", "1.7976931348623159e308", "7.3177701707893310e+15",
+		"0.000000000000000000000000000000000000000000001", "123456789012345678901234567890", "1e-400", "1e400",
+		"179769313486231570814527423731704356798070567525844996598917476803157260780028538760589558632766878171540458953"
+		"5143824642343213268894641827684675467035375169860499105765512820762454900903893289440758685084551339423045832"
+		"3690322294816580855933212334827479782620414472316873817718091929988125040402618412485836.0"
+	};
+	int bad = 0;
+	for (int i = 0; i < (int)(sizeof(tricky) / sizeof(tricky[0])); i++)
+	{
+		if (myatof(tricky[i]) != strtod(tricky[i], NULL))
+		{
+			printf("%s\n", tricky[i]);
+			bad++;
+		}
+	}
+	ASL_ASSERT(bad == 0);
+
+	// random doubles round trip, and random decimal texts are read as the C library reads them
+
+	Random random(false);
+	for (int i = 0; i < 200000; i++)
+	{
+		ULong bits = random.getLong();
+		double y;
+		memcpy(&y, &bits, sizeof(y));
+		if (y != y || y - y != 0)
+			continue;
+		mydtoa(y, s);
+		if (myatof(s) != y)
+			bad++;
+		int nd = random(1, 24);
+		char* p = s + snprintf(s, 8, "%s", random(1) ? "-" : "");
+		for (int j = 0; j < nd; j++)
+			*p++ = '0' + random(9);
+		snprintf(p, 8, "e%i", random(-345, 310));
+		if (myatof(s) != strtod(s, NULL))
+			bad++;
+	}
+	ASL_ASSERT(bad == 0);
+
+	// a sample of all finite floats
+
+	for (unsigned i = 0; i < 0x7f800000u; i += 9973)
+	{
+		float y;
+		memcpy(&y, &i, sizeof(y));
+		myftoa(y, s);
+		if ((float)myatof(s) != y || strtof(s, NULL) != y)
+			bad++;
+	}
+	ASL_ASSERT(bad == 0);
+
+	// this one's shortest form reads back as the next float when rounded from a double
+
+	float f = 7.038531e-26f;
+	myftoa(f, s);
+	ASL_ASSERT((float)myatof(s) == f);
+	ASL_ASSERT((float)Json::decode(Json::encode(Var(f))) == f);
+
+	Array<double> values;
+	values << 0.1 << 1e23 << 1.0 / 3 << -5e-324 << 1.7976931348623157e308 << 0.30000000000000004;
+	String json = Json::encode(values);
+	ASL_ASSERT(json == "[0.1,1e+23,0.3333333333333333,-5e-324,1.7976931348623157e+308,0.30000000000000004]");
+	Var decoded = Json::decode(json);
+	for (int i = 0; i < values.length(); i++)
+		ASL_ASSERT((double)decoded[i] == values[i]);
+	ASL_ASSERT(Json::decode("[1.5e3]")[0] == 1500.0);
+}
+
+// appends a random JSON string (with escapes, slashes and comment-like sequences) to `json` and returns its value
+
+static String randomJsonString(Random& random, String& json, const String& suffix = "")
+{
+	static const char* pieces[][2] = {
+		{ "a", "a" }, { "xyz", "xyz" }, { "/", "/" }, { "//", "//" }, { "/*", "/*" }, { " ", " " },
+		{ "\\\"", "\"" }, { "\\\\", "\\" }, { "\\n", "\n" }, { "\\/", "/" }, { "\\u00e9", "\xc3\xa9" }, { "\xc3\xa9", "\xc3\xa9" }
+	};
+	String text;
+	json << '"';
+	for (int i = random(8); i > 0; i--)
+	{
+		int k = random(11);
+		json << pieces[k][0];
+		text << pieces[k][1];
+	}
+	json << suffix << '"';
+	return text << suffix;
+}
+
+// appends a random JSON value (with spaces and comments around) to `json` and returns its value
+
+static Var randomJson(Random& random, String& json, int depth)
+{
+	static const char* spaces[] = { "", "", " ", "\n\t", "/*c*/", " // c\n" };
+	json << spaces[random(5)];
+	Var v;
+	switch (random(depth > 3 ? 3 : 5))
+	{
+	case 0: {
+		String n = String(random(-999999999, 999999999));
+		json << n;
+		v = (int)n;
+		break;
+	}
+	case 1: {
+		String n = String::f("%i.%ie%i", random(-9999, 9999), random(99999), random(-30, 30));
+		json << n;
+		v = strtod(n, NULL);
+		break;
+	}
+	case 2:
+	case 3:
+		v = randomJsonString(random, json);
+		break;
+	case 4:
+		v = Var::ARRAY;
+		json << '[';
+		for (int i = random(4); i > 0; i--)
+		{
+			v << randomJson(random, json, depth + 1);
+			if (i > 1)
+				json << ',';
+		}
+		json << ']';
+		break;
+	case 5:
+		v = Var::OBJ;
+		json << '{';
+		for (int i = random(4); i > 0; i--)
+		{
+			json << spaces[random(5)];
+			String key = randomJsonString(random, json, i);
+			json << spaces[random(5)] << ':';
+			v[key] = randomJson(random, json, depth + 1);
+			if (i > 1)
+				json << ',';
+		}
+		json << '}';
+		break;
+	}
+	json << spaces[random(5)];
+	return v;
+}
+
 ASL_TEST(JSON)
 {
 	String a = "A/*...*/{x=3.5, //...\ny=\"s\", z=[Y, N]}";
@@ -430,6 +685,41 @@ ASL_TEST(JSON)
 	ASL_ASSERT(f.ok());
 	ASL_ASSERT(f["y"] == 3);
 	ASL_ASSERT(f["x"].is(Var::NUL));
+	ASL_ASSERT(Json::decode("{\"a/b\": \"c/d\"}")["a/b"] == "c/d");
+
+	// random documents give the same values parsed whole or fed in pieces of random sizes (including one byte at a
+	// time), so that values, escapes and comments are split at every possible point
+
+	Random random(false);
+	int bad = 0;
+	for (int i = 0; i < 2000; i++)
+	{
+		String json;
+		Var expected = randomJson(random, json, 0);
+		if (Json::decode(json) != expected)
+			bad++;
+		int maxPiece = i % 2 ? 1 : 40;
+		XdlParser parser;
+		for (int j = 0; j < json.length();)
+		{
+			int n = min(json.length() - j, (int)random(1, maxPiece));
+			parser.parse(json.substring(j, j + n));
+			j += n;
+		}
+		parser.parse(" ");
+		if (parser.value() != expected)
+			bad++;
+	}
+	ASL_CHECK(bad, ==, 0);
+
+	// a '/' right after a chunk boundary inside a quoted property name
+
+	XdlParser split;
+	split.parse("{\"a");
+	split.parse("/b\": 1, \"c\": \"");
+	split.parse("/d\"}");
+	split.parse(" ");
+	ASL_ASSERT(split.value() == Json::decode("{\"a/b\": 1, \"c\": \"/d\"}"));
 
 	ASL_ASSERT(Xdl::decode("9123456789") == 9123456789.0);
 
@@ -478,6 +768,77 @@ ASL_TEST(JSON)
 #endif
 }
 
+ASL_TEST(XdlReader)
+{
+	XdlReader reader;
+	reader.setText("{\"a\": 1, \"b\": [true, null, \"x\"], \"c\": {\"d\": -2.5e3, \"e\": []}, \"f\": 5}");
+	ASL_ASSERT(reader.next() && reader.event() == XdlReader::BEGIN_OBJECT && reader.depth() == 1);
+	ASL_ASSERT(reader.next() && reader.event() == XdlReader::PROPERTY && reader.name() == "a");
+	ASL_ASSERT(reader.next() && reader.event() == XdlReader::VALUE && reader.value() == 1);
+	ASL_ASSERT(reader.next() && reader.name() == "b");
+	reader.skip();
+	ASL_ASSERT(reader.event() == XdlReader::END_ARRAY && reader.depth() == 1);
+	ASL_ASSERT(reader.next() && reader.name() == "c");
+	Var c = reader.readValue();
+	ASL_ASSERT(c == Json::decode("{\"d\": -2500, \"e\": []}"));
+	ASL_ASSERT(reader.next() && reader.name() == "f");
+	ASL_ASSERT(reader.next() && reader.value() == 5);
+	ASL_ASSERT(reader.next() && reader.event() == XdlReader::END_OBJECT && reader.depth() == 0);
+	ASL_ASSERT(!reader.next() && reader.event() == XdlReader::END && !reader.error());
+
+	reader.setText("[1, 2, {\"x\": 3");
+	while (reader.next()) {}
+	ASL_ASSERT(reader.error());
+
+#ifndef __ANDROID__
+	Var big = Var::ARRAY;
+	for (int i = 0; i < 30000; i++)
+		big << Var("id", i)("name", String::f("item%i", i))("tags", array<Var>("a", "b"));
+	Json::write(big, "big.json");
+	ASL_ASSERT(Json::read("big.json") == big);
+
+	XdlReader file("big.json");
+	int count = 0, sum = 0;
+	ASL_ASSERT(file.next() && file.event() == XdlReader::BEGIN_ARRAY);
+	while (file.next() && file.event() != XdlReader::END_ARRAY)
+	{
+		Var item = file.readValue();
+		sum += (int)item["id"] == count++;
+	}
+	ASL_ASSERT(count == 30000 && sum == count);
+	ASL_ASSERT(!file.next() && !file.error());
+
+	// a reader can be reused after errors or partial reads, with files or text
+
+	reader.setText("[1, } 2]");
+	while (reader.next()) {}
+	ASL_ASSERT(reader.error());
+	ASL_ASSERT(reader.open("big.json"));
+	ASL_ASSERT(!reader.error() && reader.event() == XdlReader::NONE);
+	ASL_ASSERT(reader.next() && reader.next() && reader.event() == XdlReader::BEGIN_OBJECT && reader.depth() == 2);
+	reader.setText("{\"a\": [1]}");
+	ASL_ASSERT(reader.next() && reader.event() == XdlReader::BEGIN_OBJECT && reader.depth() == 1);
+	ASL_ASSERT(reader.next() && reader.name() == "a");
+	ASL_ASSERT(reader.readValue() == Json::decode("[1]"));
+	ASL_ASSERT(reader.next() && reader.event() == XdlReader::END_OBJECT && reader.depth() == 0);
+	ASL_ASSERT(!reader.next() && !reader.error());
+	reader.setText("[1, 2, {\"x\": 3");
+	while (reader.next()) {}
+	ASL_ASSERT(reader.error());
+	reader.setText("[\"x\"]");
+	ASL_ASSERT(reader.next() && reader.next() && reader.value() == "x" && reader.depth() == 1);
+	ASL_ASSERT(reader.next() && !reader.next() && !reader.error());
+	TextFile("big.json").remove();
+#endif
+}
+
+struct VarEncoder : public Thread
+{
+	Var v;
+	String json;
+	void run() { json = Json::encode(v); }
+};
+
 ASL_TEST(Var)
 {
 	Var b = Var("x", 3);
@@ -610,6 +971,102 @@ ASL_TEST(Var)
 		v = w;
 		ASL_ASSERT(w == v);
 	}
+
+	// objects with many properties, added and removed in any order, enumerate in key order like Dic
+
+	Var o(Var::OBJ), o2 = o;
+	Dic<int> ref;
+	for (int i = 0; i < 3000; i++)
+	{
+		int k = (i * 7919) % 3001;
+		o[String::f("k%i", k)] = k;
+		ref[String::f("k%i", k)] = k;
+		if (i % 3 == 2)
+		{
+			String r = String::f("k%i", (i * 31) % 3001);
+			o.remove(r);
+			ref.remove(r);
+		}
+	}
+	ASL_ASSERT(o2.length() == ref.length());
+	ASL_ASSERT(o2.object().keys() == ref.keys());
+	foreach2(String& k, int x, ref)
+		ASL_ASSERT(o2[k] == x && o2.getp(k));
+	ASL_ASSERT(!o2.has("k3001") && !o2.getp("k3001"));
+	ASL_ASSERT(Dic<int>(o) == ref);
+	Var o3 = Json::decode(Json::encode(o));
+	ASL_ASSERT(o3 == o && Json::encode(o3) == Json::encode(o));
+	ASL_ASSERT(Json::encode(Var("b", 1)("a", 2)("c", Var("z", 3)("y", 4))) == "{\"a\":2,\"b\":1,\"c\":{\"y\":4,\"z\":3}}");
+	o3["k0"] = 5;
+	ASL_ASSERT(o3 != o);
+
+	// reading does not move properties, and an object can be read from several threads at once
+
+	Var u(Var::OBJ);
+	for (int i = 0; i < 2000; i++)
+		u[String::f("u%i", (i * 7919) % 2003)] = i;
+	const Var* pu = u.getp("u5");
+	VarEncoder readers[3];
+	for (int i = 0; i < 3; i++)
+	{
+		readers[i].v = u;
+		readers[i].start();
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		readers[i].join();
+		ASL_ASSERT(readers[i].json == readers[0].json);
+	}
+	ASL_ASSERT(readers[0].json == Json::encode(u.clone()) && u.getp("u5") == pu);
+	ASL_ASSERT(readers[0].json.startsWith("{\"u0\":") && u.object().keys()[1] == "u1");
+
+	// object() gives the properties themselves
+
+	int u5 = u["u5"];
+#ifdef ASL_HAVE_RANGEFOR
+	for (auto& e : u.object())
+		e.value = (int)e.value + 1;
+#else
+	foreach2 (String& k, Var& x, u.object())
+		x = (int)x + 1;
+#endif
+	ASL_ASSERT(u["u5"] == u5 + 1 && u.getp("u5") == pu);
+	Dic<Var> ud = u.object();
+	ASL_ASSERT(ud.length() == u.length() && ud["u5"] == u5 + 1);
+	o.clear();
+	ASL_ASSERT(o2.length() == 0 && !o2.has("k0"));
+}
+
+
+ASL_TEST(Arena)
+{
+	String json = "{\"list\":[1,2.5,\"a long string, longer than sixteen characters\",[],{}],\"obj\":{\"x\":true,\"y\":null},"
+		"\"z\":[{\"k1\":1,\"k2\":2,\"k3\":3,\"k4\":4,\"k5\":5,\"k6\":6,\"k7\":7,\"k8\":8,\"k9\":9,\"k10\":10}]}";
+	Var heap = Json::decode(json);
+	Var a = Json::decode(json, Json::ARENA);
+	ASL_ASSERT(a == heap && Json::encode(a) == Json::encode(heap));
+
+	Var b;
+	{
+		Arena arena;
+		Arena::Scope scope(arena);
+		b = Json::decode(json);
+		Array<int> numbers;
+		for (int i = 0; i < 100; i++)
+			numbers << i;
+		ASL_ASSERT(numbers.length() == 100 && numbers[99] == 99);
+		ASL_ASSERT(arena.allocated() > 0);
+	}
+	ASL_ASSERT(b == heap);
+	b["obj"]["w"] = "added after the scope ends";
+	Var& list = b["list"];
+	for (int i = 0; i < 100; i++)
+		list << i;
+	ASL_ASSERT(b["list"].length() == 105 && b["list"][104] == 99);
+	Var c = b.clone();
+	b = Var();
+	ASL_ASSERT(c["obj"]["w"] == "added after the scope ends" && c["z"][0]["k10"] == 10);
+	ASL_ASSERT(c["list"][2] == "a long string, longer than sixteen characters" && c["list"][104] == 99);
 }
 
 
@@ -642,6 +1099,13 @@ int main(int narg, char* argv[])
 			printf("subprocess %s\n", *args.all().slice(1).join(","));
 			return args.all().length();
 		}
+		if (args.has("sublines")) {
+			int n = args["sublines"];
+			for (int i = 0; i < n; i++)
+				printf("line %i\r\n", i);
+			fprintf(stderr, "%i lines\n", n);
+			return 0;
+		}
 	}
 	
 	if (narg < 2) {
@@ -1,11 +1,16 @@
 #include <asl/Array.h>
 #include <asl/Map.h>
 #include <asl/HashMap.h>
+#include <asl/FlatHashMap.h>
 #include <asl/Pointer.h>
 #include <asl/Factory.h>
 #include <asl/Thread.h>
+#include <asl/ConcurrentQueue.h>
 #include <asl/Path.h>
 #include <asl/Xml.h>
+#include <asl/Log.h>
+#include <asl/TextFile.h>
+#include <asl/File.h>
 #include <asl/testing.h>
 #include <stdio.h>
 
@@ -310,6 +315,104 @@ ASL_TEST(HashMap)
 	m2[100] = 5.5f;
 
 	ASL_ASSERT(m2 != m);
+
+	// aligned keys must use all buckets, and all key lengths hash all their bytes
+
+	HashMap<int, int> used;
+	for (int i = 0; i < 1024; i++)
+		used[hash(i * 4096) & 1023] = 1;
+	ASL_CHECK(used.length(), >, 600);
+
+	String text = "The quick brown fox jumps over the lazy dog. The quick brown fox jumps over the lazy dog again.";
+	for (int n = 0; n < text.length(); n++)
+	{
+		String s = text.substring(0, n), t = s;
+		ASL_ASSERT(hash(s) == hash(*t, n));
+		if (n > 0)
+		{
+			t[n - 1] = '#';
+			ASL_ASSERT(hash(s) != hash(t));
+			t = s;
+			t[0] = '#';
+			ASL_ASSERT(hash(s) != hash(t));
+		}
+	}
+
+	// removing entries must keep the others that share their bucket
+
+	HashMap<int, int> many;
+	for (int i = 0; i < 2000; i++)
+		many[i] = i;
+	for (int i = 0; i < 2000; i += 2)
+		many.remove(i);
+	ASL_CHECK(many.length(), ==, 1000);
+	int missing = 0;
+	for (int i = 1; i < 2000; i += 2)
+		if (!many.has(i))
+			missing++;
+	ASL_CHECK(missing, ==, 0);
+
+	ULong seed = hashSeed();
+	int h1 = hash(text);
+	setHashSeed(12345);
+	ASL_ASSERT(hash(text) != h1);
+	setHashSeed(seed);
+	ASL_ASSERT(hash(text) == h1);
+}
+
+ASL_TEST(FlatHashMap)
+{
+	FlatHashMap<int, int> m;
+	ASL_ASSERT(m.length() == 0 && !m.has(3) && !m.find(3));
+	for (int i = 0; i < 5000; i++)
+		m[i * 1024] = i;
+	ASL_ASSERT(m.length() == 5000);
+	for (int i = 0; i < 5000; i++)
+		ASL_ASSERT(m[i * 1024] == i);
+	ASL_ASSERT(!m.has(1));
+
+	for (int i = 0; i < 5000; i += 2)
+		m.remove(i * 1024);
+	ASL_ASSERT(m.length() == 2500);
+	for (int i = 0; i < 5000; i++)
+		ASL_ASSERT(m.has(i * 1024) == (i % 2 == 1));
+
+	int sum = 0, count = 0;
+	foreach2(int k, int v, m)
+	{
+		ASL_ASSERT(k == v * 1024);
+		sum += v;
+		count++;
+	}
+	ASL_ASSERT(count == 2500 && sum == 2500 * 2500);
+
+	FlatHashMap<int, int> m2 = m.clone();
+	ASL_ASSERT(m2 == m);
+	m2[1024] = 0;
+	ASL_ASSERT(m2 != m);
+	m.clear();
+	ASL_ASSERT(m.length() == 0 && m2.length() == 2500);
+
+	FlatHashDic<String> dic(100);
+	dic["one"] = "1";
+	dic[String("two")] = "2";
+	ASL_ASSERT(dic.has("two") && dic.has(String("one")));
+	ASL_ASSERT(*dic.find("one") == "1");
+	ASL_ASSERT(dic.get("three", "-") == "-");
+	dic.remove("one");
+	ASL_ASSERT(dic.length() == 1 && !dic.has("one"));
+
+	int n = 0;
+	for (auto& e : dic)
+	{
+		ASL_ASSERT(e.key == "two" && e.value == "2");
+		n++;
+	}
+	ASL_ASSERT(n == 1);
+
+	HashDic<int> hdic;
+	hdic["x"] = 3;
+	ASL_ASSERT(hdic.has("x") && *hdic.find("x") == 3 && !hdic.find("y"));
 }
 
 String join1(const Dic<String>& a)
@@ -447,3 +550,210 @@ ASL_TEST(AtomicCount)
 	ASL_ASSERT(A2Thread<ItemType>::n == ItemType(20.0 * A2Thread<ItemType>::N));
 }
 
+#ifdef ASL_EXP_THREADING
+ASL_TEST(ParallelFor)
+{
+	setParallelThreads(4); // if the pool was not used yet
+
+	Array<int> a(10000);
+	for (int k = 0; k < 100; k++)
+	{
+		Thread::parallel_for(0, a.length(), [&](int i) { a[i] = k + i; });
+		ASL_ASSERT(a[0] == k && a[9999] == k + 9999);
+	}
+
+	AtomicCount count;
+	Thread::parallel_for(0, 50, [&](int i) {
+		Thread::parallel_for(0, 100, [&](int j) { ++count; }, 0, 7);
+	});
+	ASL_ASSERT(count == 5000);
+
+	// a limited number of threads run a loop at the same time
+
+	AtomicCount active, done;
+	int peak = 0;
+	Mutex peakLock;
+	Thread::parallel_for(0, 40, [&](int i) {
+		int m = ++active;
+		{
+			Lock _(peakLock);
+			peak = max(peak, m);
+		}
+		sleep(0.002);
+		--active;
+		++done;
+	}, 2);
+	ASL_CHECK(done, ==, 40);
+	ASL_CHECK(peak, <=, 2);
+
+	Long sum = Thread::parallel_reduce(0, a.length(), (Long)0, [&](int i) { return (Long)a[i]; },
+		[](Long x, Long y) { return x + y; });
+	ASL_ASSERT(sum == 99 * 10000LL + 9999 * 10000LL / 2);
+
+	int x = 0, y = 0;
+	Thread::parallel_invoke([&]() { x = 1; }, [&]() { y = 2; });
+	ASL_ASSERT(x == 1 && y == 2);
+}
+
+template<class Q>
+static void testQueueThreads(Q& queue)
+{
+	const int N = 20000, P = 4;
+	AtomicCount consumed;
+	Array<Long> sums(P);
+	Array<Thread> threads;
+	for (int k = 0; k < P; k++)
+	{
+		sums[k] = 0;
+		threads << Thread([&, k]() {
+			for (int i = 1; i <= N; i++)
+				queue.push(i);
+		});
+		threads << Thread([&, k]() {
+			Array<int> batch;
+			while (consumed < P * N)
+			{
+				batch.clear();
+				int x;
+				if (k % 2 == 0)
+					queue.popBatch(batch, 64, 0.01);
+				else if (queue.pop(x, 0.01))
+					batch << x;
+				foreach(int y, batch)
+					sums[k] += y;
+				consumed += batch.length();
+			}
+		});
+	}
+	foreach(Thread& t, threads)
+		t.join();
+	Long sum = 0;
+	foreach(Long s, sums)
+		sum += s;
+	ASL_ASSERT(consumed == P * N && sum == (Long)P * N * (N + 1) / 2);
+}
+
+ASL_TEST(ConcurrentQueue)
+{
+	BoundedQueue<String> q(3);
+	ASL_ASSERT(q.capacity() == 4);
+	for (int i = 0; i < 4; i++)
+		ASL_ASSERT(q.tryPush(String(i)));
+	ASL_ASSERT(!q.tryPush("x") && q.length() == 4);
+	ASL_ASSERT(!q.push("x", 0.01));
+	String s;
+	ASL_ASSERT(q.tryPop(s) && s == "0");
+	Array<String> a;
+	ASL_ASSERT(q.popBatch(a, 10) == 3 && a.join(",") == "1,2,3");
+	ASL_ASSERT(!q.tryPop(s) && !q.pop(s, 0.01));
+
+	ConcurrentQueue<int> u;
+	for (int i = 0; i < 1000; i++)
+		u.push(i);
+	ASL_ASSERT(u.length() == 1000);
+	int x = -1;
+	ASL_ASSERT(u.tryPop(x) && x == 0);
+	Array<int> b;
+	ASL_ASSERT(u.popBatch(b, 600) == 600 && b[0] == 1 && b[599] == 600);
+	ASL_ASSERT(u.pop() == 601 && u.length() == 398);
+
+	BoundedQueue<int> bq(64);
+	testQueueThreads(bq);
+	ConcurrentQueue<int> cq;
+	testQueueThreads(cq);
+}
+#endif
+
+struct LogWriter : public Thread
+{
+	int id, count;
+	void run()
+	{
+		for (int i = 0; i < count; i++)
+			log("test", Log::INFO, "t%i %i", id, i);
+	}
+};
+
+// counts the test messages in a log file (checking they are in order for each writer) and the drops reported
+
+static int countLogLines(const String& name, int& reported, bool& ordered)
+{
+	int n = 0, next[4] = { 0, 0, 0, 0 };
+	reported = 0;
+	ordered = true;
+	Array<String> lines = TextFile(name).lines();
+	foreach (String& line, lines)
+	{
+		int i = line.indexOf("[test] t");
+		if (i >= 0)
+		{
+			Array<String> parts = line.substring(i + 8).split(' ');
+			int id = parts[0], k = parts[1];
+			if (k < next[id])
+				ordered = false;
+			next[id] = k + 1;
+			n++;
+		}
+		else if ((i = line.indexOf("WARNING: ")) >= 0 && line.contains("messages dropped"))
+			reported += (int)line.substring(i + 9).split(' ')[0];
+	}
+	return n;
+}
+
+ASL_TEST(Log)
+{
+	String name = "asltest.log";
+	File(name).remove();
+	Log::setFile(name);
+	Log::useConsole(false);
+
+	// threads log while the queue is replaced and asynchronous mode is turned off and on
+
+	Log::setAsync(true, 256, Log::BLOCK);
+	LogWriter writers[4];
+	for (int i = 0; i < 4; i++)
+	{
+		writers[i].id = i;
+		writers[i].count = 3000;
+		writers[i].start();
+	}
+	for (int i = 0; i < 6; i++)
+	{
+		sleep(0.002);
+		if (i == 3)
+			Log::setAsync(false);
+		else
+			Log::setAsync(true, 64 << i, Log::BLOCK);
+	}
+	for (int i = 0; i < 4; i++)
+		writers[i].join();
+	Log::flush();
+	int reported;
+	bool ordered;
+	ASL_CHECK(countLogLines(name, reported, ordered), ==, 12000);
+	ASL_ASSERT(ordered);
+	File(name).remove();
+
+	// a small queue with each overflow policy
+
+	Log::Overflow policies[] = { Log::BLOCK, Log::DROP, Log::DROP_REPORT };
+	for (int p = 0; p < 3; p++)
+	{
+		Log::setAsync(true, 4, policies[p]);
+		for (int i = 0; i < 2000; i++)
+			log("test", Log::INFO, "t0 %i", i);
+		sleep(0.01);
+		log("test", Log::INFO, "t1 0");
+		Log::flush();
+		int dropped = Log::dropped();
+		int n = countLogLines(name, reported, ordered);
+		ASL_CHECK(n + dropped, ==, 2001);
+		ASL_ASSERT(ordered);
+		ASL_ASSERT(p == 0 ? dropped == 0 : dropped > 0);
+		ASL_CHECK(reported, ==, (p == 2 ? dropped : 0));
+		File(name).remove();
+	}
+	Log::setAsync(false);
+	Log::setFile("log.log");
+	Log::useConsole(true);
+}
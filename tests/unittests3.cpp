@@ -2,6 +2,14 @@
 #include <asl/SHA1.h>
 #include <asl/Shared.h>
 #include <asl/Date.h>
+#include <asl/Deflate.h>
+#include <asl/Resolver.h>
+#include <asl/atomic.h>
+#include <asl/Thread.h>
+#include <asl/WebSocket.h>
+#include <asl/HttpServer.h>
+#include <asl/File.h>
+#include <asl/TlsSocket.h>
 #include <asl/util.h>
 #include <stdio.h>
 #include <asl/testing.h>
@@ -41,6 +49,48 @@ ASL_TEST(Process)
 		ASL_ASSERT(proc.exitStatus() == 4);
 		ASL_ASSERT(lines[0] == "subprocess -subproc,5,a \"b\\");
 	}
+	{
+		Process proc;
+		proc.run(Process::myPath(), "-sublines", 5000);
+		int n = 0;
+		while (proc.readOutputLine() == String::f("line %i", n))
+			n++;
+		proc.wait();
+		ASL_CHECK(n, ==, 5000);
+	}
+}
+
+ASL_TEST(Processes)
+{
+	Processes procs;
+	procs.setMaxRunning(4);
+	Array<int> status(20);
+	int ended = 0, lines = 0;
+	for (int i = 0; i < 20; i++)
+	{
+		if (i < 19)
+			procs.execute(Process::myPath(), array<String>("-subproc", i), [&, i](Process& p) {
+				status[i] = p.output().trimmed() == String::f("subprocess -subproc,%i", i) ? p.exitStatus() : -1;
+				ended++;
+			});
+		else
+			procs.execute(Process::myPath(), array<String>("-sublines", 100000), [&](Process& p) {
+				lines = p.output().split("\n").length() - 1;
+				ASL_CHECK(p.errors(), ==, "100000 lines\n");
+				ended++;
+			});
+	}
+	ASL_CHECK(procs.length(), ==, 20);
+	ASL_CHECK(procs.wait(), ==, 0);
+	ASL_CHECK(ended, ==, 20);
+	ASL_CHECK(lines, ==, 100000);
+	for (int i = 0; i < 19; i++)
+		ASL_CHECK(status[i], ==, 3);
+
+	Process p = Process::execute(Process::myPath(), "-sublines", 3);
+	ASL_CHECK(p.output(), ==, "line 0\r\nline 1\r\nline 2\r\n");
+	ASL_CHECK(p.errors(), ==, "3 lines\n");
+	ASL_ASSERT(p.success());
 }
 
 #endif
@@ -210,3 +260,1163 @@ ASL_TEST(Function)
 
 	ASL_CHECK(sum3(3, 5), == , 18);
 }
+
+ASL_TEST(Deflate)
+{
+#ifdef ASL_ZLIB
+	String text = "Some text, some more text, and some more text to compress";
+	ByteArray data((const byte*)*text, text.length());
+
+	ByteArray gz = Deflater::compress(data, Deflater::GZIP);
+	ASL_ASSERT(gz.length() > 10 && gz[0] == 0x1f && gz[1] == 0x8b);
+	ASL_ASSERT(Inflater::decompress(gz, Deflater::GZIP) == data);
+
+	Deflater deflater(Deflater::RAW);
+	Inflater inflater(Deflater::RAW);
+	ByteArray packed, unpacked;
+	for (int i = 0; i < 3; i++)
+	{
+		packed.clear();
+		ASL_ASSERT(deflater.compress(data.data(), data.length(), packed, Deflater::SYNC));
+		ASL_ASSERT(packed.length() > 4 && packed[packed.length() - 1] == 0xff);
+		ASL_ASSERT(inflater.decompress(packed.data(), packed.length(), unpacked));
+	}
+	ASL_CHECK(unpacked.length(), ==, 3 * data.length());
+	ASL_ASSERT(unpacked.slice(2 * data.length()) == data);
+
+	ASL_ASSERT(!inflater.decompress(packed.data(), packed.length(), unpacked, unpacked.length() + 10));
+#endif
+}
+
+struct EchoWsServer : public WebSocketServer
+{
+	void serve(WebSocket& ws)
+	{
+		while (!ws.closed())
+		{
+			ByteArray msg = ws.receive();
+			if (msg.length() > 0)
+				ws.send(msg);
+		}
+	}
+};
+
+ASL_TEST(SocketPoller)
+{
+	int port = 9985;
+	Socket server;
+	ASL_ASSERT(server.bind("127.0.0.1", port));
+	server.listen();
+	SocketPoller poller;
+	poller.add(server);
+	ASL_CHECK(poller.wait(0), ==, 0);
+
+	Socket client;
+	ASL_ASSERT(client.connect("127.0.0.1", port));
+	ASL_CHECK(poller.wait(1), ==, 1);
+	ASL_ASSERT(poller.ready(0) == server && poller.events(0) == SocketPoller::READ);
+	Socket conn = server.accept();
+	poller.add(conn);
+	ASL_CHECK(poller.length(), ==, 2);
+
+	// two lines arrive together: after reading one, the other is still buffered and reported
+
+	client << "one\ntwo\n";
+	ASL_CHECK(poller.wait(1), ==, 1);
+	ASL_ASSERT(poller.ready(0) == conn && poller.isReady(conn) && !poller.isReady(server));
+	ASL_CHECK(conn.readLine(), ==, "one");
+	ASL_CHECK(poller.wait(1), ==, 1);
+	ASL_CHECK(conn.readLine(), ==, "two");
+	ASL_CHECK(poller.wait(0), ==, 0);
+
+	// write interest, and edge-triggered input reported once until more data arrives
+
+	poller.add(client, SocketPoller::WRITE);
+	ASL_CHECK(poller.wait(0), ==, 1);
+	ASL_ASSERT(poller.ready(0) == client && poller.events(0) == SocketPoller::WRITE);
+	poller.remove(client);
+	ASL_ASSERT(!poller.has(client));
+
+#ifdef __linux__
+	poller.add(conn, SocketPoller::READ | SocketPoller::EDGE);
+	client << "x";
+	ASL_CHECK(poller.wait(1), ==, 1);
+	ASL_CHECK(poller.wait(0), ==, 0);
+	client << "y";
+	ASL_CHECK(poller.wait(1), ==, 1);
+	poller.add(conn, SocketPoller::READ);
+	ASL_CHECK(poller.wait(0), ==, 1);
+#endif
+
+	// closing the peer wakes up the other end
+
+	client.close();
+	ASL_CHECK(poller.wait(1), ==, 1);
+	ASL_ASSERT(poller.ready(0) == conn);
+	poller.remove(conn);
+	conn.close();
+	ASL_CHECK(poller.length(), ==, 1);
+
+	Sockets set;
+	set << server;
+	Socket client2;
+	client2.connect("127.0.0.1", port);
+	ASL_CHECK(set.waitInput(1), ==, 1);
+	ASL_ASSERT(set.hasInput(server) && set.activeAt(0) == server);
+	Socket conn2 = server.accept();
+
+	// sockets added with data already buffered, or read outside the wait loop, are reported
+
+	client2 << "line1\nline2\nline3\nline4\n";
+	ASL_CHECK(conn2.readLine(), ==, "line1");
+	ASL_ASSERT(conn2.available() > 0);
+	SocketPoller poller2;
+	poller2.add(conn2);
+	ASL_CHECK(poller2.wait(0.2), ==, 1);
+	ASL_ASSERT(poller2.ready(0) == conn2);
+	poller2.remove(conn2);
+	Sockets set2;
+	set2 << conn2;
+	ASL_CHECK(set2.waitInput(0.2), ==, 1);
+	ASL_CHECK(conn2.readLine(), ==, "line2");
+	ASL_CHECK(set2.waitInput(0.2), ==, 1);
+	ASL_CHECK(conn2.readLine(), ==, "line3");
+	ASL_CHECK(conn2.readLine(), ==, "line4");
+	ASL_CHECK(set2.waitInput(0), ==, 0);
+	client2 << "line5\nline6\n";
+	ASL_CHECK(conn2.readLine(), ==, "line5");
+	ASL_CHECK(set2.waitInput(0.2), ==, 1);
+	ASL_ASSERT(set2.hasInput(conn2));
+	ASL_CHECK(conn2.readLine(), ==, "line6");
+
+	client2.close();
+	set.close();
+	set2.close();
+}
+
+ASL_TEST(SocketBuffer)
+{
+	int port = 9979;
+	Socket server;
+	ASL_ASSERT(server.bind("127.0.0.1", port));
+	server.listen();
+	Socket client;
+	ASL_ASSERT(client.connect("127.0.0.1", port));
+	Socket conn = server.accept();
+
+	// a header block followed by a body in the same packet: the body stays buffered
+
+	client << "GET / HTTP/1.1\r\nHost: x\r\n\r\nBODY";
+	ASL_CHECK(conn.readUntil("\r\n\r\n"), ==, "GET / HTTP/1.1\r\nHost: x");
+	ASL_CHECK(conn.available(), ==, 4);
+	ASL_CHECK(String(conn.peek(2)), ==, "BO");
+	ASL_CHECK(conn.available(), ==, 4);
+	char body[5] = { 0 };
+	ASL_CHECK(conn.read(body, 4), ==, 4);
+	ASL_CHECK(String(body), ==, "BODY");
+	ASL_CHECK(conn.available(), ==, 0);
+
+	// a delimiter split between two packets, and a peek that waits for more input
+
+	client << "abc<";
+	ASL_CHECK(String(conn.peek(4)), ==, "abc<");
+	client << ">def\n";
+	ASL_CHECK(conn.readUntil("<>"), ==, "abc");
+	ASL_CHECK(String(conn.peek(3)), ==, "def");
+	ASL_CHECK(conn.read<char>(), ==, 'd');
+	ASL_CHECK(conn.readLine(), ==, "ef");
+
+	// a large read takes the buffered part first and the rest directly
+
+	ByteArray big(100000);
+	for (int i = 0; i < big.length(); i++)
+		big[i] = (byte)(i * 7);
+	client << "x\n";
+	client.write(big.data(), big.length());
+	ASL_CHECK(conn.readLine(), ==, "x");
+	ByteArray got(big.length());
+	ASL_CHECK(conn.read(got.data(), got.length()), ==, big.length());
+	ASL_ASSERT(got == big);
+	ASL_CHECK(conn.available(), ==, 0);
+
+	// no delimiter within the length limit
+
+	client << "0123456789012345678901234567890123456789\n";
+	ASL_CHECK(conn.readUntil("#", 10), ==, "");
+	ASL_ASSERT(conn.error() != 0);
+
+	// peek past the end of the connection returns what there is
+
+	Socket client2;
+	ASL_ASSERT(client2.connect("127.0.0.1", port));
+	Socket conn2 = server.accept();
+	client2 << "zz";
+	client2.close();
+	ASL_CHECK(String(conn2.peek(10)), ==, "zz");
+	ASL_CHECK(conn2.readLine(), ==, "zz");
+
+	conn.close();
+	conn2.close();
+	client.close();
+	server.close();
+}
+
+#ifdef __linux__
+
+struct LineServer : public SocketServer
+{
+	AtomicCount closed;
+	LineServer()
+	{
+		Socket unbound; // a listener that cannot be watched, placed before the real one
+		_sockets << unbound;
+	}
+	bool serveInput(Socket client)
+	{
+		String line = client.readLine();
+		if (line == "quit")
+			return false;
+		client << line << "\n";
+		return true;
+	}
+	void clientClosed(Socket client) { ++closed; }
+};
+
+ASL_TEST(SocketServerEvents)
+{
+	int port = 9980;
+	LineServer server;
+	ASL_ASSERT(server.bind("127.0.0.1", port));
+	server.setEventDriven(true, 2);
+	server.start(true);
+	sleep(0.1);
+
+	const int n = 10;
+	Socket clients[n];
+	for (int i = 0; i < n; i++)
+		ASL_ASSERT(clients[i].connect("127.0.0.1", port));
+
+	int bad = 0;
+	for (int k = 0; k < 3; k++)
+	{
+		for (int i = 0; i < n; i++)
+			clients[i] << String::f("c%i-%i\n", i, k);
+		for (int i = 0; i < n; i++)
+			if (clients[i].readLine() != String::f("c%i-%i", i, k))
+				bad++;
+	}
+	ASL_CHECK(bad, ==, 0);
+
+	// two messages in one packet: the second one is already buffered when the first is served
+
+	clients[0] << "one\ntwo\n";
+	ASL_CHECK(clients[0].readLine(), ==, "one");
+	ASL_ASSERT(clients[0].waitInput(2));
+	ASL_CHECK(clients[0].readLine(), ==, "two");
+
+	// connections end when serveInput() returns false or the peer disconnects
+
+	clients[0] << "quit\n";
+	for (int i = 0; i < 40 && server.closed != 1; i++)
+		sleep(0.05);
+	ASL_CHECK(server.closed, ==, 1);
+	char c;
+	ASL_ASSERT(clients[0].waitInput(2) && clients[0].read(&c, 1) <= 0);
+	for (int i = 1; i < n; i++)
+		clients[i].close();
+	for (int i = 0; i < 40 && server.closed != n; i++)
+		sleep(0.05);
+	ASL_CHECK(server.closed, ==, n);
+	server.stop(true);
+}
+
+#endif
+
+ASL_TEST(Resolver)
+{
+	// a stub backend that is slow enough for concurrent lookups to overlap
+
+	AtomicCount calls;
+	Resolver resolver;
+	resolver.setBackend([&](const String& host) {
+		++calls;
+		sleep(0.2);
+		Array<InetAddress> addrs;
+		if (host == "server.test")
+			addrs << InetAddress("10.1.2.3", 0);
+		return addrs;
+	});
+
+	Array<InetAddress> addrs = resolver.lookup("server.test");
+	ASL_CHECK(addrs.length(), ==, 1);
+	ASL_CHECK(addrs[0].host(), ==, "10.1.2.3");
+	addrs[0].setPort(80);
+	addrs = resolver.lookup("Server.Test");
+	ASL_CHECK(addrs[0].port(), ==, 0);
+	ASL_CHECK((int)calls, ==, 1);
+	ASL_ASSERT(resolver.isCached("server.test"));
+
+	// names not found are also cached, literals do not use the backend
+
+	ASL_CHECK(resolver.lookup("missing.test").length(), ==, 0);
+	ASL_CHECK(resolver.lookup("missing.test").length(), ==, 0);
+	ASL_CHECK(resolver.lookup("10.0.0.1")[0].host(), ==, "10.0.0.1");
+	ASL_CHECK((int)calls, ==, 2);
+
+	resolver.clear();
+	resolver.setTTL(0.2);
+	resolver.lookup("server.test");
+	sleep(0.3);
+	ASL_ASSERT(!resolver.isCached("server.test"));
+	resolver.lookup("server.test");
+	ASL_CHECK((int)calls, ==, 4);
+
+	// async and blocking lookups of the same name are coalesced in one query
+
+	resolver.clear();
+	AtomicCount results;
+	for (int i = 0; i < 3; i++)
+		resolver.lookup("server.test", [&](const Array<InetAddress>& a) {
+			if (a.length() == 1)
+				++results;
+		});
+	ASL_CHECK(resolver.lookup("server.test").length(), ==, 1);
+	for (int i = 0; i < 50 && results < 3; i++)
+		sleep(0.01);
+	ASL_CHECK((int)results, ==, 3);
+	ASL_CHECK((int)calls, ==, 5);
+
+	resolver.lookup("server.test", [&](const Array<InetAddress>& a) { ++results; }); // cached: called right away
+	ASL_CHECK((int)results, ==, 4);
+	ASL_CHECK(resolver.queries(), ==, 5);
+
+	// the system resolver reads /etc/hosts
+
+	Resolver system;
+	addrs = system.lookup("localhost");
+	ASL_ASSERT(addrs.length() > 0);
+
+	int port = 9984;
+	Socket server;
+	ASL_ASSERT(server.bind("127.0.0.1", port));
+	server.listen();
+	Socket client;
+	ASL_ASSERT(client.connect("localhost", port));
+	ASL_ASSERT(Resolver::shared().isCached("localhost"));
+	server.accept().close();
+	client.close();
+}
+
+ASL_TEST(WebSocket)
+{
+	int port = 9993;
+	String big;
+	for (int i = 0; i < 2000; i++)
+		big << "{\"x\":" << i << ",\"name\":\"item\"}";
+
+	for (int mode = 0; mode < 4; mode++)
+	{
+		// client+server compression, no context takeover, client only, server only
+		EchoWsServer server;
+		WebSocketCompression options;
+		options.serverNoContextTakeover = options.clientNoContextTakeover = mode == 1;
+		if (mode != 2)
+			server.setCompression(options);
+		ASL_ASSERT(server.bind(port + mode));
+		server.start(true);
+		sleep(0.1);
+
+		WebSocket ws;
+		if (mode != 3)
+			ws.setCompression(options);
+		ASL_ASSERT(ws.connect(String::f("ws://127.0.0.1:%i", port + mode)));
+#ifdef ASL_ZLIB
+		ASL_CHECK(ws.compressed(), ==, mode < 2);
+#endif
+		for (int i = 0; i < 3; i++)
+		{
+			ws.send("short");
+			String s = ws.receive();
+			ASL_CHECK(s, ==, "short");
+			ws.send(big);
+			s = ws.receive();
+			ASL_CHECK(s.length(), ==, big.length());
+			ASL_ASSERT(s == big);
+		}
+		ByteArray bytes(70000, 7);
+		ws.send(bytes);
+		ByteArray echo = ws.receive();
+		ASL_ASSERT(echo == bytes);
+#ifdef ASL_ZLIB
+		if (mode < 2)
+			ASL_ASSERT(ws.sentBytes() < 3 * big.length() / 2);
+#endif
+		ws.close();
+		server.stop(true);
+	}
+
+#ifdef ASL_ZLIB
+	// a small compressed message that inflates beyond the limit closes the connection with code 1009
+
+	EchoWsServer server;
+	WebSocketCompression options;
+	options.maxMessageSize = 100000;
+	server.setCompression(options);
+	ASL_ASSERT(server.bind(port + 5));
+	server.start(true);
+	sleep(0.1);
+	WebSocket ws;
+	ws.setCompression(WebSocketCompression());
+	ASL_ASSERT(ws.connect(String::f("ws://127.0.0.1:%i", port + 5)));
+	ws.send(ByteArray(99000, 'a'));
+	ASL_CHECK(ws.receive().length(), ==, 99000);
+	ws.send(ByteArray(1000000, 'a'));
+	ASL_ASSERT(ws.sentBytes() < 20000);
+	ASL_CHECK(ws.receive().length(), ==, 0);
+	ASL_ASSERT(ws.closed());
+	ASL_CHECK(ws.code(), ==, 1009);
+	server.stop(true);
+#endif
+}
+
+// echoes messages after sending a ping, so that the client receives control frames while it sends
+
+struct PingEchoWsServer : public WebSocketServer
+{
+	void serve(WebSocket& ws)
+	{
+		ByteArray ping(125, 'p');
+		while (!ws.closed())
+		{
+			ByteArray msg = ws.receive();
+			if (msg.length() == 0)
+				continue;
+			for (int i = 0; i < 10; i++)
+				ws.send(ping.data(), ping.length(), WebSocket::FRAME_PING);
+			ws.send(msg);
+		}
+	}
+};
+
+struct WsReceiver : public Thread
+{
+	WebSocket* ws;
+	Array<ByteArray> messages;
+	int count;
+	void run()
+	{
+		while (messages.length() < count && !ws->closed())
+		{
+			ByteArray msg = ws->receive();
+			if (msg.length() > 0)
+				messages << msg;
+		}
+	}
+};
+
+ASL_TEST(WebSocketThreads)
+{
+	// one thread receives (and answers pings) while another sends masked messages
+
+	int port = 9997;
+	PingEchoWsServer server;
+	ASL_ASSERT(server.bind(port));
+	server.start(true);
+	sleep(0.1);
+	WebSocket ws;
+	ASL_ASSERT(ws.connect(String::f("ws://127.0.0.1:%i", port)));
+	WsReceiver receiver;
+	receiver.ws = &ws;
+	receiver.count = 100;
+	receiver.start();
+	Array<ByteArray> sent;
+	for (int i = 0; i < receiver.count; i++)
+	{
+		ByteArray msg(200000 + i, (byte)i);
+		sent << msg;
+		ws.send(msg);
+	}
+	receiver.join();
+	ASL_CHECK(receiver.messages.length(), ==, receiver.count);
+	int bad = 0;
+	for (int i = 0; i < receiver.messages.length(); i++)
+		if (!(receiver.messages[i] == sent[i]))
+			bad++;
+	ASL_CHECK(bad, ==, 0);
+	ws.close();
+	server.stop(true);
+}
+
+struct HubServer : public WebSocketServer
+{
+	void onMessage(WebSocket& ws, const WebSocketMsg& msg)
+	{
+		String m = msg;
+		if (m.startsWith("sub:"))
+		{
+			subscribe(ws, m.substring(4));
+			ws.send("ok");
+		}
+		else
+			ws.send(m);
+	}
+};
+
+ASL_TEST(WebSocketHub)
+{
+#ifdef __linux__
+	int port = 9989;
+	HubServer server;
+	server.setCompression(WebSocketCompression());
+	ASL_ASSERT(server.bind(port));
+	server.setEventDriven(true, 2);
+	server.setSendQueueLimit(100000);
+	server.start(true);
+	sleep(0.1);
+
+	WebSocket ws[3];
+	for (int i = 0; i < 3; i++)
+	{
+		WebSocketCompression z;
+		z.serverNoContextTakeover = true;
+		if (i == 1)
+			ws[i].setCompression(WebSocketCompression());
+		else if (i == 2) // gets the shared compressed broadcasts
+			ws[i].setCompression(z);
+		ASL_ASSERT(ws[i].connect(String::f("ws://127.0.0.1:%i", port)));
+		ws[i].send("hello");
+		String echo = ws[i].receive();
+		ASL_CHECK(echo, ==, "hello");
+	}
+	ws[0].send("sub:news");
+	ws[1].send("sub:news");
+	String ok = ws[0].receive();
+	ASL_CHECK(ok, ==, "ok");
+	ok = ws[1].receive();
+	ASL_CHECK(ok, ==, "ok");
+	ASL_CHECK(server.clients().length(), ==, 3);
+
+	String big;
+	for (int i = 0; i < 1000; i++)
+		big << "{\"n\":" << i << "}";
+	server.publish("news", big);
+	server.broadcast("all");
+	for (int i = 0; i < 3; i++)
+	{
+		String m = ws[i].receive();
+		if (i < 2)
+		{
+			ASL_ASSERT(m == big);
+			m = ws[i].receive();
+		}
+		ASL_CHECK(m, ==, "all");
+	}
+
+	// a broadcast compressed apart must not break the context of a connection that keeps it between messages
+	String big1, big2;
+	for (int i = 0; i < 600; i++)
+	{
+		big1 << "{\"a\":" << i << "}";
+		big2 << "[\"b\"," << i * 7 << "]";
+	}
+	ws[1].send(big1);
+	String echo = ws[1].receive();
+	ASL_ASSERT(echo == big1);
+	server.broadcast(big2);
+	echo = ws[1].receive();
+	ASL_ASSERT(echo == big2);
+	ws[1].send(big1);
+	echo = ws[1].receive();
+	ASL_CHECK(echo.length(), ==, big1.length());
+	ASL_ASSERT(echo == big1);
+	for (int i = 0; i < 3; i++)
+	{
+		if (i != 1)
+		{
+			String m = ws[i].receive();
+			ASL_ASSERT(m == big2);
+		}
+	}
+
+	// a client that does not read is dropped when its queue is full, others keep working
+	WebSocket slow;
+	ASL_ASSERT(slow.connect(String::f("ws://127.0.0.1:%i", port)));
+	slow.send("sub:bulk");
+	ok = slow.receive();
+	ByteArray block(200000, 1);
+	for (int i = 0; i < 200 && server.slowClients() == 0; i++)
+		server.publish("bulk", block);
+	ASL_CHECK(server.slowClients(), ==, 1);
+	sleep(0.1);
+	ASL_CHECK(server.clients().length(), ==, 3);
+	ws[2].send("still");
+	String m = ws[2].receive();
+	ASL_CHECK(m, ==, "still");
+
+	for (int i = 0; i < 3; i++)
+		ws[i].close();
+	slow.close();
+	server.stop(true);
+#endif
+}
+
+// peak resident memory of the process so far in MB, or 0 if unknown
+
+static double peakResidentMB()
+{
+#ifdef __linux__
+	long peak = 0;
+	char line[256];
+	FILE* f = fopen("/proc/self/status", "r");
+	if (!f)
+		return 0;
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "VmHWM: %li kB", &peak) == 1)
+			break;
+	fclose(f);
+	return peak / 1024.0;
+#else
+	return 0;
+#endif
+}
+
+struct StreamingServer : public HttpServer
+{
+	void serve(HttpRequest& request, HttpResponse& response)
+	{
+		if (request.is("/upload"))
+		{
+			// counts the bytes and checks the pattern without keeping the body
+			byte buffer[65536];
+			Long total = 0;
+			bool ok = true;
+			int n;
+			while ((n = request.read(buffer, sizeof(buffer))) > 0)
+			{
+				ok = ok && buffer[0] == byte(total % 251) && buffer[n - 1] == byte((total + n - 1) % 251);
+				total += n;
+			}
+			response.put(String::f("%lli %s", total, ok && n == 0 ? "ok" : "error"));
+		}
+		else if (request.is("/download"))
+		{
+			int blocks = request.query("blocks");
+			ByteArray block(100000, 0);
+			for (int i = 0; i < blocks; i++)
+			{
+				block[0] = byte(i);
+				response.write((const char*)block.data(), block.length());
+			}
+		}
+		else
+			response.put(request.text());
+	}
+};
+
+// sends a body of `size` bytes with a pattern, with a Content-Length or in chunks, and returns the response body
+
+static String uploadPattern(int port, Long size, bool chunked)
+{
+	Socket s;
+	if (!s.connect("127.0.0.1", port))
+		return "";
+	String head = "PUT /upload HTTP/1.1\r\nHost: localhost\r\nExpect: 100-continue\r\n";
+	head << (chunked ? String("Transfer-Encoding: chunked\r\n") : String::f("Content-Length: %lli\r\n", size));
+	s << head << "\r\n";
+	if (s.readLine() != "HTTP/1.1 100 Continue\r" || s.readLine() != "\r")
+		return "no 100";
+	ByteArray block(65536 * 4 + 251);
+	for (int i = 0; i < block.length(); i++)
+		block[i] = byte(i % 251);
+	for (Long sent = 0; sent < size;)
+	{
+		int n = (int)min(size - sent, (Long)65536 * 4);
+		const byte* p = block.data() + sent % 251;
+		if (chunked)
+			s << String::f("%x\r\n", n);
+		if (s.write(p, n) != n)
+			return "write error";
+		if (chunked)
+			s << "\r\n";
+		sent += n;
+	}
+	if (chunked)
+		s << "0\r\n\r\n";
+	int length = 0;
+	String line;
+	while (line = s.readLine(), line != "\r" && !s.error())
+		if (line.startsWith("Content-Length:"))
+			length = line.substring(15).trim();
+	ByteArray body = s.read(length);
+	return String(body);
+}
+
+ASL_TEST(HttpStreaming)
+{
+	int port = 9987;
+	StreamingServer server;
+	ASL_ASSERT(server.bind(port));
+	server.start(true);
+	sleep(0.1);
+
+	ASL_CHECK(uploadPattern(port, 1000, false), ==, "1000 ok");
+	ASL_CHECK(uploadPattern(port, 10000000, true), ==, "10000000 ok");
+
+	// chunked response, read by the client
+	HttpResponse res = Http::get(String::f("http://127.0.0.1:%i/download?blocks=50", port));
+	ASL_CHECK(res.code(), ==, 200);
+	ASL_CHECK(res.header("Transfer-Encoding"), ==, "chunked");
+	ASL_CHECK(res.body().length(), ==, 50 * 100000);
+	ASL_CHECK(res.body()[49 * 100000], ==, 49);
+
+	// requests with bodies on a kept-alive connection, read in full or not read
+	res = Http::post(String::f("http://127.0.0.1:%i/echo", port), "some text");
+	ASL_CHECK(res.text(), ==, "some text");
+	res = Http::post(String::f("http://127.0.0.1:%i/download?blocks=1", port), "ignored body");
+	ASL_CHECK(res.body().length(), ==, 100000);
+	res = Http::post(String::f("http://127.0.0.1:%i/echo", port), "more text");
+	ASL_CHECK(res.text(), ==, "more text");
+
+	// 4 GB upload with constant memory: the peak must not grow even if a buffer was freed at the end
+	double peak = peakResidentMB();
+	Long size = 4LL << 30;
+	ASL_CHECK(uploadPattern(port, size, false), ==, String::f("%lli ok", size));
+	ASL_ASSERT(peakResidentMB() - peak < 64);
+
+	server.stop(true);
+}
+
+struct CompressingServer : public HttpServer
+{
+	void serve(HttpRequest& request, HttpResponse& response)
+	{
+		if (request.is("/json"))
+		{
+			Var list = Var::ARRAY;
+			for (int i = 0; i < 200; i++)
+				list << Var("id", i)("name", "item");
+			response.put(list);
+		}
+		else if (request.is("/small"))
+		{
+			response.setHeader("Content-Type", "text/plain");
+			response.put("short text");
+		}
+		else if (request.is("/stream"))
+		{
+			response.setHeader("Content-Type", "text/plain");
+			for (int i = 0; i < 1000; i++)
+				response.write(String::f("line %i\n", i));
+		}
+		else
+			serveFile(request, response);
+	}
+};
+
+ASL_TEST(HttpCompression)
+{
+#ifdef ASL_ZLIB
+	int port = 9986;
+	CompressingServer server;
+	server.setRoot(".");
+	server.setCompression(true, 100);
+	ASL_ASSERT(server.bind(port));
+	server.start(true);
+	sleep(0.1);
+	String base = String::f("http://127.0.0.1:%i", port);
+
+	HttpClient client;
+	HttpResponse res = client.get(base + "/json");
+	ASL_CHECK(res.header("Content-Encoding"), ==, "gzip");
+	ASL_CHECK(res.header("Vary"), ==, "Accept-Encoding");
+	ASL_ASSERT(res.header("Content-Length").toInt() < res.body().length() / 5);
+	ASL_CHECK(res.json().length(), ==, 200);
+	ASL_CHECK(res.json()[199]["id"], ==, 199);
+
+	res = client.get(base + "/json", Dic<>("Accept-Encoding", "deflate"));
+	ASL_CHECK(res.header("Content-Encoding"), ==, "deflate");
+	ASL_CHECK(res.json().length(), ==, 200);
+
+	res = client.get(base + "/json", Dic<>("Accept-Encoding", "gzip;q=0, identity"));
+	ASL_ASSERT(!res.hasHeader("Content-Encoding"));
+	ASL_CHECK(res.json().length(), ==, 200);
+
+	res = client.get(base + "/small");
+	ASL_ASSERT(!res.hasHeader("Content-Encoding"));
+	ASL_CHECK(res.text(), ==, "short text");
+
+	// a chunked response compressed as it is written
+
+	res = client.get(base + "/stream");
+	ASL_CHECK(res.header("Content-Encoding"), ==, "gzip");
+	ASL_CHECK(res.header("Transfer-Encoding"), ==, "chunked");
+	Array<String> lines = res.text().split('\n');
+	ASL_CHECK(lines.length(), ==, 1001);
+	ASL_CHECK(lines[999], ==, "line 999");
+
+	// static files, compressed and cached, or taken from a .gz file next to them
+
+	String page;
+	for (int i = 0; i < 100; i++)
+		page << "<p>paragraph " << i << "</p>\n";
+	File("compress.html").put(ByteArray((const byte*)*page, page.length()));
+	res = client.get(base + "/compress.html");
+	ASL_CHECK(res.header("Content-Encoding"), ==, "gzip");
+	ASL_CHECK(res.text(), ==, page);
+	res = client.get(base + "/compress.html");
+	ASL_CHECK(res.text(), ==, page);
+
+	// the compressed representation has its own entity tag
+
+	String gzTag = res.header("Etag");
+	ASL_ASSERT(gzTag.endsWith("-gz\""));
+	res = client.get(base + "/compress.html", Dic<>("If-None-Match", gzTag));
+	ASL_CHECK(res.code(), ==, 304);
+	ASL_CHECK(res.header("Etag"), ==, gzTag);
+	res = client.get(base + "/compress.html", Dic<>("Accept-Encoding", "identity")("If-None-Match", gzTag));
+	ASL_CHECK(res.code(), ==, 200);
+	ASL_CHECK(res.text(), ==, page);
+	String tag = res.header("Etag");
+	ASL_CHECK(tag, ==, gzTag.replace("-gz", ""));
+	res = client.get(base + "/compress.html", Dic<>("Accept-Encoding", "identity")("If-None-Match", tag));
+	ASL_CHECK(res.code(), ==, 304);
+	res = client.get(base + "/compress.html", Dic<>("If-None-Match", tag));
+	ASL_CHECK(res.code(), ==, 200);
+	ASL_CHECK(res.header("Content-Encoding"), ==, "gzip");
+	res = client.get(base + "/compress.html", Dic<>("Range", "bytes=0-9")("If-Range", tag));
+	ASL_CHECK(res.code(), ==, 206);
+	ASL_CHECK(res.text(), ==, page.substring(0, 10));
+	res = client.get(base + "/compress.html", Dic<>("Range", "bytes=0-9")("If-Range", gzTag));
+	ASL_CHECK(res.code(), ==, 200);
+	ASL_CHECK(res.text(), ==, page);
+
+	String script = "var x = 1; // the original script\n";
+	String packed = "var x = 2; // the precompressed script\n";
+	File("compress.js").put(ByteArray((const byte*)*script, script.length()));
+	File("compress.js.gz").put(Deflater::compress(ByteArray((const byte*)*packed, packed.length())));
+	res = client.get(base + "/compress.js");
+	ASL_CHECK(res.header("Content-Encoding"), ==, "gzip");
+	ASL_CHECK(res.text(), ==, packed);
+
+	client.setCompression(false);
+	res = client.get(base + "/compress.js");
+	ASL_ASSERT(!res.hasHeader("Content-Encoding"));
+	ASL_CHECK(res.text(), ==, script);
+	res = client.get(base + "/json");
+	ASL_ASSERT(!res.hasHeader("Content-Encoding"));
+
+	File("compress.html").remove();
+	File("compress.js").remove();
+	File("compress.js.gz").remove();
+	server.stop(true);
+#endif
+}
+
+// static files: validators, byte ranges, and files served from the memory cache or with sendfile
+
+ASL_TEST(HttpFiles)
+{
+	int port = 9978;
+	HttpServer server;
+	server.setRoot(".");
+	server.setFileCache(4096, 2048);
+	ASL_ASSERT(server.bind(port));
+	server.start(true);
+	server.setFileCache(0); // ignored while running
+	sleep(0.1);
+	String base = String::f("http://127.0.0.1:%i", port);
+
+	String small, big;
+	for (int i = 0; i < 1000; i++)
+		small << char('a' + i % 26);
+	for (int i = 0; i < 300000; i++)
+		big << char('A' + i % 23);
+	File("files_small.txt").put(ByteArray((const byte*)*small, small.length()));
+	File("files_big.txt").put(ByteArray((const byte*)*big, big.length()));
+
+	HttpClient client;
+	HttpResponse res = client.get(base + "/files_small.txt");
+	ASL_CHECK(res.code(), ==, 200);
+	ASL_CHECK(res.text(), ==, small);
+	String tag = res.header("Etag"), modified = res.header("Last-Modified");
+	ASL_ASSERT(tag.startsWith("\"") && modified != "");
+	res = client.get(base + "/files_big.txt");
+	ASL_CHECK(res.code(), ==, 200);
+	ASL_ASSERT(res.text() == big);
+
+	// conditional requests
+
+	res = client.get(base + "/files_small.txt", Dic<>("If-None-Match", tag));
+	ASL_CHECK(res.code(), ==, 304);
+	ASL_CHECK(res.body().length(), ==, 0);
+	res = client.get(base + "/files_small.txt", Dic<>("If-None-Match", "\"other\", " + tag));
+	ASL_CHECK(res.code(), ==, 304);
+	res = client.get(base + "/files_small.txt", Dic<>("If-None-Match", "*"));
+	ASL_CHECK(res.code(), ==, 304);
+	res = client.get(base + "/files_small.txt", Dic<>("If-None-Match", "\"other\""));
+	ASL_CHECK(res.code(), ==, 200);
+	ASL_CHECK(res.text(), ==, small);
+	res = client.get(base + "/files_small.txt", Dic<>("If-Modified-Since", modified));
+	ASL_CHECK(res.code(), ==, 304);
+
+	// byte ranges, from the cache (small file) and with sendfile (big file)
+
+	res = client.get(base + "/files_small.txt", Dic<>("Range", "bytes=10-19"));
+	ASL_CHECK(res.code(), ==, 206);
+	ASL_CHECK(res.header("Content-Range"), ==, "bytes 10-19/1000");
+	ASL_CHECK(res.text(), ==, small.substring(10, 20));
+	res = client.get(base + "/files_small.txt", Dic<>("Range", "bytes=-5"));
+	ASL_CHECK(res.code(), ==, 206);
+	ASL_CHECK(res.text(), ==, small.substring(995));
+	res = client.get(base + "/files_small.txt", Dic<>("Range", "bytes=990-"));
+	ASL_CHECK(res.header("Content-Range"), ==, "bytes 990-999/1000");
+	ASL_CHECK(res.text(), ==, small.substring(990));
+	res = client.get(base + "/files_small.txt", Dic<>("Range", "bytes=995-5000"));
+	ASL_CHECK(res.code(), ==, 206);
+	ASL_CHECK(res.text(), ==, small.substring(995));
+	res = client.get(base + "/files_big.txt", Dic<>("Range", "bytes=100000-100009"));
+	ASL_CHECK(res.code(), ==, 206);
+	ASL_CHECK(res.header("Content-Range"), ==, "bytes 100000-100009/300000");
+	ASL_CHECK(res.text(), ==, big.substring(100000, 100010));
+	res = client.get(base + "/files_big.txt", Dic<>("Range", "bytes=-100000"));
+	ASL_CHECK(res.code(), ==, 206);
+	ASL_ASSERT(res.text() == big.substring(200000));
+
+	// unsatisfiable ranges, and ranges ignored (malformed, multiple, reversed, or for another version)
+
+	res = client.get(base + "/files_small.txt", Dic<>("Range", "bytes=1000-"));
+	ASL_CHECK(res.code(), ==, 416);
+	ASL_CHECK(res.header("Content-Range"), ==, "bytes */1000");
+	ASL_CHECK(res.body().length(), ==, 0);
+	const char* ignored[] = { "bytes=0-1,5-6", "items=0-1", "bytes=5-2", "bytes=-", "bytes=1-2-3" };
+	for (int i = 0; i < 5; i++)
+	{
+		res = client.get(base + "/files_small.txt", Dic<>("Range", ignored[i]));
+		ASL_CHECK(res.code(), ==, 200);
+		ASL_CHECK(res.text(), ==, small);
+	}
+	res = client.get(base + "/files_small.txt", Dic<>("Range", "bytes=0-9")("If-Range", modified));
+	ASL_CHECK(res.code(), ==, 206);
+	res = client.get(base + "/files_small.txt", Dic<>("Range", "bytes=0-9")("If-Range", "\"other\""));
+	ASL_CHECK(res.code(), ==, 200);
+	ASL_CHECK(res.text(), ==, small);
+
+	// a cached file that changes is read again
+
+	small = small.substring(0, 500) + "changed";
+	File("files_small.txt").put(ByteArray((const byte*)*small, small.length()));
+	res = client.get(base + "/files_small.txt");
+	ASL_CHECK(res.text(), ==, small);
+	ASL_ASSERT(res.header("Etag") != tag);
+	res = client.get(base + "/files_small.txt", Dic<>("Range", "bytes=-7"));
+	ASL_CHECK(res.text(), ==, "changed");
+
+	res = client.get(base + "/files_none.txt");
+	ASL_CHECK(res.code(), ==, 404);
+
+	File("files_small.txt").remove();
+	File("files_big.txt").remove();
+	server.stop(true);
+}
+
+#ifdef ASL_TLS
+
+struct TlsEchoServer : public SocketServer
+{
+	void serve(Socket client)
+	{
+		String line = client.readLine();
+		client << line << "\n";
+	}
+};
+
+// relays connections to another port and counts the bytes sent back by the server on each one
+
+struct CountingProxy : public Thread
+{
+	Socket server;
+	int target, connections;
+	Array<int> received;
+	void run()
+	{
+		char buffer[4096];
+		for (int k = 0; k < connections; k++)
+		{
+			Socket a = server.accept(), b;
+			if (!b.connect("127.0.0.1", target))
+				break;
+			Sockets set;
+			set << a << b;
+			int n = 0;
+			while (set.waitInput(5) > 0)
+			{
+				Socket& from = set.hasInput(a) ? a : b;
+				Socket& to = set.hasInput(a) ? b : a;
+				int m = min(from.available(), (int)sizeof(buffer));
+				if (m <= 0 || from.read(buffer, m) != m || to.write(buffer, m) != m)
+					break;
+				if (&from == &b)
+					n += m;
+			}
+			received << n;
+			a.close();
+			b.close();
+		}
+	}
+};
+
+#endif
+
+// a new TLS connection to a server visited before resumes the session: the abbreviated handshake does not send
+// the server certificate again
+
+ASL_TEST(TlsResume)
+{
+#ifdef ASL_TLS
+	int port = 9976;
+	TlsEchoServer server;
+	ASL_ASSERT(server.bindTLS("127.0.0.1", port));
+	server.start(true);
+	CountingProxy proxy;
+	ASL_ASSERT(proxy.server.bind("127.0.0.1", port + 1));
+	proxy.server.listen();
+	proxy.target = port;
+	proxy.connections = 3;
+	proxy.start();
+	sleep(0.1);
+
+	for (int i = 0; i < 3; i++)
+	{
+		TlsSocket client;
+		ASL_ASSERT(client.connect("127.0.0.1", port + 1));
+		client << String::f("hello %i\n", i);
+		ASL_CHECK(client.readLine(), ==, String::f("hello %i", i));
+		client.close();
+	}
+	proxy.join();
+	ASL_CHECK(proxy.received.length(), ==, 3);
+	ASL_CHECK(proxy.received[0], >, 1000);
+	ASL_CHECK(proxy.received[1], <, 500);
+	ASL_CHECK(proxy.received[2], <, 500);
+	proxy.server.close();
+	server.stop(true);
+#endif
+}
+
+// answers with the client's port, to know which connection a request came on
+
+struct PortServer : public HttpServer
+{
+	void serve(HttpRequest& request, HttpResponse& response)
+	{
+		response.put(String(request.sender().port()));
+	}
+};
+
+// answers one request per connection, then waits for another one and closes without answering it, like a server
+// closing an idle connection as a request arrives; connections after the third are counted and closed
+
+struct DroppingServer : public Thread
+{
+	Socket server;
+	int connections, dropped, closedByClient, extra;
+	static bool readRequest(Socket& s)
+	{
+		String line;
+		do
+			line = s.readLine();
+		while (line.ok() && line != "\r" && !s.error());
+		return line == "\r";
+	}
+	void run()
+	{
+		dropped = closedByClient = extra = 0;
+		for (connections = 0; connections < 3; connections++)
+		{
+			Socket s = server.accept();
+			if (!readRequest(s))
+				break;
+			s << "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+			if (readRequest(s))
+				dropped++;
+			else
+				closedByClient++;
+			s.close();
+		}
+		Sockets listening;
+		listening << server;
+		while (listening.waitInput(0.5) > 0)
+		{
+			Socket s = server.accept();
+			extra++;
+			s.close();
+		}
+	}
+};
+
+ASL_TEST(HttpClient)
+{
+	int port = 9982;
+	PortServer server;
+	ASL_ASSERT(server.bind(port));
+	server.start(true);
+	sleep(0.1);
+	String base = String::f("http://127.0.0.1:%i", port);
+
+	// connections are reused
+
+	HttpClient client;
+	String first = client.get(base + "/").text();
+	ASL_ASSERT(first.length() > 0);
+	for (int i = 0; i < 5; i++)
+		ASL_CHECK(client.get(base + "/").text(), ==, first);
+	ASL_CHECK(client.idleConnections(), ==, 1);
+	client.setKeepAlive(false);
+	ASL_ASSERT(client.get(base + "/").text() != first);
+	ASL_CHECK(client.idleConnections(), ==, 0);
+	client.setKeepAlive(true);
+
+	// idle connections expire, also those to other hosts when a request is made to any
+
+	client.setIdleTimeout(0.2);
+	client.get(base + "/");
+	ASL_CHECK(client.idleConnections(), ==, 1);
+	sleep(0.3);
+	ASL_CHECK(client.idleConnections(), ==, 0);
+
+	DroppingServer dropping;
+	ASL_ASSERT(dropping.server.bind("127.0.0.1", port + 1));
+	dropping.server.listen();
+	dropping.start();
+	String base2 = String::f("http://127.0.0.1:%i", port + 1);
+	HttpResponse res = client.get(base2 + "/");
+	ASL_CHECK(res.text(), ==, "ok");
+	sleep(0.3);
+	client.get(base + "/");
+	sleep(0.1);
+	ASL_CHECK(dropping.closedByClient, ==, 1);
+	client.closeIdle();
+	server.stop(true);
+
+	// a reused connection closed by the server before answering is retried on a new one
+
+	client.setIdleTimeout(30);
+	res = client.get(base2 + "/");
+	ASL_CHECK(res.text(), ==, "ok");
+	ASL_CHECK(client.idleConnections(), ==, 1);
+	res = client.get(base2 + "/");
+	ASL_CHECK(res.code(), ==, 200);
+	ASL_CHECK(res.text(), ==, "ok");
+
+	// but not a POST that was sent, as the server may have processed it
+
+	ASL_CHECK(client.idleConnections(), ==, 1);
+	res = client.post(base2 + "/", "data");
+	ASL_ASSERT(res.code() != 200 && res.socketError() != "");
+	dropping.join();
+	ASL_CHECK(dropping.connections, ==, 3);
+	ASL_CHECK(dropping.dropped, ==, 2);
+	ASL_CHECK(dropping.closedByClient, ==, 1);
+	ASL_CHECK(dropping.extra, ==, 0);
+	dropping.server.close();
+}
@@ -209,6 +209,43 @@ ASL_TEST(Matrix)
 		s += x;
 	ASL_ASSERT(s == 5);
 #endif
+
+	// sizes that do not fill the GEMM and factorization blocks
+
+	int n = 150, m = 211;
+	Matrixd P(n, m), Q(m, n - 3);
+	unsigned r = 12345;
+	for (int i = 0; i < P.rows(); i++)
+		for (int j = 0; j < P.cols(); j++)
+			P(i, j) = ((r = r * 1103515245 + 12345) >> 16) % 1000 / 500.0 - 1;
+	for (int i = 0; i < Q.rows(); i++)
+		for (int j = 0; j < Q.cols(); j++)
+			Q(i, j) = ((r = r * 1103515245 + 12345) >> 16) % 1000 / 500.0 - 1;
+
+	Matrixd PQ = P * Q, PQ0(n, n - 3, 0.0);
+	for (int i = 0; i < n; i++)
+		for (int k = 0; k < m; k++)
+			for (int j = 0; j < n - 3; j++)
+				PQ0(i, j) += P(i, k) * Q(k, j);
+	ASL_CHECK((PQ - PQ0).norm(), <, 1e-9);
+	ASL_CHECK((Q.transposed(Q) - Q.transposed() * Q).norm(), <, 1e-9);
+
+	Matrixd M = P.slice(0, n, 0, n);
+	for (int i = 0; i < n; i++)
+		M(i, i) += 2;
+	ASL_CHECK((M.inverse() * M - Matrixd::identity(n)).norm(), <, 1e-9);
+
+	Matrixd S = Q.transposed(Q);
+	Matrixd x0 = Q.slice(0, n - 3, 0, 1), y = S * x0;
+	ASL_CHECK((solve(S, y, SOLVE_CHOLESKY) - x0).norm(), <, 1e-6);
+	ASL_CHECK((solve(S, y, SOLVE_LU) - x0).norm(), <, 1e-6);
+
+	Matrixd R = P.transposed().slice(0, m, 0, 20), x1 = Q.slice(0, 20, 0, 2), z = R * x1;
+	ASL_CHECK((solve(R, z) - x1).norm(), <, 1e-9);
+	ASL_CHECK((solve(R, z, SOLVE_CHOLESKY) - x1).norm(), <, 1e-6);
+
+	Matrix Rf = Matrix(2, 2, array<float>(1, 2, 3, 4)).transposed() * Matrix::identity(2);
+	ASL_ASSERT(Rf(0, 1) == 3 && Rf(1, 0) == 2);
 }
 
 ASL_TEST(URL)